@@ -0,0 +1,1380 @@
+/*
+    CPU microbenchmarks of the loader, hashing and per-frame math hot paths.
+
+    Only uses the GPU-free parts of the application (no Vulkan or GLFW calls),
+    so it builds and runs on any machine, including a Linux box without a GPU.
+*/
+
+#include "microbenchmark.h"
+
+#include "../bvh.h"
+#include "../file_utils.h"
+#include "../image_loader.h"
+#include "../image_writer.h"
+#include "../job_system.h"
+#include "../mesh_lod.h"
+#include "../meshlets.h"
+#include "../model_loader.h"
+#include "../parallel_for.h"
+#include "../render_queue.h"
+#include "../scene_uniforms.h"
+#include "../software_occlusion.h"
+#include "../transform_system.h"
+#include "../vertex.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+static const char* USAGE =
+    "usage: VulkanPlaygroundBenchmarks [options]\n"
+    "  --assets <dir>          directory containing Models/ and Textures/ (default .)\n"
+    "  --max-triangles <n>     largest synthetic mesh (default 10000000)\n"
+    "  --repetitions <n>       timed runs per benchmark (default 5)\n"
+    "  --json <file>           also write the results as JSON\n";
+
+struct BenchmarkOptions
+{
+    std::string assetDirectory = ".";
+    uint64_t maxTriangles = 10000000;
+    uint32_t repetitions = 5;
+    std::string jsonFile;
+};
+
+static BenchmarkOptions ParseOptions(int argc, char** argv)
+{
+    BenchmarkOptions options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        auto nextValue = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for " + arg + "\n" + USAGE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--assets")
+        {
+            options.assetDirectory = nextValue();
+        }
+        else if (arg == "--max-triangles")
+        {
+            options.maxTriangles = std::stoull(nextValue());
+        }
+        else if (arg == "--repetitions")
+        {
+            options.repetitions = static_cast<uint32_t>(std::stoul(nextValue()));
+        }
+        else if (arg == "--json")
+        {
+            options.jsonFile = nextValue();
+        }
+        else
+        {
+            throw std::runtime_error("unknown option " + arg + "\n" + USAGE);
+        }
+    }
+
+    return options;
+}
+
+static bool FileExists(const std::string& filePath)
+{
+    return std::ifstream(filePath).good();
+}
+
+/*
+    Synthetic mesh: a regular grid of quads, two triangles each, streamed corner by corner like the OBJ loader does.
+    Neighbouring triangles share corners, so the deduplicator sees every vertex up to 6 times, roughly like a real model.
+*/
+static void BuildGridMesh(uint64_t triangleCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    const uint64_t quadCount = (triangleCount + 1) / 2;
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(quadCount))));
+    const float invSide = 1.0f / side;
+
+    VertexDeduplicator deduplicator(vertices, indices);
+
+    auto corner = [invSide](uint32_t x, uint32_t y)
+    {
+        Vertex vertex{};
+        vertex.pos = { x * invSide, y * invSide, 0.0f };
+        vertex.texCoord = { x * invSide, 1.0f - y * invSide };
+        return vertex;
+    };
+
+    uint64_t emitted = 0;
+    for (uint32_t y = 0; y < side && emitted < triangleCount; ++y)
+    {
+        for (uint32_t x = 0; x < side && emitted < triangleCount; ++x)
+        {
+            deduplicator.Add(corner(x, y));
+            deduplicator.Add(corner(x + 1, y));
+            deduplicator.Add(corner(x + 1, y + 1));
+            ++emitted;
+
+            if (emitted < triangleCount)
+            {
+                deduplicator.Add(corner(x + 1, y + 1));
+                deduplicator.Add(corner(x, y + 1));
+                deduplicator.Add(corner(x, y));
+                ++emitted;
+            }
+        }
+    }
+}
+
+static std::string TriangleLabel(uint64_t triangleCount)
+{
+    if (triangleCount >= 1000000)
+    {
+        return std::to_string(triangleCount / 1000000) + "M";
+    }
+    return std::to_string(triangleCount / 1000) + "k";
+}
+
+static void RunHashBenchmarks(MicrobenchmarkRunner& runner)
+{
+    const size_t vertexCount = 1000000;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    std::vector<Vertex> vertices(vertexCount);
+    for (Vertex& vertex : vertices)
+    {
+        vertex.pos = { distribution(random), distribution(random), distribution(random) };
+        vertex.texCoord = { distribution(random), distribution(random) };
+    }
+
+    runner.Run("hash/vertex_1M", vertexCount, vertexCount * sizeof(Vertex), [&]()
+        {
+            uint64_t combined = 0;
+            for (const Vertex& vertex : vertices)
+            {
+                combined += std::hash<Vertex>()(vertex);
+            }
+            DoNotOptimize(combined);
+        });
+}
+
+static void RunDeduplicationBenchmarks(MicrobenchmarkRunner& runner, uint64_t maxTriangles)
+{
+    for (uint64_t triangleCount = 10000; triangleCount <= maxTriangles; triangleCount *= 10)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        runner.Run("dedup/grid_" + TriangleLabel(triangleCount), triangleCount, 0, [&]()
+            {
+                vertices.clear();
+                indices.clear();
+                BuildGridMesh(triangleCount, vertices, indices);
+                DoNotOptimize(vertices.size() + indices.size());
+            });
+    }
+}
+
+static void RunAssetBenchmarks(MicrobenchmarkRunner& runner, const std::string& assetDirectory)
+{
+    const std::string modelPath = assetDirectory + "/Models/viking_room.obj";
+    const std::string texturePath = assetDirectory + "/Textures/viking_room.png";
+
+    if (FileExists(modelPath))
+    {
+        std::vector<char> buffer;
+        ReadFile(modelPath, buffer);
+        const uint64_t fileSize = buffer.size();
+
+        runner.Run("read_file/viking_room.obj", 1, fileSize, [&]()
+            {
+                ReadFile(modelPath, buffer);
+                DoNotOptimize(buffer.size());
+            });
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        LoadObjModel(modelPath, vertices, indices);
+        const uint64_t triangleCount = indices.size() / 3;
+
+        runner.Run("load_obj/viking_room.obj", triangleCount, fileSize, [&]()
+            {
+                vertices.clear();
+                indices.clear();
+                LoadObjModel(modelPath, vertices, indices);
+                DoNotOptimize(vertices.size() + indices.size());
+            });
+    }
+    else
+    {
+        std::printf("skipping model benchmarks, %s not found (see --assets)\n", modelPath.c_str());
+    }
+
+    if (FileExists(texturePath))
+    {
+        std::vector<char> buffer;
+        ReadFile(texturePath, buffer);
+
+        runner.Run("read_file/viking_room.png", 1, buffer.size(), [&]()
+            {
+                ReadFile(texturePath, buffer);
+                DoNotOptimize(buffer.size());
+            });
+
+        const ImageData image = LoadImageRGBA(texturePath);
+        const uint64_t pixelCount = static_cast<uint64_t>(image.width) * image.height;
+
+        runner.Run("decode_png/viking_room.png", pixelCount, pixelCount * 4, [&]()
+            {
+                const ImageData decoded = LoadImageRGBA(texturePath);
+                DoNotOptimize(decoded.pixels.get()[0]);
+            });
+    }
+    else
+    {
+        std::printf("skipping texture benchmarks, %s not found (see --assets)\n", texturePath.c_str());
+    }
+}
+
+// Every LOD must reference existing vertices, have fewer triangles and a larger error than the previous one
+static void CheckMeshLods(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods,
+    const std::string& mesh)
+{
+    for (size_t lod = 0; lod < lods.size(); ++lod)
+    {
+        const MeshLod& range = lods[lod];
+        if (range.firstIndex + range.indexCount > indices.size() || range.indexCount % 3 != 0)
+        {
+            throw std::runtime_error(mesh + " LOD " + std::to_string(lod) + " index range is out of bounds");
+        }
+        if (lod > 0 && (range.indexCount >= lods[lod - 1].indexCount || range.error < lods[lod - 1].error))
+        {
+            throw std::runtime_error(mesh + " LOD " + std::to_string(lod) + " is not coarser than LOD " + std::to_string(lod - 1));
+        }
+        for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; i += 3)
+        {
+            if (indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() || indices[i + 2] >= vertices.size())
+            {
+                throw std::runtime_error(mesh + " LOD " + std::to_string(lod) + " references a missing vertex");
+            }
+            const glm::vec3& a = vertices[indices[i]].pos;
+            const glm::vec3& b = vertices[indices[i + 1]].pos;
+            const glm::vec3& c = vertices[indices[i + 2]].pos;
+            if (a == b || b == c || c == a)
+            {
+                throw std::runtime_error(mesh + " LOD " + std::to_string(lod) + " has a degenerate triangle");
+            }
+        }
+        std::printf("%s LOD %zu: %u triangles, error %g\n", mesh.c_str(), lod, range.indexCount / 3, range.error);
+    }
+}
+
+static void RunMeshLodBenchmarks(MicrobenchmarkRunner& runner, const std::string& assetDirectory)
+{
+    for (uint64_t triangleCount : { 20000ull, 200000ull })
+    {
+        // Unit grid with waves of 2% of its size, so the collapses have a real geometric error
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        BuildGridMesh(triangleCount, vertices, indices);
+        for (Vertex& vertex : vertices)
+        {
+            vertex.pos.z = 0.02f * std::sin(vertex.pos.x * 12.0f) * std::cos(vertex.pos.y * 9.0f);
+        }
+        const size_t fullIndexCount = indices.size();
+
+        const std::string label = TriangleLabel(triangleCount);
+        std::vector<MeshLod> lods = GenerateMeshLods(vertices, indices);
+        CheckMeshLods(vertices, indices, lods, "grid_" + label);
+        if (lods.size() < 4)
+        {
+            throw std::runtime_error("grid_" + label + " only got " + std::to_string(lods.size()) + " LODs");
+        }
+
+        runner.Run("mesh_lod/generate_grid_" + label, triangleCount, 0, [&]()
+            {
+                indices.resize(fullIndexCount);
+                lods = GenerateMeshLods(vertices, indices);
+                DoNotOptimize(lods.size());
+            });
+    }
+
+    const std::string modelPath = assetDirectory + "/Models/viking_room.obj";
+    if (FileExists(modelPath))
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        LoadObjModel(modelPath, vertices, indices);
+        const size_t fullIndexCount = indices.size();
+
+        std::vector<MeshLod> lods = GenerateMeshLods(vertices, indices);
+        CheckMeshLods(vertices, indices, lods, "viking_room");
+
+        runner.Run("mesh_lod/generate_viking_room", fullIndexCount / 3, 0, [&]()
+            {
+                indices.resize(fullIndexCount);
+                lods = GenerateMeshLods(vertices, indices);
+                DoNotOptimize(lods.size());
+            });
+    }
+}
+
+/*
+    Every triangle of the source must be in exactly one meshlet, both as meshlet vertices and as indices, the meshlets
+    within the limits and their spheres around their vertices. The backface test must never cull a meshlet with a
+    triangle facing the camera: checked from cameraCount random points around the mesh.
+*/
+static void CheckMeshlets(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const MeshletMesh& mesh,
+    const std::string& label, uint32_t cameraCount)
+{
+    std::vector<std::array<uint32_t, 3>> expected;
+    std::vector<std::array<uint32_t, 3>> result;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        expected.push_back({ indices[i], indices[i + 1], indices[i + 2] });
+    }
+
+    uint64_t vertexSum = 0;
+    for (size_t m = 0; m < mesh.meshlets.size(); ++m)
+    {
+        const Meshlet& meshlet = mesh.meshlets[m];
+        const MeshletBounds& bounds = mesh.bounds[m];
+        if (meshlet.vertexCount > MAX_MESHLET_VERTICES || meshlet.triangleCount > MAX_MESHLET_TRIANGLES || meshlet.triangleCount == 0)
+        {
+            throw std::runtime_error(label + " meshlet " + std::to_string(m) + " is out of the limits");
+        }
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            const glm::vec3& position = vertices[mesh.vertices[meshlet.vertexOffset + i]].pos;
+            if (glm::length(position - bounds.center) > bounds.radius * 1.0001f + 1e-6f)
+            {
+                throw std::runtime_error(label + " meshlet " + std::to_string(m) + " has a vertex out of its sphere");
+            }
+        }
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+        {
+            std::array<uint32_t, 3> triangle;
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const uint32_t index = (meshlet.triangleOffset + t) * 3 + corner;
+                const uint8_t local = mesh.triangles[index];
+                if (local >= meshlet.vertexCount || mesh.vertices[meshlet.vertexOffset + local] != mesh.indices[index])
+                {
+                    throw std::runtime_error(label + " meshlet " + std::to_string(m) + " has a wrong triangle");
+                }
+                triangle[corner] = mesh.indices[index];
+            }
+            result.push_back(triangle);
+        }
+        vertexSum += meshlet.vertexCount;
+    }
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(result.begin(), result.end());
+    if (result != expected)
+    {
+        throw std::runtime_error(label + " meshlets don't hold every triangle exactly once");
+    }
+
+    // Random cameras on a sphere twice the size of the mesh
+    Aabb box = ComputeBoundingBox(vertices);
+    const float distance = glm::length(box.GetExtent()) * 2.0f;
+    std::mt19937 random(41);
+    std::normal_distribution<float> direction(0.0f, 1.0f);
+    uint64_t culled = 0;
+    for (uint32_t camera = 0; camera < cameraCount; ++camera)
+    {
+        const glm::vec3 position = box.GetCenter() + glm::normalize(glm::vec3(direction(random), direction(random), direction(random))) * distance;
+        for (size_t m = 0; m < mesh.meshlets.size(); ++m)
+        {
+            if (!IsMeshletBackfacing(mesh.bounds[m], position))
+            {
+                continue;
+            }
+            ++culled;
+
+            const Meshlet& meshlet = mesh.meshlets[m];
+            for (uint32_t i = meshlet.triangleOffset * 3; i < (meshlet.triangleOffset + meshlet.triangleCount) * 3; i += 3)
+            {
+                const glm::vec3& a = vertices[mesh.indices[i]].pos;
+                const glm::vec3 normal = glm::cross(vertices[mesh.indices[i + 1]].pos - a, vertices[mesh.indices[i + 2]].pos - a);
+                if (glm::dot(normal, a - position) < -1e-6f * glm::length(normal) * distance)
+                {
+                    throw std::runtime_error(label + " meshlet " + std::to_string(m) + " is culled with a front facing triangle");
+                }
+            }
+        }
+    }
+
+    std::printf("%s: %zu meshlets, %.1f vertices and %.1f triangles on average, %.1f%% backface culled\n", label.c_str(),
+        mesh.meshlets.size(), static_cast<double>(vertexSum) / mesh.meshlets.size(), static_cast<double>(indices.size() / 3) / mesh.meshlets.size(),
+        100.0 * culled / (static_cast<double>(cameraCount) * mesh.meshlets.size()));
+}
+
+static void RunMeshletBenchmarks(MicrobenchmarkRunner& runner, const std::string& assetDirectory)
+{
+    auto run = [&runner](const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::string& label)
+    {
+        MeshletMesh mesh;
+        AppendMeshlets(mesh, vertices, indices.data(), indices.size());
+        CheckMeshlets(vertices, indices, mesh, label, 64);
+
+        runner.Run("meshlets/build_" + label, indices.size() / 3, 0, [&]()
+            {
+                MeshletMesh rebuilt;
+                AppendMeshlets(rebuilt, vertices, indices.data(), indices.size());
+                DoNotOptimize(rebuilt.meshlets.size());
+            });
+
+        // What the culling shaders do for every meshlet of an object
+        const glm::vec3 camera = mesh.bounds.empty() ? glm::vec3(0.0f) : mesh.bounds[0].center + glm::vec3(0.0f, 0.0f, 1.0f);
+        runner.Run("meshlets/backface_test_" + label, mesh.meshlets.size(), 0, [&]()
+            {
+                uint32_t culled = 0;
+                for (const MeshletBounds& bounds : mesh.bounds)
+                {
+                    culled += IsMeshletBackfacing(bounds, camera) ? 1 : 0;
+                }
+                DoNotOptimize(culled);
+            });
+    };
+
+    for (uint64_t triangleCount : { 20000ull, 200000ull })
+    {
+        // Bumpy grid like the LOD benchmarks: a range of normals, flat enough for narrow cones
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        BuildGridMesh(triangleCount, vertices, indices);
+        for (Vertex& vertex : vertices)
+        {
+            vertex.pos.z = 0.02f * std::sin(vertex.pos.x * 12.0f) * std::cos(vertex.pos.y * 9.0f);
+        }
+        run(vertices, indices, "grid_" + TriangleLabel(triangleCount));
+    }
+
+    const std::string modelPath = assetDirectory + "/Models/viking_room.obj";
+    if (FileExists(modelPath))
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        LoadObjModel(modelPath, vertices, indices);
+        run(vertices, indices, "viking_room");
+    }
+}
+
+static void RunUniformBenchmarks(MicrobenchmarkRunner& runner)
+{
+    const uint32_t iterations = 1000000;
+
+    runner.Run("uniforms/build_ubo_1M", iterations, iterations * sizeof(UniformBufferObject), [&]()
+        {
+            float checksum = 0.0f;
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                const UniformBufferObject ubo = BuildUniformBufferObject(glm::vec3(2.0f, 2.0f, 2.0f + i * 0.001f), glm::vec3(0.0f), 800.0f / 600.0f);
+                checksum += ubo.viewProj[0][0] + ubo.viewProj[3][2];
+            }
+            DoNotOptimize(static_cast<uint64_t>(std::fabs(checksum)));
+        });
+}
+
+/*
+    Same objects through the naive glm loop and the SoA SIMD kernels, single and multithreaded.
+    The outputs are compared first so a fast but wrong kernel doesn't go unnoticed.
+*/
+static void RunTransformBenchmarks(MicrobenchmarkRunner& runner)
+{
+    const UniformBufferObject ubo = BuildUniformBufferObject(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), 800.0f / 600.0f);
+
+    for (uint32_t objectCount : { 100000u, 1000000u })
+    {
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+        TransformSystem transforms;
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            const glm::vec3 axis = glm::normalize(glm::vec3(distribution(random), distribution(random), distribution(random) + 2.0f));
+            const float scale = 1.0f + 0.5f * distribution(random);
+
+            transforms.Add(glm::vec3(distribution(random), distribution(random), distribution(random)) * 100.0f,
+                glm::angleAxis(distribution(random) * 3.14159265f, axis), glm::vec3(scale), BoundingSphere{ glm::vec3(0.0f, 0.0f, 0.5f), 1.0f });
+        }
+
+        std::vector<ObjectTransform> output(objectCount);
+        std::vector<glm::vec4> bounds(objectCount);
+        std::vector<ObjectTransform> reference(objectCount);
+        std::vector<glm::vec4> referenceBounds(objectCount);
+
+        transforms.UpdateReference(ubo.viewProj, reference.data(), referenceBounds.data());
+        transforms.Update(ubo.viewProj, output.data(), bounds.data());
+
+        float maxError = 0.0f;
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            const float* a = &output[i].world[0][0];
+            const float* b = &reference[i].world[0][0];
+            for (uint32_t j = 0; j < 32; ++j)
+            {
+                maxError = std::max(maxError, std::fabs(a[j] - b[j]) / std::max(1.0f, std::fabs(b[j])));
+            }
+            maxError = std::max(maxError, std::fabs(bounds[i].w - referenceBounds[i].w));
+        }
+        std::printf("transforms: %u objects, %s, %u threads, max relative error vs glm %g\n",
+            objectCount, TransformSystem::GetSimdName(), GetParallelForThreadCount(), maxError);
+
+        const std::string label = TriangleLabel(objectCount);
+        const uint64_t bytes = objectCount * static_cast<uint64_t>(sizeof(ObjectTransform) + sizeof(glm::vec4));
+
+        runner.Run("transforms/glm_" + label, objectCount, bytes, [&]()
+            {
+                transforms.UpdateReference(ubo.viewProj, reference.data(), referenceBounds.data());
+                DoNotOptimize(static_cast<uint64_t>(reference.back().worldViewProj[3][3]));
+            });
+
+        runner.Run("transforms/simd_" + label, objectCount, bytes, [&]()
+            {
+                transforms.Update(ubo.viewProj, output.data(), bounds.data(), false);
+                DoNotOptimize(static_cast<uint64_t>(output.back().worldViewProj[3][3]));
+            });
+
+        runner.Run("transforms/simd_mt_" + label, objectCount, bytes, [&]()
+            {
+                transforms.Update(ubo.viewProj, output.data(), bounds.data(), true);
+                DoNotOptimize(static_cast<uint64_t>(output.back().worldViewProj[3][3]));
+            });
+    }
+}
+
+static RenderQueueStats CountStateChanges(const std::vector<DrawPacket>& packets)
+{
+    RenderStateTracker tracker;
+    for (const DrawPacket& packet : packets)
+    {
+        tracker.Apply(packet);
+    }
+    return tracker.GetStats();
+}
+
+/*
+    Random packets over 8 pipelines, 256 materials and 512 meshes: radix sort (single and multithreaded)
+    against std::sort on the same keys, and the binds needed in submission order versus sorted order.
+*/
+static void RunRenderQueueBenchmarks(MicrobenchmarkRunner& runner)
+{
+    for (uint32_t packetCount : { 100000u, 1000000u })
+    {
+        std::mt19937 random(42);
+
+        std::vector<DrawPacket> packets(packetCount);
+        for (uint32_t i = 0; i < packetCount; ++i)
+        {
+            DrawPacket& packet = packets[i];
+            packet.pipeline = random() % 8;
+            packet.material = random() % 256;
+            packet.mesh = random() % 512;
+            packet.object = i;
+            packet.sortKey = SortKey::MakeOpaque(0, packet.pipeline, packet.material, packet.mesh, random() & 0xffffff);
+        }
+
+        RenderQueue queue;
+        for (const DrawPacket& packet : packets)
+        {
+            queue.Add(packet);
+        }
+        queue.Sort();
+
+        std::vector<DrawPacket> sorted(packetCount);
+        for (uint32_t i = 0; i < packetCount; ++i)
+        {
+            sorted[i] = queue.GetSorted(i);
+            if (i > 0 && sorted[i - 1].sortKey > sorted[i].sortKey)
+            {
+                throw std::runtime_error("render queue is not sorted");
+            }
+        }
+
+        const RenderQueueStats unsortedStats = CountStateChanges(packets);
+        const RenderQueueStats sortedStats = CountStateChanges(sorted);
+        std::printf("render queue: %u draws, binds unsorted/sorted: pipeline %u/%u, material %u/%u, mesh %u/%u\n", packetCount,
+            unsortedStats.pipelineBinds, sortedStats.pipelineBinds, unsortedStats.materialBinds, sortedStats.materialBinds,
+            unsortedStats.meshBinds, sortedStats.meshBinds);
+
+        const std::string label = TriangleLabel(packetCount);
+
+        runner.Run("render_queue/std_sort_" + label, packetCount, 0, [&]()
+            {
+                std::vector<DrawPacket> copy = packets;
+                std::sort(copy.begin(), copy.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.sortKey < b.sortKey; });
+                DoNotOptimize(copy.front().object);
+            });
+
+        runner.Run("render_queue/radix_" + label, packetCount, 0, [&]()
+            {
+                queue.Sort(false);
+                DoNotOptimize(queue.GetSorted(0).object);
+            });
+
+        runner.Run("render_queue/radix_mt_" + label, packetCount, 0, [&]()
+            {
+                queue.Sort(true);
+                DoNotOptimize(queue.GetSorted(0).object);
+            });
+    }
+}
+
+/*
+    A wall of grid triangles in front of the camera and random spheres in front of, behind and around it.
+    Spheres between the camera and the wall must stay visible (a culled one is a bug), and most of the ones
+    hidden behind it should be culled. Then the occluder rasterization and the sphere tests are timed.
+*/
+static void RunSoftwareOcclusionBenchmarks(MicrobenchmarkRunner& runner)
+{
+    const UniformBufferObject ubo = BuildUniformBufferObject(glm::vec3(0.0f, -5.0f, 0.0f), glm::vec3(0.0f), 800.0f / 600.0f);
+
+    // The grid is the unit square of the XY plane: stretch it to a 4x4 wall in the XZ plane, at y = 0, facing the camera
+    glm::mat4 wall(0.0f);
+    wall[0] = glm::vec4(4.0f, 0.0f, 0.0f, 0.0f);
+    wall[1] = glm::vec4(0.0f, 0.0f, 4.0f, 0.0f);
+    wall[2] = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+    wall[3] = glm::vec4(-2.0f, 0.0f, -2.0f, 1.0f);
+    const glm::mat4 worldViewProj = ubo.viewProj * wall;
+
+    const uint32_t sphereCount = 100000;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    std::vector<glm::vec4> spheres(sphereCount);
+    for (glm::vec4& sphere : spheres)
+    {
+        sphere = glm::vec4(-3.0f + 6.0f * distribution(random), -3.0f + 7.0f * distribution(random),
+            -3.0f + 6.0f * distribution(random), 0.02f + 0.2f * distribution(random));
+    }
+    std::vector<uint8_t> visible(sphereCount);
+
+    for (uint64_t triangleCount : { 2000ull, 200000ull })
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        BuildGridMesh(triangleCount, vertices, indices);
+
+        SoftwareOcclusionCuller culler;
+        culler.Init(256, 128);
+        const uint32_t mesh = culler.AddMesh(vertices, indices);
+
+        culler.BeginFrame();
+        culler.AddOccluder(mesh, worldViewProj);
+        culler.RasterizeOccluders();
+        culler.TestSpheres(spheres.data(), sphereCount, ubo.viewProj, visible.data());
+
+        // Well inside the silhouette of the wall, seen from the camera: |x| and |z| shrink with the distance
+        uint32_t inFront = 0, inFrontCulled = 0, hidden = 0, hiddenCulled = 0;
+        for (uint32_t i = 0; i < sphereCount; ++i)
+        {
+            const glm::vec4& sphere = spheres[i];
+            if (sphere.y + sphere.w < 0.0f)
+            {
+                ++inFront;
+                inFrontCulled += visible[i] == 0;
+            }
+            else if (sphere.y - sphere.w > 0.0f)
+            {
+                const float scale = 5.0f / (5.0f + sphere.y);
+                const float extent = (std::max(std::fabs(sphere.x), std::fabs(sphere.z)) + sphere.w * 1.5f) * scale;
+                if (extent < 1.75f)
+                {
+                    ++hidden;
+                    hiddenCulled += visible[i] == 0;
+                }
+            }
+        }
+
+        const SoftwareOcclusionStats& stats = culler.GetStats();
+        std::printf("software occlusion: %u occluder triangles rasterized, %u of %u spheres culled, %u/%u hidden spheres culled\n",
+            stats.occluderTriangles, stats.occludedObjects, stats.testedObjects, hiddenCulled, hidden);
+
+        if (inFrontCulled > 0)
+        {
+            throw std::runtime_error("software occlusion culled " + std::to_string(inFrontCulled) + " of "
+                + std::to_string(inFront) + " spheres in front of the occluder");
+        }
+        if (hiddenCulled < hidden * 9 / 10)
+        {
+            throw std::runtime_error("software occlusion only culled " + std::to_string(hiddenCulled) + " of "
+                + std::to_string(hidden) + " spheres hidden by the occluder");
+        }
+
+        const std::string label = TriangleLabel(triangleCount);
+
+        runner.Run("software_occlusion/rasterize_" + label, triangleCount, 0, [&]()
+            {
+                culler.BeginFrame();
+                culler.AddOccluder(mesh, worldViewProj);
+                culler.RasterizeOccluders(false);
+                DoNotOptimize(culler.GetStats().occluderTriangles);
+            });
+
+        runner.Run("software_occlusion/rasterize_mt_" + label, triangleCount, 0, [&]()
+            {
+                culler.BeginFrame();
+                culler.AddOccluder(mesh, worldViewProj);
+                culler.RasterizeOccluders(true);
+                DoNotOptimize(culler.GetStats().occluderTriangles);
+            });
+    }
+
+    SoftwareOcclusionCuller culler;
+    culler.Init(256, 128);
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    BuildGridMesh(2000, vertices, indices);
+    culler.AddOccluder(culler.AddMesh(vertices, indices), worldViewProj);
+    culler.RasterizeOccluders();
+
+    runner.Run("software_occlusion/test_spheres_100k", sphereCount, 0, [&]()
+        {
+            culler.TestSpheres(spheres.data(), sphereCount, ubo.viewProj, visible.data(), false);
+            DoNotOptimize(visible[0]);
+        });
+
+    runner.Run("software_occlusion/test_spheres_mt_100k", sphereCount, 0, [&]()
+        {
+            culler.TestSpheres(spheres.data(), sphereCount, ubo.viewProj, visible.data(), true);
+            DoNotOptimize(visible[0]);
+        });
+}
+
+// Reference for the BVH queries: every box, with the same plane test
+static bool IsBoxInFrustum(const Aabb& box, const glm::mat4& viewProj)
+{
+    const glm::vec4 rows[4] = {
+        glm::vec4(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]),
+        glm::vec4(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]),
+        glm::vec4(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]),
+        glm::vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]) };
+    const glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+
+    const glm::vec3 center = box.GetCenter();
+    const glm::vec3 extent = box.GetExtent();
+    for (const glm::vec4& plane : planes)
+    {
+        const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        const float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+        if (distance + radius < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float IntersectRayBox(const Aabb& box, const glm::vec3& origin, const glm::vec3& direction, float maxDistance)
+{
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float t0 = (box.min[axis] - origin[axis]) / direction[axis];
+        const float t1 = (box.max[axis] - origin[axis]) / direction[axis];
+        entry = std::max(entry, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return entry <= exit ? entry : FLT_MAX;
+}
+
+static void CheckSameInstances(std::vector<uint32_t> result, std::vector<uint32_t> expected, const std::string& query)
+{
+    std::sort(result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+    if (result != expected)
+    {
+        throw std::runtime_error("BVH " + query + " returned " + std::to_string(result.size()) + " instances instead of "
+            + std::to_string(expected.size()));
+    }
+}
+
+static void RunBvhBenchmarks(MicrobenchmarkRunner& runner)
+{
+    for (uint32_t instanceCount : { 100000u, 1000000u })
+    {
+        // Boxes of 0.1 to 2 units, uniformly spread over a cube holding about the same number of instances per unit
+        const float sceneSize = 200.0f * std::cbrt(instanceCount / 100000.0f);
+
+        // From a quarter of the scene in front of its center, seeing a few percent of it
+        UniformBufferObject ubo{};
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, sceneSize * 0.5f);
+        proj[1][1] *= -1;
+        ubo.viewProj = proj * glm::lookAt(glm::vec3(0.0f, -sceneSize * 0.25f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        std::vector<Aabb> boxes(instanceCount);
+        for (Aabb& box : boxes)
+        {
+            box.min = glm::vec3(distribution(random), distribution(random), distribution(random)) * sceneSize - sceneSize * 0.5f;
+            box.max = box.min + glm::vec3(0.1f) + glm::vec3(distribution(random), distribution(random), distribution(random)) * 1.9f;
+        }
+
+        Bvh bvh;
+        bvh.Build(boxes.data(), instanceCount);
+
+        std::vector<uint32_t> result, expected;
+        bvh.QueryFrustum(ubo.viewProj, result);
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+            if (IsBoxInFrustum(boxes[i], ubo.viewProj))
+            {
+                expected.push_back(i);
+            }
+        }
+        CheckSameInstances(result, expected, "frustum query");
+        const size_t frustumCount = result.size();
+
+        result.clear();
+        bvh.QueryFrustum(ubo.viewProj, result, true);
+        CheckSameInstances(result, expected, "multithreaded frustum query");
+
+        const Aabb queryBox = { glm::vec3(-10.0f, -5.0f, -20.0f), glm::vec3(15.0f, 10.0f, 0.0f) };
+        result.clear();
+        expected.clear();
+        bvh.QueryBox(queryBox, result);
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+            const Aabb& box = boxes[i];
+            if (box.min.x <= queryBox.max.x && box.max.x >= queryBox.min.x && box.min.y <= queryBox.max.y && box.max.y >= queryBox.min.y
+                && box.min.z <= queryBox.max.z && box.max.z >= queryBox.min.z)
+            {
+                expected.push_back(i);
+            }
+        }
+        CheckSameInstances(result, expected, "box query");
+
+        const glm::vec3 sphereCenter(5.0f, -3.0f, 8.0f);
+        const float sphereRadius = 12.0f;
+        result.clear();
+        expected.clear();
+        bvh.QuerySphere(sphereCenter, sphereRadius, result);
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+            const glm::vec3 outside = glm::max(glm::max(boxes[i].min - sphereCenter, sphereCenter - boxes[i].max), glm::vec3(0.0f));
+            if (glm::dot(outside, outside) <= sphereRadius * sphereRadius)
+            {
+                expected.push_back(i);
+            }
+        }
+        CheckSameInstances(result, expected, "sphere query");
+
+        // Rays from outside of the scene toward random points inside
+        const uint32_t rayCount = 1000;
+        std::vector<glm::vec3> rayOrigins(rayCount), rayDirections(rayCount);
+        for (uint32_t ray = 0; ray < rayCount; ++ray)
+        {
+            rayOrigins[ray] = glm::vec3(distribution(random) - 0.5f, -1.0f, distribution(random) - 0.5f) * sceneSize;
+            const glm::vec3 target = (glm::vec3(distribution(random), distribution(random), distribution(random)) - 0.5f) * sceneSize;
+            rayDirections[ray] = glm::normalize(target - rayOrigins[ray]);
+        }
+        for (uint32_t ray = 0; ray < 100; ++ray)
+        {
+            float nearest = FLT_MAX;
+            for (const Aabb& box : boxes)
+            {
+                nearest = std::min(nearest, IntersectRayBox(box, rayOrigins[ray], rayDirections[ray], sceneSize * 2.0f));
+            }
+
+            BvhRayHit hit;
+            const bool found = bvh.Raycast(rayOrigins[ray], rayDirections[ray], sceneSize * 2.0f, hit);
+            if (found != (nearest != FLT_MAX) || (found && std::fabs(hit.distance - nearest) > 1e-3f))
+            {
+                throw std::runtime_error("BVH raycast " + std::to_string(ray) + " hit at " + std::to_string(hit.distance)
+                    + " instead of " + std::to_string(nearest));
+            }
+        }
+
+        // Every instance moves a bit, as if animated: the refitted tree gets slower than a rebuilt one
+        std::vector<Aabb> movedBoxes = boxes;
+        for (Aabb& box : movedBoxes)
+        {
+            const glm::vec3 offset = (glm::vec3(distribution(random), distribution(random), distribution(random)) - 0.5f) * 4.0f;
+            box.min += offset;
+            box.max += offset;
+        }
+        Bvh refitted = bvh;
+        refitted.Refit(movedBoxes.data());
+
+        result.clear();
+        expected.clear();
+        refitted.QueryFrustum(ubo.viewProj, result);
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+            if (IsBoxInFrustum(movedBoxes[i], ubo.viewProj))
+            {
+                expected.push_back(i);
+            }
+        }
+        CheckSameInstances(result, expected, "frustum query after refit");
+
+        std::printf("bvh %u instances: %u nodes, %zu in the frustum, cost ratio %.2f after moving them\n",
+            instanceCount, bvh.GetNodeCount(), frustumCount, refitted.GetCostRatio());
+
+        const std::string label = TriangleLabel(instanceCount);
+
+        runner.Run("bvh/build_" + label, instanceCount, 0, [&]()
+            {
+                bvh.Build(boxes.data(), instanceCount, false);
+                DoNotOptimize(bvh.GetNodeCount());
+            });
+
+        runner.Run("bvh/build_mt_" + label, instanceCount, 0, [&]()
+            {
+                bvh.Build(boxes.data(), instanceCount, true);
+                DoNotOptimize(bvh.GetNodeCount());
+            });
+
+        runner.Run("bvh/refit_" + label, instanceCount, 0, [&]()
+            {
+                refitted.Refit(movedBoxes.data(), false);
+                DoNotOptimize(refitted.GetNodeCount());
+            });
+
+        runner.Run("bvh/frustum_" + label, instanceCount, 0, [&]()
+            {
+                result.clear();
+                bvh.QueryFrustum(ubo.viewProj, result, false);
+                DoNotOptimize(result.size());
+            });
+
+        runner.Run("bvh/frustum_mt_" + label, instanceCount, 0, [&]()
+            {
+                result.clear();
+                bvh.QueryFrustum(ubo.viewProj, result, true);
+                DoNotOptimize(result.size());
+            });
+
+        runner.Run("bvh/frustum_brute_force_" + label, instanceCount, 0, [&]()
+            {
+                result.clear();
+                for (uint32_t i = 0; i < instanceCount; ++i)
+                {
+                    if (IsBoxInFrustum(boxes[i], ubo.viewProj))
+                    {
+                        result.push_back(i);
+                    }
+                }
+                DoNotOptimize(result.size());
+            });
+
+        runner.Run("bvh/raycast_1k_rays_" + label, rayCount, 0, [&]()
+            {
+                BvhRayHit hit;
+                for (uint32_t ray = 0; ray < rayCount; ++ray)
+                {
+                    bvh.Raycast(rayOrigins[ray], rayDirections[ray], sceneSize * 2.0f, hit);
+                }
+                DoNotOptimize(hit.instance);
+            });
+    }
+}
+
+// The reference QOI decoder, to check the encoder against
+static std::vector<uint8_t> DecodeQoi(const std::vector<uint8_t>& file, uint32_t width, uint32_t height)
+{
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> pixels(pixelCount * 4);
+
+    uint8_t index[64][4] = {};
+    uint8_t pixel[4] = { 0, 0, 0, 255 };
+    uint32_t run = 0;
+    size_t position = 14;
+
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        if (run > 0)
+        {
+            --run;
+        }
+        else
+        {
+            if (position >= file.size())
+            {
+                throw std::runtime_error("QOI file is truncated");
+            }
+            const uint8_t op = file[position++];
+            if (op == 0xFE)
+            {
+                pixel[0] = file[position++];
+                pixel[1] = file[position++];
+                pixel[2] = file[position++];
+            }
+            else if (op == 0xFF)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    pixel[c] = file[position++];
+                }
+            }
+            else if ((op & 0xC0) == 0x00)
+            {
+                std::copy(index[op], index[op] + 4, pixel);
+            }
+            else if ((op & 0xC0) == 0x40)
+            {
+                pixel[0] += ((op >> 4) & 3) - 2;
+                pixel[1] += ((op >> 2) & 3) - 2;
+                pixel[2] += (op & 3) - 2;
+            }
+            else if ((op & 0xC0) == 0x80)
+            {
+                const uint8_t second = file[position++];
+                const int dg = (op & 0x3F) - 32;
+                pixel[0] += dg - 8 + ((second >> 4) & 0x0F);
+                pixel[1] += dg;
+                pixel[2] += dg - 8 + (second & 0x0F);
+            }
+            else
+            {
+                run = op & 0x3F;
+            }
+            std::copy(pixel, pixel + 4, index[(pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64]);
+        }
+        std::copy(pixel, pixel + 4, &pixels[i * 4]);
+    }
+    return pixels;
+}
+
+// Every format must give back the exact pixels, the PNG through stb_image
+static void CheckImageRoundTrip(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height, const std::string& image)
+{
+    std::vector<uint8_t> file;
+    EncodeImage(pixels.data(), width, height, IMAGE_FILE_PNG, file);
+
+    int decodedWidth, decodedHeight, channels;
+    stbi_uc* decoded = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &decodedWidth, &decodedHeight, &channels, STBI_rgb_alpha);
+    if (decoded == nullptr)
+    {
+        throw std::runtime_error(image + ": stb_image can't decode the PNG: " + stbi_failure_reason());
+    }
+    const bool pngMatches = static_cast<uint32_t>(decodedWidth) == width && static_cast<uint32_t>(decodedHeight) == height
+        && std::equal(pixels.begin(), pixels.end(), decoded);
+    stbi_image_free(decoded);
+    if (!pngMatches)
+    {
+        throw std::runtime_error(image + ": the decoded PNG differs from the encoded pixels");
+    }
+    const size_t pngSize = file.size();
+
+    file.clear();
+    EncodeImage(pixels.data(), width, height, IMAGE_FILE_QOI, file);
+    if (DecodeQoi(file, width, height) != pixels)
+    {
+        throw std::runtime_error(image + ": the decoded QOI differs from the encoded pixels");
+    }
+
+    std::printf("%s %ux%u: PNG %zu bytes, QOI %zu bytes, raw %zu bytes\n", image.c_str(), width, height, pngSize, file.size(), pixels.size());
+}
+
+static void RunImageWriterBenchmarks(MicrobenchmarkRunner& runner)
+{
+    /*
+    Something like a rendered frame: smooth gradients, a flat background and a noisy textured area,
+    which exercise the matches, the literals, the runs and the diffs of the encoders.
+    */
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> noise(0, 255);
+
+    std::vector<uint8_t> frame(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = &frame[(static_cast<size_t>(y) * width + x) * 4];
+            if (y < height / 3)
+            {
+                pixel[0] = pixel[1] = pixel[2] = 40;
+            }
+            else if (x < width / 2)
+            {
+                pixel[0] = static_cast<uint8_t>(x * 255 / width);
+                pixel[1] = static_cast<uint8_t>(y * 255 / height);
+                pixel[2] = 128;
+            }
+            else
+            {
+                const int base = ((x / 16 + y / 16) % 2) * 96 + 64;
+                pixel[0] = static_cast<uint8_t>(base + noise(random) % 32);
+                pixel[1] = static_cast<uint8_t>(base + noise(random) % 32);
+                pixel[2] = static_cast<uint8_t>(base);
+            }
+            pixel[3] = 255;
+        }
+    }
+
+    // Odd sizes, pure noise and translucent pixels: the cases the frame above barely has
+    std::vector<uint8_t> small(37 * 23 * 4);
+    for (uint8_t& value : small)
+    {
+        value = static_cast<uint8_t>(noise(random));
+    }
+
+    CheckImageRoundTrip(small, 37, 23, "noise");
+    CheckImageRoundTrip(frame, width, height, "frame");
+
+    const uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+    std::vector<uint8_t> file;
+    const std::pair<const char*, ImageFileFormat> formats[] = { { "png", IMAGE_FILE_PNG }, { "qoi", IMAGE_FILE_QOI } };
+    for (const auto& [name, format] : formats)
+    {
+        runner.Run(std::string("encode_") + name + "/frame_1080p", pixelCount, pixelCount * 4, [&]()
+            {
+                file.clear();
+                EncodeImage(frame.data(), width, height, format, file);
+                DoNotOptimize(file.size());
+            });
+    }
+}
+
+/*
+    The CPU side of a frame over 100k objects as a graph of jobs: the transform update and the occluder rasterization
+    side by side, the BVH refit and frustum query once the transforms are done, then the occlusion test and the draw
+    list sort once both are. Timed from 1 thread (every job on the caller) to one per hardware thread, every thread
+    count checked against the draw list of the first.
+*/
+static void RunJobSystemBenchmarks(MicrobenchmarkRunner& runner)
+{
+    const uint32_t objectCount = 100000;
+    const float sceneSize = 200.0f;
+    const glm::vec3 eye(0.0f, -sceneSize * 0.25f, 0.0f);
+
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, sceneSize);
+    proj[1][1] *= -1;
+    const glm::mat4 viewProj = proj * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    TransformSystem transforms;
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        const glm::vec3 axis = glm::normalize(glm::vec3(distribution(random), distribution(random), distribution(random) + 2.0f));
+        transforms.Add(glm::vec3(distribution(random), distribution(random), distribution(random)) * sceneSize * 0.5f,
+            glm::angleAxis(distribution(random) * 3.14159265f, axis), glm::vec3(1.0f + 0.5f * distribution(random)),
+            BoundingSphere{ glm::vec3(0.0f, 0.0f, 0.5f), 1.0f });
+    }
+
+    // An 8x8 wall between the camera and the center of the scene, hiding the objects right behind it
+    glm::mat4 wall(0.0f);
+    wall[0] = glm::vec4(8.0f, 0.0f, 0.0f, 0.0f);
+    wall[1] = glm::vec4(0.0f, 0.0f, 8.0f, 0.0f);
+    wall[2] = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+    wall[3] = glm::vec4(-4.0f, -sceneSize * 0.15f, -4.0f, 1.0f);
+    std::vector<Vertex> wallVertices;
+    std::vector<uint32_t> wallIndices;
+    BuildGridMesh(20000, wallVertices, wallIndices);
+    SoftwareOcclusionCuller culler;
+    culler.Init(256, 128);
+    const uint32_t wallMesh = culler.AddMesh(wallVertices, wallIndices);
+
+    std::vector<ObjectTransform> objectTransforms(objectCount);
+    std::vector<glm::vec4> bounds(objectCount);
+    std::vector<Aabb> boxes(objectCount);
+    transforms.Update(viewProj, objectTransforms.data(), bounds.data(), false);
+    auto sphereBox = [](const glm::vec4& sphere)
+    {
+        const glm::vec3 center(sphere.x, sphere.y, sphere.z);
+        return Aabb{ center - glm::vec3(sphere.w), center + glm::vec3(sphere.w) };
+    };
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        boxes[i] = sphereBox(bounds[i]);
+    }
+    Bvh bvh;
+    bvh.Build(boxes.data(), objectCount, false);
+
+    std::vector<uint32_t> instances;
+    std::vector<glm::vec4> spheres;
+    std::vector<uint8_t> visible;
+    RenderQueue queue;
+
+    auto runFrame = [&](JobSystem& jobs)
+    {
+        JobCounter transformsDone, visibilityInputs, frameDone;
+
+        jobs.Submit("Transforms", [&]()
+            {
+                transforms.Update(viewProj, objectTransforms.data(), bounds.data());
+            }, &transformsDone);
+
+        jobs.Submit("Occluders", [&]()
+            {
+                culler.BeginFrame();
+                culler.AddOccluder(wallMesh, viewProj * wall);
+                culler.RasterizeOccluders();
+            }, &visibilityInputs);
+
+        jobs.SubmitAfter(transformsDone, "Frustum culling", [&]()
+            {
+                ParallelFor(objectCount, 4096, [&](uint32_t begin, uint32_t end)
+                    {
+                        for (uint32_t i = begin; i < end; ++i)
+                        {
+                            boxes[i] = sphereBox(bounds[i]);
+                        }
+                    });
+                bvh.Refit(boxes.data());
+                instances.clear();
+                bvh.QueryFrustum(viewProj, instances, true);
+                // The order of the multithreaded query depends on the workers
+                std::sort(instances.begin(), instances.end());
+            }, &visibilityInputs);
+
+        jobs.SubmitAfter(visibilityInputs, "Draw list", [&]()
+            {
+                const uint32_t count = static_cast<uint32_t>(instances.size());
+                spheres.resize(count);
+                visible.resize(count);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    spheres[i] = bounds[instances[i]];
+                }
+                culler.TestSpheres(spheres.data(), count, viewProj, visible.data());
+
+                queue.Clear();
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    if (visible[i] != 0)
+                    {
+                        const uint32_t object = instances[i];
+                        DrawPacket packet{};
+                        packet.pipeline = object % 4;
+                        packet.material = object % 64;
+                        packet.mesh = object % 16;
+                        packet.object = object;
+                        packet.sortKey = SortKey::MakeOpaque(0, packet.pipeline, packet.material, packet.mesh,
+                            SortKey::QuantizeDepth(glm::length(glm::vec3(spheres[i].x, spheres[i].y, spheres[i].z) - eye), 0.1f, sceneSize));
+                        queue.Add(packet);
+                    }
+                }
+                queue.Sort();
+            }, &frameDone);
+
+        jobs.Wait(frameDone);
+    };
+
+    auto hashDrawList = [&]()
+    {
+        uint64_t hash = queue.GetCount();
+        for (uint32_t i = 0; i < queue.GetCount(); ++i)
+        {
+            hash = hash * 1099511628211ull ^ queue.GetSorted(i).object;
+        }
+        return hash;
+    };
+
+    const uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    uint64_t expectedHash = 0;
+    double singleThreadMs = 0.0;
+    for (uint32_t threads : threadCounts)
+    {
+        JobSystem jobs(threads - 1);
+
+        runFrame(jobs);
+        const uint64_t hash = hashDrawList();
+        if (threads == 1)
+        {
+            expectedHash = hash;
+            std::printf("job system frame: %u objects, %zu in the frustum, %u draws after occlusion culling\n",
+                objectCount, instances.size(), queue.GetCount());
+        }
+        else if (hash != expectedHash)
+        {
+            throw std::runtime_error("job system frame on " + std::to_string(threads) + " threads built another draw list");
+        }
+
+        const JobSystemStats before = jobs.GetStats();
+        const MicrobenchmarkResult result = runner.Run("job_system/frame_100k_" + std::to_string(threads) + "t", objectCount, 0, [&]()
+            {
+                runFrame(jobs);
+                DoNotOptimize(queue.GetCount());
+            });
+        const JobSystemStats after = jobs.GetStats();
+
+        if (threads == 1)
+        {
+            singleThreadMs = result.runTimesMs.p50;
+        }
+        const uint32_t frames = runner.GetRepetitions() + 1;
+        const uint64_t jobCount = after.jobs - before.jobs;
+        const double utilization = (after.busyMs - before.busyMs) / ((after.elapsedMs - before.elapsedMs) * threads);
+        std::printf("job system: %u threads, speedup %.2fx, %llu jobs per frame, %.1f%% stolen, %.0f%% utilization\n",
+            threads, singleThreadMs / result.runTimesMs.p50, static_cast<unsigned long long>(jobCount / frames),
+            jobCount > 0 ? 100.0 * (after.steals - before.steals) / jobCount : 0.0, 100.0 * utilization);
+
+        if (threads == maxThreads)
+        {
+            for (const JobSystemStats::Timing& timing : after.timings)
+            {
+                std::printf("    %-20s %8llu jobs %10.3f ms average %10.3f ms max\n", timing.name,
+                    static_cast<unsigned long long>(timing.count), timing.totalMs / timing.count, timing.maxMs);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        const BenchmarkOptions options = ParseOptions(argc, argv);
+
+        MicrobenchmarkRunner runner(options.repetitions);
+
+        RunHashBenchmarks(runner);
+        RunDeduplicationBenchmarks(runner, options.maxTriangles);
+        RunAssetBenchmarks(runner, options.assetDirectory);
+        RunMeshLodBenchmarks(runner, options.assetDirectory);
+        RunMeshletBenchmarks(runner, options.assetDirectory);
+        RunUniformBenchmarks(runner);
+        RunTransformBenchmarks(runner);
+        RunRenderQueueBenchmarks(runner);
+        RunSoftwareOcclusionBenchmarks(runner);
+        RunBvhBenchmarks(runner);
+        RunImageWriterBenchmarks(runner);
+        RunJobSystemBenchmarks(runner);
+
+        runner.PrintTable();
+
+        if (!options.jsonFile.empty())
+        {
+            runner.WriteJson(options.jsonFile);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "microbenchmark.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+static volatile uint64_t g_Sink = 0;
+
+void DoNotOptimize(uint64_t value)
+{
+    g_Sink = g_Sink + value;
+}
+
+MicrobenchmarkResult MicrobenchmarkRunner::Run(const std::string& name, uint64_t itemsPerRun, uint64_t bytesPerRun, const std::function<void()>& run)
+{
+    run();
+
+    std::vector<double> runTimesMs;
+    runTimesMs.reserve(m_Repetitions);
+
+    for (uint32_t i = 0; i < m_Repetitions; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const auto end = std::chrono::steady_clock::now();
+
+        runTimesMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    MicrobenchmarkResult result;
+    result.name = name;
+    result.itemsPerRun = itemsPerRun;
+    result.bytesPerRun = bytesPerRun;
+    result.runTimesMs = SummarizeFrameTimes(std::move(runTimesMs));
+    m_Results.push_back(result);
+
+    // Print as we go, the large cases take a while
+    const double seconds = result.runTimesMs.p50 / 1000.0;
+    std::printf("%-40s %12.3f ms %14.2f Mitems/s", name.c_str(), result.runTimesMs.p50, itemsPerRun / seconds / 1e6);
+    if (bytesPerRun > 0)
+    {
+        std::printf(" %10.1f MB/s", bytesPerRun / seconds / (1024.0 * 1024.0));
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+
+    return result;
+}
+
+void MicrobenchmarkRunner::PrintTable() const
+{
+    std::printf("\n%-40s %12s %12s %12s %12s\n", "benchmark", "min ms", "p50 ms", "p95 ms", "max ms");
+    for (const MicrobenchmarkResult& result : m_Results)
+    {
+        std::printf("%-40s %12.3f %12.3f %12.3f %12.3f\n", result.name.c_str(),
+            result.runTimesMs.min, result.runTimesMs.p50, result.runTimesMs.p95, result.runTimesMs.max);
+    }
+}
+
+void MicrobenchmarkRunner::WriteJson(const std::string& filePath) const
+{
+    std::ofstream file(filePath, std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to write benchmark results " + filePath);
+    }
+
+    file << "[\n";
+    for (size_t i = 0; i < m_Results.size(); ++i)
+    {
+        const MicrobenchmarkResult& result = m_Results[i];
+        const double seconds = result.runTimesMs.p50 / 1000.0;
+
+        file << "  { \"name\": \"" << result.name << "\""
+            << ", \"repetitions\": " << result.runTimesMs.count
+            << ", \"items\": " << result.itemsPerRun
+            << ", \"bytes\": " << result.bytesPerRun
+            << ", \"minMs\": " << result.runTimesMs.min
+            << ", \"p50Ms\": " << result.runTimesMs.p50
+            << ", \"p95Ms\": " << result.runTimesMs.p95
+            << ", \"maxMs\": " << result.runTimesMs.max
+            << ", \"itemsPerSecond\": " << result.itemsPerRun / seconds
+            << ", \"bytesPerSecond\": " << result.bytesPerRun / seconds
+            << " }" << (i + 1 < m_Results.size() ? ",\n" : "\n");
+    }
+    file << "]\n";
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../benchmark.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct MicrobenchmarkResult
+{
+    std::string name;
+    uint64_t itemsPerRun = 0;
+    uint64_t bytesPerRun = 0;       // 0 when throughput in bytes is meaningless
+    FrameTimeSummary runTimesMs;
+};
+
+/*
+    Minimal benchmark runner, no dependency besides the standard library.
+
+    Every case runs once untimed (page faults, caches, lazy allocations), then `repetitions` timed runs.
+    Throughput is derived from the median run, which is less sensitive to a noisy machine than the mean.
+*/
+class MicrobenchmarkRunner
+{
+public:
+    explicit MicrobenchmarkRunner(uint32_t repetitions) : m_Repetitions(repetitions) {}
+
+    // Runs the case 1 + repetitions times, returns the timings of the repetitions
+    MicrobenchmarkResult Run(const std::string& name, uint64_t itemsPerRun, uint64_t bytesPerRun, const std::function<void()>& run);
+    uint32_t GetRepetitions() const { return m_Repetitions; }
+
+    void PrintTable() const;
+    void WriteJson(const std::string& filePath) const;
+
+private:
+    uint32_t m_Repetitions;
+    std::vector<MicrobenchmarkResult> m_Results;
+};
+
+// Keeps the compiler from discarding a computation whose result is otherwise unused
+void DoNotOptimize(uint64_t value);
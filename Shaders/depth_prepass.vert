@@ -0,0 +1,22 @@
+#version 450
+
+// Depth-only prepass: same transform as shader.vert, but only the position stream is read
+
+layout(binding = 0) uniform UniformBufferObject
+{
+    mat4 viewProj;
+} ubo;
+
+layout(push_constant) uniform ObjectPushConstants
+{
+    mat4 model;
+} object;
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = ubo.viewProj * (object.model * vec4(inPosition, 1.0));
+}
@@ -8,6 +8,19 @@ layout(location = 0) out vec4 outColor;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Feature flags of the permutation, see ShadingFeature (shader_permutations.h)
+const uint FEATURE_UV_DEBUG = 1u;
+const uint FEATURE_REPEAT = 2u;
+const uint FEATURE_VERTEX_COLOR = 4u;
+
+#ifdef FEATURES
+// --permutation-defines: a literal, each permutation is compiled (and optimized) on its own
+const uint features = FEATURES;
+#else
+// Set at pipeline creation: one SPIR-V for every permutation, the driver removes the disabled branches
+layout(constant_id = 0) const uint features = 0u;
+#endif
+
 void main() {
 
 // Just like the per vertex colors, the fragTexCoord values will be smoothly interpolated across the area of the square by the rasterizer. 
@@ -16,13 +29,20 @@ void main() {
 // The black and yellow corners confirm that the texture coordinates are correctly interpolated from 0, 0 to 1, 1 across the square.
 // Visualizing data using colors is the shader programming equivalent of printf debugging, for lack of a better option!
 
-    //outColor = vec4(fragTexCoord, 0.0, 1.0);
+    if ((features & FEATURE_UV_DEBUG) != 0u)
+    {
+        outColor = vec4(fragTexCoord, 0.0, 1.0);
+        return;
+    }
 
     // the result in the image when using VK_SAMPLER_ADDRESS_MODE_REPEAT
-    //outColor = texture(texSampler, fragTexCoord * 2.0);
+    const vec2 texCoord = (features & FEATURE_REPEAT) != 0u ? fragTexCoord * 2.0 : fragTexCoord;
 
-    // separated the RGB and alpha channels here to not scale the alpha channel.
-    //outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
+    outColor = texture(texSampler, texCoord);
 
-    outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+    // separated the RGB and alpha channels here to not scale the alpha channel.
+    if ((features & FEATURE_VERTEX_COLOR) != 0u)
+    {
+        outColor.rgb *= fragColor;
+    }
+}
@@ -2,11 +2,14 @@
 
 layout(binding = 0) uniform UniformBufferObject
 {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
+    mat4 viewProj;
 } ubo;
 
+layout(push_constant) uniform ObjectPushConstants
+{
+    mat4 model;
+} object;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
@@ -14,9 +17,13 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
+// Must match depth_prepass.vert bit for bit, the depth test of the main pass is EQUAL with the prepass
+invariant gl_Position;
+
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    // Two matrix-vector products per vertex, no matrix-matrix product
+    gl_Position = ubo.viewProj * (object.model * vec4(inPosition, 1.0));
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
\ No newline at end of file
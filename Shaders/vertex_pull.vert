@@ -0,0 +1,62 @@
+#version 450
+
+// shader.vert (and depth_prepass.vert with DEPTH_PREPASS) without vertex input: the vertices are read from the
+// geometry pool by gl_VertexIndex, which already includes the vertexOffset of the mesh, see GeometryPool.
+// BUFFER_DEVICE_ADDRESS: through a pointer in the push constants, otherwise a storage buffer of the scene set.
+
+#ifdef BUFFER_DEVICE_ADDRESS
+#extension GL_EXT_buffer_reference : require
+#endif
+
+layout(binding = 0) uniform UniformBufferObject
+{
+    mat4 viewProj;
+} ubo;
+
+// Vertex as 8 floats: pos, color, texCoord. A vec3 member would be aligned to 16 bytes in std430.
+#ifdef BUFFER_DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VertexBuffer
+{
+    float data[];
+};
+
+// PulledObjectPushConstants
+layout(push_constant) uniform ObjectPushConstants
+{
+    mat4 model;
+    VertexBuffer vertices;
+} object;
+
+#define VERTEX_DATA object.vertices.data
+#else
+layout(std430, binding = 2) readonly buffer VertexBuffer
+{
+    float data[];
+} vertices;
+
+layout(push_constant) uniform ObjectPushConstants
+{
+    mat4 model;
+} object;
+
+#define VERTEX_DATA vertices.data
+#endif
+
+#ifndef DEPTH_PREPASS
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+#endif
+
+// Both variants compute the position the same way: the depth test of the main pass is EQUAL with the prepass
+invariant gl_Position;
+
+void main()
+{
+    uint base = uint(gl_VertexIndex) * 8u;
+    vec3 position = vec3(VERTEX_DATA[base], VERTEX_DATA[base + 1u], VERTEX_DATA[base + 2u]);
+    gl_Position = ubo.viewProj * (object.model * vec4(position, 1.0));
+#ifndef DEPTH_PREPASS
+    fragColor = vec3(VERTEX_DATA[base + 3u], VERTEX_DATA[base + 4u], VERTEX_DATA[base + 5u]);
+    fragTexCoord = vec2(VERTEX_DATA[base + 6u], VERTEX_DATA[base + 7u]);
+#endif
+}
@@ -0,0 +1,223 @@
+#include "app_config.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "shader_compiler.h"
+#include "shader_permutations.h"
+
+static const char* USAGE =
+    "usage: VulkanPlayground [options]\n"
+    "  --trace <file>       write a Chrome/Perfetto JSON trace of CPU and GPU scopes\n"
+    "  --pipeline-stats     collect pipeline statistics (vertex/fragment invocations) into the trace\n"
+    "  --benchmark          render a fixed number of frames with a fixed timestep and report frame times\n"
+    "  --frames <n>         measured benchmark frames (default 1000)\n"
+    "  --warmup <n>         benchmark frames rendered before measuring (default 100)\n"
+    "  --timestep <sec>     simulation time per benchmark frame (default 1/60)\n"
+    "  --camera-path <file> scripted camera/model path for the benchmark\n"
+    "  --report <file>      write the benchmark JSON report to a file instead of stdout\n"
+    "  --headless           render into an invisible window\n"
+    "  --startup-timing     print the duration of every startup step, shader reload and pipeline build\n"
+    "  --serial-startup     load assets on the main thread instead of overlapping them with Vulkan setup\n"
+    "  --dynamic-rendering  render without VkRenderPass/VkFramebuffer (VK_KHR_dynamic_rendering), if supported\n"
+    "  --resize-benchmark <n> resize the window n times, print the swap chain recreation times and exit\n"
+    "  --depth-prepass      depth-only prepass, then shade only the visible fragments (depth test EQUAL)\n"
+    "  --occlusion-culling  skip hidden objects with a depth pyramid (two-phase Hi-Z culling), if supported\n"
+    "  --cpu-occlusion-culling skip hidden objects with a CPU rasterized occlusion buffer before recording\n"
+    "  --lod-error <px>     simplify the model into LODs at load time, draw the coarsest one within px pixels of error\n"
+    "  --meshlets           split the model into meshlets, cull them against the frustum and the camera direction in compute\n"
+    "  --mesh-shaders       cull and draw the meshlets with task and mesh shaders (VK_EXT_mesh_shader), if supported\n"
+    "  --geometry-pool      sub-allocate the meshes in one vertex and one index buffer, the shaders fetch the vertices\n"
+    "  --shading <features> permutation of the fragment shader: none or a list of uv, repeat, color (keys 1-3 toggle them)\n"
+    "  --permutation-defines compile a fragment shader per permutation (defines) instead of specializing one (constants)\n"
+    "  --pipeline-library   link the permutations from graphics pipeline libraries, fast first, then optimized, if supported\n"
+    "  --thumbnails <k>     render k views of the model per frame (1 to 64) in a grid, from one sorted draw list\n"
+    "  --render-thread      render on a thread of its own, fed the latest scene snapshot by the main thread without a lock\n"
+    "  --mouse-camera       orbit the camera with the cursor, print the input to present latency on exit\n"
+    "  --late-latch         write the camera matrices right before submit, from the latest cursor position\n"
+    "  --job-threads <n>    threads of the job system (loading, culling, transforms, sorting), 1 runs everything inline\n"
+    "  --pin-threads        pin each job worker thread to a core of its own\n"
+    "  --hot-reload         compile the shaders from GLSL at startup, recompile and swap the pipelines when one is saved\n"
+    "  --export <dir>       write every presented frame to dir, read back and encoded without stalling the GPU\n"
+    "  --export-format <f>  png (default), qoi or raw RGBA8 for --export\n";
+
+ApplicationConfig ParseCommandLine(int argc, char** argv)
+{
+    ApplicationConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        auto nextValue = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for " + arg + "\n" + USAGE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--trace")
+        {
+            config.traceFilePath = nextValue();
+        }
+        else if (arg == "--pipeline-stats")
+        {
+            config.enablePipelineStatistics = true;
+        }
+        else if (arg == "--benchmark")
+        {
+            config.runBenchmark = true;
+        }
+        else if (arg == "--frames")
+        {
+            config.benchmark.frameCount = static_cast<uint32_t>(std::stoul(nextValue()));
+            if (config.benchmark.frameCount == 0)
+            {
+                throw std::runtime_error("--frames expects at least 1 frame");
+            }
+        }
+        else if (arg == "--warmup")
+        {
+            config.benchmark.warmupFrames = static_cast<uint32_t>(std::stoul(nextValue()));
+        }
+        else if (arg == "--timestep")
+        {
+            config.benchmark.timestep = std::stof(nextValue());
+            // Zero freezes the simulation, a negative step runs it backwards
+            if (!(config.benchmark.timestep > 0.0f))
+            {
+                throw std::runtime_error("--timestep expects a positive number of seconds");
+            }
+        }
+        else if (arg == "--camera-path")
+        {
+            config.benchmark.cameraPathFile = nextValue();
+        }
+        else if (arg == "--report")
+        {
+            config.benchmark.reportFile = nextValue();
+        }
+        else if (arg == "--headless")
+        {
+            config.headless = true;
+        }
+        else if (arg == "--startup-timing")
+        {
+            config.printStartupTiming = true;
+        }
+        else if (arg == "--serial-startup")
+        {
+            config.serialStartup = true;
+        }
+        else if (arg == "--dynamic-rendering")
+        {
+            config.dynamicRendering = true;
+        }
+        else if (arg == "--resize-benchmark")
+        {
+            config.resizeBenchmarkCount = static_cast<uint32_t>(std::stoul(nextValue()));
+        }
+        else if (arg == "--depth-prepass")
+        {
+            config.depthPrepass = true;
+        }
+        else if (arg == "--occlusion-culling")
+        {
+            config.occlusionCulling = true;
+        }
+        else if (arg == "--cpu-occlusion-culling")
+        {
+            config.cpuOcclusionCulling = true;
+        }
+        else if (arg == "--lod-error")
+        {
+            config.lodPixelError = std::stof(nextValue());
+        }
+        else if (arg == "--meshlets")
+        {
+            config.meshlets = true;
+        }
+        else if (arg == "--mesh-shaders")
+        {
+            config.meshlets = true;
+            config.meshShaders = true;
+        }
+        else if (arg == "--geometry-pool")
+        {
+            config.geometryPool = true;
+        }
+        else if (arg == "--shading")
+        {
+            config.shadingFeatures = ParseShadingFeatures(nextValue());
+        }
+        else if (arg == "--permutation-defines")
+        {
+            config.permutationDefines = true;
+            if (!ShaderCompiler::IsAvailable())
+            {
+                throw std::runtime_error("--permutation-defines needs the GLSL compiler, regenerate the project with premake5 --hot-reload");
+            }
+        }
+        else if (arg == "--pipeline-library")
+        {
+            config.pipelineLibrary = true;
+        }
+        else if (arg == "--thumbnails")
+        {
+            config.thumbnailViews = static_cast<uint32_t>(std::stoul(nextValue()));
+            if (config.thumbnailViews == 0 || config.thumbnailViews > MAX_THUMBNAIL_VIEWS)
+            {
+                throw std::runtime_error("--thumbnails expects 1 to " + std::to_string(MAX_THUMBNAIL_VIEWS) + " views");
+            }
+        }
+        else if (arg == "--render-thread")
+        {
+            config.renderThread = true;
+        }
+        else if (arg == "--mouse-camera")
+        {
+            config.mouseCamera = true;
+        }
+        else if (arg == "--late-latch")
+        {
+            config.lateLatch = true;
+            config.mouseCamera = true;
+        }
+        else if (arg == "--job-threads")
+        {
+            config.jobThreads = static_cast<uint32_t>(std::stoul(nextValue()));
+            if (config.jobThreads == 0)
+            {
+                throw std::runtime_error("--job-threads expects at least 1 thread");
+            }
+        }
+        else if (arg == "--pin-threads")
+        {
+            config.pinThreads = true;
+        }
+        else if (arg == "--hot-reload")
+        {
+            config.shaderHotReload = true;
+            if (!ShaderCompiler::IsAvailable())
+            {
+                throw std::runtime_error("--hot-reload needs the GLSL compiler, regenerate the project with premake5 --hot-reload");
+            }
+        }
+        else if (arg == "--export")
+        {
+            config.exportDirectory = nextValue();
+        }
+        else if (arg == "--export-format")
+        {
+            config.exportFormat = ParseImageFileFormat(nextValue());
+        }
+        else
+        {
+            throw std::runtime_error("unknown option " + arg + "\n" + USAGE);
+        }
+    }
+
+    return config;
+}
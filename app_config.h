@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+
+#include "benchmark.h"
+#include "image_writer.h"
+
+// Upper bound of --thumbnails, each view takes a UBO window of the frame allocator
+static const uint32_t MAX_THUMBNAIL_VIEWS = 64;
+
+/*
+    Runtime options of the application.
+    Everything is off by default, so running the executable without arguments behaves like before.
+*/
+struct ApplicationConfig
+{
+    // Profiler
+    std::string traceFilePath;              // --trace <file>: stream CPU and GPU scopes as a Chrome/Perfetto JSON trace
+    bool enablePipelineStatistics = false;  // --pipeline-stats: also collect VK_QUERY_TYPE_PIPELINE_STATISTICS per frame
+
+    // Benchmark
+    bool runBenchmark = false;              // --benchmark: deterministic run, then print/write a JSON report and exit
+    BenchmarkSettings benchmark;            // --frames, --warmup, --timestep, --camera-path, --report
+
+    // Window
+    bool headless = false;                  // --headless: render into an invisible window
+
+    // Startup
+    bool printStartupTiming = false;        // --startup-timing: print the duration of every startup step, shader reload and pipeline build
+    bool serialStartup = false;             // --serial-startup: load the assets on the main thread, in order
+
+    // Rendering
+    bool dynamicRendering = false;          // --dynamic-rendering: VK_KHR_dynamic_rendering instead of VkRenderPass/VkFramebuffer, if supported
+    uint32_t resizeBenchmarkCount = 0;      // --resize-benchmark <n>: time n swap chain recreations, print them and exit
+    bool depthPrepass = false;              // --depth-prepass: lay down depth first, then shade with depthCompareOp EQUAL
+    bool occlusionCulling = false;          // --occlusion-culling: two-phase Hi-Z occlusion culling in compute, if supported
+    bool cpuOcclusionCulling = false;       // --cpu-occlusion-culling: rasterize the occluders on the CPU and skip hidden objects before recording
+    float lodPixelError = 0.0f;             // --lod-error <px>: generate mesh LODs at load time, draw the coarsest one within px pixels of error
+    bool meshlets = false;                  // --meshlets: split the model into meshlets, cull them in compute and draw the compacted indices
+    bool meshShaders = false;               // --mesh-shaders: cull and draw the meshlets in task/mesh shaders (VK_EXT_mesh_shader), if supported
+    bool geometryPool = false;              // --geometry-pool: every mesh in one vertex and one index buffer, vertices pulled by the shaders
+    uint32_t shadingFeatures = 0;           // --shading <features>: permutation of shader.frag at startup, see ShadingFeature
+    bool permutationDefines = false;        // --permutation-defines: compile each permutation with its features as defines, instead of specialization constants
+    bool pipelineLibrary = false;           // --pipeline-library: link the graphics pipelines from VK_EXT_graphics_pipeline_library parts, if supported
+    uint32_t thumbnailViews = 0;            // --thumbnails <k>: k cameras around the model per frame, each in a cell of a grid over the window
+    bool renderThread = false;              // --render-thread: record and present on a render thread, the main thread polls the input and simulates
+
+    // Input
+    bool mouseCamera = false;               // --mouse-camera: the cursor orbits the camera, input to present latency is measured
+    bool lateLatch = false;                 // --late-latch: write the camera into the uniforms right before submit, from the latest input (implies --mouse-camera)
+
+    // Jobs
+    uint32_t jobThreads = 0;                // --job-threads <n>: threads of the job system, the caller included, 0 for one per hardware thread
+    bool pinThreads = false;                // --pin-threads: pin each job worker to a core
+
+    // Development
+    bool shaderHotReload = false;           // --hot-reload: compile the GLSL in-process, rebuild the pipelines when a shader is saved
+
+    // Export
+    std::string exportDirectory;            // --export <dir>: read every presented frame back and write it to dir, encoded on worker threads
+    ImageFileFormat exportFormat = IMAGE_FILE_PNG; // --export-format <png|qoi|raw>: file format of the exported frames
+};
+
+// Throws std::runtime_error on unknown options or missing values
+ApplicationConfig ParseCommandLine(int argc, char** argv);
@@ -0,0 +1,299 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+//////////////////////////////////////////////////////////////////////////
+// CameraPath
+
+void CameraPath::LoadFromFile(const std::string& filePath)
+{
+    std::ifstream file(filePath);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open camera path " + filePath);
+    }
+
+    m_Keyframes.clear();
+
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+
+        std::istringstream stream(line);
+        CameraKeyframe keyframe;
+        float modelAngleDegrees = 0.0f;
+
+        if (!(stream >> keyframe.time))
+        {
+            continue; // empty line
+        }
+
+        if (!(stream >> keyframe.eye.x >> keyframe.eye.y >> keyframe.eye.z
+            >> keyframe.target.x >> keyframe.target.y >> keyframe.target.z >> modelAngleDegrees))
+        {
+            throw std::runtime_error(filePath + ":" + std::to_string(lineNumber) + ": expected 8 values per keyframe");
+        }
+
+        if (!m_Keyframes.empty() && keyframe.time < m_Keyframes.back().time)
+        {
+            throw std::runtime_error(filePath + ":" + std::to_string(lineNumber) + ": keyframe times must be increasing");
+        }
+
+        keyframe.modelAngle = glm::radians(modelAngleDegrees);
+        m_Keyframes.push_back(keyframe);
+    }
+
+    if (m_Keyframes.empty())
+    {
+        throw std::runtime_error("camera path " + filePath + " has no keyframes");
+    }
+}
+
+void CameraPath::SetDefault(float duration)
+{
+    CameraKeyframe first;
+    CameraKeyframe last;
+    last.time = duration;
+    last.modelAngle = duration * glm::radians(90.0f);
+
+    m_Keyframes = { first, last };
+}
+
+CameraKeyframe CameraPath::Sample(float time) const
+{
+    if (time <= m_Keyframes.front().time)
+    {
+        return m_Keyframes.front();
+    }
+
+    if (time >= m_Keyframes.back().time)
+    {
+        return m_Keyframes.back();
+    }
+
+    // First keyframe that is strictly after time
+    const auto next = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), time,
+        [](float t, const CameraKeyframe& keyframe) { return t < keyframe.time; });
+    const auto prev = next - 1;
+
+    const float span = next->time - prev->time;
+    const float t = span > 0.0f ? (time - prev->time) / span : 0.0f;
+
+    CameraKeyframe result;
+    result.time = time;
+    result.eye = prev->eye + (next->eye - prev->eye) * t;
+    result.target = prev->target + (next->target - prev->target) * t;
+    result.modelAngle = prev->modelAngle + (next->modelAngle - prev->modelAngle) * t;
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Statistics
+
+FrameTimeSummary SummarizeFrameTimes(std::vector<double> samplesMs)
+{
+    FrameTimeSummary summary;
+    summary.count = samplesMs.size();
+    if (samplesMs.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samplesMs.begin(), samplesMs.end());
+
+    double sum = 0.0;
+    for (double sample : samplesMs)
+    {
+        sum += sample;
+    }
+
+    // Nearest-rank method: the smallest sample such that at least p percent of the samples are <= to it
+    auto percentile = [&samplesMs](double p)
+    {
+        const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samplesMs.size()));
+        return samplesMs[std::min(std::max<size_t>(rank, 1), samplesMs.size()) - 1];
+    };
+
+    summary.mean = sum / samplesMs.size();
+    summary.min = samplesMs.front();
+    summary.max = samplesMs.back();
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+    return summary;
+}
+
+static std::string JsonEscape(const std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+static void WriteSummaryJson(std::ostream& out, const char* name, const FrameTimeSummary& summary)
+{
+    out << "  \"" << name << "\": { "
+        << "\"count\": " << summary.count
+        << ", \"mean\": " << summary.mean
+        << ", \"min\": " << summary.min
+        << ", \"max\": " << summary.max
+        << ", \"p50\": " << summary.p50
+        << ", \"p95\": " << summary.p95
+        << ", \"p99\": " << summary.p99
+        << " }";
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Benchmark
+
+void Benchmark::Start(const BenchmarkSettings& settings)
+{
+    m_Settings = settings;
+    m_IsActive = true;
+    m_FrameIndex = 0;
+
+    if (!settings.cameraPathFile.empty())
+    {
+        m_CameraPath.LoadFromFile(settings.cameraPathFile);
+    }
+    else
+    {
+        m_CameraPath.SetDefault((settings.warmupFrames + settings.frameCount) * settings.timestep);
+    }
+
+    m_CpuFrameTimesMs.clear();
+    m_CpuFrameTimesMs.reserve(settings.frameCount);
+    m_GpuFrameTimesMs.clear();
+    m_GpuFrameTimesMs.reserve(settings.frameCount);
+    m_VertexInvocations.clear();
+    m_FragmentInvocations.clear();
+}
+
+CameraKeyframe Benchmark::GetCurrentCamera() const
+{
+    return m_CameraPath.Sample(m_FrameIndex * m_Settings.timestep);
+}
+
+void Benchmark::EndFrame(double cpuFrameMs)
+{
+    if (m_FrameIndex >= m_Settings.warmupFrames)
+    {
+        m_CpuFrameTimesMs.push_back(cpuFrameMs);
+    }
+
+    ++m_FrameIndex;
+}
+
+void Benchmark::AddGpuFrameTime(int64_t frameNumber, double gpuFrameMs)
+{
+    if (frameNumber >= static_cast<int64_t>(m_Settings.warmupFrames))
+    {
+        m_GpuFrameTimesMs.push_back(gpuFrameMs);
+    }
+}
+
+void Benchmark::AddShaderInvocations(int64_t frameNumber, uint64_t vertexInvocations, uint64_t fragmentInvocations)
+{
+    if (frameNumber >= static_cast<int64_t>(m_Settings.warmupFrames))
+    {
+        m_VertexInvocations.push_back(static_cast<double>(vertexInvocations));
+        m_FragmentInvocations.push_back(static_cast<double>(fragmentInvocations));
+    }
+}
+
+void Benchmark::AddLodTriangles(const std::vector<uint64_t>& trianglesPerLod)
+{
+    if (m_FrameIndex < m_Settings.warmupFrames)
+    {
+        return;
+    }
+
+    if (m_LodTriangles.size() < trianglesPerLod.size())
+    {
+        m_LodTriangles.resize(trianglesPerLod.size());
+    }
+    for (size_t lod = 0; lod < trianglesPerLod.size(); ++lod)
+    {
+        m_LodTriangles[lod].push_back(static_cast<double>(trianglesPerLod[lod]));
+    }
+}
+
+void Benchmark::WriteReport(const std::string& deviceName, uint32_t width, uint32_t height) const
+{
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"device\": \"" << JsonEscape(deviceName) << "\",\n"
+        << "  \"width\": " << width << ",\n"
+        << "  \"height\": " << height << ",\n"
+        << "  \"frames\": " << m_Settings.frameCount << ",\n"
+        << "  \"warmupFrames\": " << m_Settings.warmupFrames << ",\n"
+        << "  \"timestep\": " << m_Settings.timestep << ",\n"
+        << "  \"cameraPath\": \"" << JsonEscape(m_Settings.cameraPathFile) << "\",\n"
+        << "  \"features\": [";
+    for (size_t i = 0; i < m_Features.size(); ++i)
+    {
+        out << (i > 0 ? ", " : "") << "\"" << JsonEscape(m_Features[i]) << "\"";
+    }
+    out << "],\n";
+    WriteSummaryJson(out, "cpuFrameMs", SummarizeFrameTimes(m_CpuFrameTimesMs));
+    out << ",\n";
+    WriteSummaryJson(out, "gpuFrameMs", SummarizeFrameTimes(m_GpuFrameTimesMs));
+    if (!m_FragmentInvocations.empty())
+    {
+        out << ",\n";
+        WriteSummaryJson(out, "vertexInvocations", SummarizeFrameTimes(m_VertexInvocations));
+        out << ",\n";
+        WriteSummaryJson(out, "fragmentInvocations", SummarizeFrameTimes(m_FragmentInvocations));
+    }
+    if (!m_LodTriangles.empty())
+    {
+        // Throughput over the mean frame time, GPU when it was measured
+        const double frameMs = m_GpuFrameTimesMs.empty() ? SummarizeFrameTimes(m_CpuFrameTimesMs).mean : SummarizeFrameTimes(m_GpuFrameTimesMs).mean;
+        out << ",\n  \"lods\": [";
+        for (size_t lod = 0; lod < m_LodTriangles.size(); ++lod)
+        {
+            const FrameTimeSummary triangles = SummarizeFrameTimes(m_LodTriangles[lod]);
+            out << (lod > 0 ? ",\n" : "\n")
+                << "    { \"lod\": " << lod
+                << ", \"trianglesPerFrame\": " << triangles.mean
+                << ", \"trianglesPerSecond\": " << (frameMs > 0.0 ? triangles.mean * 1000.0 / frameMs : 0.0)
+                << " }";
+        }
+        out << "\n  ]";
+    }
+    out << "\n}\n";
+
+    if (m_Settings.reportFile.empty())
+    {
+        std::cout << out.str();
+        return;
+    }
+
+    std::ofstream file(m_Settings.reportFile, std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to write benchmark report " + m_Settings.reportFile);
+    }
+    file << out.str();
+}
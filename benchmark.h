@@ -0,0 +1,108 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CameraKeyframe
+{
+    float time = 0.0f;          // seconds
+    glm::vec3 eye{ 2.0f, 2.0f, 2.0f };
+    glm::vec3 target{ 0.0f, 0.0f, 0.0f };
+    float modelAngle = 0.0f;    // radians, rotation of the model around Z
+};
+
+/*
+    Scripted camera/model path.
+
+    Text file, one keyframe per line, '#' starts a comment:
+        time  eye.x eye.y eye.z  target.x target.y target.z  modelAngleDegrees
+
+    Keyframes are linearly interpolated, times past the last keyframe clamp to it.
+    Without a file the path reproduces the default interactive animation: fixed eye, model spinning at 90 degrees/s.
+*/
+class CameraPath
+{
+public:
+    void LoadFromFile(const std::string& filePath);
+    void SetDefault(float duration);
+
+    CameraKeyframe Sample(float time) const;
+
+    float GetDuration() const { return m_Keyframes.empty() ? 0.0f : m_Keyframes.back().time; }
+
+private:
+    std::vector<CameraKeyframe> m_Keyframes;
+};
+
+struct FrameTimeSummary
+{
+    size_t count = 0;
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+// Nearest-rank percentiles over a copy of the samples
+FrameTimeSummary SummarizeFrameTimes(std::vector<double> samplesMs);
+
+struct BenchmarkSettings
+{
+    uint32_t frameCount = 1000;
+    uint32_t warmupFrames = 100;
+    float timestep = 1.0f / 60.0f;
+    std::string cameraPathFile;
+    std::string reportFile;     // empty: print the report to stdout
+};
+
+/*
+    Deterministic benchmark run.
+
+    Simulation time advances by a fixed timestep per frame instead of following the wall clock,
+    so every run renders the same sequence of images. The first warmupFrames frames are rendered
+    but not measured (pipeline caches, driver allocations, clocks ramping up).
+*/
+class Benchmark
+{
+public:
+    void Start(const BenchmarkSettings& settings);
+
+    bool IsActive() const { return m_IsActive; }
+    bool IsFinished() const { return m_FrameIndex >= m_Settings.warmupFrames + m_Settings.frameCount; }
+
+    // Camera of the frame that is about to be rendered
+    CameraKeyframe GetCurrentCamera() const;
+
+    // cpuFrameMs: time spent in DrawFrame; gpu sample comes from the profiler and lags behind
+    void EndFrame(double cpuFrameMs);
+    void AddGpuFrameTime(int64_t frameNumber, double gpuFrameMs);
+    // Pipeline statistics of a collected frame (--pipeline-stats), to compare overdraw between runs
+    void AddShaderInvocations(int64_t frameNumber, uint64_t vertexInvocations, uint64_t fragmentInvocations);
+    // Triangles submitted per mesh LOD in the frame about to end (before EndFrame), for the per-LOD throughput
+    void AddLodTriangles(const std::vector<uint64_t>& trianglesPerLod);
+    // Rendering options of the run, listed in the report so runs can be told apart
+    void AddFeature(const std::string& name) { m_Features.push_back(name); }
+
+    void WriteReport(const std::string& deviceName, uint32_t width, uint32_t height) const;
+
+private:
+    BenchmarkSettings m_Settings;
+    CameraPath m_CameraPath;
+
+    bool m_IsActive = false;
+    uint32_t m_FrameIndex = 0;
+
+    std::vector<double> m_CpuFrameTimesMs;
+    std::vector<double> m_GpuFrameTimesMs;
+    std::vector<double> m_VertexInvocations;
+    std::vector<double> m_FragmentInvocations;
+    std::vector<std::vector<double>> m_LodTriangles;    // per LOD, per measured frame
+    std::vector<std::string> m_Features;
+};
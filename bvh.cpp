@@ -0,0 +1,698 @@
+#include "bvh.h"
+
+#include "parallel_for.h"
+#include "simd.h"
+
+#include <algorithm>
+
+static const uint32_t SAH_BIN_COUNT = 16;
+// Visiting a node relative to testing one instance box: leaf boxes are tested SIMD_WIDTH at a time from contiguous arrays
+static const float SAH_TRAVERSAL_COST = 1.0f;
+static const float SAH_INTERSECTION_COST = 0.25f;
+// Past this depth nodes are split at the median, so no tree gets deeper than about MEDIAN_SPLIT_DEPTH + 32
+static const uint32_t MEDIAN_SPLIT_DEPTH = 64;
+static const uint32_t TRAVERSAL_STACK_SIZE = 128;
+
+// Subtrees smaller than this are never split between workers, the task overhead would dominate
+static const uint32_t MIN_BUILD_TASK_SIZE = 1024;
+static const uint32_t SLOT_BATCH_SIZE = 4096;
+
+struct Bvh::FrustumPlanes
+{
+    // plane i: normal . position + distance >= 0 inside, padded to 8 planes that contain everything
+    alignas(32) float normalX[8];
+    alignas(32) float normalY[8];
+    alignas(32) float normalZ[8];
+    alignas(32) float distance[8];
+};
+
+namespace
+{
+    enum FrustumTest { FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTING, FRUSTUM_INSIDE };
+
+    // Lanes holding one of count remaining slots
+    uint32_t LaneMask(uint32_t count)
+    {
+        return (1u << std::min(count, SIMD_WIDTH)) - 1;
+    }
+
+    uint32_t GetBin(float centroid, float centroidMin, float binScale)
+    {
+        return std::min(static_cast<uint32_t>((centroid - centroidMin) * binScale), SAH_BIN_COUNT - 1);
+    }
+}
+
+void Bvh::Build(const Aabb* bounds, uint32_t count, bool multithreaded)
+{
+    m_Nodes.clear();
+    m_BuildItems.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_BuildItems[i] = { bounds[i], bounds[i].GetCenter(), i };
+    }
+
+    if (count > 0)
+    {
+        m_Nodes.push_back({});
+
+        if (!multithreaded)
+        {
+            BuildSubtree(m_Nodes, 0, 0, count, 0, 0, nullptr);
+        }
+        else
+        {
+            // The top of the tree on this thread, down to subtrees small enough to balance the workers
+            const uint32_t maxTaskSize = std::max(count / (GetParallelForThreadCount() * 8), MIN_BUILD_TASK_SIZE);
+            std::vector<uint32_t> tasks;
+            BuildSubtree(m_Nodes, 0, 0, count, 0, maxTaskSize, &tasks);
+
+            std::vector<std::vector<Node>> subtrees(tasks.size());
+            ParallelFor(static_cast<uint32_t>(tasks.size()), 1, [&](uint32_t begin, uint32_t end)
+                {
+                    for (uint32_t task = begin; task < end; ++task)
+                    {
+                        const Node& root = m_Nodes[tasks[task]];
+                        subtrees[task].push_back({});
+                        BuildSubtree(subtrees[task], 0, root.firstSlot, root.slotCount, root.depth, 0, nullptr);
+                    }
+                });
+
+            // Each subtree root replaces its task node, the other nodes are appended with their child indices shifted
+            for (uint32_t task = 0; task < tasks.size(); ++task)
+            {
+                const std::vector<Node>& subtree = subtrees[task];
+                const uint32_t offset = static_cast<uint32_t>(m_Nodes.size()) - 1;
+
+                for (uint32_t i = 0; i < subtree.size(); ++i)
+                {
+                    Node node = subtree[i];
+                    if (node.leftChild != 0)
+                    {
+                        node.leftChild += offset;
+                    }
+
+                    if (i == 0)
+                    {
+                        m_Nodes[tasks[task]] = node;
+                    }
+                    else
+                    {
+                        m_Nodes.push_back(node);
+                    }
+                }
+            }
+        }
+    }
+
+    m_SlotInstance.resize(count);
+    for (uint32_t slot = 0; slot < count; ++slot)
+    {
+        m_SlotInstance[slot] = m_BuildItems[slot].instance;
+    }
+    m_BuildItems.clear();
+    m_BuildItems.shrink_to_fit();
+
+    StoreSlotBounds(bounds, multithreaded);
+    m_BuildCost = ComputeSahCost();
+}
+
+void Bvh::BuildSubtree(std::vector<Node>& nodes, uint32_t nodeIndex, uint32_t firstSlot, uint32_t slotCount, uint32_t depth,
+    uint32_t maxTaskSize, std::vector<uint32_t>* tasks)
+{
+    Node& node = nodes[nodeIndex];
+    node.firstSlot = firstSlot;
+    node.slotCount = slotCount;
+    node.leftChild = 0;
+    node.depth = depth;
+    node.bounds = Aabb();
+    for (uint32_t slot = firstSlot; slot < firstSlot + slotCount; ++slot)
+    {
+        node.bounds.Grow(m_BuildItems[slot].bounds);
+    }
+
+    // Built later by a worker
+    if (tasks && slotCount <= maxTaskSize)
+    {
+        tasks->push_back(nodeIndex);
+        return;
+    }
+
+    uint32_t leftCount;
+    if (!SplitNode(node, leftCount))
+    {
+        return;
+    }
+
+    // node is invalidated by the push_back
+    const uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+    nodes[nodeIndex].leftChild = leftChild;
+    nodes.push_back({});
+    nodes.push_back({});
+
+    BuildSubtree(nodes, leftChild, firstSlot, leftCount, depth + 1, maxTaskSize, tasks);
+    BuildSubtree(nodes, leftChild + 1, firstSlot + leftCount, slotCount - leftCount, depth + 1, maxTaskSize, tasks);
+}
+
+bool Bvh::SplitNode(const Node& node, uint32_t& leftCount)
+{
+    const uint32_t first = node.firstSlot;
+    const uint32_t count = node.slotCount;
+    if (count <= 1)
+    {
+        return false;
+    }
+
+    Aabb centroidBounds;
+    for (uint32_t slot = first; slot < first + count; ++slot)
+    {
+        centroidBounds.Grow(m_BuildItems[slot].centroid);
+    }
+
+    // Best split among the bin boundaries of the 3 axes: cost of the children, relative to the area of the node
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+
+    if (node.depth < MEDIAN_SPLIT_DEPTH)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0.0f)
+            {
+                continue;
+            }
+
+            Aabb binBounds[SAH_BIN_COUNT];
+            uint32_t binCounts[SAH_BIN_COUNT] = {};
+            const float binScale = SAH_BIN_COUNT / extent;
+            for (uint32_t slot = first; slot < first + count; ++slot)
+            {
+                const BuildItem& item = m_BuildItems[slot];
+                const uint32_t bin = GetBin(item.centroid[axis], centroidBounds.min[axis], binScale);
+                binBounds[bin].Grow(item.bounds);
+                ++binCounts[bin];
+            }
+
+            // Sweep from the right for the right side costs, then from the left
+            float rightCosts[SAH_BIN_COUNT];
+            Aabb right;
+            uint32_t rightCount = 0;
+            for (uint32_t bin = SAH_BIN_COUNT - 1; bin > 0; --bin)
+            {
+                right.Grow(binBounds[bin]);
+                rightCount += binCounts[bin];
+                rightCosts[bin - 1] = right.GetSurfaceArea() * rightCount;
+            }
+
+            Aabb left;
+            uint32_t leftBinCount = 0;
+            for (uint32_t bin = 0; bin + 1 < SAH_BIN_COUNT; ++bin)
+            {
+                left.Grow(binBounds[bin]);
+                leftBinCount += binCounts[bin];
+                const float cost = left.GetSurfaceArea() * leftBinCount + rightCosts[bin];
+                if (leftBinCount > 0 && leftBinCount < count && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+    }
+
+    const float nodeArea = node.bounds.GetSurfaceArea();
+    const float leafCost = SAH_INTERSECTION_COST * count;
+    const float splitCost = nodeArea > 0.0f ? SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * bestCost / nodeArea : FLT_MAX;
+
+    if (bestAxis >= 0 && (splitCost < leafCost || count > MAX_LEAF_SIZE))
+    {
+        const float binScale = SAH_BIN_COUNT / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        const auto middle = std::partition(m_BuildItems.begin() + first, m_BuildItems.begin() + first + count,
+            [&](const BuildItem& item)
+            {
+                return GetBin(item.centroid[bestAxis], centroidBounds.min[bestAxis], binScale) <= bestBin;
+            });
+        leftCount = static_cast<uint32_t>(middle - (m_BuildItems.begin() + first));
+        return true;
+    }
+
+    if (count <= MAX_LEAF_SIZE)
+    {
+        return false;
+    }
+
+    // Identical centroids, or too deep: any half of the instances is as good as another
+    leftCount = count / 2;
+    return true;
+}
+
+void Bvh::StoreSlotBounds(const Aabb* bounds, bool multithreaded)
+{
+    const uint32_t count = GetInstanceCount();
+    for (std::vector<float>* stream : { &m_MinX, &m_MinY, &m_MinZ })
+    {
+        stream->assign(count + SIMD_WIDTH, FLT_MAX);
+    }
+    for (std::vector<float>* stream : { &m_MaxX, &m_MaxY, &m_MaxZ })
+    {
+        stream->assign(count + SIMD_WIDTH, -FLT_MAX);
+    }
+
+    auto storeRange = [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t slot = begin; slot < end; ++slot)
+        {
+            const Aabb& box = bounds[m_SlotInstance[slot]];
+            m_MinX[slot] = box.min.x;
+            m_MinY[slot] = box.min.y;
+            m_MinZ[slot] = box.min.z;
+            m_MaxX[slot] = box.max.x;
+            m_MaxY[slot] = box.max.y;
+            m_MaxZ[slot] = box.max.z;
+        }
+    };
+
+    if (multithreaded)
+    {
+        ParallelFor(count, SLOT_BATCH_SIZE, storeRange);
+    }
+    else
+    {
+        storeRange(0, count);
+    }
+}
+
+Aabb Bvh::ComputeSlotBounds(uint32_t firstSlot, uint32_t slotCount) const
+{
+    Aabb box;
+    for (uint32_t slot = firstSlot; slot < firstSlot + slotCount; ++slot)
+    {
+        box.Grow(Aabb{ glm::vec3(m_MinX[slot], m_MinY[slot], m_MinZ[slot]), glm::vec3(m_MaxX[slot], m_MaxY[slot], m_MaxZ[slot]) });
+    }
+    return box;
+}
+
+void Bvh::Refit(const Aabb* bounds, bool multithreaded)
+{
+    StoreSlotBounds(bounds, multithreaded);
+
+    // Children always come after their parent, so a reverse walk sees them first
+    for (uint32_t i = GetNodeCount(); i-- > 0;)
+    {
+        Node& node = m_Nodes[i];
+        if (node.leftChild == 0)
+        {
+            node.bounds = ComputeSlotBounds(node.firstSlot, node.slotCount);
+        }
+        else
+        {
+            node.bounds = m_Nodes[node.leftChild].bounds;
+            node.bounds.Grow(m_Nodes[node.leftChild + 1].bounds);
+        }
+    }
+}
+
+float Bvh::ComputeSahCost() const
+{
+    if (m_Nodes.empty() || m_Nodes[0].bounds.GetSurfaceArea() <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    float cost = 0.0f;
+    for (const Node& node : m_Nodes)
+    {
+        cost += node.bounds.GetSurfaceArea() * (node.leftChild == 0 ? SAH_INTERSECTION_COST * node.slotCount : SAH_TRAVERSAL_COST);
+    }
+    return cost / m_Nodes[0].bounds.GetSurfaceArea();
+}
+
+float Bvh::GetCostRatio() const
+{
+    return m_BuildCost > 0.0f ? ComputeSahCost() / m_BuildCost : 1.0f;
+}
+
+void Bvh::AppendSubtree(const Node& node, std::vector<uint32_t>& instances) const
+{
+    instances.insert(instances.end(), m_SlotInstance.begin() + node.firstSlot, m_SlotInstance.begin() + node.firstSlot + node.slotCount);
+}
+
+template<typename NodeTest, typename LeafTest>
+void Bvh::Traverse(uint32_t root, const NodeTest& nodeTest, const LeafTest& leafTest) const
+{
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = root;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_Nodes[stack[--stackSize]];
+        if (!nodeTest(node))
+        {
+            continue;
+        }
+
+        if (node.leftChild == 0)
+        {
+            leafTest(node);
+        }
+        else
+        {
+            stack[stackSize++] = node.leftChild + 1;
+            stack[stackSize++] = node.leftChild;
+        }
+    }
+}
+
+void Bvh::QueryFrustumFrom(uint32_t root, const FrustumPlanes& planes, std::vector<uint32_t>& instances) const
+{
+    // The 8 (padded) planes against one node, in SIMD lanes
+    auto testNode = [&planes](const Aabb& box)
+    {
+        const glm::vec3 center = box.GetCenter();
+        const glm::vec3 extent = box.GetExtent();
+        const SimdFloat centerX = SimdFloat::Set(center.x), centerY = SimdFloat::Set(center.y), centerZ = SimdFloat::Set(center.z);
+        const SimdFloat extentX = SimdFloat::Set(extent.x), extentY = SimdFloat::Set(extent.y), extentZ = SimdFloat::Set(extent.z);
+
+        uint32_t outside = 0;
+        uint32_t intersecting = 0;
+        for (uint32_t plane = 0; plane < 8; plane += SIMD_WIDTH)
+        {
+            const SimdFloat normalX = SimdFloat::Load(planes.normalX + plane);
+            const SimdFloat normalY = SimdFloat::Load(planes.normalY + plane);
+            const SimdFloat normalZ = SimdFloat::Load(planes.normalZ + plane);
+            const SimdFloat distance = MulAdd(normalX, centerX, MulAdd(normalY, centerY, MulAdd(normalZ, centerZ, SimdFloat::Load(planes.distance + plane))));
+            const SimdFloat radius = MulAdd(Abs(normalX), extentX, MulAdd(Abs(normalY), extentY, Abs(normalZ) * extentZ));
+            outside |= SignMask(distance + radius);
+            intersecting |= SignMask(distance - radius);
+        }
+        return outside ? FRUSTUM_OUTSIDE : (intersecting ? FRUSTUM_INTERSECTING : FRUSTUM_INSIDE);
+    };
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = root;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_Nodes[stack[--stackSize]];
+        const FrustumTest test = testNode(node.bounds);
+        if (test == FRUSTUM_OUTSIDE)
+        {
+            continue;
+        }
+        if (test == FRUSTUM_INSIDE)
+        {
+            AppendSubtree(node, instances);
+            continue;
+        }
+        if (node.leftChild != 0)
+        {
+            stack[stackSize++] = node.leftChild + 1;
+            stack[stackSize++] = node.leftChild;
+            continue;
+        }
+
+        // Leaf crossing the frustum: its instances in SIMD lanes, one plane at a time
+        const uint32_t end = node.firstSlot + node.slotCount;
+        for (uint32_t slot = node.firstSlot; slot < end; slot += SIMD_WIDTH)
+        {
+            const SimdFloat half = SimdFloat::Set(0.5f);
+            const SimdFloat minX = SimdFloat::Load(&m_MinX[slot]), maxX = SimdFloat::Load(&m_MaxX[slot]);
+            const SimdFloat minY = SimdFloat::Load(&m_MinY[slot]), maxY = SimdFloat::Load(&m_MaxY[slot]);
+            const SimdFloat minZ = SimdFloat::Load(&m_MinZ[slot]), maxZ = SimdFloat::Load(&m_MaxZ[slot]);
+            const SimdFloat centerX = (minX + maxX) * half, extentX = (maxX - minX) * half;
+            const SimdFloat centerY = (minY + maxY) * half, extentY = (maxY - minY) * half;
+            const SimdFloat centerZ = (minZ + maxZ) * half, extentZ = (maxZ - minZ) * half;
+
+            uint32_t outside = 0;
+            for (uint32_t plane = 0; plane < 6; ++plane)
+            {
+                const SimdFloat normalX = SimdFloat::Set(planes.normalX[plane]);
+                const SimdFloat normalY = SimdFloat::Set(planes.normalY[plane]);
+                const SimdFloat normalZ = SimdFloat::Set(planes.normalZ[plane]);
+                const SimdFloat distance = MulAdd(normalX, centerX, MulAdd(normalY, centerY, MulAdd(normalZ, centerZ, SimdFloat::Set(planes.distance[plane]))));
+                const SimdFloat radius = MulAdd(Abs(normalX), extentX, MulAdd(Abs(normalY), extentY, Abs(normalZ) * extentZ));
+                outside |= SignMask(distance + radius);
+            }
+
+            for (uint32_t visible = ~outside & LaneMask(end - slot); visible != 0; visible &= visible - 1)
+            {
+                instances.push_back(m_SlotInstance[slot + CountTrailingZeros(visible)]);
+            }
+        }
+    }
+}
+
+void Bvh::QueryFrustum(const glm::mat4& viewProj, std::vector<uint32_t>& instances, bool multithreaded) const
+{
+    if (m_Nodes.empty())
+    {
+        return;
+    }
+
+    // Gribb-Hartmann: the planes are sums of the rows of the matrix, 0 <= z <= w for the Vulkan depth range
+    FrustumPlanes planes;
+    const glm::vec4 rows[4] = {
+        glm::vec4(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]),
+        glm::vec4(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]),
+        glm::vec4(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]),
+        glm::vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]) };
+    const glm::vec4 planeEquations[8] = {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[2], rows[3] - rows[2],
+        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) };
+    for (uint32_t plane = 0; plane < 8; ++plane)
+    {
+        planes.normalX[plane] = planeEquations[plane].x;
+        planes.normalY[plane] = planeEquations[plane].y;
+        planes.normalZ[plane] = planeEquations[plane].z;
+        planes.distance[plane] = planeEquations[plane].w;
+    }
+
+    if (!multithreaded)
+    {
+        QueryFrustumFrom(0, planes, instances);
+        return;
+    }
+
+    // Split the top of the tree into enough subtrees for the workers, each fills its own list
+    std::vector<uint32_t> roots = { 0 };
+    const uint32_t targetRoots = GetParallelForThreadCount() * 4;
+    while (roots.size() < targetRoots)
+    {
+        std::vector<uint32_t> next;
+        for (uint32_t root : roots)
+        {
+            if (m_Nodes[root].leftChild == 0)
+            {
+                next.push_back(root);
+            }
+            else
+            {
+                next.push_back(m_Nodes[root].leftChild);
+                next.push_back(m_Nodes[root].leftChild + 1);
+            }
+        }
+        if (next.size() == roots.size())
+        {
+            break;
+        }
+        roots.swap(next);
+    }
+
+    std::vector<std::vector<uint32_t>> results(roots.size());
+    ParallelFor(static_cast<uint32_t>(roots.size()), 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                QueryFrustumFrom(roots[i], planes, results[i]);
+            }
+        });
+
+    for (const std::vector<uint32_t>& result : results)
+    {
+        instances.insert(instances.end(), result.begin(), result.end());
+    }
+}
+
+void Bvh::QueryBox(const Aabb& box, std::vector<uint32_t>& instances) const
+{
+    if (m_Nodes.empty())
+    {
+        return;
+    }
+
+    auto overlaps = [&box](const Node& node)
+    {
+        return node.bounds.min.x <= box.max.x && node.bounds.max.x >= box.min.x
+            && node.bounds.min.y <= box.max.y && node.bounds.max.y >= box.min.y
+            && node.bounds.min.z <= box.max.z && node.bounds.max.z >= box.min.z;
+    };
+
+    auto testLeaf = [&](const Node& node)
+    {
+        const SimdFloat boxMinX = SimdFloat::Set(box.min.x), boxMinY = SimdFloat::Set(box.min.y), boxMinZ = SimdFloat::Set(box.min.z);
+        const SimdFloat boxMaxX = SimdFloat::Set(box.max.x), boxMaxY = SimdFloat::Set(box.max.y), boxMaxZ = SimdFloat::Set(box.max.z);
+
+        const uint32_t end = node.firstSlot + node.slotCount;
+        for (uint32_t slot = node.firstSlot; slot < end; slot += SIMD_WIDTH)
+        {
+            // Separated on an axis when a difference is negative
+            const uint32_t outside =
+                SignMask(boxMaxX - SimdFloat::Load(&m_MinX[slot])) | SignMask(SimdFloat::Load(&m_MaxX[slot]) - boxMinX)
+                | SignMask(boxMaxY - SimdFloat::Load(&m_MinY[slot])) | SignMask(SimdFloat::Load(&m_MaxY[slot]) - boxMinY)
+                | SignMask(boxMaxZ - SimdFloat::Load(&m_MinZ[slot])) | SignMask(SimdFloat::Load(&m_MaxZ[slot]) - boxMinZ);
+
+            for (uint32_t inside = ~outside & LaneMask(end - slot); inside != 0; inside &= inside - 1)
+            {
+                instances.push_back(m_SlotInstance[slot + CountTrailingZeros(inside)]);
+            }
+        }
+    };
+
+    Traverse(0, overlaps, testLeaf);
+}
+
+void Bvh::QuerySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& instances) const
+{
+    if (m_Nodes.empty())
+    {
+        return;
+    }
+
+    // Distance from the center to the closest point of the box
+    auto overlaps = [&](const Node& node)
+    {
+        const glm::vec3 outside = glm::max(glm::max(node.bounds.min - center, center - node.bounds.max), glm::vec3(0.0f));
+        return glm::dot(outside, outside) <= radius * radius;
+    };
+
+    auto testLeaf = [&](const Node& node)
+    {
+        const SimdFloat zero = SimdFloat::Set(0.0f);
+        const SimdFloat centerX = SimdFloat::Set(center.x), centerY = SimdFloat::Set(center.y), centerZ = SimdFloat::Set(center.z);
+        const SimdFloat radiusSquared = SimdFloat::Set(radius * radius);
+
+        const uint32_t end = node.firstSlot + node.slotCount;
+        for (uint32_t slot = node.firstSlot; slot < end; slot += SIMD_WIDTH)
+        {
+            const SimdFloat dx = Max(Max(SimdFloat::Load(&m_MinX[slot]) - centerX, centerX - SimdFloat::Load(&m_MaxX[slot])), zero);
+            const SimdFloat dy = Max(Max(SimdFloat::Load(&m_MinY[slot]) - centerY, centerY - SimdFloat::Load(&m_MaxY[slot])), zero);
+            const SimdFloat dz = Max(Max(SimdFloat::Load(&m_MinZ[slot]) - centerZ, centerZ - SimdFloat::Load(&m_MaxZ[slot])), zero);
+            const uint32_t outside = SignMask(radiusSquared - MulAdd(dx, dx, MulAdd(dy, dy, dz * dz)));
+
+            for (uint32_t inside = ~outside & LaneMask(end - slot); inside != 0; inside &= inside - 1)
+            {
+                instances.push_back(m_SlotInstance[slot + CountTrailingZeros(inside)]);
+            }
+        }
+    };
+
+    Traverse(0, overlaps, testLeaf);
+}
+
+bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhRayHit& hit) const
+{
+    hit = BvhRayHit();
+    if (m_Nodes.empty())
+    {
+        return false;
+    }
+
+    const glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float nearest = maxDistance;
+
+    // Slab test, returns the entry distance or FLT_MAX when the box is missed or farther than the nearest hit
+    auto enterNode = [&](const Aabb& box)
+    {
+        float entry = 0.0f;
+        float exit = nearest;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float t0 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+            const float t1 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+            entry = std::max(entry, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        }
+        return entry <= exit ? entry : FLT_MAX;
+    };
+
+    const SimdFloat originX = SimdFloat::Set(origin.x), originY = SimdFloat::Set(origin.y), originZ = SimdFloat::Set(origin.z);
+    const SimdFloat inverseX = SimdFloat::Set(inverseDirection.x), inverseY = SimdFloat::Set(inverseDirection.y), inverseZ = SimdFloat::Set(inverseDirection.z);
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    uint32_t stackSize = 0;
+    if (enterNode(m_Nodes[0].bounds) != FLT_MAX)
+    {
+        stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_Nodes[stack[--stackSize]];
+
+        if (node.leftChild != 0)
+        {
+            // Nearest child on top of the stack, the other one is often skipped once a hit is found
+            uint32_t first = node.leftChild;
+            uint32_t second = node.leftChild + 1;
+            float firstEntry = enterNode(m_Nodes[first].bounds);
+            float secondEntry = enterNode(m_Nodes[second].bounds);
+            if (secondEntry < firstEntry)
+            {
+                std::swap(first, second);
+                std::swap(firstEntry, secondEntry);
+            }
+            if (secondEntry != FLT_MAX)
+            {
+                stack[stackSize++] = second;
+            }
+            if (firstEntry != FLT_MAX)
+            {
+                stack[stackSize++] = first;
+            }
+            continue;
+        }
+
+        // The node may have been pushed before a nearer hit was found
+        if (enterNode(node.bounds) == FLT_MAX)
+        {
+            continue;
+        }
+
+        const uint32_t end = node.firstSlot + node.slotCount;
+        for (uint32_t slot = node.firstSlot; slot < end; slot += SIMD_WIDTH)
+        {
+            const SimdFloat x0 = (SimdFloat::Load(&m_MinX[slot]) - originX) * inverseX, x1 = (SimdFloat::Load(&m_MaxX[slot]) - originX) * inverseX;
+            const SimdFloat y0 = (SimdFloat::Load(&m_MinY[slot]) - originY) * inverseY, y1 = (SimdFloat::Load(&m_MaxY[slot]) - originY) * inverseY;
+            const SimdFloat z0 = (SimdFloat::Load(&m_MinZ[slot]) - originZ) * inverseZ, z1 = (SimdFloat::Load(&m_MaxZ[slot]) - originZ) * inverseZ;
+            const SimdFloat entry = Max(Max(Min(x0, x1), Min(y0, y1)), Max(Min(z0, z1), SimdFloat::Set(0.0f)));
+            const SimdFloat exit = Min(Min(Max(x0, x1), Max(y0, y1)), Min(Max(z0, z1), SimdFloat::Set(nearest)));
+
+            uint32_t hits = ~SignMask(exit - entry) & LaneMask(end - slot);
+            if (hits == 0)
+            {
+                continue;
+            }
+
+            float entries[SIMD_WIDTH];
+            entry.Store(entries);
+            for (; hits != 0; hits &= hits - 1)
+            {
+                const uint32_t lane = CountTrailingZeros(hits);
+                if (entries[lane] <= nearest)
+                {
+                    nearest = entries[lane];
+                    hit.instance = m_SlotInstance[slot + lane];
+                    hit.distance = nearest;
+                }
+            }
+        }
+    }
+
+    return hit.instance != UINT32_MAX;
+}
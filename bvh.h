@@ -0,0 +1,98 @@
+#pragma once
+
+#include "transform_system.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct BvhRayHit
+{
+    uint32_t instance = UINT32_MAX;
+    float distance = 0.0f;      // along the ray direction, in units of its length
+};
+
+/*
+    Bounding volume hierarchy over the world space boxes of scene instances, for culling and picking.
+
+    Binary tree built top-down with the binned surface area heuristic (SAH): every split is the one among
+    16 bins per axis that minimizes (area left * count left + area right * count right). The top of the tree
+    is split on the calling thread until there are enough subtrees for the ParallelFor workers, which then build
+    them independently. Leaves hold up to MAX_LEAF_SIZE instances.
+
+    Instances are stored in leaf order as a structure of arrays, so the boxes of a leaf are tested SIMD_WIDTH at
+    a time (simd.h). Frustum node tests run the 6 planes in SIMD lanes as well, and a node fully inside the frustum
+    returns its whole subtree, a contiguous range of instances, without visiting it.
+
+    When instances move, Refit recomputes the node boxes bottom-up and keeps the tree: O(n) and cheap, but the
+    boxes overlap more and more. GetCostRatio tells how much worse the tree got since it was built, rebuild it
+    when it's past ~1.5.
+*/
+class Bvh
+{
+public:
+    static const uint32_t MAX_LEAF_SIZE = 8;
+
+    void Build(const Aabb* bounds, uint32_t count, bool multithreaded = true);
+    // Same instances as the last Build, new bounds
+    void Refit(const Aabb* bounds, bool multithreaded = true);
+
+    // SAH cost of the tree divided by its cost right after Build
+    float GetCostRatio() const;
+
+    // Instances whose box intersects the frustum of a Vulkan (depth 0 to 1) projection, appended to instances
+    void QueryFrustum(const glm::mat4& viewProj, std::vector<uint32_t>& instances, bool multithreaded = false) const;
+    void QueryBox(const Aabb& box, std::vector<uint32_t>& instances) const;
+    void QuerySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& instances) const;
+    // Nearest instance box hit by origin + t * direction for t in [0, maxDistance]
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhRayHit& hit) const;
+
+    uint32_t GetInstanceCount() const { return static_cast<uint32_t>(m_SlotInstance.size()); }
+    uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_Nodes.size()); }
+
+private:
+    struct Node
+    {
+        Aabb bounds;
+        uint32_t firstSlot;     // instances of the subtree, contiguous in leaf order
+        uint32_t slotCount;
+        uint32_t leftChild;     // the right one follows it, 0 for leaves (the root is never a child)
+        uint32_t depth;
+    };
+
+    struct FrustumPlanes;
+
+    // With tasks, stops at the subtrees of up to maxTaskSize instances and records them instead
+    void BuildSubtree(std::vector<Node>& nodes, uint32_t nodeIndex, uint32_t firstSlot, uint32_t slotCount, uint32_t depth,
+        uint32_t maxTaskSize, std::vector<uint32_t>* tasks);
+    bool SplitNode(const Node& node, uint32_t& leftCount);
+    void StoreSlotBounds(const Aabb* bounds, bool multithreaded);
+    Aabb ComputeSlotBounds(uint32_t firstSlot, uint32_t slotCount) const;
+    float ComputeSahCost() const;
+
+    void AppendSubtree(const Node& node, std::vector<uint32_t>& instances) const;
+    // Depth-first from root, into the children of the nodes passing nodeTest, calling leafTest on the leaves reached
+    template<typename NodeTest, typename LeafTest>
+    void Traverse(uint32_t root, const NodeTest& nodeTest, const LeafTest& leafTest) const;
+    void QueryFrustumFrom(uint32_t root, const FrustumPlanes& planes, std::vector<uint32_t>& instances) const;
+
+    std::vector<Node> m_Nodes;
+    std::vector<uint32_t> m_SlotInstance;   // leaf order -> instance
+
+    // Instance boxes in leaf order, padded by SIMD_WIDTH so a leaf can always be loaded whole
+    std::vector<float> m_MinX, m_MinY, m_MinZ, m_MaxX, m_MaxY, m_MaxZ;
+
+    // Only during Build, in leaf order: partitioned in place, so a node reads its instances contiguously
+    struct BuildItem
+    {
+        Aabb bounds;
+        glm::vec3 centroid;
+        uint32_t instance;
+    };
+    std::vector<BuildItem> m_BuildItems;
+
+    float m_BuildCost = 0.0f;
+};
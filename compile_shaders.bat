@@ -3,7 +3,21 @@ cls
 
 CD %~dp0%\Shaders
 
+rem Same list as SHADER_SOURCES in shader_compiler.cpp, --hot-reload compiles them in-process instead
+
 %VULKAN_SDK%/Bin/glslc.exe shader.vert -o vert.spv
 %VULKAN_SDK%/Bin/glslc.exe shader.frag -o frag.spv
+%VULKAN_SDK%/Bin/glslc.exe depth_prepass.vert -o depth_prepass_vert.spv
+%VULKAN_SDK%/Bin/glslc.exe vertex_pull.vert -o vertex_pull_vert.spv
+%VULKAN_SDK%/Bin/glslc.exe vertex_pull.vert -DBUFFER_DEVICE_ADDRESS -o vertex_pull_bda_vert.spv
+%VULKAN_SDK%/Bin/glslc.exe vertex_pull.vert -DDEPTH_PREPASS -o depth_prepass_pull_vert.spv
+%VULKAN_SDK%/Bin/glslc.exe vertex_pull.vert -DDEPTH_PREPASS -DBUFFER_DEVICE_ADDRESS -o depth_prepass_pull_bda_vert.spv
+%VULKAN_SDK%/Bin/glslc.exe hiz_depth.comp -o hiz_depth_comp.spv
+%VULKAN_SDK%/Bin/glslc.exe hiz_depth.comp -DMULTISAMPLED -o hiz_depth_ms_comp.spv
+%VULKAN_SDK%/Bin/glslc.exe hiz_reduce.comp -o hiz_reduce_comp.spv
+%VULKAN_SDK%/Bin/glslc.exe occlusion_cull.comp -o occlusion_cull_comp.spv
+%VULKAN_SDK%/Bin/glslc.exe meshlet_cull.comp -o meshlet_cull_comp.spv
+%VULKAN_SDK%/Bin/glslc.exe --target-spv=spv1.4 meshlet.task -o meshlet_task.spv
+%VULKAN_SDK%/Bin/glslc.exe --target-spv=spv1.4 meshlet.mesh -o meshlet_mesh.spv
 
 pause
@@ -0,0 +1,245 @@
+#include "descriptor_allocator.h"
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// Descriptors of each type reserved per set, a pool holds setsPerPool times these
+static const std::pair<VkDescriptorType, uint32_t> POOL_SIZE_RATIOS[] = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+};
+
+template<typename T>
+static void HashCombine(size_t& seed, const T& value)
+{
+    seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// Non-dispatchable handles are pointers on 64-bit platforms and uint64_t on 32-bit ones
+template<typename Handle>
+static uint64_t HandleBits(Handle handle)
+{
+    return (uint64_t)(handle);
+}
+
+void DescriptorAllocator::Init(VkDevice device, uint32_t setsPerPool)
+{
+    m_Device = device;
+    m_SetsPerPool = setsPerPool;
+}
+
+void DescriptorAllocator::Cleanup()
+{
+    for (VkDescriptorPool pool : m_UsedPools)
+    {
+        vkDestroyDescriptorPool(m_Device, pool, nullptr);
+    }
+    for (VkDescriptorPool pool : m_FreePools)
+    {
+        vkDestroyDescriptorPool(m_Device, pool, nullptr);
+    }
+
+    m_UsedPools.clear();
+    m_FreePools.clear();
+    m_CurrentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::GrabPool()
+{
+    if (!m_FreePools.empty())
+    {
+        VkDescriptorPool pool = m_FreePools.back();
+        m_FreePools.pop_back();
+        return pool;
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (const auto& ratio : POOL_SIZE_RATIOS)
+    {
+        poolSizes.push_back({ ratio.first, ratio.second * m_SetsPerPool });
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = m_SetsPerPool;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+    return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+    if (m_CurrentPool == VK_NULL_HANDLE)
+    {
+        m_CurrentPool = GrabPool();
+        m_UsedPools.push_back(m_CurrentPool);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_CurrentPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptorSet;
+    VkResult result = vkAllocateDescriptorSets(m_Device, &allocInfo, &descriptorSet);
+
+    /*
+    The pool is exhausted (or too fragmented for this layout): chain a new one and retry once.
+    A failure on a fresh pool means the layout itself doesn't fit in a pool, which retrying won't fix.
+    */
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+    {
+        m_CurrentPool = GrabPool();
+        m_UsedPools.push_back(m_CurrentPool);
+
+        allocInfo.descriptorPool = m_CurrentPool;
+        result = vkAllocateDescriptorSets(m_Device, &allocInfo, &descriptorSet);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate descriptor set! (VkResult " + std::to_string(result) + ")");
+    }
+
+    return descriptorSet;
+}
+
+void DescriptorAllocator::ResetPools()
+{
+    for (VkDescriptorPool pool : m_UsedPools)
+    {
+        vkResetDescriptorPool(m_Device, pool, 0);
+        m_FreePools.push_back(pool);
+    }
+
+    m_UsedPools.clear();
+    m_CurrentPool = VK_NULL_HANDLE;
+}
+
+DescriptorSetBindings& DescriptorSetBindings::Buffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+    Entry entry{};
+    entry.binding = binding;
+    entry.type = type;
+    entry.bufferInfo = { buffer, offset, range };
+    m_Entries.push_back(entry);
+    return *this;
+}
+
+DescriptorSetBindings& DescriptorSetBindings::Image(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+{
+    Entry entry{};
+    entry.binding = binding;
+    entry.type = type;
+    entry.imageInfo = { sampler, imageView, imageLayout };
+    m_Entries.push_back(entry);
+    return *this;
+}
+
+size_t DescriptorSetBindings::GetHash() const
+{
+    size_t hash = m_Entries.size();
+    for (const Entry& entry : m_Entries)
+    {
+        HashCombine(hash, entry.binding);
+        HashCombine(hash, static_cast<uint32_t>(entry.type));
+        HashCombine(hash, HandleBits(entry.bufferInfo.buffer));
+        HashCombine(hash, entry.bufferInfo.offset);
+        HashCombine(hash, entry.bufferInfo.range);
+        HashCombine(hash, HandleBits(entry.imageInfo.imageView));
+        HashCombine(hash, HandleBits(entry.imageInfo.sampler));
+        HashCombine(hash, static_cast<uint32_t>(entry.imageInfo.imageLayout));
+    }
+    return hash;
+}
+
+bool DescriptorSetBindings::operator==(const DescriptorSetBindings& other) const
+{
+    if (m_Entries.size() != other.m_Entries.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_Entries.size(); ++i)
+    {
+        const Entry& a = m_Entries[i];
+        const Entry& b = other.m_Entries[i];
+
+        if (a.binding != b.binding || a.type != b.type
+            || a.bufferInfo.buffer != b.bufferInfo.buffer || a.bufferInfo.offset != b.bufferInfo.offset || a.bufferInfo.range != b.bufferInfo.range
+            || a.imageInfo.imageView != b.imageInfo.imageView || a.imageInfo.sampler != b.imageInfo.sampler || a.imageInfo.imageLayout != b.imageInfo.imageLayout)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DescriptorSetBindings::Write(VkDevice device, VkDescriptorSet descriptorSet) const
+{
+    std::vector<VkWriteDescriptorSet> descriptorWrites(m_Entries.size());
+
+    for (size_t i = 0; i < m_Entries.size(); ++i)
+    {
+        const Entry& entry = m_Entries[i];
+        const bool isImage = entry.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || entry.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+            || entry.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || entry.type == VK_DESCRIPTOR_TYPE_SAMPLER;
+
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = descriptorSet;
+        descriptorWrites[i].dstBinding = entry.binding;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorType = entry.type;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pBufferInfo = isImage ? nullptr : &entry.bufferInfo;
+        descriptorWrites[i].pImageInfo = isImage ? &entry.imageInfo : nullptr;
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void DescriptorSetCache::Init(VkDevice device, DescriptorAllocator* allocator)
+{
+    m_Device = device;
+    m_Allocator = allocator;
+}
+
+VkDescriptorSet DescriptorSetCache::Get(VkDescriptorSetLayout layout, const DescriptorSetBindings& bindings)
+{
+    size_t hash = bindings.GetHash();
+    HashCombine(hash, HandleBits(layout));
+
+    std::vector<CachedSet>& bucket = m_Sets[hash];
+    for (const CachedSet& cached : bucket)
+    {
+        if (cached.layout == layout && cached.bindings == bindings)
+        {
+            ++m_Hits;
+            return cached.descriptorSet;
+        }
+    }
+
+    ++m_Misses;
+
+    VkDescriptorSet descriptorSet = m_Allocator->Allocate(layout);
+    bindings.Write(m_Device, descriptorSet);
+
+    bucket.push_back({ layout, bindings, descriptorSet });
+    return descriptorSet;
+}
+
+void DescriptorSetCache::Clear()
+{
+    m_Sets.clear();
+}
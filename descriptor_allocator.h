@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Growable descriptor set allocator.
+
+    Sets are allocated from the current pool until vkAllocateDescriptorSets reports VK_ERROR_OUT_OF_POOL_MEMORY
+    (or VK_ERROR_FRAGMENTED_POOL), then a new pool is chained, so there is no hard limit on materials or objects.
+    Sets are never freed one by one: ResetPools resets every pool at once (vkResetDescriptorPool) and keeps them
+    for reuse. A per-frame allocator is reset right after the fence of its frame, when none of its sets can be in use.
+*/
+class DescriptorAllocator
+{
+public:
+    void Init(VkDevice device, uint32_t setsPerPool = 64);
+    void Cleanup();
+
+    // Throws std::runtime_error on any failure other than an exhausted pool
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+    // Invalidates every set allocated so far
+    void ResetPools();
+
+    uint32_t GetPoolCount() const { return static_cast<uint32_t>(m_UsedPools.size() + m_FreePools.size()); }
+
+private:
+    VkDescriptorPool GrabPool();
+
+    VkDevice m_Device = VK_NULL_HANDLE;
+    uint32_t m_SetsPerPool = 0;
+
+    VkDescriptorPool m_CurrentPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> m_UsedPools;
+    std::vector<VkDescriptorPool> m_FreePools;
+};
+
+// Contents of a descriptor set, one entry per binding, compared and hashed by value
+class DescriptorSetBindings
+{
+public:
+    DescriptorSetBindings& Buffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+    DescriptorSetBindings& Image(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout);
+
+    size_t GetHash() const;
+    bool operator==(const DescriptorSetBindings& other) const;
+
+    void Write(VkDevice device, VkDescriptorSet descriptorSet) const;
+
+private:
+    struct Entry
+    {
+        uint32_t binding;
+        VkDescriptorType type;
+        VkDescriptorBufferInfo bufferInfo;
+        VkDescriptorImageInfo imageInfo;
+    };
+
+    std::vector<Entry> m_Entries;
+};
+
+/*
+    Descriptor sets keyed by their layout and contents.
+
+    Asking twice for the same layout and bindings returns the same set, allocated and written only the first time,
+    so identical sets are shared and a lookup per draw replaces a vkUpdateDescriptorSets per draw.
+    Clear must be called whenever the backing allocator is reset.
+*/
+class DescriptorSetCache
+{
+public:
+    void Init(VkDevice device, DescriptorAllocator* allocator);
+
+    VkDescriptorSet Get(VkDescriptorSetLayout layout, const DescriptorSetBindings& bindings);
+    void Clear();
+
+    uint64_t GetHitCount() const { return m_Hits; }
+    uint64_t GetMissCount() const { return m_Misses; }
+
+private:
+    struct CachedSet
+    {
+        VkDescriptorSetLayout layout;
+        DescriptorSetBindings bindings;
+        VkDescriptorSet descriptorSet;
+    };
+
+    VkDevice m_Device = VK_NULL_HANDLE;
+    DescriptorAllocator* m_Allocator = nullptr;
+    // Keyed by hash, the bucket is searched by value, so a hit doesn't copy the bindings
+    std::unordered_map<size_t, std::vector<CachedSet>> m_Sets;
+
+    uint64_t m_Hits = 0;
+    uint64_t m_Misses = 0;
+};
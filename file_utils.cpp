@@ -0,0 +1,22 @@
+#include "file_utils.h"
+
+#include <fstream>
+#include <stdexcept>
+
+void ReadFile(const std::string& filename, std::vector<char>& buffer)
+{
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open file!");
+    }
+
+    size_t fileSize = (size_t)file.tellg();
+    buffer.resize(fileSize);
+
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+
+    file.close();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Reads a whole binary file, throws std::runtime_error if it can't be opened
+void ReadFile(const std::string& filename, std::vector<char>& buffer);
@@ -0,0 +1,72 @@
+#include "file_watcher.h"
+
+// A file that can't be read (deleted, or being replaced) keeps its previous time instead of reporting a change
+static std::filesystem::file_time_type GetWriteTime(const std::string& path, std::filesystem::file_time_type previous)
+{
+    std::error_code error;
+    const std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    return error ? previous : time;
+}
+
+void FileWatcher::Start(const std::vector<std::string>& paths, std::chrono::milliseconds interval,
+    std::function<void(const std::vector<std::string>& changedPaths)> onChange)
+{
+    Stop();
+
+    m_Files.clear();
+    for (const std::string& path : paths)
+    {
+        const std::filesystem::file_time_type time = GetWriteTime(path, std::filesystem::file_time_type::min());
+        m_Files.push_back({ path, time, time });
+    }
+    m_Interval = interval;
+    m_OnChange = std::move(onChange);
+    m_Exit = false;
+    m_Thread = std::thread(&FileWatcher::ThreadMain, this);
+}
+
+void FileWatcher::Stop()
+{
+    if (!m_Thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Exit = true;
+    }
+    m_WakeUp.notify_all();
+    m_Thread.join();
+}
+
+void FileWatcher::ThreadMain()
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if (m_WakeUp.wait_for(lock, m_Interval, [this]() { return m_Exit; }))
+            {
+                return;
+            }
+        }
+
+        std::vector<std::string> changedPaths;
+        for (WatchedFile& file : m_Files)
+        {
+            const std::filesystem::file_time_type time = GetWriteTime(file.path, file.polledTime);
+            if (time != file.reportedTime && time == file.polledTime)
+            {
+                changedPaths.push_back(file.path);
+                file.reportedTime = time;
+            }
+            file.polledTime = time;
+        }
+
+        if (!changedPaths.empty())
+        {
+            m_OnChange(changedPaths);
+        }
+    }
+}
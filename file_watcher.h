@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Watches the modification time of a few files from a background thread.
+
+    The files are polled every interval, which works the same on every platform and every editor (some save by
+    writing in place, others by renaming a temporary file). A change is reported once the time has stayed the same
+    for a whole interval, so a file still being written is not read half way. onChange runs on the watcher thread,
+    with the paths that changed since the last call, and may take as long as it needs: polling waits for it.
+*/
+class FileWatcher
+{
+public:
+    ~FileWatcher() { Stop(); }
+
+    void Start(const std::vector<std::string>& paths, std::chrono::milliseconds interval,
+        std::function<void(const std::vector<std::string>& changedPaths)> onChange);
+    // Waits for a running onChange to return
+    void Stop();
+
+private:
+    struct WatchedFile
+    {
+        std::string path;
+        std::filesystem::file_time_type reportedTime;   // of the last call, or of Start
+        std::filesystem::file_time_type polledTime;     // of the previous poll
+    };
+
+    void ThreadMain();
+
+    std::vector<WatchedFile> m_Files;
+    std::chrono::milliseconds m_Interval{ 0 };
+    std::function<void(const std::vector<std::string>&)> m_OnChange;
+
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    bool m_Exit = false;
+};
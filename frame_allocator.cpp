@@ -0,0 +1,41 @@
+#include "frame_allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void FrameLinearAllocator::Init(VkBuffer buffer, void* mappedData, VkDeviceSize bytesPerFrame, VkDeviceSize alignment)
+{
+    m_Buffer = buffer;
+    m_MappedData = static_cast<uint8_t*>(mappedData);
+    m_Alignment = std::max<VkDeviceSize>(alignment, 1);
+    // Every region starts aligned, so offsets aligned within a region are aligned in the buffer
+    m_BytesPerFrame = AlignUp(bytesPerFrame, m_Alignment);
+
+    BeginFrame(0);
+}
+
+VkDeviceSize FrameLinearAllocator::GetRequiredSize(VkDeviceSize bytesPerFrame, uint32_t framesInFlight, VkDeviceSize alignment)
+{
+    return AlignUp(bytesPerFrame, std::max<VkDeviceSize>(alignment, 1)) * framesInFlight;
+}
+
+void FrameLinearAllocator::BeginFrame(uint32_t frameIdx)
+{
+    m_FrameBegin = frameIdx * m_BytesPerFrame;
+    m_FrameEnd = m_FrameBegin + m_BytesPerFrame;
+    m_Head = m_FrameBegin;
+}
+
+FrameLinearAllocator::Allocation FrameLinearAllocator::Allocate(VkDeviceSize size)
+{
+    const VkDeviceSize offset = AlignUp(m_Head, m_Alignment);
+    if (offset + size > m_FrameEnd)
+    {
+        throw std::runtime_error("frame allocator out of memory: " + std::to_string(size) + " bytes requested, "
+            + std::to_string(m_FrameEnd - m_Head) + " left of " + std::to_string(m_BytesPerFrame));
+    }
+
+    m_Head = offset + size;
+    return { m_MappedData + offset, static_cast<uint32_t>(offset) };
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+
+/*
+    Per-frame linear (bump) allocator for transient GPU data: uniforms and anything else written once per frame.
+
+    One persistently mapped buffer is split into one region per frame in flight. Allocating bumps an offset
+    inside the region of the current frame, and the region is reset as a whole in BeginFrame, once the fence
+    of that frame has signaled and the GPU is done reading it. Allocations are aligned to the given alignment
+    (minUniformBufferOffsetAlignment), so offsets can be used directly as dynamic offsets of
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptors: any number of per-draw uniforms share one descriptor set.
+
+    The allocator does not own the buffer, it must be host visible and coherent.
+*/
+class FrameLinearAllocator
+{
+public:
+    struct Allocation
+    {
+        void* data;         // mapped pointer
+        uint32_t offset;    // from the start of the buffer, usable as a dynamic offset
+    };
+
+    void Init(VkBuffer buffer, void* mappedData, VkDeviceSize bytesPerFrame, VkDeviceSize alignment);
+
+    // Call after waiting on the in-flight fence of frameIdx
+    void BeginFrame(uint32_t frameIdx);
+
+    // Throws std::runtime_error when the frame region is full
+    Allocation Allocate(VkDeviceSize size);
+
+    template<typename T>
+    uint32_t Push(const T& value)
+    {
+        const Allocation allocation = Allocate(sizeof(T));
+        memcpy(allocation.data, &value, sizeof(T));
+        return allocation.offset;
+    }
+
+    VkBuffer GetBuffer() const { return m_Buffer; }
+    VkDeviceSize GetBytesPerFrame() const { return m_BytesPerFrame; }
+    VkDeviceSize GetUsedBytes() const { return m_Head - m_FrameBegin; }
+
+    // Size a buffer needs for the given per-frame capacity
+    static VkDeviceSize GetRequiredSize(VkDeviceSize bytesPerFrame, uint32_t framesInFlight, VkDeviceSize alignment);
+
+private:
+    static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    VkBuffer m_Buffer = VK_NULL_HANDLE;
+    uint8_t* m_MappedData = nullptr;
+    VkDeviceSize m_BytesPerFrame = 0;
+    VkDeviceSize m_Alignment = 1;
+
+    VkDeviceSize m_FrameBegin = 0;
+    VkDeviceSize m_FrameEnd = 0;
+    VkDeviceSize m_Head = 0;
+};
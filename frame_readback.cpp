@@ -0,0 +1,329 @@
+#include "frame_readback.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "vulkan_memory.h"
+
+bool FrameReadback::IsFormatSupported(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void FrameReadback::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t slotCount, uint32_t workerCount,
+    const std::string& directory, ImageFileFormat format)
+{
+    Destroy();
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!std::filesystem::is_directory(directory, error))
+    {
+        throw std::runtime_error("failed to create the export directory " + directory + "!");
+    }
+
+    m_PhysicalDevice = physicalDevice;
+    m_Device = device;
+    m_Directory = directory;
+    m_Format = format;
+    m_Slots.assign(slotCount, Slot());
+    m_NextFrameNumber = 0;
+    m_Stats = Stats();
+
+    m_Exit = false;
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_Threads.emplace_back(&FrameReadback::ThreadMain, this);
+    }
+}
+
+void FrameReadback::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // The device is idle, so every recorded copy is complete: they are all written before the buffers go
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        for (uint32_t i = 0; i < m_Slots.size(); ++i)
+        {
+            if (m_Slots[i].state == SLOT_COPYING)
+            {
+                m_Slots[i].state = SLOT_ENCODING;
+                m_Queue.push_back(i);
+            }
+        }
+        m_WakeUp.notify_all();
+        m_Idle.wait(lock, [this]() { return m_Queue.empty() && m_RunningJobs == 0; });
+        m_Exit = true;
+    }
+    m_WakeUp.notify_all();
+    for (std::thread& thread : m_Threads)
+    {
+        thread.join();
+    }
+    m_Threads.clear();
+
+    for (Slot& slot : m_Slots)
+    {
+        DestroySlotBuffer(slot);
+    }
+    m_Slots.clear();
+
+    std::cout << "frame export: " << m_Stats.exported << " frames written to " << m_Directory << ", "
+        << m_Stats.dropped << " dropped, " << m_Stats.failed << " failed" << std::endl;
+
+    m_Device = VK_NULL_HANDLE;
+}
+
+void FrameReadback::BeginFrame(uint32_t frameSlot)
+{
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (uint32_t i = 0; i < m_Slots.size(); ++i)
+        {
+            Slot& slot = m_Slots[i];
+            if (slot.state == SLOT_COPYING && slot.frameSlot == frameSlot)
+            {
+                slot.state = SLOT_ENCODING;
+                m_Queue.push_back(i);
+                queued = true;
+            }
+        }
+    }
+    if (queued)
+    {
+        m_WakeUp.notify_all();
+    }
+}
+
+bool FrameReadback::RecordCopy(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t frameSlot)
+{
+    if (!IsFormatSupported(format))
+    {
+        throw std::runtime_error("frame export only reads back 8-bit RGBA and BGRA images!");
+    }
+
+    const uint64_t frameNumber = m_NextFrameNumber++;
+
+    Slot* slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (Slot& candidate : m_Slots)
+        {
+            if (candidate.state == SLOT_FREE)
+            {
+                slot = &candidate;
+                break;
+            }
+        }
+        if (slot == nullptr)
+        {
+            ++m_Stats.dropped;
+            return false;
+        }
+        slot->state = SLOT_COPYING;
+    }
+
+    // Grown with the swap chain, never shrunk. Only this thread touches a slot between FREE and the next BeginFrame.
+    const VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    if (slot->size < size)
+    {
+        DestroySlotBuffer(*slot);
+        CreateSlotBuffer(*slot, size);
+    }
+    slot->frameSlot = frameSlot;
+    slot->frameNumber = frameNumber;
+    slot->extent = extent;
+    slot->bgra = format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+
+    /*
+    After the last pass wrote the image, before the presentation engine reads it. The transition to PRESENT_SRC_KHR
+    that ended the pass (render pass finalLayout or the barrier after dynamic rendering) has the transfer stage as
+    destination, with the color writes made visible to the transfer reads: this barrier chains with it on that stage.
+    */
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+    // Tightly packed rows, top row first
+    VkBufferImageCopy region{};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { extent.width, extent.height, 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = 0;
+
+    // The fence makes the copy available to the host, the barrier makes it visible to the reads of the workers
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = slot->buffer;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &imageBarrier);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+    return true;
+}
+
+FrameReadback::Stats FrameReadback::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Stats stats = m_Stats;
+    stats.busySlots = 0;
+    for (const Slot& slot : m_Slots)
+    {
+        stats.busySlots += slot.state != SLOT_FREE ? 1 : 0;
+    }
+    return stats;
+}
+
+void FrameReadback::CreateSlotBuffer(Slot& slot, VkDeviceSize size)
+{
+    // Cached first, coherent otherwise: every host visible type is one or the other on the usual devices
+    const VkMemoryPropertyFlags memoryProperties = CreateBuffer(m_PhysicalDevice, m_Device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+        "frame readback", slot.buffer, slot.memory);
+    slot.hostCoherent = (memoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    void* mapped;
+    vkMapMemory(m_Device, slot.memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    slot.mapped = static_cast<const uint8_t*>(mapped);
+    slot.size = size;
+}
+
+void FrameReadback::DestroySlotBuffer(Slot& slot)
+{
+    if (slot.buffer == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkUnmapMemory(m_Device, slot.memory);
+    vkDestroyBuffer(m_Device, slot.buffer, nullptr);
+    vkFreeMemory(m_Device, slot.memory, nullptr);
+    slot.buffer = VK_NULL_HANDLE;
+    slot.memory = VK_NULL_HANDLE;
+    slot.mapped = nullptr;
+    slot.size = 0;
+}
+
+void FrameReadback::WriteFile(const Slot& slot, std::vector<uint8_t>& pixels, std::vector<uint8_t>& file)
+{
+    const size_t byteCount = static_cast<size_t>(slot.extent.width) * slot.extent.height * 4;
+
+    if (!slot.hostCoherent)
+    {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = slot.memory;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
+    }
+
+    /*
+    One sequential pass over the mapped memory into RGBA. The alpha of the swap chain image is whatever the blending
+    left there, the window is composited opaque: the files are too.
+    */
+    pixels.resize(byteCount);
+    const uint8_t* source = slot.mapped;
+    const uint32_t red = slot.bgra ? 2 : 0;
+    const uint32_t blue = slot.bgra ? 0 : 2;
+    for (size_t i = 0; i < byteCount; i += 4)
+    {
+        pixels[i + 0] = source[i + red];
+        pixels[i + 1] = source[i + 1];
+        pixels[i + 2] = source[i + blue];
+        pixels[i + 3] = 255;
+    }
+
+    file.clear();
+    EncodeImage(pixels.data(), slot.extent.width, slot.extent.height, m_Format, file);
+
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06llu", static_cast<unsigned long long>(slot.frameNumber));
+    const std::string path = m_Directory + "/" + name + GetImageFileExtension(m_Format);
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+    if (!stream)
+    {
+        throw std::runtime_error("failed to write " + path + "!");
+    }
+}
+
+void FrameReadback::ThreadMain()
+{
+    // Reused from frame to frame, a frame is several megabytes
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> file;
+
+    for (;;)
+    {
+        uint32_t slotIndex;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WakeUp.wait(lock, [this]() { return m_Exit || !m_Queue.empty(); });
+            if (m_Exit)
+            {
+                return;
+            }
+            slotIndex = m_Queue.front();
+            m_Queue.pop_front();
+            ++m_RunningJobs;
+        }
+
+        bool written = true;
+        try
+        {
+            WriteFile(m_Slots[slotIndex], pixels, file);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "frame export: " << e.what() << std::endl;
+            written = false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            ++(written ? m_Stats.exported : m_Stats.failed);
+            m_Slots[slotIndex].state = SLOT_FREE;
+            --m_RunningJobs;
+        }
+        m_Idle.notify_all();
+    }
+}
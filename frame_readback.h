@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_writer.h"
+
+/*
+    Writes the presented frames to files without stalling the GPU or the frame loop.
+
+    The copy of the swap chain image into a host visible buffer is recorded at the end of the frame's command buffer,
+    and that buffer is only read once the fence of the frame slot says the GPU is done with it, the next time the
+    slot comes around: no vkQueueWaitIdle, the CPU never waits for the copy. The buffers are a pool larger than the
+    frames in flight, since a buffer stays busy while a worker thread converts and encodes it. When every buffer is
+    still busy (the disk or the encoder can't keep up), the frame is dropped and counted instead of blocking: the
+    export never slows the rendering down, and the gap shows in the numbering of the files.
+
+    The buffers are persistently mapped, from HOST_CACHED memory when there is some: the workers read every byte,
+    which is slow from write-combined memory.
+*/
+class FrameReadback
+{
+public:
+    struct Stats
+    {
+        uint64_t exported = 0;      // files written
+        uint64_t dropped = 0;       // frames skipped because no buffer was free
+        uint64_t failed = 0;        // files that couldn't be written
+        uint32_t busySlots = 0;     // buffers copying or encoding right now
+    };
+
+    // The color formats RecordCopy can read back: 8 bits per channel, RGBA or BGRA
+    static bool IsFormatSupported(VkFormat format);
+
+    ~FrameReadback() { Destroy(); }
+
+    // Creates directory, the buffers are created on first use and grown with the swap chain
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t slotCount, uint32_t workerCount,
+        const std::string& directory, ImageFileFormat format);
+    // Writes the frames already copied, then frees the buffers. The device must be idle.
+    void Destroy();
+
+    // Once the fence of frameSlot is signaled: the copies recorded in its command buffer are complete, the workers take them
+    void BeginFrame(uint32_t frameSlot);
+
+    /*
+        Records the copy of image (the swap chain image, in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR after the last pass) into a
+        free buffer, and leaves the image in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR. False if the frame was dropped.
+        The transition that ended the last pass must have VK_PIPELINE_STAGE_TRANSFER_BIT as destination stage.
+    */
+    bool RecordCopy(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t frameSlot);
+
+    Stats GetStats() const;
+    bool IsEnabled() const { return m_Device != VK_NULL_HANDLE; }
+
+private:
+    enum SlotState
+    {
+        SLOT_FREE,
+        SLOT_COPYING,       // recorded, waiting for the fence of its frame slot
+        SLOT_ENCODING,      // queued or on a worker
+    };
+
+    struct Slot
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        const uint8_t* mapped = nullptr;
+        bool hostCoherent = true;
+
+        SlotState state = SLOT_FREE;
+        uint32_t frameSlot = 0;
+        uint64_t frameNumber = 0;
+        VkExtent2D extent{};
+        bool bgra = false;
+    };
+
+    void CreateSlotBuffer(Slot& slot, VkDeviceSize size);
+    void DestroySlotBuffer(Slot& slot);
+    void WriteFile(const Slot& slot, std::vector<uint8_t>& pixels, std::vector<uint8_t>& file);
+    void ThreadMain();
+
+    VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+    VkDevice m_Device = VK_NULL_HANDLE;
+    std::string m_Directory;
+    ImageFileFormat m_Format = IMAGE_FILE_PNG;
+
+    // The state is guarded by m_Mutex, the rest of a slot belongs to whoever moved it out of SLOT_FREE
+    std::vector<Slot> m_Slots;
+    uint64_t m_NextFrameNumber = 0;
+
+    std::vector<std::thread> m_Threads;
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    std::condition_variable m_Idle;
+    std::deque<uint32_t> m_Queue;   // slots to encode
+    uint32_t m_RunningJobs = 0;
+    bool m_Exit = false;
+    Stats m_Stats;
+};
@@ -0,0 +1,126 @@
+#include "geometry_pool.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "vulkan_memory.h"
+
+void GeometryPool::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t maxVertices, uint32_t maxIndices,
+    PFN_vkGetBufferDeviceAddressKHR getBufferDeviceAddress)
+{
+    m_PhysicalDevice = physicalDevice;
+    m_Device = device;
+    m_MaxVertices = maxVertices;
+    m_MaxIndices = maxIndices;
+    m_VertexCount = 0;
+    m_IndexCount = 0;
+
+    // Storage buffer for the vertex shaders, and for the mesh shaders of the meshlets
+    VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (getBufferDeviceAddress)
+    {
+        vertexUsage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+    }
+    CreateBuffer(physicalDevice, device, static_cast<VkDeviceSize>(maxVertices) * sizeof(Vertex), vertexUsage,
+        { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }, "geometry pool", m_VertexBuffer, m_VertexMemory);
+    CreateBuffer(physicalDevice, device, static_cast<VkDeviceSize>(maxIndices) * sizeof(uint32_t),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }, "geometry pool",
+        m_IndexBuffer, m_IndexMemory);
+
+    if (getBufferDeviceAddress)
+    {
+        VkBufferDeviceAddressInfoKHR addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+        addressInfo.buffer = m_VertexBuffer;
+        m_VertexBufferAddress = getBufferDeviceAddress(device, &addressInfo);
+    }
+}
+
+void GeometryPool::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_IndexMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_VertexMemory, nullptr);
+
+    m_Device = VK_NULL_HANDLE;
+}
+
+GeometryAllocation GeometryPool::Add(VkQueue queue, VkCommandPool commandPool, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    if (vertices.size() > m_MaxVertices - m_VertexCount || indices.size() > m_MaxIndices - m_IndexCount)
+    {
+        throw std::runtime_error("geometry pool is full: " + std::to_string(vertices.size()) + " vertices and "
+            + std::to_string(indices.size()) + " indices don't fit!");
+    }
+
+    GeometryAllocation allocation;
+    allocation.firstIndex = m_IndexCount;
+    allocation.vertexOffset = static_cast<int32_t>(m_VertexCount);
+    allocation.indexCount = static_cast<uint32_t>(indices.size());
+    allocation.vertexCount = static_cast<uint32_t>(vertices.size());
+
+    Upload(queue, commandPool, vertices.data(), vertices.size() * sizeof(Vertex), m_VertexBuffer, m_VertexCount * sizeof(Vertex));
+    Upload(queue, commandPool, indices.data(), indices.size() * sizeof(uint32_t), m_IndexBuffer, m_IndexCount * sizeof(uint32_t));
+
+    m_VertexCount += allocation.vertexCount;
+    m_IndexCount += allocation.indexCount;
+    return allocation;
+}
+
+void GeometryPool::Upload(VkQueue queue, VkCommandPool commandPool, const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset) const
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    CreateBuffer(m_PhysicalDevice, m_Device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT }, "geometry pool", stagingBuffer, stagingMemory);
+
+    void* mapped;
+    vkMapMemory(m_Device, stagingMemory, 0, size, 0, &mapped);
+    memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(m_Device, stagingMemory);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    // Only the range of the new mesh, the meshes already in the pool may be in use
+    VkBufferCopy copyRegion{};
+    copyRegion.dstOffset = offset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(queue);
+
+    vkFreeCommandBuffers(m_Device, commandPool, 1, &commandBuffer);
+    vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+    vkFreeMemory(m_Device, stagingMemory, nullptr);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// Place of one mesh in the pool: the indices are relative to the mesh, vertexOffset is added by the draw
+struct GeometryAllocation
+{
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    uint32_t indexCount = 0;
+    uint32_t vertexCount = 0;
+};
+
+// Vertex pulling variants of shader.vert and depth_prepass.vert (vertex_pull.vert), picked once the device is known
+struct VertexPullingShaders
+{
+    std::vector<char> storageBuffer;            // the vertices are a storage buffer of the scene set
+    std::vector<char> deviceAddress;            // the vertices are a pointer in the push constants
+    std::vector<char> depthPrepassStorageBuffer;
+    std::vector<char> depthPrepassDeviceAddress;
+};
+
+/*
+    One vertex buffer and one index buffer for every mesh, sub-allocated linearly.
+
+    The vertex buffer has no vertex input binding: the vertex shaders read it by gl_VertexIndex, as a storage buffer
+    or through its VK_KHR_buffer_device_address. A mesh is only a range of both buffers, so every draw of every mesh
+    binds the same index buffer once, and the draws only differ by firstIndex and vertexOffset, which is what
+    merging them into indirect or multi-draws needs.
+
+    Meshes are never freed one by one, the pool lives as long as the scene.
+*/
+class GeometryPool
+{
+public:
+    // With getBufferDeviceAddress (the device enabled bufferDeviceAddress) the vertex buffer gets an address
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t maxVertices, uint32_t maxIndices,
+        PFN_vkGetBufferDeviceAddressKHR getBufferDeviceAddress);
+    void Destroy();
+
+    // Uploads through a staging buffer, with a one time command buffer from commandPool. Throws when the pool is full.
+    GeometryAllocation Add(VkQueue queue, VkCommandPool commandPool, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+    VkBuffer GetVertexBuffer() const { return m_VertexBuffer; }
+    VkBuffer GetIndexBuffer() const { return m_IndexBuffer; }
+    // 0 without buffer device address
+    VkDeviceAddress GetVertexBufferAddress() const { return m_VertexBufferAddress; }
+
+    uint32_t GetVertexCount() const { return m_VertexCount; }
+    uint32_t GetIndexCount() const { return m_IndexCount; }
+
+private:
+    void Upload(VkQueue queue, VkCommandPool commandPool, const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset) const;
+
+    VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+    VkDevice m_Device = VK_NULL_HANDLE;
+
+    uint32_t m_MaxVertices = 0;
+    uint32_t m_MaxIndices = 0;
+    uint32_t m_VertexCount = 0;
+    uint32_t m_IndexCount = 0;
+
+    VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_VertexMemory = VK_NULL_HANDLE;
+    VkDeviceAddress m_VertexBufferAddress = 0;
+    VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_IndexMemory = VK_NULL_HANDLE;
+};
@@ -0,0 +1,462 @@
+#include "gpu_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static const uint32_t GPU_TRACK_ID = 1000;
+
+static void WriteEscaped(std::ofstream& file, const char* text)
+{
+    for (const char* c = text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            file << '\\';
+        }
+        file << *c;
+    }
+}
+
+// Small sequential ids look better in the trace viewer than hashed std::thread::id values
+static uint32_t GetCurrentThreadTrackId()
+{
+    static std::atomic<uint32_t> s_NextId{ 1 };
+    thread_local uint32_t id = s_NextId++;
+    return id;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ChromeTraceWriter
+
+bool ChromeTraceWriter::Open(const std::string& filePath)
+{
+    m_File.open(filePath, std::ios::out | std::ios::trunc);
+    if (!m_File.is_open())
+    {
+        return false;
+    }
+
+    m_File << "[\n";
+    m_HasEvents = false;
+    return true;
+}
+
+void ChromeTraceWriter::Close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_File.is_open())
+    {
+        m_File << "\n]\n";
+        m_File.close();
+    }
+}
+
+void ChromeTraceWriter::BeginEvent()
+{
+    if (m_HasEvents)
+    {
+        m_File << ",\n";
+    }
+    m_HasEvents = true;
+}
+
+void ChromeTraceWriter::WriteComplete(const char* name, const char* category, uint32_t threadId, double startUs, double durationUs)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_File.is_open())
+    {
+        return;
+    }
+
+    BeginEvent();
+    m_File << "{\"name\":\"";
+    WriteEscaped(m_File, name);
+    m_File << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+        << ",\"ts\":" << std::fixed << startUs << ",\"dur\":" << durationUs << "}";
+}
+
+void ChromeTraceWriter::WriteCounter(const char* name, double timestampUs, const std::vector<std::pair<const char*, uint64_t>>& values)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_File.is_open())
+    {
+        return;
+    }
+
+    BeginEvent();
+    m_File << "{\"name\":\"";
+    WriteEscaped(m_File, name);
+    m_File << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << std::fixed << timestampUs << ",\"args\":{";
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        m_File << (i > 0 ? "," : "") << "\"" << values[i].first << "\":" << values[i].second;
+    }
+    m_File << "}}";
+}
+
+void ChromeTraceWriter::WriteThreadName(uint32_t threadId, const char* name)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_File.is_open())
+    {
+        return;
+    }
+
+    BeginEvent();
+    m_File << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId << ",\"args\":{\"name\":\"";
+    WriteEscaped(m_File, name);
+    m_File << "\"}}";
+}
+
+void ChromeTraceWriter::Flush()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_File.is_open())
+    {
+        m_File.flush();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// GpuProfiler
+
+void GpuProfiler::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight,
+    const std::string& traceFilePath, bool enableGpuTiming, bool enablePipelineStatistics)
+{
+    m_StartTime = std::chrono::steady_clock::now();
+    m_Device = device;
+    m_Frames.resize(framesInFlight);
+
+    // Without a trace file the queries still run, so GPU frame times are available (e.g. to the benchmark)
+    if (traceFilePath.empty() && !enableGpuTiming && !enablePipelineStatistics)
+    {
+        return;
+    }
+
+    if (!traceFilePath.empty() && !m_TraceWriter.Open(traceFilePath))
+    {
+        throw std::runtime_error("failed to open trace file " + traceFilePath);
+    }
+    m_Enabled = true;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_TimestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    const uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+    /*
+    timestampValidBits is 0 when the queue does not support timestamps at all.
+    Otherwise only the low validBits of a result are meaningful, the rest must be masked off.
+    */
+    if (validBits > 0)
+    {
+        m_TimestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = framesInFlight * MAX_GPU_SCOPES_PER_FRAME * 2;
+
+        if (vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_TimestampQueryPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+    else
+    {
+        std::cerr << "profiler: graphics queue does not support timestamps, only CPU scopes are recorded" << std::endl;
+    }
+
+    if (enablePipelineStatistics)
+    {
+        // Requires the pipelineStatisticsQuery device feature, enabled in CreateLogicalDevice
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = framesInFlight;
+        poolInfo.pipelineStatistics =
+            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        /*
+        The results are written in the order of the bits, from the lowest to the highest,
+        regardless of the order they are listed here.
+        */
+
+        if (vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_StatisticsQueryPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create pipeline statistics query pool!");
+        }
+    }
+
+    m_TraceWriter.WriteThreadName(GPU_TRACK_ID, "GPU");
+}
+
+void GpuProfiler::Destroy()
+{
+    if (m_TimestampQueryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(m_Device, m_TimestampQueryPool, nullptr);
+        m_TimestampQueryPool = VK_NULL_HANDLE;
+    }
+
+    if (m_StatisticsQueryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(m_Device, m_StatisticsQueryPool, nullptr);
+        m_StatisticsQueryPool = VK_NULL_HANDLE;
+    }
+
+    m_TraceWriter.Close();
+    m_Enabled = false;
+}
+
+void GpuProfiler::BeginFrame(uint32_t frameIdx)
+{
+    if (!m_Enabled)
+    {
+        return;
+    }
+
+    CollectFrame(frameIdx);
+
+    FrameQueries& frame = m_Frames[frameIdx];
+    frame.scopes.clear();
+    frame.openScopes.clear();
+    frame.hasStatistics = false;
+    frame.frameNumber = -1;
+
+    m_CurrentFrameIdx = frameIdx;
+}
+
+bool GpuProfiler::CollectOldestFrame()
+{
+    if (!m_Enabled)
+    {
+        return false;
+    }
+
+    uint32_t oldest = UINT32_MAX;
+    for (uint32_t frameIdx = 0; frameIdx < m_Frames.size(); ++frameIdx)
+    {
+        const int64_t frameNumber = m_Frames[frameIdx].frameNumber;
+        if (frameNumber >= 0 && (oldest == UINT32_MAX || frameNumber < m_Frames[oldest].frameNumber))
+        {
+            oldest = frameIdx;
+        }
+    }
+    if (oldest == UINT32_MAX)
+    {
+        return false;
+    }
+
+    CollectFrame(oldest);
+    return true;
+}
+
+void GpuProfiler::CollectFrame(uint32_t frameIdx)
+{
+    FrameQueries& frame = m_Frames[frameIdx];
+
+    // Never submitted (acquire returned VK_ERROR_OUT_OF_DATE_KHR), or already collected
+    if (frame.frameNumber < 0)
+    {
+        return;
+    }
+
+    if (HasGpuTimestamps() && !frame.scopes.empty())
+    {
+        const uint32_t queryCount = static_cast<uint32_t>(frame.scopes.size()) * 2;
+        uint64_t timestamps[MAX_GPU_SCOPES_PER_FRAME * 2];
+
+        const VkResult result = vkGetQueryPoolResults(m_Device, m_TimestampQueryPool, frameIdx * MAX_GPU_SCOPES_PER_FRAME * 2, queryCount,
+            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        // The frame was submitted and its fence has been signaled, the results are available
+        if (result == VK_SUCCESS)
+        {
+            const uint64_t frameBegin = timestamps[0] & m_TimestampMask;
+            uint64_t frameEnd = frameBegin;
+
+            for (size_t i = 0; i < frame.scopes.size(); ++i)
+            {
+                const uint64_t begin = timestamps[2 * i] & m_TimestampMask;
+                const uint64_t end = timestamps[2 * i + 1] & m_TimestampMask;
+                frameEnd = std::max(frameEnd, end);
+
+                const double startUs = frame.submitUs + (begin - frameBegin) * m_TimestampPeriod / 1000.0;
+                const double durationUs = (end - begin) * m_TimestampPeriod / 1000.0;
+                m_TraceWriter.WriteComplete(frame.scopes[i].name, "gpu", GPU_TRACK_ID, startUs, durationUs);
+            }
+
+            m_LastGpuFrameTimeMs = (frameEnd - frameBegin) * m_TimestampPeriod / 1000000.0;
+            m_LastCollectedFrameNumber = frame.frameNumber;
+        }
+    }
+
+    if (HasPipelineStatistics() && frame.hasStatistics)
+    {
+        uint64_t values[4];
+        const VkResult result = vkGetQueryPoolResults(m_Device, m_StatisticsQueryPool, frameIdx, 1,
+            sizeof(values), values, sizeof(values), VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS)
+        {
+            m_LastPipelineStatistics.inputAssemblyVertices = values[0];
+            m_LastPipelineStatistics.vertexShaderInvocations = values[1];
+            m_LastPipelineStatistics.clippingPrimitives = values[2];
+            m_LastPipelineStatistics.fragmentShaderInvocations = values[3];
+
+            m_TraceWriter.WriteCounter("Pipeline statistics", frame.submitUs,
+                {
+                    { "IA vertices", values[0] },
+                    { "VS invocations", values[1] },
+                    { "Clipping primitives", values[2] },
+                    { "FS invocations", values[3] },
+                });
+        }
+    }
+
+    frame.frameNumber = -1;
+    m_TraceWriter.Flush();
+}
+
+void GpuProfiler::ResetQueries(VkCommandBuffer commandBuffer)
+{
+    if (!m_Enabled)
+    {
+        return;
+    }
+
+    if (HasGpuTimestamps())
+    {
+        vkCmdResetQueryPool(commandBuffer, m_TimestampQueryPool, m_CurrentFrameIdx * MAX_GPU_SCOPES_PER_FRAME * 2, MAX_GPU_SCOPES_PER_FRAME * 2);
+    }
+
+    if (HasPipelineStatistics())
+    {
+        vkCmdResetQueryPool(commandBuffer, m_StatisticsQueryPool, m_CurrentFrameIdx, 1);
+    }
+}
+
+void GpuProfiler::BeginGpuScope(VkCommandBuffer commandBuffer, const char* name)
+{
+    if (!m_Enabled || !HasGpuTimestamps())
+    {
+        return;
+    }
+
+    FrameQueries& frame = m_Frames[m_CurrentFrameIdx];
+    if (frame.scopes.size() >= MAX_GPU_SCOPES_PER_FRAME)
+    {
+        // Out of queries for this frame: the scope is dropped, but EndGpuScope must still match it
+        frame.openScopes.push_back(UINT32_MAX);
+        return;
+    }
+
+    const uint32_t scopeIdx = static_cast<uint32_t>(frame.scopes.size());
+    frame.scopes.push_back({ name, static_cast<uint32_t>(frame.openScopes.size()) });
+    frame.openScopes.push_back(scopeIdx);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_TimestampQueryPool,
+        (m_CurrentFrameIdx * MAX_GPU_SCOPES_PER_FRAME + scopeIdx) * 2);
+}
+
+void GpuProfiler::EndGpuScope(VkCommandBuffer commandBuffer)
+{
+    if (!m_Enabled || !HasGpuTimestamps())
+    {
+        return;
+    }
+
+    FrameQueries& frame = m_Frames[m_CurrentFrameIdx];
+    const uint32_t scopeIdx = frame.openScopes.back();
+    frame.openScopes.pop_back();
+
+    if (scopeIdx == UINT32_MAX)
+    {
+        return;
+    }
+
+    /*
+    BOTTOM_OF_PIPE makes the timestamp wait for all the previously submitted work of the command buffer,
+    so the difference between the two queries covers the whole scope.
+    */
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_TimestampQueryPool,
+        (m_CurrentFrameIdx * MAX_GPU_SCOPES_PER_FRAME + scopeIdx) * 2 + 1);
+}
+
+void GpuProfiler::BeginPipelineStatistics(VkCommandBuffer commandBuffer)
+{
+    if (!m_Enabled || !HasPipelineStatistics())
+    {
+        return;
+    }
+
+    vkCmdBeginQuery(commandBuffer, m_StatisticsQueryPool, m_CurrentFrameIdx, 0);
+    m_Frames[m_CurrentFrameIdx].hasStatistics = true;
+}
+
+void GpuProfiler::EndPipelineStatistics(VkCommandBuffer commandBuffer)
+{
+    if (!m_Enabled || !HasPipelineStatistics())
+    {
+        return;
+    }
+
+    vkCmdEndQuery(commandBuffer, m_StatisticsQueryPool, m_CurrentFrameIdx);
+}
+
+void GpuProfiler::MarkSubmit()
+{
+    if (!m_Enabled)
+    {
+        return;
+    }
+
+    FrameQueries& frame = m_Frames[m_CurrentFrameIdx];
+    frame.submitUs = NowUs();
+    frame.frameNumber = m_NextFrameNumber++;
+}
+
+double GpuProfiler::NowUs() const
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_StartTime).count();
+}
+
+void GpuProfiler::AddCpuScope(const char* name, double startUs, double endUs)
+{
+    if (!m_Enabled || !m_TraceWriter.IsOpen())
+    {
+        return;
+    }
+
+    const uint32_t threadId = GetCurrentThreadTrackId();
+
+    thread_local bool s_IsThreadNamed = false;
+    if (!s_IsThreadNamed)
+    {
+        const std::string threadName = "CPU thread " + std::to_string(threadId);
+        m_TraceWriter.WriteThreadName(threadId, threadName.c_str());
+        s_IsThreadNamed = true;
+    }
+
+    m_TraceWriter.WriteComplete(name, "cpu", threadId, startUs, endUs - startUs);
+}
+
+void GpuProfiler::AddCounter(const char* name, const std::vector<std::pair<const char*, uint64_t>>& values)
+{
+    if (!m_Enabled || !m_TraceWriter.IsOpen())
+    {
+        return;
+    }
+
+    m_TraceWriter.WriteCounter(name, NowUs(), values);
+}
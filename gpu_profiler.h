@@ -0,0 +1,168 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    Streams trace events in the Chrome "JSON Array Format".
+    The resulting file can be opened with chrome://tracing or https://ui.perfetto.dev
+*/
+class ChromeTraceWriter
+{
+public:
+    bool Open(const std::string& filePath);
+    void Close();
+
+    bool IsOpen() const { return m_File.is_open(); }
+
+    // "ph":"X" complete event, times in microseconds
+    void WriteComplete(const char* name, const char* category, uint32_t threadId, double startUs, double durationUs);
+    // "ph":"C" counter event, one value per series
+    void WriteCounter(const char* name, double timestampUs, const std::vector<std::pair<const char*, uint64_t>>& values);
+    // "ph":"M" metadata event naming a track
+    void WriteThreadName(uint32_t threadId, const char* name);
+
+    void Flush();
+
+private:
+    void BeginEvent();
+
+    std::ofstream m_File;
+    std::mutex m_Mutex;
+    bool m_HasEvents = false;
+};
+
+struct PipelineStatistics
+{
+    uint64_t inputAssemblyVertices = 0;
+    uint64_t vertexShaderInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentShaderInvocations = 0;
+};
+
+/*
+    Frame profiler.
+
+    GPU scopes are vkCmdWriteTimestamp pairs written into a query pool that has one region per frame in flight.
+    A region is read back in BeginFrame, right after the fence of that frame was waited on,
+    so the results are always available and reading them never stalls the GPU.
+
+    GPU events have no common clock with the CPU. They are placed on their own track,
+    anchored at the CPU time the frame was submitted, which keeps the ordering and exact durations.
+*/
+class GpuProfiler
+{
+public:
+    static const uint32_t MAX_GPU_SCOPES_PER_FRAME = 32;
+
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight,
+        const std::string& traceFilePath, bool enableGpuTiming, bool enablePipelineStatistics);
+    void Destroy();
+
+    bool IsEnabled() const { return m_Enabled; }
+    bool HasGpuTimestamps() const { return m_TimestampQueryPool != VK_NULL_HANDLE; }
+    bool HasPipelineStatistics() const { return m_StatisticsQueryPool != VK_NULL_HANDLE; }
+
+    // Call after waiting on the in-flight fence of frameIdx: collects that frame's previous queries
+    void BeginFrame(uint32_t frameIdx);
+    // After vkDeviceWaitIdle: collects the oldest submitted frame not collected yet, false once there is none.
+    // Called in a loop, the frames still in flight at the end of a run are read one by one.
+    bool CollectOldestFrame();
+
+    // Must be recorded outside of a render pass, before any scope of the frame
+    void ResetQueries(VkCommandBuffer commandBuffer);
+
+    // Scopes can be nested
+    void BeginGpuScope(VkCommandBuffer commandBuffer, const char* name);
+    void EndGpuScope(VkCommandBuffer commandBuffer);
+
+    void BeginPipelineStatistics(VkCommandBuffer commandBuffer);
+    void EndPipelineStatistics(VkCommandBuffer commandBuffer);
+
+    // Marks the CPU time of vkQueueSubmit for the current frame
+    void MarkSubmit();
+
+    double NowUs() const;
+    void AddCpuScope(const char* name, double startUs, double endUs);
+    // Trace counter sampled now, e.g. per-frame statistics
+    void AddCounter(const char* name, const std::vector<std::pair<const char*, uint64_t>>& values);
+
+    // Results of the most recently collected frame. Frame numbers count the submitted frames (MarkSubmit), starting at 0.
+    // GPU results lag MAX_FRAMES_IN_FLIGHT frames behind the CPU, check the number to detect a new result.
+    double GetLastGpuFrameTimeMs() const { return m_LastGpuFrameTimeMs; }
+    int64_t GetLastCollectedFrameNumber() const { return m_LastCollectedFrameNumber; }
+    const PipelineStatistics& GetLastPipelineStatistics() const { return m_LastPipelineStatistics; }
+
+private:
+    struct GpuScope
+    {
+        const char* name;
+        uint32_t depth;
+    };
+
+    struct FrameQueries
+    {
+        std::vector<GpuScope> scopes;
+        std::vector<uint32_t> openScopes;
+        bool hasStatistics = false;
+        double submitUs = 0.0;
+        int64_t frameNumber = -1;       // -1 until submitted, and once collected
+    };
+
+    void CollectFrame(uint32_t frameIdx);
+
+    bool m_Enabled = false;
+
+    VkDevice m_Device = VK_NULL_HANDLE;
+    VkQueryPool m_TimestampQueryPool = VK_NULL_HANDLE;
+    VkQueryPool m_StatisticsQueryPool = VK_NULL_HANDLE;
+
+    float m_TimestampPeriod = 1.0f; // nanoseconds per tick
+    uint64_t m_TimestampMask = ~0ull;
+
+    std::vector<FrameQueries> m_Frames;
+    uint32_t m_CurrentFrameIdx = 0;
+    int64_t m_NextFrameNumber = 0;
+
+    std::chrono::steady_clock::time_point m_StartTime;
+    ChromeTraceWriter m_TraceWriter;
+
+    double m_LastGpuFrameTimeMs = 0.0;
+    int64_t m_LastCollectedFrameNumber = -1;
+    PipelineStatistics m_LastPipelineStatistics;
+};
+
+/*
+    RAII helper for CPU scopes:
+        CpuProfileScope scope(m_Profiler, "Acquire");
+*/
+class CpuProfileScope
+{
+public:
+    CpuProfileScope(GpuProfiler& profiler, const char* name)
+        : m_Profiler(profiler), m_Name(name), m_StartUs(profiler.IsEnabled() ? profiler.NowUs() : 0.0)
+    {
+    }
+
+    ~CpuProfileScope()
+    {
+        if (m_Profiler.IsEnabled())
+        {
+            m_Profiler.AddCpuScope(m_Name, m_StartUs, m_Profiler.NowUs());
+        }
+    }
+
+    CpuProfileScope(const CpuProfileScope&) = delete;
+    CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+    GpuProfiler& m_Profiler;
+    const char* m_Name;
+    double m_StartUs;
+};
@@ -0,0 +1,23 @@
+#include "image_loader.h"
+
+#include <stdexcept>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+ImageData LoadImageRGBA(const std::string& filePath)
+{
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(filePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+    if (!pixels)
+    {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    ImageData image;
+    image.width = texWidth;
+    image.height = texHeight;
+    image.pixels = { pixels, stbi_image_free };
+    return image;
+}
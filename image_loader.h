@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// 8-bit RGBA pixels, top row first
+struct ImageData
+{
+    int width = 0;
+    int height = 0;
+    std::unique_ptr<uint8_t, void (*)(void*)> pixels{ nullptr, nullptr };
+
+    size_t GetSize() const { return static_cast<size_t>(width) * height * 4; }
+};
+
+// Decodes PNG/JPG/TGA/BMP files with stb_image, throws std::runtime_error on failure
+ImageData LoadImageRGBA(const std::string& filePath);
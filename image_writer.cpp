@@ -0,0 +1,468 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+ImageFileFormat ParseImageFileFormat(const std::string& name)
+{
+    if (name == "png")
+    {
+        return IMAGE_FILE_PNG;
+    }
+    if (name == "qoi")
+    {
+        return IMAGE_FILE_QOI;
+    }
+    if (name == "raw")
+    {
+        return IMAGE_FILE_RAW;
+    }
+    throw std::runtime_error("unknown image format " + name + ", expected png, qoi or raw");
+}
+
+const char* GetImageFileExtension(ImageFileFormat format)
+{
+    switch (format)
+    {
+    case IMAGE_FILE_PNG: return ".png";
+    case IMAGE_FILE_QOI: return ".qoi";
+    default: return ".raw";
+    }
+}
+
+static void AppendBigEndian32(std::vector<uint8_t>& bytes, uint32_t value)
+{
+    bytes.push_back(static_cast<uint8_t>(value >> 24));
+    bytes.push_back(static_cast<uint8_t>(value >> 16));
+    bytes.push_back(static_cast<uint8_t>(value >> 8));
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Deflate (RFC 1951), fixed Huffman codes only
+
+// Deflate packs its fields least significant bit first
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t>& bytes) : m_Bytes(bytes) {}
+
+    void Write(uint32_t bits, uint32_t count)
+    {
+        m_Buffer |= static_cast<uint64_t>(bits) << m_Count;
+        m_Count += count;
+        while (m_Count >= 8)
+        {
+            m_Bytes.push_back(static_cast<uint8_t>(m_Buffer));
+            m_Buffer >>= 8;
+            m_Count -= 8;
+        }
+    }
+
+    void Flush()
+    {
+        if (m_Count > 0)
+        {
+            m_Bytes.push_back(static_cast<uint8_t>(m_Buffer));
+        }
+        m_Buffer = 0;
+        m_Count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& m_Bytes;
+    uint64_t m_Buffer = 0;
+    uint32_t m_Count = 0;
+};
+
+static const uint16_t LENGTH_BASES[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DISTANCE_BASES[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static const uint32_t DEFLATE_WINDOW = 32768;
+static const uint32_t DEFLATE_MIN_MATCH = 3;
+static const uint32_t DEFLATE_MAX_MATCH = 258;
+static const uint32_t DEFLATE_HASH_BITS = 15;
+
+static uint32_t ReverseBits(uint32_t bits, uint32_t count)
+{
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        reversed = (reversed << 1) | ((bits >> i) & 1);
+    }
+    return reversed;
+}
+
+// The fixed codes (RFC 1951 3.2.6) bit-reversed once, and the code of every match length and distance
+struct FixedHuffmanTables
+{
+    uint16_t literalCodes[288];
+    uint8_t literalLengths[288];
+    uint8_t distanceCodes[30];
+    uint8_t lengthSymbols[DEFLATE_MAX_MATCH + 1];   // index of LENGTH_BASES, by length
+    uint8_t distanceSymbols[512];                   // index of DISTANCE_BASES, see GetDistanceSymbol
+
+    FixedHuffmanTables()
+    {
+        for (uint32_t symbol = 0; symbol < 288; ++symbol)
+        {
+            uint32_t code, length;
+            if (symbol < 144)
+            {
+                code = 0x30 + symbol;
+                length = 8;
+            }
+            else if (symbol < 256)
+            {
+                code = 0x190 + symbol - 144;
+                length = 9;
+            }
+            else if (symbol < 280)
+            {
+                code = symbol - 256;
+                length = 7;
+            }
+            else
+            {
+                code = 0xC0 + symbol - 280;
+                length = 8;
+            }
+            literalCodes[symbol] = static_cast<uint16_t>(ReverseBits(code, length));
+            literalLengths[symbol] = static_cast<uint8_t>(length);
+        }
+
+        for (uint32_t symbol = 0; symbol < 30; ++symbol)
+        {
+            distanceCodes[symbol] = static_cast<uint8_t>(ReverseBits(symbol, 5));
+        }
+
+        for (uint32_t symbol = 0; symbol < 29; ++symbol)
+        {
+            const uint32_t end = symbol == 28 ? DEFLATE_MAX_MATCH + 1 : LENGTH_BASES[symbol + 1];
+            for (uint32_t length = LENGTH_BASES[symbol]; length < end; ++length)
+            {
+                lengthSymbols[length] = static_cast<uint8_t>(symbol);
+            }
+        }
+        // Code 28 is 258 only, 227 to 257 belong to code 27
+        for (uint32_t length = 227; length < DEFLATE_MAX_MATCH; ++length)
+        {
+            lengthSymbols[length] = 27;
+        }
+
+        for (uint32_t symbol = 0; symbol < 30; ++symbol)
+        {
+            const uint32_t first = DISTANCE_BASES[symbol] - 1;
+            const uint32_t count = 1u << DISTANCE_EXTRA_BITS[symbol];
+            for (uint32_t distance = first; distance < first + count; ++distance)
+            {
+                distanceSymbols[distance < 256 ? distance : 256 + (distance >> 7)] = static_cast<uint8_t>(symbol);
+            }
+        }
+    }
+
+    // Same two-level lookup as zlib: above 256 the code ranges are multiples of 128
+    uint32_t GetDistanceSymbol(uint32_t distance) const
+    {
+        const uint32_t d = distance - 1;
+        return distanceSymbols[d < 256 ? d : 256 + (d >> 7)];
+    }
+};
+
+static const FixedHuffmanTables& GetFixedHuffmanTables()
+{
+    static const FixedHuffmanTables tables;
+    return tables;
+}
+
+static uint32_t HashTriplet(const uint8_t* bytes)
+{
+    const uint32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// One fixed Huffman block, greedy matches against the last position of each hash
+static void Deflate(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+    const FixedHuffmanTables& tables = GetFixedHuffmanTables();
+    BitWriter writer(output);
+
+    writer.Write(1, 1); // BFINAL
+    writer.Write(1, 2); // BTYPE 01: fixed Huffman codes
+
+    auto writeSymbol = [&](uint32_t symbol)
+    {
+        writer.Write(tables.literalCodes[symbol], tables.literalLengths[symbol]);
+    };
+
+    // Position + 1 of the last occurrence of every hash, 0 when there is none
+    std::vector<uint32_t> lastPositions(size_t(1) << DEFLATE_HASH_BITS, 0);
+
+    size_t position = 0;
+    while (position < size)
+    {
+        uint32_t matchLength = 0;
+        uint32_t matchDistance = 0;
+        if (position + DEFLATE_MIN_MATCH <= size)
+        {
+            uint32_t& last = lastPositions[HashTriplet(data + position)];
+            if (last != 0 && position - (last - 1) <= DEFLATE_WINDOW)
+            {
+                const uint8_t* candidate = data + last - 1;
+                const uint32_t maxLength = static_cast<uint32_t>(std::min<size_t>(DEFLATE_MAX_MATCH, size - position));
+                uint32_t length = 0;
+                while (length < maxLength && candidate[length] == data[position + length])
+                {
+                    ++length;
+                }
+                if (length >= DEFLATE_MIN_MATCH)
+                {
+                    matchLength = length;
+                    matchDistance = static_cast<uint32_t>(data + position - candidate);
+                }
+            }
+            last = static_cast<uint32_t>(position + 1);
+        }
+
+        if (matchLength == 0)
+        {
+            writeSymbol(data[position]);
+            ++position;
+            continue;
+        }
+
+        const uint32_t lengthSymbol = tables.lengthSymbols[matchLength];
+        writeSymbol(257 + lengthSymbol);
+        writer.Write(matchLength - LENGTH_BASES[lengthSymbol], LENGTH_EXTRA_BITS[lengthSymbol]);
+
+        const uint32_t distanceSymbol = tables.GetDistanceSymbol(matchDistance);
+        writer.Write(tables.distanceCodes[distanceSymbol], 5);
+        writer.Write(matchDistance - DISTANCE_BASES[distanceSymbol], DISTANCE_EXTRA_BITS[distanceSymbol]);
+
+        // The positions inside the match are hashed too, later matches can start there
+        const size_t end = position + matchLength;
+        for (++position; position < end && position + DEFLATE_MIN_MATCH <= size; ++position)
+        {
+            lastPositions[HashTriplet(data + position)] = static_cast<uint32_t>(position + 1);
+        }
+        position = end;
+    }
+
+    writeSymbol(256); // end of block
+    writer.Flush();
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (size > 0)
+    {
+        // The largest block before b can overflow 32 bits
+        const size_t blockSize = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < blockSize; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += blockSize;
+        size -= blockSize;
+    }
+    return (b << 16) | a;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PNG
+
+static const std::array<uint32_t, 256>& GetCrc32Table()
+{
+    static const std::array<uint32_t, 256> table = []()
+    {
+        std::array<uint32_t, 256> values{};
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            values[n] = c;
+        }
+        return values;
+    }();
+    return table;
+}
+
+static void AppendPngChunk(std::vector<uint8_t>& file, const char* type, const std::vector<uint8_t>& data)
+{
+    AppendBigEndian32(file, static_cast<uint32_t>(data.size()));
+    const size_t typeOffset = file.size();
+    file.insert(file.end(), type, type + 4);
+    file.insert(file.end(), data.begin(), data.end());
+
+    // Over the type and the data
+    const std::array<uint32_t, 256>& table = GetCrc32Table();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = typeOffset; i < file.size(); ++i)
+    {
+        crc = table[(crc ^ file[i]) & 0xFF] ^ (crc >> 8);
+    }
+    AppendBigEndian32(file, crc ^ 0xFFFFFFFFu);
+}
+
+static void EncodePng(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& file)
+{
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.insert(file.end(), SIGNATURE, SIGNATURE + 8);
+
+    std::vector<uint8_t> header;
+    AppendBigEndian32(header, width);
+    AppendBigEndian32(header, height);
+    header.push_back(8);    // bits per channel
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // not interlaced
+    AppendPngChunk(file, "IHDR", header);
+
+    /*
+    Every row with the "up" filter: the difference with the row above, zero wherever the image is flat vertically,
+    which the matches of the deflate encoder then shorten. The first row is compared with zeros.
+    */
+    const size_t rowSize = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> filtered((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint8_t* out = filtered.data() + (rowSize + 1) * y;
+        const uint8_t* row = pixels + rowSize * y;
+        out[0] = 2;
+        if (y == 0)
+        {
+            std::memcpy(out + 1, row, rowSize);
+            continue;
+        }
+        const uint8_t* above = row - rowSize;
+        for (size_t x = 0; x < rowSize; ++x)
+        {
+            out[1 + x] = static_cast<uint8_t>(row[x] - above[x]);
+        }
+    }
+
+    // zlib stream: header (deflate, 32K window, fastest), compressed data, Adler-32 of the uncompressed data
+    std::vector<uint8_t> imageData = { 0x78, 0x01 };
+    Deflate(filtered.data(), filtered.size(), imageData);
+    AppendBigEndian32(imageData, Adler32(filtered.data(), filtered.size()));
+    AppendPngChunk(file, "IDAT", imageData);
+
+    AppendPngChunk(file, "IEND", {});
+}
+
+//////////////////////////////////////////////////////////////////////////
+// QOI, https://qoiformat.org/qoi-specification.pdf
+
+static void EncodeQoi(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint8_t>& file)
+{
+    static const uint8_t QOI_OP_INDEX = 0x00;
+    static const uint8_t QOI_OP_DIFF = 0x40;
+    static const uint8_t QOI_OP_LUMA = 0x80;
+    static const uint8_t QOI_OP_RUN = 0xC0;
+    static const uint8_t QOI_OP_RGB = 0xFE;
+    static const uint8_t QOI_OP_RGBA = 0xFF;
+
+    file.insert(file.end(), { 'q', 'o', 'i', 'f' });
+    AppendBigEndian32(file, width);
+    AppendBigEndian32(file, height);
+    file.push_back(4);  // RGBA
+    file.push_back(0);  // sRGB with linear alpha
+
+    uint8_t index[64][4] = {};
+    uint8_t previous[4] = { 0, 0, 0, 255 };
+    uint32_t run = 0;
+
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        const uint8_t* pixel = pixels + i * 4;
+
+        if (std::memcmp(pixel, previous, 4) == 0)
+        {
+            ++run;
+            if (run == 62 || i + 1 == pixelCount)
+            {
+                file.push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0)
+        {
+            file.push_back(static_cast<uint8_t>(QOI_OP_RUN | (run - 1)));
+            run = 0;
+        }
+
+        const uint32_t hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+        if (std::memcmp(index[hash], pixel, 4) == 0)
+        {
+            file.push_back(static_cast<uint8_t>(QOI_OP_INDEX | hash));
+        }
+        else
+        {
+            std::memcpy(index[hash], pixel, 4);
+
+            if (pixel[3] == previous[3])
+            {
+                // Differences wrap around, as in the reference encoder
+                const int dr = static_cast<int8_t>(pixel[0] - previous[0]);
+                const int dg = static_cast<int8_t>(pixel[1] - previous[1]);
+                const int db = static_cast<int8_t>(pixel[2] - previous[2]);
+                const int drg = dr - dg;
+                const int dbg = db - dg;
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    file.push_back(static_cast<uint8_t>(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                }
+                else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7)
+                {
+                    file.push_back(static_cast<uint8_t>(QOI_OP_LUMA | (dg + 32)));
+                    file.push_back(static_cast<uint8_t>(((drg + 8) << 4) | (dbg + 8)));
+                }
+                else
+                {
+                    file.insert(file.end(), { QOI_OP_RGB, pixel[0], pixel[1], pixel[2] });
+                }
+            }
+            else
+            {
+                file.insert(file.end(), { QOI_OP_RGBA, pixel[0], pixel[1], pixel[2], pixel[3] });
+            }
+        }
+
+        std::memcpy(previous, pixel, 4);
+    }
+
+    file.insert(file.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+}
+
+void EncodeImage(const uint8_t* pixels, uint32_t width, uint32_t height, ImageFileFormat format, std::vector<uint8_t>& file)
+{
+    switch (format)
+    {
+    case IMAGE_FILE_PNG:
+        EncodePng(pixels, width, height, file);
+        break;
+    case IMAGE_FILE_QOI:
+        EncodeQoi(pixels, width, height, file);
+        break;
+    default:
+        file.insert(file.end(), pixels, pixels + static_cast<size_t>(width) * height * 4);
+        break;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// File formats of the frame export, see FrameReadback
+enum ImageFileFormat : uint32_t
+{
+    IMAGE_FILE_PNG = 0,     // deflate compressed, readable everywhere
+    IMAGE_FILE_QOI = 1,     // "Quite OK Image", several times faster to encode than PNG for a similar size
+    IMAGE_FILE_RAW = 2,     // the RGBA8 pixels as they are, no header
+};
+
+// "png", "qoi" or "raw", throws std::runtime_error otherwise
+ImageFileFormat ParseImageFileFormat(const std::string& name);
+// With the dot, e.g. ".png"
+const char* GetImageFileExtension(ImageFileFormat format);
+
+/*
+    Encodes 8-bit RGBA pixels, top row first, into the bytes of a file of the given format (appended to file).
+
+    The PNG encoder is a single pass one meant for frames at full rate: "up" filter on every row and deflate with the
+    fixed Huffman codes and greedy matches from a one-entry hash table. The files are larger than what zlib would write
+    at its default level, in a fraction of the time.
+*/
+void EncodeImage(const uint8_t* pixels, uint32_t width, uint32_t height, ImageFileFormat format, std::vector<uint8_t>& file);
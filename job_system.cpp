@@ -0,0 +1,471 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX    // std::max
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    // Yields before a thread without jobs goes to sleep: a wake-up costs more than a few rounds of looking
+    const uint32_t SPIN_ROUNDS = 64;
+
+    std::mutex g_GlobalMutex;
+    uint32_t g_GlobalThreadCount = 0;
+    bool g_GlobalPinThreads = false;
+    bool g_GlobalStarted = false;
+
+    thread_local JobSystem* t_CurrentSystem = nullptr;  // of the job running on this thread
+    thread_local const JobSystem* t_WorkerSystem = nullptr;
+    thread_local uint32_t t_WorkerIndex = 0;
+    thread_local double t_WaitMs = 0.0;                 // time the running job spent in Wait
+
+    uint32_t GetHardwareThreadCount()
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    JobSystem* CreateGlobal()
+    {
+        std::lock_guard<std::mutex> lock(g_GlobalMutex);
+        g_GlobalStarted = true;
+        const uint32_t threadCount = g_GlobalThreadCount > 0 ? g_GlobalThreadCount : GetHardwareThreadCount();
+        return new JobSystem(threadCount - 1, g_GlobalPinThreads);
+    }
+
+    void PinCurrentThread(uint32_t core)
+    {
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)core;
+#endif
+    }
+
+    uint32_t NextRandom(uint32_t& state)
+    {
+        // xorshift32, only spreads the thieves over the deques
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+}
+
+JobSystem::JobSystem(uint32_t workerCount, bool pinThreads)
+    : m_StartTime(std::chrono::steady_clock::now())
+{
+    for (uint32_t i = 0; i < workerCount + 1; ++i)
+    {
+        m_Workers.push_back(std::make_unique<Worker>());
+    }
+
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        m_Workers[i]->thread = std::thread(&JobSystem::WorkerMain, this, i, pinThreads);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_Exit = true;
+    }
+    m_WakeUp.notify_all();
+
+    for (std::unique_ptr<Worker>& worker : m_Workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+JobSystem& JobSystem::GetGlobal()
+{
+    // Joined at exit, like the other static objects
+    static std::unique_ptr<JobSystem> system(CreateGlobal());
+    return *system;
+}
+
+void JobSystem::ConfigureGlobal(uint32_t threadCount, bool pinThreads)
+{
+    std::lock_guard<std::mutex> lock(g_GlobalMutex);
+    if (g_GlobalStarted)
+    {
+        throw std::runtime_error("the job system is already running, configure it before its first use!");
+    }
+    g_GlobalThreadCount = threadCount;
+    g_GlobalPinThreads = pinThreads;
+}
+
+JobSystem& JobSystem::GetCurrent()
+{
+    return t_CurrentSystem != nullptr ? *t_CurrentSystem : GetGlobal();
+}
+
+void JobSystem::Submit(const char* name, std::function<void()> function, JobCounter* counter)
+{
+    if (counter != nullptr)
+    {
+        counter->m_Pending.fetch_add(1);
+    }
+
+    Job job;
+    job.function = std::move(function);
+    job.name = name;
+    job.counter = counter;
+    Push(std::move(job));
+}
+
+void JobSystem::SubmitAfter(JobCounter& dependency, const char* name, std::function<void()> function, JobCounter* counter)
+{
+    // Counted now, so that waiting for counter also waits for the dependency
+    if (counter != nullptr)
+    {
+        counter->m_Pending.fetch_add(1);
+    }
+
+    Job job;
+    job.function = std::move(function);
+    job.name = name;
+    job.counter = counter;
+
+    {
+        std::lock_guard<std::mutex> lock(dependency.m_Mutex);
+        if (dependency.m_Pending.load() != 0)
+        {
+            // Pushed by the thread that finishes the last job of dependency, see Finish
+            dependency.m_Continuations.push_back(std::move(job));
+            return;
+        }
+    }
+    Push(std::move(job));
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const uint32_t workerIndex = GetCallerIndex();
+    uint32_t randomState = 0x9e3779b9u ^ workerIndex;
+    uint32_t idleRounds = 0;
+
+    while (!counter.IsDone())
+    {
+        Job job;
+        bool stolen;
+        if (FindJob(workerIndex, randomState, job, stolen))
+        {
+            Execute(job, workerIndex, stolen);
+            idleRounds = 0;
+        }
+        else if (++idleRounds < SPIN_ROUNDS)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            // The last jobs run on other threads: sleep until one is done or a new one comes
+            Sleep(&counter);
+            idleRounds = 0;
+        }
+    }
+
+    // The thread that finished the last job may still hold the lock, the counter is only free once it left
+    std::lock_guard<std::mutex> lock(counter.m_Mutex);
+
+    t_WaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::future<void> JobSystem::Async(const char* name, std::function<void()> function)
+{
+    auto task = std::make_shared<std::packaged_task<void()>>(std::move(function));
+    std::future<void> future = task->get_future();
+    Submit(name, [task]() { (*task)(); });
+    return future;
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& function,
+    const char* name)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    batchSize = std::max(batchSize, 1u);
+    const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+
+    // One call per batch, even inline: the callers index their per-batch data with begin / batchSize
+    if (batchCount == 1 || GetThreadCount() == 1)
+    {
+        for (uint32_t begin = 0; begin < count; begin += batchSize)
+        {
+            function(begin, std::min(begin + batchSize, count));
+        }
+        return;
+    }
+
+    // The jobs capture a pointer and an index only, which std::function stores without an allocation
+    struct Batches
+    {
+        const std::function<void(uint32_t begin, uint32_t end)>* function;
+        uint32_t batchSize;
+        uint32_t count;
+    };
+    const Batches batches = { &function, batchSize, count };
+
+    JobCounter counter;
+    for (uint32_t batch = 0; batch < batchCount; ++batch)
+    {
+        const Batches* context = &batches;
+        Submit(name, [context, batch]()
+            {
+                const uint32_t begin = batch * context->batchSize;
+                (*context->function)(begin, std::min(begin + context->batchSize, context->count));
+            }, &counter);
+    }
+    Wait(counter);
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+    JobSystemStats stats;
+    stats.threadCount = GetThreadCount();
+    stats.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_StartTime).count();
+
+    for (const std::unique_ptr<Worker>& worker : m_Workers)
+    {
+        std::lock_guard<std::mutex> lock(worker->statsMutex);
+        stats.jobs += worker->jobs;
+        stats.steals += worker->steals;
+        stats.busyMs += worker->busyMs;
+
+        for (const JobSystemStats::Timing& timing : worker->timings)
+        {
+            auto merged = std::find_if(stats.timings.begin(), stats.timings.end(),
+                [&](const JobSystemStats::Timing& other) { return std::strcmp(other.name, timing.name) == 0; });
+            if (merged == stats.timings.end())
+            {
+                stats.timings.push_back(timing);
+                continue;
+            }
+            merged->count += timing.count;
+            merged->totalMs += timing.totalMs;
+            merged->maxMs = std::max(merged->maxMs, timing.maxMs);
+        }
+    }
+
+    std::sort(stats.timings.begin(), stats.timings.end(),
+        [](const JobSystemStats::Timing& a, const JobSystemStats::Timing& b) { return a.totalMs > b.totalMs; });
+    return stats;
+}
+
+void JobSystem::Push(Job job)
+{
+    Worker& worker = *m_Workers[GetCallerIndex()];
+    {
+        // Counted first, the count never drops below the number of jobs in the deques
+        std::lock_guard<std::mutex> lock(worker.queueMutex);
+        m_QueuedJobs.fetch_add(1);
+        worker.queue.push_back(std::move(job));
+    }
+
+    // A sleeping thread counts itself before it checks m_QueuedJobs, so one of the two sides sees the other
+    if (m_SleepingThreads.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+        }
+        m_WakeUp.notify_one();
+    }
+}
+
+bool JobSystem::FindJob(uint32_t workerIndex, uint32_t& randomState, Job& job, bool& stolen)
+{
+    // The newest job of the own deque first, its data is the most likely to still be in the caches
+    {
+        Worker& worker = *m_Workers[workerIndex];
+        std::lock_guard<std::mutex> lock(worker.queueMutex);
+        if (!worker.queue.empty())
+        {
+            job = std::move(worker.queue.back());
+            worker.queue.pop_back();
+            m_QueuedJobs.fetch_sub(1);
+            stolen = false;
+            return true;
+        }
+    }
+
+    if (m_QueuedJobs.load() == 0)
+    {
+        return false;
+    }
+
+    // Then the oldest job of another deque, from a random one so that the thieves don't all line up on the same
+    const uint32_t workerCount = static_cast<uint32_t>(m_Workers.size());
+    const uint32_t first = NextRandom(randomState) % workerCount;
+    for (uint32_t i = 0; i < workerCount; ++i)
+    {
+        const uint32_t victimIndex = (first + i) % workerCount;
+        if (victimIndex == workerIndex)
+        {
+            continue;
+        }
+
+        Worker& victim = *m_Workers[victimIndex];
+        std::lock_guard<std::mutex> lock(victim.queueMutex);
+        if (!victim.queue.empty())
+        {
+            job = std::move(victim.queue.front());
+            victim.queue.pop_front();
+            m_QueuedJobs.fetch_sub(1);
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::Execute(Job& job, uint32_t workerIndex, bool stolen)
+{
+    JobSystem* previousSystem = t_CurrentSystem;
+    const double previousWaitMs = t_WaitMs;
+    t_CurrentSystem = this;
+    t_WaitMs = 0.0;
+
+    const auto start = std::chrono::steady_clock::now();
+    job.function();
+    const double durationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // The jobs run while waiting count their own time
+    const double busyMs = durationMs - t_WaitMs;
+    t_CurrentSystem = previousSystem;
+    t_WaitMs = previousWaitMs;
+
+    {
+        Worker& worker = *m_Workers[workerIndex];
+        std::lock_guard<std::mutex> lock(worker.statsMutex);
+        ++worker.jobs;
+        worker.steals += stolen ? 1 : 0;
+        worker.busyMs += busyMs;
+
+        const char* name = job.name != nullptr ? job.name : "Job";
+        auto timing = std::find_if(worker.timings.begin(), worker.timings.end(),
+            [name](const JobSystemStats::Timing& other) { return other.name == name; });
+        if (timing == worker.timings.end())
+        {
+            worker.timings.push_back({ name });
+            timing = worker.timings.end() - 1;
+        }
+        ++timing->count;
+        timing->totalMs += durationMs;
+        timing->maxMs = std::max(timing->maxMs, durationMs);
+    }
+
+    // Releases the captures before the waiting thread returns
+    job.function = nullptr;
+    if (job.counter != nullptr)
+    {
+        Finish(*job.counter);
+    }
+}
+
+void JobSystem::Finish(JobCounter& counter)
+{
+    std::vector<Job> continuations;
+    {
+        std::lock_guard<std::mutex> lock(counter.m_Mutex);
+        if (counter.m_Pending.fetch_sub(1) != 1)
+        {
+            return;
+        }
+        continuations.swap(counter.m_Continuations);
+    }
+    // The counter may be gone from here on, its waiter returns as soon as it gets the lock
+
+    if (m_SleepingThreads.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+        }
+        m_WakeUp.notify_all();
+    }
+
+    for (Job& continuation : continuations)
+    {
+        Push(std::move(continuation));
+    }
+}
+
+void JobSystem::Sleep(const JobCounter* counter)
+{
+    std::unique_lock<std::mutex> lock(m_SleepMutex);
+    m_SleepingThreads.fetch_add(1);
+    m_WakeUp.wait(lock, [&]()
+        {
+            return m_Exit || m_QueuedJobs.load() > 0 || (counter != nullptr && counter->IsDone());
+        });
+    m_SleepingThreads.fetch_sub(1);
+}
+
+uint32_t JobSystem::GetCallerIndex() const
+{
+    return t_WorkerSystem == this ? t_WorkerIndex : static_cast<uint32_t>(m_Workers.size()) - 1;
+}
+
+void JobSystem::WorkerMain(uint32_t workerIndex, bool pinThread)
+{
+    t_WorkerSystem = this;
+    t_WorkerIndex = workerIndex;
+    if (pinThread)
+    {
+        // Core 0 is left to the thread that created the job system, usually the main thread
+        PinCurrentThread((workerIndex + 1) % GetHardwareThreadCount());
+    }
+
+    uint32_t randomState = 0x9e3779b9u ^ (workerIndex + 1);
+    uint32_t idleRounds = 0;
+
+    for (;;)
+    {
+        Job job;
+        bool stolen;
+        if (FindJob(workerIndex, randomState, job, stolen))
+        {
+            Execute(job, workerIndex, stolen);
+            idleRounds = 0;
+            continue;
+        }
+
+        if (++idleRounds < SPIN_ROUNDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        idleRounds = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(m_SleepMutex);
+            if (m_Exit && m_QueuedJobs.load() == 0)
+            {
+                return;
+            }
+        }
+        Sleep(nullptr);
+    }
+}
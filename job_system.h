@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+struct Job
+{
+    std::function<void()> function;
+    const char* name = nullptr;         // a string literal, the key of the per-job timings
+    JobCounter* counter = nullptr;      // decremented once the function returned
+};
+
+/*
+    Counts the jobs submitted with it that are not done yet, and holds the jobs that wait for it (SubmitAfter).
+    A parent job that submits children with a counter and waits for it only completes once they all did.
+    The counter must outlive its jobs: wait for it before destroying it.
+*/
+class JobCounter
+{
+public:
+    bool IsDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> m_Pending{ 0 };
+    std::mutex m_Mutex;                 // guards the zero transition and the continuations
+    std::vector<Job> m_Continuations;
+};
+
+// Per-job timings and utilization, cumulative since the job system started
+struct JobSystemStats
+{
+    struct Timing
+    {
+        const char* name = nullptr;
+        uint64_t count = 0;
+        double totalMs = 0.0;           // including the children the job waited for
+        double maxMs = 0.0;
+    };
+
+    uint32_t threadCount = 0;           // the workers, plus one for the threads that submit and wait
+    uint64_t jobs = 0;
+    uint64_t steals = 0;                // jobs taken from the deque of another thread
+    double busyMs = 0.0;                // time spent in jobs but not waiting in them, all threads summed
+    double elapsedMs = 0.0;
+    std::vector<Timing> timings;        // one per job name
+
+    // Fraction of the thread time spent in jobs, 0 to 1
+    double GetUtilization() const { return elapsedMs > 0.0 ? busyMs / (elapsedMs * threadCount) : 0.0; }
+};
+
+/*
+    Work-stealing job scheduler shared by the loading, the culling, the transform updates and the draw list sort.
+
+    Every worker has a deque of its own: it pushes and pops its jobs at the back (the most recent job, whose data is
+    still in its caches) while idle workers steal from the front (the oldest, usually the largest piece of work).
+    The threads that are not workers (main thread, render thread) push into a shared deque, and take part while
+    they wait: Wait runs the queued jobs until the counter is done instead of blocking, so a job can submit
+    children and wait for them without holding up a worker. That replaces fibers, which would need a context switch
+    per platform: a waiting job keeps its stack, and the dependencies that don't need a waiting stack at all are
+    expressed as continuations with SubmitAfter.
+
+    Workers spin briefly when they run out of jobs, then sleep until something is submitted. They are optionally
+    pinned to a core each, the caller is never pinned. A job must not throw; Async wraps one that may in a future.
+*/
+class JobSystem
+{
+public:
+    // workerCount threads are started, the threads that wait take part too: 0 runs everything on them
+    explicit JobSystem(uint32_t workerCount, bool pinThreads = false);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /*
+        The engine-wide job system, started on first use with one worker per hardware thread minus the caller, or with
+        the settings given to ConfigureGlobal before.
+    */
+    static JobSystem& GetGlobal();
+    // threadCount includes the caller, 0 for one per hardware thread. Throws once the global job system is started.
+    static void ConfigureGlobal(uint32_t threadCount, bool pinThreads);
+    // The job system of the job running on this thread, the global one outside of jobs
+    static JobSystem& GetCurrent();
+
+    void Submit(const char* name, std::function<void()> function, JobCounter* counter = nullptr);
+    // Submitted once dependency is done, right away if it already is
+    void SubmitAfter(JobCounter& dependency, const char* name, std::function<void()> function, JobCounter* counter = nullptr);
+    // Runs jobs until counter is done
+    void Wait(JobCounter& counter);
+
+    // A job whose result or exception is taken from the future (get blocks, it does not run other jobs)
+    std::future<void> Async(const char* name, std::function<void()> function);
+
+    // Splits [0, count) into jobs of batchSize items and waits for them, see parallel_for.h
+    void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& function,
+        const char* name = "ParallelFor");
+
+    // The workers and the caller
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+    JobSystemStats GetStats() const;
+
+private:
+    struct Worker
+    {
+        std::mutex queueMutex;
+        std::deque<Job> queue;
+        std::thread thread;
+
+        mutable std::mutex statsMutex;
+        uint64_t jobs = 0;
+        uint64_t steals = 0;
+        double busyMs = 0.0;
+        std::vector<JobSystemStats::Timing> timings;
+    };
+
+    void Push(Job job);
+    bool FindJob(uint32_t workerIndex, uint32_t& randomState, Job& job, bool& stolen);
+    void Execute(Job& job, uint32_t workerIndex, bool stolen);
+    void Finish(JobCounter& counter);
+    void Sleep(const JobCounter* counter);
+    uint32_t GetCallerIndex() const;
+    void WorkerMain(uint32_t workerIndex, bool pinThread);
+
+    // The workers, then the deque and the stats of the threads that aren't workers
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+    std::chrono::steady_clock::time_point m_StartTime;
+
+    std::atomic<uint64_t> m_QueuedJobs{ 0 };
+    std::atomic<uint32_t> m_SleepingThreads{ 0 };
+    std::mutex m_SleepMutex;
+    std::condition_variable m_WakeUp;
+    bool m_Exit = false;
+};
@@ -0,0 +1,213 @@
+#include "latency_markers.h"
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    // Slice of vkWaitForPresentKHR, the longest a present call waits for the swap chain lock
+    const uint64_t PRESENT_WAIT_SLICE_NS = 500000;
+
+    // A long session stops adding samples instead of growing without bounds
+    const size_t MAX_SAMPLES = 1 << 20;
+
+    const char* MARKER_NAMES[LatencyMarkers::MARKER_COUNT] = { "latch", "submit", "present", "display" };
+}
+
+void LatencyMarkers::Init(VkDevice device, PFN_vkWaitForPresentKHR waitForPresent)
+{
+    Destroy();
+
+    m_Device = device;
+    m_WaitForPresent = waitForPresent;
+    m_FrameMeasured = false;
+    for (std::vector<double>& samples : m_SamplesMs)
+    {
+        samples.clear();
+    }
+
+    if (m_WaitForPresent != nullptr)
+    {
+        m_Exit = false;
+        m_Thread = std::thread(&LatencyMarkers::ThreadMain, this);
+    }
+}
+
+void LatencyMarkers::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Exit = true;
+        m_Pending.clear();
+    }
+    m_WakeUp.notify_all();
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+
+    m_Device = VK_NULL_HANDLE;
+    m_WaitForPresent = nullptr;
+}
+
+void LatencyMarkers::SetFrameInput(uint64_t inputSequence, Clock::time_point inputTime)
+{
+    m_FrameMeasured = inputSequence > m_LastMeasuredSequence;
+    m_FrameInputSequence = inputSequence;
+    m_FrameInputTime = inputTime;
+}
+
+void LatencyMarkers::Mark(Marker marker)
+{
+    if (m_FrameMeasured)
+    {
+        AddSample(marker, Clock::now(), m_FrameInputTime);
+    }
+}
+
+void LatencyMarkers::EndFrame(VkSwapchainKHR swapchain, uint64_t presentId)
+{
+    if (!m_FrameMeasured)
+    {
+        return;
+    }
+    m_FrameMeasured = false;
+    m_LastMeasuredSequence = m_FrameInputSequence;
+
+    if (presentId != 0 && HasPresentWait())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Pending.push_back({ swapchain, presentId, m_FrameInputTime });
+        }
+        m_WakeUp.notify_one();
+    }
+}
+
+std::unique_lock<std::mutex> LatencyMarkers::LockSwapchain()
+{
+    // Seen by the thread before its next slice, which then lets the caller go first
+    m_SwapchainRequests.fetch_add(1);
+    std::unique_lock<std::mutex> lock(m_SwapchainMutex);
+    m_SwapchainRequests.fetch_sub(1);
+    return lock;
+}
+
+void LatencyMarkers::ForgetSwapchain(VkSwapchainKHR swapchain)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pending.erase(std::remove_if(m_Pending.begin(), m_Pending.end(),
+        [swapchain](const PendingPresent& pending) { return pending.swapchain == swapchain; }), m_Pending.end());
+}
+
+std::array<uint64_t, LatencyMarkers::MARKER_COUNT> LatencyMarkers::GetLastMicroseconds() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::array<uint64_t, MARKER_COUNT> last{};
+    for (uint32_t marker = 0; marker < MARKER_COUNT; ++marker)
+    {
+        if (!m_SamplesMs[marker].empty())
+        {
+            last[marker] = static_cast<uint64_t>(m_SamplesMs[marker].back() * 1000.0);
+        }
+    }
+    return last;
+}
+
+void LatencyMarkers::Print(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_SamplesMs[MARKER_LATCH].empty())
+    {
+        out << "Input latency: no frame drawn with new input" << std::endl;
+        return;
+    }
+
+    char line[128];
+    out << "Input latency over " << m_SamplesMs[MARKER_LATCH].size() << " frames with new input (ms):" << std::endl;
+    for (uint32_t marker = 0; marker < MARKER_COUNT; ++marker)
+    {
+        if (m_SamplesMs[marker].empty())
+        {
+            continue;
+        }
+        const FrameTimeSummary summary = SummarizeFrameTimes(m_SamplesMs[marker]);
+        std::snprintf(line, sizeof(line), "  to %-8s p50 %7.2f  p95 %7.2f  max %7.2f", MARKER_NAMES[marker],
+            summary.p50, summary.p95, summary.max);
+        out << line << std::endl;
+    }
+}
+
+void LatencyMarkers::AddSample(Marker marker, Clock::time_point time, Clock::time_point inputTime)
+{
+    const double milliseconds = std::chrono::duration<double, std::milli>(time - inputTime).count();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_SamplesMs[marker].size() < MAX_SAMPLES)
+    {
+        m_SamplesMs[marker].push_back(milliseconds);
+    }
+}
+
+void LatencyMarkers::ThreadMain()
+{
+    for (;;)
+    {
+        PendingPresent pending;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WakeUp.wait(lock, [this]() { return m_Exit || !m_Pending.empty(); });
+            if (m_Exit)
+            {
+                return;
+            }
+            pending = m_Pending.front();
+        }
+
+        // A present or a swap chain destruction is waiting for the lock
+        while (m_SwapchainRequests.load() > 0)
+        {
+            std::this_thread::yield();
+        }
+
+        VkResult result;
+        {
+            std::lock_guard<std::mutex> swapchainLock(m_SwapchainMutex);
+            {
+                // Dropped by ForgetSwapchain while this thread was not holding the lock
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                if (m_Pending.empty() || m_Pending.front().presentId != pending.presentId)
+                {
+                    continue;
+                }
+            }
+            result = m_WaitForPresent(m_Device, pending.swapchain, pending.presentId, PRESENT_WAIT_SLICE_NS);
+        }
+        const Clock::time_point now = Clock::now();
+
+        if (result == VK_TIMEOUT)
+        {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!m_Pending.empty() && m_Pending.front().presentId == pending.presentId)
+            {
+                m_Pending.pop_front();
+            }
+        }
+        // Out of date or lost surface: the image may never show, it is not counted
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+        {
+            AddSample(MARKER_DISPLAY, now, pending.inputTime);
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+/*
+    Input to photon latency: from the time an input sample was taken to the marks of the frame that used it.
+
+        latch     the camera built from the input is written into the uniform buffer
+        submit    vkQueueSubmit returned
+        present   vkQueuePresentKHR returned
+        display   the presentation engine reports the image as presented (VK_KHR_present_id and VK_KHR_present_wait)
+
+    Only the frames with an input sample that no earlier frame used are measured: a frame drawn long after the last
+    input says nothing about latency. vkWaitForPresentKHR blocks, so it runs on a thread of its own, in short slices:
+    the swap chain must be externally synchronized between it, vkQueuePresentKHR and the destruction of the swap chain,
+    which lock the swap chain mutex (LockSwapchain) and so wait for one slice at most.
+*/
+class LatencyMarkers
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Marker
+    {
+        MARKER_LATCH,
+        MARKER_SUBMIT,
+        MARKER_PRESENT,
+        MARKER_DISPLAY,
+        MARKER_COUNT
+    };
+
+    ~LatencyMarkers() { Destroy(); }
+
+    // Without waitForPresent (the device lacks the extensions), the frames are measured up to the present call
+    void Init(VkDevice device, PFN_vkWaitForPresentKHR waitForPresent);
+    // Stops waiting for the presents, the swap chain can be destroyed afterwards
+    void Destroy();
+
+    bool IsEnabled() const { return m_Device != VK_NULL_HANDLE; }
+    bool HasPresentWait() const { return m_WaitForPresent != nullptr; }
+
+    // The input the frame is drawn with, until the latch: a later call replaces it (late latching)
+    void SetFrameInput(uint64_t inputSequence, Clock::time_point inputTime);
+    // Time from the input of the current frame to now, if the frame is measured
+    void Mark(Marker marker);
+
+    // The id to chain into VkPresentInfoKHR (VkPresentIdKHR), increasing over all the swap chains
+    uint64_t GetNextPresentId() { return ++m_LastPresentId; }
+    // After vkQueuePresentKHR: the display of presentId is waited for on the thread, 0 when not presented
+    void EndFrame(VkSwapchainKHR swapchain, uint64_t presentId);
+
+    // Around vkQueuePresentKHR and vkDestroySwapchainKHR, takes the lock from the thread between two slices
+    std::unique_lock<std::mutex> LockSwapchain();
+    // With the lock held, before the swap chain is destroyed: its pending presents are dropped
+    void ForgetSwapchain(VkSwapchainKHR swapchain);
+
+    // Microseconds of the last measured frame that reached each marker, for the profiler counters
+    std::array<uint64_t, MARKER_COUNT> GetLastMicroseconds() const;
+    // Median and 95th percentile of every marker
+    void Print(std::ostream& out) const;
+
+private:
+    struct PendingPresent
+    {
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+        uint64_t presentId = 0;
+        Clock::time_point inputTime;
+    };
+
+    void AddSample(Marker marker, Clock::time_point time, Clock::time_point inputTime);
+    void ThreadMain();
+
+    VkDevice m_Device = VK_NULL_HANDLE;
+    PFN_vkWaitForPresentKHR m_WaitForPresent = nullptr;
+    uint64_t m_LastPresentId = 0;
+
+    // The frame being drawn, owned by the thread that draws
+    bool m_FrameMeasured = false;
+    uint64_t m_LastMeasuredSequence = 0;
+    uint64_t m_FrameInputSequence = 0;
+    Clock::time_point m_FrameInputTime;
+
+    // Guarded by m_Mutex: the display marker is added by the thread
+    mutable std::mutex m_Mutex;
+    std::array<std::vector<double>, MARKER_COUNT> m_SamplesMs;
+    std::deque<PendingPresent> m_Pending;
+    std::condition_variable m_WakeUp;
+    bool m_Exit = false;
+
+    std::mutex m_SwapchainMutex;
+    std::atomic<uint32_t> m_SwapchainRequests{ 0 };
+    std::thread m_Thread;
+};
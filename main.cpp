@@ -4,12 +4,11 @@
     https://vulkan-tutorial.com/
 */
 
-int main()
+int main(int argc, char** argv)
 {
-    VulkanApplication app;
-
     try
     {
+        VulkanApplication app(ParseCommandLine(argc, argv));
         app.Run();
     }
     catch (const std::exception& e)
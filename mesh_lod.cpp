@@ -0,0 +1,541 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+// Border planes are weighted by the squared edge length times this, so borders barely move
+static const double BORDER_WEIGHT = 10.0;
+// A collapse may rotate a triangle normal by up to ~75 degrees
+static const float MIN_NORMAL_COSINE = 0.25f;
+// Below this the LODs stop: the per-draw overhead dominates anyway
+static const size_t MIN_LOD_TRIANGLES = 64;
+// Collapses of a pass cost at most this times the cost of the collapse that would reach the target
+static const double PASS_COST_LIMIT = 1.5;
+// A LOD that doesn't remove at least 10% of the triangles of the previous one isn't worth an index range
+static const float MIN_LOD_REDUCTION = 0.9f;
+
+namespace
+{
+    // Sum of weight * (n . p + d)^2 over planes, as the terms of the symmetric 4x4 matrix
+    struct Quadric
+    {
+        double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+        double weight = 0;
+
+        void AddPlane(const glm::vec3& normal, float distance, double planeWeight)
+        {
+            const double x = normal.x, y = normal.y, z = normal.z, d = distance;
+            a00 += planeWeight * x * x;
+            a11 += planeWeight * y * y;
+            a22 += planeWeight * z * z;
+            a01 += planeWeight * x * y;
+            a02 += planeWeight * x * z;
+            a12 += planeWeight * y * z;
+            b0 += planeWeight * x * d;
+            b1 += planeWeight * y * d;
+            b2 += planeWeight * z * d;
+            c += planeWeight * d * d;
+            weight += planeWeight;
+        }
+
+        void Add(const Quadric& other)
+        {
+            a00 += other.a00; a11 += other.a11; a22 += other.a22;
+            a01 += other.a01; a02 += other.a02; a12 += other.a12;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        // Weighted mean squared distance of p to the planes
+        double Evaluate(const glm::vec3& p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            const double sum = a00 * x * x + a11 * y * y + a22 * z * z
+                + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0.0 ? std::max(sum / weight, 0.0) : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double cost;        // geometric and attribute error, to sort
+        double error;       // geometric only, squared
+    };
+
+    uint64_t EdgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+    }
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const std::vector<Vertex>& vertices, const MeshSimplifyOptions& options)
+            : m_Vertices(vertices), m_Options(options)
+        {
+            // Seams: vertices with the same position share one position id, and move together
+            std::unordered_map<glm::vec3, uint32_t> positionIds;
+            m_PositionOf.resize(vertices.size());
+            for (uint32_t vertex = 0; vertex < vertices.size(); ++vertex)
+            {
+                auto inserted = positionIds.emplace(vertices[vertex].pos, static_cast<uint32_t>(m_Positions.size()));
+                if (inserted.second)
+                {
+                    m_Positions.push_back(vertices[vertex].pos);
+                }
+                m_PositionOf[vertex] = inserted.first->second;
+            }
+
+            glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+            for (const glm::vec3& position : m_Positions)
+            {
+                boundsMin = glm::min(boundsMin, position);
+                boundsMax = glm::max(boundsMax, position);
+            }
+            const float diagonal = m_Positions.empty() ? 0.0f : glm::length(boundsMax - boundsMin);
+            m_AttributeScale = static_cast<double>(diagonal) * diagonal;
+        }
+
+        float Simplify(const uint32_t* indices, size_t indexCount, size_t targetIndexCount, std::vector<uint32_t>& result)
+        {
+            result.assign(indices, indices + indexCount);
+            ComputeQuadrics(result);
+
+            double maxError = 0.0;
+            while (result.size() > targetIndexCount)
+            {
+                BuildAdjacency(result);
+
+                const size_t removeTarget = (result.size() - targetIndexCount) / 3;
+                const size_t removed = CollapseEdges(removeTarget, maxError);
+                if (removed == 0)
+                {
+                    break;
+                }
+
+                RemapTriangles(result);
+            }
+
+            return static_cast<float>(std::sqrt(maxError));
+        }
+
+    private:
+        void ComputeQuadrics(const std::vector<uint32_t>& indices)
+        {
+            m_Quadrics.assign(m_Positions.size(), Quadric());
+
+            std::vector<uint64_t> edges;
+            edges.reserve(indices.size());
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    edges.push_back(EdgeKey(m_PositionOf[indices[i + k]], m_PositionOf[indices[i + (k + 1) % 3]]));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                const uint32_t corners[3] = { m_PositionOf[indices[i]], m_PositionOf[indices[i + 1]], m_PositionOf[indices[i + 2]] };
+                const glm::vec3& p0 = m_Positions[corners[0]];
+                glm::vec3 normal = glm::cross(m_Positions[corners[1]] - p0, m_Positions[corners[2]] - p0);
+                const float doubleArea = glm::length(normal);
+                if (doubleArea <= 0.0f)
+                {
+                    continue;
+                }
+                normal /= doubleArea;
+
+                for (uint32_t corner : corners)
+                {
+                    m_Quadrics[corner].AddPlane(normal, -glm::dot(normal, p0), doubleArea * 0.5);
+                }
+
+                // Open border edges (used by one triangle): plane through the edge, perpendicular to the triangle
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t a = corners[k];
+                    const uint32_t b = corners[(k + 1) % 3];
+                    const uint64_t key = EdgeKey(a, b);
+                    const auto range = std::equal_range(edges.begin(), edges.end(), key);
+                    if (range.second - range.first != 1)
+                    {
+                        continue;
+                    }
+
+                    const glm::vec3 edge = m_Positions[b] - m_Positions[a];
+                    const float length = glm::length(edge);
+                    if (length <= 0.0f)
+                    {
+                        continue;
+                    }
+                    const glm::vec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+                    const double borderWeight = BORDER_WEIGHT * length * length;
+                    m_Quadrics[a].AddPlane(borderNormal, -glm::dot(borderNormal, m_Positions[a]), borderWeight);
+                    m_Quadrics[b].AddPlane(borderNormal, -glm::dot(borderNormal, m_Positions[a]), borderWeight);
+                }
+            }
+        }
+
+        void BuildAdjacency(const std::vector<uint32_t>& indices)
+        {
+            m_Indices = &indices;
+
+            // Triangles around each position, as offsets into one array
+            m_TriangleOffsets.assign(m_Positions.size() + 1, 0);
+            for (uint32_t index : indices)
+            {
+                ++m_TriangleOffsets[m_PositionOf[index] + 1];
+            }
+            for (size_t i = 1; i < m_TriangleOffsets.size(); ++i)
+            {
+                m_TriangleOffsets[i] += m_TriangleOffsets[i - 1];
+            }
+            m_Triangles.resize(indices.size());
+            std::vector<uint32_t> fill(m_TriangleOffsets.begin(), m_TriangleOffsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+            {
+                m_Triangles[fill[m_PositionOf[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            // Border edges are the edges of a single triangle
+            m_Edges.clear();
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    m_Edges.push_back(EdgeKey(m_PositionOf[indices[i + k]], m_PositionOf[indices[i + (k + 1) % 3]]));
+                }
+            }
+            std::sort(m_Edges.begin(), m_Edges.end());
+
+            m_BorderEdges.clear();
+            m_IsBorder.assign(m_Positions.size(), 0);
+            for (size_t i = 0; i < m_Edges.size();)
+            {
+                size_t end = i + 1;
+                while (end < m_Edges.size() && m_Edges[end] == m_Edges[i])
+                {
+                    ++end;
+                }
+                if (end - i == 1)
+                {
+                    m_BorderEdges.push_back(m_Edges[i]);
+                    m_IsBorder[m_Edges[i] >> 32] = 1;
+                    m_IsBorder[m_Edges[i] & 0xffffffff] = 1;
+                }
+                i = end;
+            }
+        }
+
+        bool IsBorderEdge(uint32_t a, uint32_t b) const
+        {
+            return std::binary_search(m_BorderEdges.begin(), m_BorderEdges.end(), EdgeKey(a, b));
+        }
+
+        uint32_t GetCornerPosition(uint32_t triangle, int corner) const
+        {
+            return m_PositionOf[(*m_Indices)[triangle * 3 + corner]];
+        }
+
+        // Destination of every vertex at position from, taken from the triangles that hold both positions
+        bool MapWedges(uint32_t from, uint32_t to, std::vector<std::pair<uint32_t, uint32_t>>& wedges) const
+        {
+            wedges.clear();
+            for (uint32_t i = m_TriangleOffsets[from]; i < m_TriangleOffsets[from + 1]; ++i)
+            {
+                const uint32_t triangle = m_Triangles[i];
+                uint32_t fromVertex = UINT32_MAX, toVertex = UINT32_MAX;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t vertex = (*m_Indices)[triangle * 3 + k];
+                    if (m_PositionOf[vertex] == from)
+                    {
+                        fromVertex = vertex;
+                    }
+                    else if (m_PositionOf[vertex] == to)
+                    {
+                        toVertex = vertex;
+                    }
+                }
+                if (toVertex == UINT32_MAX)
+                {
+                    continue;
+                }
+
+                auto found = std::find_if(wedges.begin(), wedges.end(), [&](const std::pair<uint32_t, uint32_t>& wedge) { return wedge.first == fromVertex; });
+                if (found == wedges.end())
+                {
+                    wedges.emplace_back(fromVertex, toVertex);
+                }
+                else if (found->second != toVertex)
+                {
+                    return false;
+                }
+            }
+
+            // Vertices whose triangles don't reach the destination would get the attributes of another side of a seam
+            for (uint32_t i = m_TriangleOffsets[from]; i < m_TriangleOffsets[from + 1]; ++i)
+            {
+                const uint32_t triangle = m_Triangles[i];
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t vertex = (*m_Indices)[triangle * 3 + k];
+                    if (m_PositionOf[vertex] == from
+                        && std::none_of(wedges.begin(), wedges.end(), [&](const std::pair<uint32_t, uint32_t>& wedge) { return wedge.first == vertex; }))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return !wedges.empty();
+        }
+
+        bool EvaluateCollapse(uint32_t from, uint32_t to, Collapse& collapse)
+        {
+            // A border vertex can only slide along its border
+            if (m_IsBorder[from] && !IsBorderEdge(from, to))
+            {
+                return false;
+            }
+            if (!MapWedges(from, to, m_Wedges))
+            {
+                return false;
+            }
+
+            Quadric quadric = m_Quadrics[from];
+            quadric.Add(m_Quadrics[to]);
+            const double error = quadric.Evaluate(m_Positions[to]);
+
+            double attributeError = 0.0;
+            for (const std::pair<uint32_t, uint32_t>& wedge : m_Wedges)
+            {
+                const glm::vec2 uv = m_Vertices[wedge.first].texCoord - m_Vertices[wedge.second].texCoord;
+                const glm::vec3 color = m_Vertices[wedge.first].color - m_Vertices[wedge.second].color;
+                attributeError = std::max(attributeError, static_cast<double>(m_Options.uvWeight * m_Options.uvWeight * glm::dot(uv, uv)
+                    + m_Options.colorWeight * m_Options.colorWeight * glm::dot(color, color)));
+            }
+
+            collapse = { from, to, error + attributeError * m_AttributeScale, error };
+            return true;
+        }
+
+        // Moving from onto to must not flip or fold the triangles that are not removed
+        bool IsCollapseFlipFree(uint32_t from, uint32_t to) const
+        {
+            for (uint32_t i = m_TriangleOffsets[from]; i < m_TriangleOffsets[from + 1]; ++i)
+            {
+                const uint32_t triangle = m_Triangles[i];
+                glm::vec3 before[3], after[3];
+                bool degenerate = false;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t position = GetCornerPosition(triangle, k);
+                    degenerate |= position == to;
+                    before[k] = m_Positions[position];
+                    after[k] = position == from ? m_Positions[to] : before[k];
+                }
+                if (degenerate)
+                {
+                    continue;
+                }
+
+                const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(normalBefore, normalAfter) <= MIN_NORMAL_COSINE * glm::length(normalBefore) * glm::length(normalAfter))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t CollapseEdges(size_t removeTarget, double& maxError)
+        {
+            const std::vector<uint32_t>& indices = *m_Indices;
+
+            // Cheapest direction of every edge, each edge once (the border ones only exist once anyway)
+            m_Collapses.clear();
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t a = m_PositionOf[indices[i + k]];
+                    const uint32_t b = m_PositionOf[indices[i + (k + 1) % 3]];
+                    if (a == b || (a > b && !IsBorderEdge(a, b)))
+                    {
+                        continue;
+                    }
+
+                    Collapse forward, backward;
+                    const bool canForward = EvaluateCollapse(a, b, forward);
+                    const bool canBackward = EvaluateCollapse(b, a, backward);
+                    if (canForward || canBackward)
+                    {
+                        m_Collapses.push_back(canForward && (!canBackward || forward.cost <= backward.cost) ? forward : backward);
+                    }
+                }
+            }
+            std::sort(m_Collapses.begin(), m_Collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+            if (m_Collapses.empty())
+            {
+                return 0;
+            }
+
+            /*
+            Most collapses remove 2 triangles, but many are skipped because a neighbour was collapsed first.
+            Past the cost of the collapse that would reach the target, the next pass will find cheaper ones instead,
+            around the vertices that were locked in this one.
+            */
+            const size_t goal = std::min(removeTarget / 2, m_Collapses.size() - 1);
+            const double maxCost = m_Collapses[goal].cost * PASS_COST_LIMIT;
+
+            m_VertexRemap.resize(m_Vertices.size());
+            for (uint32_t vertex = 0; vertex < m_VertexRemap.size(); ++vertex)
+            {
+                m_VertexRemap[vertex] = vertex;
+            }
+            m_Locked.assign(m_Positions.size(), 0);
+
+            // Independent collapses only: the triangles around a collapsed vertex are locked for the rest of the pass
+            size_t removed = 0;
+            for (const Collapse& collapse : m_Collapses)
+            {
+                if (removed >= removeTarget || collapse.cost > maxCost)
+                {
+                    break;
+                }
+                if (m_Locked[collapse.from] || m_Locked[collapse.to] || !IsCollapseFlipFree(collapse.from, collapse.to))
+                {
+                    continue;
+                }
+
+                MapWedges(collapse.from, collapse.to, m_Wedges);
+                for (const std::pair<uint32_t, uint32_t>& wedge : m_Wedges)
+                {
+                    m_VertexRemap[wedge.first] = wedge.second;
+                }
+
+                for (uint32_t i = m_TriangleOffsets[collapse.from]; i < m_TriangleOffsets[collapse.from + 1]; ++i)
+                {
+                    bool removedTriangle = false;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const uint32_t position = GetCornerPosition(m_Triangles[i], k);
+                        m_Locked[position] = 1;
+                        removedTriangle |= position == collapse.to;
+                    }
+                    removed += removedTriangle;
+                }
+
+                m_Quadrics[collapse.to].Add(m_Quadrics[collapse.from]);
+                maxError = std::max(maxError, collapse.error);
+            }
+
+            return removed;
+        }
+
+        void RemapTriangles(std::vector<uint32_t>& indices) const
+        {
+            size_t write = 0;
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                const uint32_t a = m_VertexRemap[indices[i]];
+                const uint32_t b = m_VertexRemap[indices[i + 1]];
+                const uint32_t c = m_VertexRemap[indices[i + 2]];
+                if (m_PositionOf[a] == m_PositionOf[b] || m_PositionOf[b] == m_PositionOf[c] || m_PositionOf[c] == m_PositionOf[a])
+                {
+                    continue;
+                }
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            indices.resize(write);
+        }
+
+        const std::vector<Vertex>& m_Vertices;
+        MeshSimplifyOptions m_Options;
+        double m_AttributeScale = 1.0;
+
+        std::vector<uint32_t> m_PositionOf;     // vertex -> position id
+        std::vector<glm::vec3> m_Positions;
+        std::vector<Quadric> m_Quadrics;        // per position id
+
+        // Rebuilt every pass
+        const std::vector<uint32_t>* m_Indices = nullptr;
+        std::vector<uint32_t> m_TriangleOffsets;
+        std::vector<uint32_t> m_Triangles;
+        std::vector<uint64_t> m_Edges;
+        std::vector<uint64_t> m_BorderEdges;
+        std::vector<uint8_t> m_IsBorder;
+        std::vector<Collapse> m_Collapses;
+        std::vector<uint32_t> m_VertexRemap;
+        std::vector<uint8_t> m_Locked;
+        std::vector<std::pair<uint32_t, uint32_t>> m_Wedges;
+    };
+}
+
+float SimplifyMesh(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount, size_t targetIndexCount,
+    std::vector<uint32_t>& result, const MeshSimplifyOptions& options)
+{
+    Simplifier simplifier(vertices, options);
+    return simplifier.Simplify(indices, indexCount, targetIndexCount, result);
+}
+
+std::vector<MeshLod> GenerateMeshLods(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t maxLodCount,
+    const MeshSimplifyOptions& options)
+{
+    std::vector<MeshLod> lods;
+    lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+
+    // Each LOD is simplified from the previous one, the errors add up
+    Simplifier simplifier(vertices, options);
+    std::vector<uint32_t> previous = indices;
+    std::vector<uint32_t> simplified;
+    float error = 0.0f;
+
+    while (lods.size() < maxLodCount)
+    {
+        const size_t targetTriangles = previous.size() / 3 / 2;
+        if (targetTriangles < MIN_LOD_TRIANGLES)
+        {
+            break;
+        }
+
+        error += simplifier.Simplify(previous.data(), previous.size(), targetTriangles * 3, simplified);
+        if (simplified.size() > previous.size() * MIN_LOD_REDUCTION)
+        {
+            break;
+        }
+
+        lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), error });
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        previous.swap(simplified);
+    }
+
+    return lods;
+}
+
+uint32_t SelectMeshLod(const std::vector<MeshLod>& lods, float worldScale, float distance, float pixelsPerUnit, float maxPixelError)
+{
+    // Object space error that projects to maxPixelError at this distance
+    const float maxError = maxPixelError * distance / (pixelsPerUnit * worldScale);
+
+    uint32_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error <= maxError)
+    {
+        ++lod;
+    }
+    return lod;
+}
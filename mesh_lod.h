@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+// Index range of one level of detail, all levels share the vertex buffer
+struct MeshLod
+{
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    float error = 0.0f;         // estimated object space distance to the full detail surface, 0 for LOD 0
+};
+
+static const uint32_t MAX_MESH_LOD_COUNT = 6;
+
+struct MeshSimplifyOptions
+{
+    // Cost of changing the attributes of the vertices kept, relative to the size of the mesh:
+    // a texture coordinate difference of 1 costs as much as moving uvWeight * mesh diagonal
+    float uvWeight = 0.05f;
+    float colorWeight = 0.05f;
+};
+
+/*
+    Quadric error metric edge collapse (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997).
+
+    Every vertex accumulates the planes of its triangles, weighted by their area, plus planes perpendicular to the open
+    borders so they keep their shape. Collapsing an edge moves one vertex onto the other, never creating vertices, so
+    the simplified indices reference the original vertex buffer. The cost of a collapse is the mean squared distance to
+    the planes of both vertices, plus the attribute difference between the merged vertices (options).
+
+    Vertices sharing a position but not their texture coordinates or colors (seams) move together: a collapse is only
+    allowed when each of them has a matching vertex at the destination, which keeps the seams closed. Collapses that
+    flip or fold a triangle are rejected. Each pass collapses the cheapest independent edges, until the target is
+    reached or nothing can be collapsed any more.
+*/
+// Returns the simplified triangles in result and the error reached, in object space units
+float SimplifyMesh(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount, size_t targetIndexCount,
+    std::vector<uint32_t>& result, const MeshSimplifyOptions& options = {});
+
+// Appends up to maxLodCount - 1 simplified copies of indices, each with half the triangles of the previous one.
+// Stops early when the simplification gets stuck. Element 0 of the result is the original mesh.
+std::vector<MeshLod> GenerateMeshLods(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+    uint32_t maxLodCount = MAX_MESH_LOD_COUNT, const MeshSimplifyOptions& options = {});
+
+/*
+    Coarsest LOD whose error, projected to the screen, stays under maxPixelError.
+    pixelsPerUnit is the size in pixels of one world unit at distance 1 (GetProjectionPixelScale), worldScale the scale
+    of the object and distance the distance from the camera to the nearest point of its bounding sphere.
+*/
+uint32_t SelectMeshLod(const std::vector<MeshLod>& lods, float worldScale, float distance, float pixelsPerUnit, float maxPixelError);
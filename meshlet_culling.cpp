@@ -0,0 +1,333 @@
+#include "meshlet_culling.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "vulkan_memory.h"
+
+// One meshlet of meshlet_cull.comp, meshlet.task and meshlet.mesh (std430)
+struct GpuMeshlet
+{
+    glm::vec4 sphere;           // object space center and radius
+    glm::vec4 cone;             // axis and cutoff
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;    // also the first index / 3 in the meshlet index buffer
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Push constants of meshlet_cull.comp
+struct CullPushConstants
+{
+    glm::vec4 frustumPlanes[6];     // world space, normalized, inside is dot(plane.xyz, p) + plane.w >= 0
+    uint32_t statsIndex;
+    uint32_t padding[3];
+};
+
+static void ComputeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+glm::vec4 GetMeshletCullingCamera(const glm::mat4& world, const glm::vec3& cameraPosition)
+{
+    // The cones are tested in object space, the spheres are moved to world space and scaled by the largest axis
+    const glm::vec3 objectCamera = glm::vec3(glm::inverse(world) * glm::vec4(cameraPosition, 1.0f));
+    const float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+    return glm::vec4(objectCamera, scale);
+}
+
+void MeshletCuller::Init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool,
+    uint32_t framesInFlight, uint32_t maxObjects, uint32_t maxIndices, const MeshletMesh& mesh, const std::vector<char>& cullShader)
+{
+    m_PhysicalDevice = physicalDevice;
+    m_Device = device;
+    m_FramesInFlight = framesInFlight;
+    m_MaxObjects = maxObjects;
+    m_MaxIndices = maxIndices;
+
+    if (mesh.meshlets.empty())
+    {
+        throw std::runtime_error("no meshlets to cull!");
+    }
+
+    std::vector<GpuMeshlet> meshlets(mesh.meshlets.size());
+    for (size_t i = 0; i < meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = mesh.meshlets[i];
+        const MeshletBounds& bounds = mesh.bounds[i];
+        meshlets[i].sphere = glm::vec4(bounds.center, bounds.radius);
+        meshlets[i].cone = glm::vec4(bounds.coneAxis, bounds.coneCutoff);
+        meshlets[i].vertexOffset = meshlet.vertexOffset;
+        meshlets[i].triangleOffset = meshlet.triangleOffset;
+        meshlets[i].vertexCount = meshlet.vertexCount;
+        meshlets[i].triangleCount = meshlet.triangleCount;
+    }
+
+    // One uint per triangle, its 3 meshlet vertices in the low bytes: GLSL has no 8 bit storage without an extension
+    std::vector<uint32_t> triangles(mesh.triangles.size() / 3);
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        triangles[i] = mesh.triangles[i * 3] | (mesh.triangles[i * 3 + 1] << 8) | (mesh.triangles[i * 3 + 2] << 16);
+    }
+
+    CreateDeviceBuffer(meshlets.data(), meshlets.size() * sizeof(GpuMeshlet), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        queue, commandPool, m_MeshletBuffer, m_MeshletMemory);
+    CreateDeviceBuffer(mesh.vertices.data(), mesh.vertices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        queue, commandPool, m_MeshletVertexBuffer, m_MeshletVertexMemory);
+    CreateDeviceBuffer(triangles.data(), triangles.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        queue, commandPool, m_MeshletTriangleBuffer, m_MeshletTriangleMemory);
+
+    const VkDeviceSize statsSize = framesInFlight * sizeof(MeshletCullingStats);
+    CreateBuffer(m_PhysicalDevice, m_Device, statsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT }, "meshlet culling", m_StatsBuffer, m_StatsMemory);
+
+    void* mappedStats;
+    vkMapMemory(device, m_StatsMemory, 0, statsSize, 0, &mappedStats);
+    memset(mappedStats, 0, static_cast<size_t>(statsSize));
+    m_MappedStats = static_cast<const MeshletCullingStats*>(mappedStats);
+
+    // The mesh shader path reads the meshlets directly, the rest is for the compute culling
+    if (cullShader.empty())
+    {
+        return;
+    }
+
+    CreateDeviceBuffer(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        queue, commandPool, m_MeshletIndexBuffer, m_MeshletIndexMemory);
+    CreateBuffer(m_PhysicalDevice, m_Device, static_cast<VkDeviceSize>(maxIndices) * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }, "meshlet culling",
+        m_OutputIndexBuffer, m_OutputIndexMemory);
+    CreateBuffer(m_PhysicalDevice, m_Device, maxObjects * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }, "meshlet culling", m_DrawCommandBuffer, m_DrawCommandMemory);
+
+    // objects, meshlets, meshlet indices, output indices, draw commands, statistics
+    std::vector<VkDescriptorSetLayoutBinding> bindings(6);
+    for (uint32_t i = 0; i < bindings.size(); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    setLayoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &m_CullSetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create meshlet culling descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_CullSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_CullLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create meshlet culling pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = cullShader.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t*>(cullShader.data());
+
+    VkShaderModule module;
+    if (vkCreateShaderModule(device, &moduleInfo, nullptr, &module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create meshlet culling shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_CullLayout;
+
+    const VkResult result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_CullPipeline);
+    vkDestroyShaderModule(device, module, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create meshlet culling pipeline!");
+    }
+}
+
+void MeshletCuller::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // Null handles are ignored, the compute resources don't exist on the mesh shader path
+    vkDestroyBuffer(m_Device, m_StatsBuffer, nullptr);
+    vkFreeMemory(m_Device, m_StatsMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_DrawCommandBuffer, nullptr);
+    vkFreeMemory(m_Device, m_DrawCommandMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_OutputIndexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_OutputIndexMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_MeshletIndexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_MeshletIndexMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_MeshletTriangleBuffer, nullptr);
+    vkFreeMemory(m_Device, m_MeshletTriangleMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_MeshletVertexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_MeshletVertexMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_MeshletBuffer, nullptr);
+    vkFreeMemory(m_Device, m_MeshletMemory, nullptr);
+
+    vkDestroyPipeline(m_Device, m_CullPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_CullLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_CullSetLayout, nullptr);
+
+    m_Device = VK_NULL_HANDLE;
+}
+
+MeshletCullingStats MeshletCuller::ReadStats(uint32_t frameIdx) const
+{
+    return m_MappedStats[frameIdx];
+}
+
+void MeshletCuller::RecordResetStats(VkCommandBuffer commandBuffer, uint32_t frameIdx, VkPipelineStageFlags cullStages)
+{
+    vkCmdFillBuffer(commandBuffer, m_StatsBuffer, frameIdx * sizeof(MeshletCullingStats), sizeof(MeshletCullingStats), 0);
+    ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        cullStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void MeshletCuller::RecordStatsReadBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags cullStages)
+{
+    ComputeBarrier(commandBuffer, cullStages, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+void MeshletCuller::RecordCull(VkCommandBuffer commandBuffer, DescriptorAllocator& frameDescriptors, uint32_t frameIdx,
+    VkBuffer objectBuffer, VkDeviceSize objectOffset, uint32_t objectCount, uint32_t maxMeshletCount, const glm::mat4& viewProj)
+{
+    if (objectCount > m_MaxObjects)
+    {
+        throw std::runtime_error("too many objects for meshlet culling: " + std::to_string(objectCount)
+            + ", the maximum is " + std::to_string(m_MaxObjects));
+    }
+
+    /*
+    The compacted indices and the draw commands are shared by the frames in flight: the previous frame must be done
+    reading them before they are cleared and written again.
+    */
+    ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+
+    // instanceCount and firstIndex are set by the first meshlet of each object, indexCount grows with every visible one
+    if (objectCount > 0)
+    {
+        vkCmdFillBuffer(commandBuffer, m_DrawCommandBuffer, 0, objectCount * sizeof(VkDrawIndexedIndirectCommand), 0);
+    }
+    RecordResetStats(commandBuffer, frameIdx, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    if (objectCount == 0)
+    {
+        return;
+    }
+
+    // The objects move every frame in the frame allocator, so the set lives in the per-frame descriptor pools
+    DescriptorSetBindings bindings;
+    bindings.Buffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, objectBuffer, objectOffset, objectCount * sizeof(MeshletCullObject));
+    bindings.Buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletBuffer, 0, VK_WHOLE_SIZE);
+    bindings.Buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletIndexBuffer, 0, VK_WHOLE_SIZE);
+    bindings.Buffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_OutputIndexBuffer, 0, VK_WHOLE_SIZE);
+    bindings.Buffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_DrawCommandBuffer, 0, VK_WHOLE_SIZE);
+    bindings.Buffer(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_StatsBuffer, 0, VK_WHOLE_SIZE);
+    VkDescriptorSet cullSet = frameDescriptors.Allocate(m_CullSetLayout);
+    bindings.Write(m_Device, cullSet);
+
+    // Gribb-Hartmann: the planes are sums of the rows of the matrix, depth 0 to 1 so near is row 2 alone
+    const glm::mat4 m = glm::transpose(viewProj);
+    CullPushConstants constants{};
+    constants.frustumPlanes[0] = m[3] + m[0];
+    constants.frustumPlanes[1] = m[3] - m[0];
+    constants.frustumPlanes[2] = m[3] + m[1];
+    constants.frustumPlanes[3] = m[3] - m[1];
+    constants.frustumPlanes[4] = m[2];
+    constants.frustumPlanes[5] = m[3] - m[2];
+    for (glm::vec4& plane : constants.frustumPlanes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    constants.statsIndex = frameIdx;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullLayout, 0, 1, &cullSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_CullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    // Workgroups past the meshlets of their object return right away
+    vkCmdDispatch(commandBuffer, maxMeshletCount, objectCount, 1);
+
+    // The draws read the commands and the indices, the host reads the statistics after the fence
+    ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+}
+
+void MeshletCuller::CreateDeviceBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkQueue queue,
+    VkCommandPool commandPool, VkBuffer& buffer, VkDeviceMemory& memory) const
+{
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    CreateBuffer(m_PhysicalDevice, m_Device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT }, "meshlet culling", stagingBuffer, stagingMemory);
+
+    void* mapped;
+    vkMapMemory(m_Device, stagingMemory, 0, size, 0, &mapped);
+    memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(m_Device, stagingMemory);
+
+    CreateBuffer(m_PhysicalDevice, m_Device, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+        "meshlet culling", buffer, memory);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(queue);
+
+    vkFreeCommandBuffers(m_Device, commandPool, 1, &commandBuffer);
+    vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+    vkFreeMemory(m_Device, stagingMemory, nullptr);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "descriptor_allocator.h"
+#include "meshlets.h"
+
+// Per-object input of meshlet_cull.comp (std430), written every frame into the frame allocator
+struct MeshletCullObject
+{
+    glm::mat4 world;
+    glm::vec4 cameraPosition;   // xyz: camera in object space, for the cone test, w: largest scale of world, for the spheres
+    uint32_t firstMeshlet;      // meshlets of the LOD drawn
+    uint32_t meshletCount;
+    uint32_t outputFirstIndex;  // where the indices of the object start in the compacted index buffer
+    int32_t vertexOffset;       // of the mesh in the vertex buffer, copied to the draw command
+};
+
+// Per-draw constants of the task and mesh shaders (meshlet.task, meshlet.mesh), same meaning as MeshletCullObject
+struct MeshletPushConstants
+{
+    glm::mat4 model;
+    glm::vec4 cameraPosition;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t statsIndex;
+    int32_t vertexOffset;       // of the mesh in the vertex buffer, added to the meshlet vertices
+};
+
+// MeshletCullObject::cameraPosition of an object: the camera in object space and the largest scale of world
+glm::vec4 GetMeshletCullingCamera(const glm::mat4& world, const glm::vec3& cameraPosition);
+
+// Counted by the culling shaders, read back once the frame has finished
+struct MeshletCullingStats
+{
+    uint32_t meshlets = 0;
+    uint32_t frustumCulled = 0;
+    uint32_t backfaceCulled = 0;
+    uint32_t triangles = 0;         // of the meshlets drawn
+};
+
+/*
+    Meshlet culling on the GPU.
+
+    The meshlets of the model, with their bounding spheres and normal cones, are uploaded once. Every frame each
+    object drawn gets a MeshletCullObject, and meshlet_cull.comp runs one workgroup per (meshlet, object): the first
+    invocation tests the sphere against the frustum and the cone against the camera, and when the meshlet survives
+    it reserves room in the draw command of the object with an atomic on its indexCount; then the whole workgroup
+    copies the indices of the meshlet there. Each object ends up as one VkDrawIndexedIndirectCommand over a compacted
+    range of the index buffer holding only its visible meshlets, in no particular order.
+
+    With VK_EXT_mesh_shader the same tests run in a task shader instead and the mesh shader reads the meshlets
+    directly, without an index buffer: the meshlet buffers and the statistics are exposed for that pipeline.
+*/
+class MeshletCuller
+{
+public:
+    static const uint32_t CULL_GROUP_SIZE = 64;     // local_size_x of meshlet_cull.comp
+    static const uint32_t TASK_GROUP_SIZE = 32;     // local_size_x of meshlet.task, meshlets per task workgroup
+
+    // The buffers are uploaded with a one time command buffer from commandPool, submitted to queue.
+    // Without cullShader only the meshlets and the statistics are created, for the mesh shader path.
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool,
+        uint32_t framesInFlight, uint32_t maxObjects, uint32_t maxIndices, const MeshletMesh& mesh, const std::vector<char>& cullShader);
+    void Destroy();
+
+    // Call after waiting on the in-flight fence of frameIdx: the statistics this frame slot counted last time
+    MeshletCullingStats ReadStats(uint32_t frameIdx) const;
+
+    // Outside of a render pass, around the culling shaders of the frame. RecordCull does both itself.
+    void RecordResetStats(VkCommandBuffer commandBuffer, uint32_t frameIdx, VkPipelineStageFlags cullStages);
+    void RecordStatsReadBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags cullStages);
+
+    /*
+    Outside of a render pass. objectCount MeshletCullObject start at objectOffset in objectBuffer, aligned to
+    minStorageBufferOffsetAlignment, none with more than maxMeshletCount meshlets, and their outputs within maxIndices.
+    */
+    void RecordCull(VkCommandBuffer commandBuffer, DescriptorAllocator& frameDescriptors, uint32_t frameIdx,
+        VkBuffer objectBuffer, VkDeviceSize objectOffset, uint32_t objectCount, uint32_t maxMeshletCount, const glm::mat4& viewProj);
+
+    // Compute path: draw command i draws object i of RecordCull, from the compacted index buffer
+    VkBuffer GetIndexBuffer() const { return m_OutputIndexBuffer; }
+    VkBuffer GetDrawCommandBuffer() const { return m_DrawCommandBuffer; }
+    VkDeviceSize GetDrawCommandOffset(uint32_t object) const { return object * sizeof(VkDrawIndexedIndirectCommand); }
+    uint32_t GetMaxIndices() const { return m_MaxIndices; }
+    uint32_t GetMaxObjects() const { return m_MaxObjects; }
+
+    // Mesh shader path: meshlets (bounds and ranges), meshlet vertices, packed meshlet triangles, statistics
+    VkBuffer GetMeshletBuffer() const { return m_MeshletBuffer; }
+    VkBuffer GetMeshletVertexBuffer() const { return m_MeshletVertexBuffer; }
+    VkBuffer GetMeshletTriangleBuffer() const { return m_MeshletTriangleBuffer; }
+    VkBuffer GetStatsBuffer() const { return m_StatsBuffer; }
+
+private:
+    // Device local buffer holding data, through a staging buffer
+    void CreateDeviceBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkQueue queue, VkCommandPool commandPool,
+        VkBuffer& buffer, VkDeviceMemory& memory) const;
+
+    VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+    VkDevice m_Device = VK_NULL_HANDLE;
+    uint32_t m_FramesInFlight = 0;
+    uint32_t m_MaxObjects = 0;
+    uint32_t m_MaxIndices = 0;
+
+    VkDescriptorSetLayout m_CullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_CullLayout = VK_NULL_HANDLE;
+    VkPipeline m_CullPipeline = VK_NULL_HANDLE;
+
+    // Static, uploaded by Init
+    VkBuffer m_MeshletBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_MeshletMemory = VK_NULL_HANDLE;
+    VkBuffer m_MeshletVertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_MeshletVertexMemory = VK_NULL_HANDLE;
+    VkBuffer m_MeshletTriangleBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_MeshletTriangleMemory = VK_NULL_HANDLE;
+    VkBuffer m_MeshletIndexBuffer = VK_NULL_HANDLE;     // MeshletMesh::indices, copied from by the culling
+    VkDeviceMemory m_MeshletIndexMemory = VK_NULL_HANDLE;
+
+    // Written by the culling every frame, shared by the frames in flight like the depth attachment
+    VkBuffer m_OutputIndexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_OutputIndexMemory = VK_NULL_HANDLE;
+    VkBuffer m_DrawCommandBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_DrawCommandMemory = VK_NULL_HANDLE;
+
+    // One MeshletCullingStats per frame in flight, persistently mapped
+    VkBuffer m_StatsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_StatsMemory = VK_NULL_HANDLE;
+    const MeshletCullingStats* m_MappedStats = nullptr;
+};
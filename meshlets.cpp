@@ -0,0 +1,267 @@
+#include "meshlets.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+// Normals more than ~84 degrees away from the axis: the cone would be too wide to ever cull, don't test it
+static const float MIN_CONE_COSINE = 0.1f;
+static const uint8_t NOT_IN_MESHLET = 0xff;
+// Triangles searched for the continuation of a meshlet that ran out of neighbours
+static const uint32_t SEED_SEARCH_WINDOW = 256;
+// and how close to the meshlet normal theirs must be (~45 degrees)
+static const float MIN_JOIN_COSINE = 0.7f;
+
+static glm::vec3 ComputeTriangleNormal(const std::vector<Vertex>& vertices, const uint32_t* triangle)
+{
+    const glm::vec3& a = vertices[triangle[0]].pos;
+    const glm::vec3 normal = glm::cross(vertices[triangle[1]].pos - a, vertices[triangle[2]].pos - a);
+    const float length = glm::length(normal);
+    // Degenerate triangles cover no pixel, they don't constrain the cone
+    return length > 0.0f ? normal / length : glm::vec3(0.0f);
+}
+
+static MeshletBounds ComputeMeshletBounds(const MeshletMesh& mesh, const Meshlet& meshlet, const std::vector<Vertex>& vertices,
+    const std::vector<glm::vec3>& normals, uint32_t firstNormal)
+{
+    MeshletBounds bounds;
+
+    // Center of the bounding box and distance to the farthest vertex, like ComputeBoundingSphere
+    glm::vec3 min(FLT_MAX);
+    glm::vec3 max(-FLT_MAX);
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const glm::vec3& position = vertices[mesh.vertices[meshlet.vertexOffset + i]].pos;
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    bounds.center = (min + max) * 0.5f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        bounds.radius = std::max(bounds.radius, glm::length(vertices[mesh.vertices[meshlet.vertexOffset + i]].pos - bounds.center));
+    }
+
+    glm::vec3 normalSum(0.0f);
+    for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+    {
+        normalSum += normals[firstNormal + i];
+    }
+    const float sumLength = glm::length(normalSum);
+    if (sumLength == 0.0f)
+    {
+        return bounds;
+    }
+    bounds.coneAxis = normalSum / sumLength;
+
+    float minCosine = 1.0f;
+    for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+    {
+        const glm::vec3& normal = normals[firstNormal + i];
+        if (normal != glm::vec3(0.0f))
+        {
+            minCosine = std::min(minCosine, glm::dot(normal, bounds.coneAxis));
+        }
+    }
+
+    /*
+    The normals are within acos(minCosine) of the axis. Seen from a direction d, every triangle faces away when the
+    angle between d and the axis is below 90 degrees minus that, i.e. cos(d, axis) > sin(acos(minCosine)).
+    */
+    if (minCosine > MIN_CONE_COSINE)
+    {
+        bounds.coneCutoff = std::sqrt(1.0f - minCosine * minCosine);
+    }
+    return bounds;
+}
+
+MeshletRange AppendMeshlets(MeshletMesh& mesh, const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+
+    MeshletRange range;
+    range.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+
+    /*
+    Vertices split by a texture or color seam are still neighbours: the adjacency goes through the first vertex
+    with the same position. Triangles around position p are adjacency[offsets[p], offsets[p + 1]).
+    */
+    std::vector<uint32_t> positionIds(vertices.size());
+    std::unordered_map<glm::vec3, uint32_t> firstVertex;
+    for (uint32_t v = 0; v < vertices.size(); ++v)
+    {
+        positionIds[v] = firstVertex.emplace(vertices[v].pos, v).first->second;
+    }
+
+    std::vector<uint32_t> offsets(vertices.size() + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        ++offsets[positionIds[indices[i]] + 1];
+    }
+    for (size_t v = 0; v < vertices.size(); ++v)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            adjacency[next[positionIds[indices[triangle * 3 + corner]]]++] = triangle;
+        }
+    }
+
+    std::vector<glm::vec3> normals(triangleCount);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        normals[triangle] = ComputeTriangleNormal(vertices, indices + triangle * 3);
+    }
+
+    std::vector<uint8_t> used(triangleCount, 0);
+    std::vector<uint8_t> localIndex(vertices.size(), NOT_IN_MESHLET);
+    std::vector<glm::vec3> meshletNormals;     // in the order of the triangles of the mesh, for the bounds
+
+    // Vertices of the triangle that are not in the meshlet yet, counted once even if the triangle repeats one
+    auto countNewVertices = [&](uint32_t triangle)
+    {
+        const uint32_t* corners = indices + triangle * 3;
+        uint32_t count = 0;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const bool repeated = (corner > 0 && corners[corner] == corners[0]) || (corner > 1 && corners[corner] == corners[1]);
+            count += localIndex[corners[corner]] == NOT_IN_MESHLET && !repeated ? 1 : 0;
+        }
+        return count;
+    };
+
+    uint32_t seed = 0;
+    while (true)
+    {
+        while (seed < triangleCount && used[seed])
+        {
+            ++seed;
+        }
+        if (seed == triangleCount)
+        {
+            break;
+        }
+
+        Meshlet meshlet{};
+        meshlet.vertexOffset = static_cast<uint32_t>(mesh.vertices.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(mesh.triangles.size() / 3);
+        const uint32_t firstNormal = static_cast<uint32_t>(meshletNormals.size());
+        glm::vec3 positionSum(0.0f);
+        glm::vec3 normalSum(0.0f);
+
+        auto addTriangle = [&](uint32_t triangle)
+        {
+            used[triangle] = 1;
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const uint32_t vertex = indices[triangle * 3 + corner];
+                if (localIndex[vertex] == NOT_IN_MESHLET)
+                {
+                    localIndex[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+                    mesh.vertices.push_back(vertex);
+                    positionSum += vertices[vertex].pos;
+                }
+                mesh.triangles.push_back(localIndex[vertex]);
+                mesh.indices.push_back(vertex);
+            }
+            ++meshlet.triangleCount;
+            normalSum += normals[triangle];
+            meshletNormals.push_back(normals[triangle]);
+        };
+
+        addTriangle(seed);
+
+        while (meshlet.triangleCount < MAX_MESHLET_TRIANGLES)
+        {
+            const glm::vec3 center = positionSum / static_cast<float>(meshlet.vertexCount);
+            const float normalLength = glm::length(normalSum);
+            const glm::vec3 axis = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+
+            uint32_t best = UINT32_MAX;
+            uint32_t bestNewVertices = 4;
+            float bestCost = FLT_MAX;
+            bool hasFreeNeighbour = false;
+            auto consider = [&](uint32_t triangle)
+            {
+                if (used[triangle])
+                {
+                    return;
+                }
+                hasFreeNeighbour = true;
+
+                const uint32_t newVertices = countNewVertices(triangle);
+                if (newVertices > bestNewVertices || meshlet.vertexCount + newVertices > MAX_MESHLET_VERTICES)
+                {
+                    return;
+                }
+
+                const uint32_t* corners = indices + triangle * 3;
+                const glm::vec3 centroid = (vertices[corners[0]].pos + vertices[corners[1]].pos + vertices[corners[2]].pos) / 3.0f;
+                // Distance from 1x (same normal as the meshlet) to 3x (opposite normal)
+                const float cost = glm::length(centroid - center) * (2.0f - glm::dot(normals[triangle], axis));
+                if (newVertices < bestNewVertices || cost < bestCost)
+                {
+                    best = triangle;
+                    bestNewVertices = newVertices;
+                    bestCost = cost;
+                }
+            };
+
+            // Neighbours of the meshlet are the triangles around its vertices
+            for (uint32_t i = meshlet.vertexOffset; i < mesh.vertices.size(); ++i)
+            {
+                const uint32_t position = positionIds[mesh.vertices[i]];
+                for (uint32_t a = offsets[position]; a < offsets[position + 1]; ++a)
+                {
+                    consider(adjacency[a]);
+                }
+            }
+
+            /*
+            No free neighbour: the meshlet covers a whole connected piece. Models made of many small pieces would
+            end up with tiny meshlets, so the closest of the next triangles in index order (usually nearby) joins it,
+            as long as it faces roughly the same way: a piece facing elsewhere would make the cone useless.
+            */
+            if (!hasFreeNeighbour)
+            {
+                const uint32_t windowEnd = std::min(seed + SEED_SEARCH_WINDOW, triangleCount);
+                for (uint32_t triangle = seed; triangle < windowEnd; ++triangle)
+                {
+                    if (glm::dot(normals[triangle], axis) >= MIN_JOIN_COSINE)
+                    {
+                        consider(triangle);
+                    }
+                }
+            }
+
+            if (best == UINT32_MAX)
+            {
+                break;
+            }
+            addTriangle(best);
+        }
+
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            localIndex[mesh.vertices[meshlet.vertexOffset + i]] = NOT_IN_MESHLET;
+        }
+
+        mesh.meshlets.push_back(meshlet);
+        mesh.bounds.push_back(ComputeMeshletBounds(mesh, meshlet, vertices, meshletNormals, firstNormal));
+    }
+
+    range.meshletCount = static_cast<uint32_t>(mesh.meshlets.size()) - range.firstMeshlet;
+    return range;
+}
+
+bool IsMeshletBackfacing(const MeshletBounds& bounds, const glm::vec3& cameraPosition)
+{
+    // The cone test on the view direction to the center, widened by the sphere for the directions to the other points
+    const glm::vec3 toCenter = bounds.center - cameraPosition;
+    return glm::dot(toCenter, bounds.coneAxis) >= bounds.coneCutoff * glm::length(toCenter) + bounds.radius;
+}
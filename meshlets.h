@@ -0,0 +1,60 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+// Limits of one meshlet, within the output limits every VK_EXT_mesh_shader device supports (256 vertices and primitives)
+static const uint32_t MAX_MESHLET_VERTICES = 64;
+static const uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+struct Meshlet
+{
+    uint32_t vertexOffset;      // in MeshletMesh::vertices
+    uint32_t triangleOffset;    // in triangles: MeshletMesh::triangles from 3 * triangleOffset, MeshletMesh::indices as well
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Object space culling data of one meshlet
+struct MeshletBounds
+{
+    glm::vec3 center{ 0.0f };   // sphere around the vertices
+    float radius = 0.0f;
+    glm::vec3 coneAxis{ 0.0f }; // average direction of the triangle normals
+    float coneCutoff = 1.0f;    // sine of the largest angle between a normal and the axis, 1 when the cone can't cull anything
+};
+
+// Meshlets of one or more index ranges of the same vertex buffer
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;  // per meshlet
+    std::vector<uint32_t> vertices;     // meshlet vertex -> index in the vertex buffer
+    std::vector<uint8_t> triangles;     // 3 meshlet vertices per triangle
+    std::vector<uint32_t> indices;      // the same triangles with vertex buffer indices, for indexed draws
+};
+
+struct MeshletRange
+{
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+};
+
+/*
+    Splits the triangles indices[0, indexCount) into meshlets and appends them to mesh.
+
+    Greedy growth: a meshlet starts from the first triangle not taken yet, then keeps adding the neighbouring triangle
+    that adds the fewest new vertices, ties broken by the distance to the meshlet center weighted by how far its
+    normal is from the average normal, so the meshlets stay compact (tight spheres) and flat (narrow cones).
+    A meshlet that runs out of neighbours continues with the closest of the next free triangles in index order,
+    so models made of many small pieces still get full meshlets. It ends when it's full.
+*/
+MeshletRange AppendMeshlets(MeshletMesh& mesh, const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount);
+
+/*
+    True when every triangle of the meshlet faces away from cameraPosition (object space), with the counter-clockwise
+    front faces of the pipeline. Conservative: false negatives only. The culling shaders run the same test.
+*/
+bool IsMeshletBackfacing(const MeshletBounds& bounds, const glm::vec3& cameraPosition);
@@ -0,0 +1,60 @@
+#include "model_loader.h"
+
+#include <stdexcept>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+void VertexDeduplicator::Add(const Vertex& vertex)
+{
+    if (m_UniqueVertices.count(vertex) == 0)
+    {
+        m_UniqueVertices[vertex] = static_cast<uint32_t>(m_Vertices.size());
+        m_Vertices.push_back(vertex);
+    }
+
+    m_Indices.push_back(m_UniqueVertices[vertex]);
+}
+
+void LoadObjModel(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filePath.c_str()))
+    {
+        throw std::runtime_error(warn + err);
+    }
+
+    VertexDeduplicator deduplicator(vertices, indices);
+
+    for (const auto& shape : shapes)
+    {
+        for (const auto& index : shape.mesh.indices)
+        {
+            Vertex vertex{};
+
+            vertex.pos =
+            {
+                attrib.vertices[3 * index.vertex_index + 0],
+                attrib.vertices[3 * index.vertex_index + 1],
+                attrib.vertices[3 * index.vertex_index + 2]
+            };
+
+            vertex.texCoord =
+            {
+                attrib.texcoords[2 * index.texcoord_index + 0],
+                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                /*
+                The OBJ format assumes a coordinate system where a vertical coordinate of 0 means the bottom of the image,
+                however we've uploaded our image into Vulkan in a top to bottom orientation where 0 means the top of the image.
+                Solve this by flipping the vertical component of the texture coordinates
+                */
+            };
+
+            deduplicator.Add(vertex);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Builds an indexed mesh from a stream of triangle corners:
+    every distinct vertex is stored once, in order of first appearance, and referenced by index.
+*/
+class VertexDeduplicator
+{
+public:
+    VertexDeduplicator(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+        : m_Vertices(vertices), m_Indices(indices)
+    {
+    }
+
+    void Add(const Vertex& vertex);
+
+private:
+    std::vector<Vertex>& m_Vertices;
+    std::vector<uint32_t>& m_Indices;
+    std::unordered_map<Vertex, uint32_t> m_UniqueVertices;
+};
+
+// Appends the triangles of an OBJ file to vertices/indices, throws std::runtime_error if the file can't be parsed
+void LoadObjModel(const std::string& filePath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
@@ -0,0 +1,497 @@
+#include "occlusion_culling.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "vulkan_memory.h"
+
+static const VkFormat PYRAMID_FORMAT = VK_FORMAT_R32G32_SFLOAT;
+static const uint32_t REDUCE_GROUP_SIZE = 8;    // local_size_x/y of hiz_depth.comp and hiz_reduce.comp
+static const uint32_t CULL_GROUP_SIZE = 64;     // local_size_x of occlusion_cull.comp
+
+// Push constants of hiz_depth.comp and hiz_reduce.comp
+struct ReducePushConstants
+{
+    int32_t srcWidth;
+    int32_t srcHeight;
+    int32_t dstWidth;
+    int32_t dstHeight;
+    int32_t sampleCount;
+};
+
+// Push constants of occlusion_cull.comp
+struct CullPushConstants
+{
+    glm::mat4 viewProj;
+    int32_t pyramidWidth;
+    int32_t pyramidHeight;
+    uint32_t pyramidLevels;
+    uint32_t objectCount;
+    uint32_t phase;
+    uint32_t maxObjects;
+    uint32_t statsIndex;
+};
+
+static VkDescriptorSetLayout CreateSetLayout(VkDevice device, const std::vector<VkDescriptorType>& types)
+{
+    std::vector<VkDescriptorSetLayoutBinding> bindings(types.size());
+    for (uint32_t i = 0; i < types.size(); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create occlusion culling descriptor set layout!");
+    }
+    return layout;
+}
+
+static void ComputeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+bool OcclusionCuller::IsSupported(VkPhysicalDevice physicalDevice, VkFormat depthFormat, VkSampleCountFlagBits samples)
+{
+    VkFormatProperties depthProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &depthProperties);
+
+    VkFormatProperties pyramidProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, PYRAMID_FORMAT, &pyramidProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    const VkFormatFeatureFlags pyramidFeatures = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    return (depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0
+        && (properties.limits.sampledImageDepthSampleCounts & samples) != 0
+        && (pyramidProperties.optimalTilingFeatures & pyramidFeatures) == pyramidFeatures;
+}
+
+void OcclusionCuller::Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, uint32_t maxObjects,
+    const OcclusionCullingShaders& shaders)
+{
+    m_PhysicalDevice = physicalDevice;
+    m_Device = device;
+    m_FramesInFlight = framesInFlight;
+    m_MaxObjects = maxObjects;
+
+    m_DepthReduceSetLayout = CreateSetLayout(device, { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE });
+    m_ReduceSetLayout = CreateSetLayout(device, { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE });
+    m_CullSetLayout = CreateSetLayout(device, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER });
+
+    m_DepthReduceLayout = CreatePipelineLayout(m_DepthReduceSetLayout, sizeof(ReducePushConstants));
+    m_ReduceLayout = CreatePipelineLayout(m_ReduceSetLayout, sizeof(ReducePushConstants));
+    m_CullLayout = CreatePipelineLayout(m_CullSetLayout, sizeof(CullPushConstants));
+
+    m_DepthReducePipeline = CreateComputePipeline(shaders.depthReduce, m_DepthReduceLayout);
+    m_DepthReduceMsPipeline = CreateComputePipeline(shaders.depthReduceMs, m_DepthReduceLayout);
+    m_ReducePipeline = CreateComputePipeline(shaders.pyramidReduce, m_ReduceLayout);
+    m_CullPipeline = CreateComputePipeline(shaders.cull, m_CullLayout);
+
+    // Texel fetches only: no filtering, and coordinates past the edges read the edge
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &m_Sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create occlusion culling sampler!");
+    }
+
+    CreateBuffer(m_PhysicalDevice, m_Device, PHASE_COUNT * maxObjects * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+        "occlusion culling", m_DrawCommandBuffer, m_DrawCommandMemory);
+
+    const VkDeviceSize statsSize = framesInFlight * sizeof(OcclusionCullingStats);
+    CreateBuffer(m_PhysicalDevice, m_Device, statsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT }, "occlusion culling", m_StatsBuffer, m_StatsMemory);
+
+    void* mappedStats;
+    vkMapMemory(device, m_StatsMemory, 0, statsSize, 0, &mappedStats);
+    memset(mappedStats, 0, static_cast<size_t>(statsSize));
+    m_MappedStats = static_cast<const OcclusionCullingStats*>(mappedStats);
+
+    m_DescriptorAllocator.Init(device, 16);
+}
+
+void OcclusionCuller::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    DestroyDepthPyramid();
+    m_DescriptorAllocator.Cleanup();
+
+    vkDestroyBuffer(m_Device, m_StatsBuffer, nullptr);
+    vkFreeMemory(m_Device, m_StatsMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_DrawCommandBuffer, nullptr);
+    vkFreeMemory(m_Device, m_DrawCommandMemory, nullptr);
+
+    vkDestroySampler(m_Device, m_Sampler, nullptr);
+    vkDestroyPipeline(m_Device, m_CullPipeline, nullptr);
+    vkDestroyPipeline(m_Device, m_ReducePipeline, nullptr);
+    vkDestroyPipeline(m_Device, m_DepthReduceMsPipeline, nullptr);
+    vkDestroyPipeline(m_Device, m_DepthReducePipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_CullLayout, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_ReduceLayout, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_DepthReduceLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_CullSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_ReduceSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_Device, m_DepthReduceSetLayout, nullptr);
+
+    m_Device = VK_NULL_HANDLE;
+}
+
+void OcclusionCuller::CreateDepthPyramid(VkImage depthImage, VkImageView depthView, VkImageAspectFlags depthAspects,
+    VkSampleCountFlagBits samples, VkExtent2D extent)
+{
+    m_DepthImage = depthImage;
+    m_DepthAspects = depthAspects;
+    m_DepthSamples = samples;
+    m_DepthExtent = extent;
+
+    /*
+    Level 0 is half the resolution of the depth attachment, every level halves again (rounding down) until 1x1.
+    The reductions take every source texel a destination texel overlaps, so odd sizes stay conservative.
+    */
+    m_PyramidLevelExtents.clear();
+    VkExtent2D levelExtent = { std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u) };
+    while (true)
+    {
+        m_PyramidLevelExtents.push_back(levelExtent);
+        if (levelExtent.width == 1 && levelExtent.height == 1)
+        {
+            break;
+        }
+        levelExtent = { std::max(levelExtent.width / 2, 1u), std::max(levelExtent.height / 2, 1u) };
+    }
+    const uint32_t levelCount = static_cast<uint32_t>(m_PyramidLevelExtents.size());
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = { m_PyramidLevelExtents[0].width, m_PyramidLevelExtents[0].height, 1 };
+    imageInfo.mipLevels = levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = PYRAMID_FORMAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateImage(m_Device, &imageInfo, nullptr, &m_PyramidImage) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth pyramid image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(m_Device, m_PyramidImage, &memRequirements);
+    m_PyramidMemory = AllocateMemory(m_PhysicalDevice, m_Device, memRequirements, { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }, "occlusion culling");
+    vkBindImageMemory(m_Device, m_PyramidImage, m_PyramidMemory, 0);
+
+    auto createView = [this](uint32_t baseLevel, uint32_t levels)
+    {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_PyramidImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = PYRAMID_FORMAT;
+        viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levels, 0, 1 };
+
+        VkImageView view;
+        if (vkCreateImageView(m_Device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create depth pyramid view!");
+        }
+        return view;
+    };
+
+    m_PyramidView = createView(0, levelCount);
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        m_PyramidLevelViews.push_back(createView(level, 1));
+    }
+
+    // Level 0 samples the depth attachment, the other levels read the previous one
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        DescriptorSetBindings bindings;
+        VkDescriptorSet set;
+        if (level == 0)
+        {
+            bindings.Image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthView, m_Sampler, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+            set = m_DescriptorAllocator.Allocate(m_DepthReduceSetLayout);
+        }
+        else
+        {
+            bindings.Image(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_PyramidLevelViews[level - 1], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL);
+            set = m_DescriptorAllocator.Allocate(m_ReduceSetLayout);
+        }
+        bindings.Image(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_PyramidLevelViews[level], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL);
+        bindings.Write(m_Device, set);
+        m_ReduceSets.push_back(set);
+    }
+
+    m_PyramidNeedsClear = true;
+}
+
+void OcclusionCuller::DestroyDepthPyramid()
+{
+    if (m_PyramidImage == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    m_DescriptorAllocator.ResetPools();
+    m_ReduceSets.clear();
+
+    for (VkImageView view : m_PyramidLevelViews)
+    {
+        vkDestroyImageView(m_Device, view, nullptr);
+    }
+    m_PyramidLevelViews.clear();
+    vkDestroyImageView(m_Device, m_PyramidView, nullptr);
+    vkDestroyImage(m_Device, m_PyramidImage, nullptr);
+    vkFreeMemory(m_Device, m_PyramidMemory, nullptr);
+
+    m_PyramidImage = VK_NULL_HANDLE;
+}
+
+OcclusionCullingStats OcclusionCuller::ReadStats(uint32_t frameIdx) const
+{
+    return m_MappedStats[frameIdx];
+}
+
+void OcclusionCuller::RecordCull(VkCommandBuffer commandBuffer, DescriptorAllocator& frameDescriptors, uint32_t frameIdx, uint32_t phase,
+    VkBuffer objectBuffer, VkDeviceSize objectOffset, uint32_t objectCount, const glm::mat4& viewProj)
+{
+    if (objectCount > m_MaxObjects)
+    {
+        throw std::runtime_error("too many objects for occlusion culling: " + std::to_string(objectCount)
+            + ", the maximum is " + std::to_string(m_MaxObjects));
+    }
+
+    if (phase == 0)
+    {
+        if (m_PyramidNeedsClear)
+        {
+            // No occluder until the first build: farthest depth everywhere, every object passes
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = m_PyramidImage;
+            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &barrier);
+
+            VkClearColorValue clearValue{};
+            clearValue.float32[0] = 0.0f;
+            clearValue.float32[1] = 1.0f;
+            vkCmdClearColorImage(commandBuffer, m_PyramidImage, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &barrier.subresourceRange);
+
+            m_PyramidNeedsClear = false;
+        }
+
+        vkCmdFillBuffer(commandBuffer, m_StatsBuffer, frameIdx * sizeof(OcclusionCullingStats), sizeof(OcclusionCullingStats), 0);
+
+        /*
+        The draw commands and the pyramid are shared by the frames in flight, like the depth attachment:
+        the previous frame must be done drawing from the commands and building the pyramid.
+        */
+        ComputeBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    if (objectCount == 0)
+    {
+        return;
+    }
+
+    // The objects move every frame in the frame allocator, so the set lives in the per-frame descriptor pools
+    DescriptorSetBindings bindings;
+    bindings.Buffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, objectBuffer, objectOffset, objectCount * sizeof(OcclusionCullObject));
+    bindings.Buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_DrawCommandBuffer, 0, VK_WHOLE_SIZE);
+    bindings.Image(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_PyramidView, m_Sampler, VK_IMAGE_LAYOUT_GENERAL);
+    bindings.Buffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_StatsBuffer, 0, VK_WHOLE_SIZE);
+    VkDescriptorSet cullSet = frameDescriptors.Allocate(m_CullSetLayout);
+    bindings.Write(m_Device, cullSet);
+
+    CullPushConstants constants{};
+    constants.viewProj = viewProj;
+    constants.pyramidWidth = static_cast<int32_t>(m_PyramidLevelExtents[0].width);
+    constants.pyramidHeight = static_cast<int32_t>(m_PyramidLevelExtents[0].height);
+    constants.pyramidLevels = static_cast<uint32_t>(m_PyramidLevelExtents.size());
+    constants.objectCount = objectCount;
+    constants.phase = phase;
+    constants.maxObjects = m_MaxObjects;
+    constants.statsIndex = frameIdx;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullLayout, 0, 1, &cullSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_CullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // Phase 2 reads the phase 1 commands, the draws read both, the host reads the statistics after the fence
+    ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+}
+
+void OcclusionCuller::RecordDepthPyramid(VkCommandBuffer commandBuffer)
+{
+    VkImageMemoryBarrier depthBarrier{};
+    depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    depthBarrier.image = m_DepthImage;
+    depthBarrier.subresourceRange = { m_DepthAspects, 0, 1, 0, 1 };
+    depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    // The phase 1 culling sampled the pyramid that is about to be overwritten
+    VkMemoryBarrier pyramidBarrier{};
+    pyramidBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    pyramidBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &pyramidBarrier, 0, nullptr, 1, &depthBarrier);
+
+    VkExtent2D srcExtent = m_DepthExtent;
+    for (uint32_t level = 0; level < m_PyramidLevelExtents.size(); ++level)
+    {
+        const VkExtent2D dstExtent = m_PyramidLevelExtents[level];
+
+        if (level == 0)
+        {
+            const VkPipeline pipeline = m_DepthSamples == VK_SAMPLE_COUNT_1_BIT ? m_DepthReducePipeline : m_DepthReduceMsPipeline;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_DepthReduceLayout, 0, 1, &m_ReduceSets[level], 0, nullptr);
+        }
+        else
+        {
+            if (level == 1)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ReducePipeline);
+            }
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ReduceLayout, 0, 1, &m_ReduceSets[level], 0, nullptr);
+        }
+
+        ReducePushConstants constants{};
+        constants.srcWidth = static_cast<int32_t>(srcExtent.width);
+        constants.srcHeight = static_cast<int32_t>(srcExtent.height);
+        constants.dstWidth = static_cast<int32_t>(dstExtent.width);
+        constants.dstHeight = static_cast<int32_t>(dstExtent.height);
+        constants.sampleCount = static_cast<int32_t>(m_DepthSamples);
+        vkCmdPushConstants(commandBuffer, level == 0 ? m_DepthReduceLayout : m_ReduceLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(constants), &constants);
+
+        vkCmdDispatch(commandBuffer, (dstExtent.width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+            (dstExtent.height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+
+        // The next level reads this one
+        ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        srcExtent = dstExtent;
+    }
+
+    // Back to an attachment for the phase 2 draws, which load the depth of phase 1
+    depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
+
+VkPipelineLayout OcclusionCuller::CreatePipelineLayout(VkDescriptorSetLayout setLayout, uint32_t pushConstantSize) const
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = pushConstantSize;
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &setLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(m_Device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create occlusion culling pipeline layout!");
+    }
+    return layout;
+}
+
+VkPipeline OcclusionCuller::CreateComputePipeline(const std::vector<char>& code, VkPipelineLayout layout) const
+{
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule module;
+    if (vkCreateShaderModule(m_Device, &moduleInfo, nullptr, &module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create occlusion culling shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    const VkResult result = vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(m_Device, module, nullptr);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create occlusion culling pipeline!");
+    }
+    return pipeline;
+}
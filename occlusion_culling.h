@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "descriptor_allocator.h"
+
+// Per-object input of the culling shader (std430), written every frame into the frame allocator
+struct OcclusionCullObject
+{
+    glm::vec4 sphere;       // world-space center and radius
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+};
+
+// Counted by the culling shader, read back once the frame has finished
+struct OcclusionCullingStats
+{
+    uint32_t objects = 0;
+    uint32_t frustumCulled = 0;
+    uint32_t phase1Visible = 0;     // drawn in the first pass, tested against the pyramid of the previous frame
+    uint32_t phase2Visible = 0;     // rejected in phase 1, but visible against the pyramid of the current frame
+};
+
+struct OcclusionCullingShaders
+{
+    std::vector<char> depthReduce;      // hiz_depth.comp: depth attachment -> pyramid level 0
+    std::vector<char> depthReduceMs;    // same, multisampled depth attachment
+    std::vector<char> pyramidReduce;    // hiz_reduce.comp: level i-1 -> level i
+    std::vector<char> cull;             // occlusion_cull.comp
+};
+
+/*
+    Two-phase hierarchical-Z occlusion culling.
+
+    The depth pyramid is a min/max mip chain (R32G32_SFLOAT) of the depth attachment, built in compute.
+    Each object is projected to a screen-space rectangle and a depth, the pyramid level where the rectangle
+    covers at most 2x2 texels is sampled at its corners, and the object is hidden when it is behind the
+    farthest depth of all four.
+
+    Every frame:
+        phase 1: test all objects against the pyramid built during the previous frame, draw the visible ones
+        build the pyramid from the depth of the phase 1 draws
+        phase 2: test again the objects rejected by phase 1 against the new pyramid, draw the ones that are visible now
+
+    Phase 1 uses an outdated pyramid, phase 2 catches its mistakes: objects that became visible are still drawn
+    in the same frame, only one frame late objects would otherwise pop in. The pyramid of the next frame is the one
+    built here, it misses the phase 2 objects, which can only make it less occluding.
+
+    The results are VkDrawIndexedIndirectCommand, one per object and phase, with instanceCount 0 for the culled
+    objects, so hidden draws are skipped by the GPU without a CPU round trip.
+*/
+class OcclusionCuller
+{
+public:
+    static const uint32_t PHASE_COUNT = 2;
+
+    void Init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, uint32_t maxObjects,
+        const OcclusionCullingShaders& shaders);
+    void Destroy();
+
+    // Depth attachment with VK_IMAGE_USAGE_SAMPLED_BIT and a depth-only view, call again after every resize
+    void CreateDepthPyramid(VkImage depthImage, VkImageView depthView, VkImageAspectFlags depthAspects,
+        VkSampleCountFlagBits samples, VkExtent2D extent);
+    void DestroyDepthPyramid();
+
+    // Call after waiting on the in-flight fence of frameIdx: the statistics this frame slot counted last time
+    OcclusionCullingStats ReadStats(uint32_t frameIdx) const;
+
+    /*
+    Outside of a render pass. objectCount OcclusionCullObject start at objectOffset in objectBuffer, which must be
+    aligned to minStorageBufferOffsetAlignment. The descriptor set is allocated from frameDescriptors.
+    */
+    void RecordCull(VkCommandBuffer commandBuffer, DescriptorAllocator& frameDescriptors, uint32_t frameIdx, uint32_t phase,
+        VkBuffer objectBuffer, VkDeviceSize objectOffset, uint32_t objectCount, const glm::mat4& viewProj);
+    // Between the two phases, the depth attachment is in DEPTH_STENCIL_ATTACHMENT_OPTIMAL before and after
+    void RecordDepthPyramid(VkCommandBuffer commandBuffer);
+
+    VkBuffer GetDrawCommandBuffer() const { return m_DrawCommandBuffer; }
+    VkDeviceSize GetDrawCommandOffset(uint32_t phase, uint32_t object) const
+    {
+        return (static_cast<VkDeviceSize>(phase) * m_MaxObjects + object) * sizeof(VkDrawIndexedIndirectCommand);
+    }
+
+    // Device requirements: sampling the depth format with the MSAA sample count, storage R32G32_SFLOAT images
+    static bool IsSupported(VkPhysicalDevice physicalDevice, VkFormat depthFormat, VkSampleCountFlagBits samples);
+
+private:
+    VkPipeline CreateComputePipeline(const std::vector<char>& code, VkPipelineLayout layout) const;
+    VkPipelineLayout CreatePipelineLayout(VkDescriptorSetLayout setLayout, uint32_t pushConstantSize) const;
+
+    VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+    VkDevice m_Device = VK_NULL_HANDLE;
+    uint32_t m_FramesInFlight = 0;
+    uint32_t m_MaxObjects = 0;
+
+    // Pipelines: depth -> level 0, level -> level, culling
+    VkDescriptorSetLayout m_ReduceSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_DepthReduceSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_CullSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_ReduceLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_DepthReduceLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_CullLayout = VK_NULL_HANDLE;
+    VkPipeline m_DepthReducePipeline = VK_NULL_HANDLE;
+    VkPipeline m_DepthReduceMsPipeline = VK_NULL_HANDLE;
+    VkPipeline m_ReducePipeline = VK_NULL_HANDLE;
+    VkPipeline m_CullPipeline = VK_NULL_HANDLE;
+    VkSampler m_Sampler = VK_NULL_HANDLE;   // nearest, clamped
+
+    // phase * maxObjects + object
+    VkBuffer m_DrawCommandBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_DrawCommandMemory = VK_NULL_HANDLE;
+
+    // One OcclusionCullingStats per frame in flight, persistently mapped
+    VkBuffer m_StatsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_StatsMemory = VK_NULL_HANDLE;
+    const OcclusionCullingStats* m_MappedStats = nullptr;
+
+    // Depth pyramid, recreated with the swap chain. Always in VK_IMAGE_LAYOUT_GENERAL.
+    VkImage m_DepthImage = VK_NULL_HANDLE;
+    VkImageAspectFlags m_DepthAspects = 0;
+    VkSampleCountFlagBits m_DepthSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkExtent2D m_DepthExtent{};
+    VkImage m_PyramidImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_PyramidMemory = VK_NULL_HANDLE;
+    VkImageView m_PyramidView = VK_NULL_HANDLE;                 // every level, sampled by the culling shader
+    std::vector<VkImageView> m_PyramidLevelViews;               // one level each, storage images of the reductions
+    std::vector<VkExtent2D> m_PyramidLevelExtents;
+    bool m_PyramidNeedsClear = false;   // a new pyramid holds no occluders until its first build
+
+    // Sets of the reductions reference the depth and pyramid views, reset with them
+    DescriptorAllocator m_DescriptorAllocator;
+    std::vector<VkDescriptorSet> m_ReduceSets;   // per level, level 0 reads the depth attachment
+};
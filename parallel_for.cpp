@@ -0,0 +1,13 @@
+#include "parallel_for.h"
+
+#include "job_system.h"
+
+void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& function)
+{
+    JobSystem::GetCurrent().ParallelFor(count, batchSize, function);
+}
+
+uint32_t GetParallelForThreadCount()
+{
+    return JobSystem::GetCurrent().GetThreadCount();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/*
+    Splits [0, count) into batches of batchSize items and runs them as jobs of the job system (job_system.h).
+    The calling thread takes batches too and returns once all of them are done.
+
+    The workers are started on first use (one per hardware thread minus the caller by default) and live until exit,
+    so a call costs a wake-up, not a thread creation. Nested calls, from a batch or any other job, split their work
+    over the workers as well: the waiting thread runs the queued jobs instead of blocking one of them.
+*/
+void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& function);
+
+// Threads used by ParallelFor, the caller included: those of the job system running the current job, the global one otherwise
+uint32_t GetParallelForThreadCount();
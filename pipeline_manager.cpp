@@ -0,0 +1,150 @@
+#include "pipeline_manager.h"
+
+#include <exception>
+
+void PipelineManager::Start(VkDevice device, uint32_t threadCount)
+{
+    Stop();
+
+    m_Device = device;
+    m_Exit = false;
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_Threads.emplace_back(&PipelineManager::ThreadMain, this);
+    }
+}
+
+void PipelineManager::Stop()
+{
+    if (m_Threads.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Exit = true;
+        // Dropped before the device goes away: the jobs may hold objects that are destroyed with them
+        m_Queue.clear();
+    }
+    m_WakeUp.notify_all();
+    for (std::thread& thread : m_Threads)
+    {
+        thread.join();
+    }
+    m_Threads.clear();
+
+    for (const Result& result : m_Results)
+    {
+        vkDestroyPipeline(m_Device, result.pipeline, nullptr);
+    }
+    m_Results.clear();
+    m_Pending.clear();
+}
+
+bool PipelineManager::Request(uint64_t key, BuildFunction build)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Pending.count(key) != 0)
+        {
+            return false;
+        }
+        m_Pending[key] = m_Generation;
+        m_Queue.push_back({ key, m_Generation, std::move(build) });
+    }
+    m_WakeUp.notify_one();
+    return true;
+}
+
+bool PipelineManager::IsPending(uint64_t key) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Pending.count(key) != 0;
+}
+
+void PipelineManager::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Idle.wait(lock, [this]() { return m_Queue.empty() && m_RunningJobs == 0; });
+}
+
+void PipelineManager::Invalidate()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Generation;
+    m_Pending.clear();
+
+    // Not taken yet, so not in use: built from the old sources all the same
+    for (const Result& result : m_Results)
+    {
+        vkDestroyPipeline(m_Device, result.pipeline, nullptr);
+    }
+    m_Results.clear();
+}
+
+std::vector<PipelineManager::Result> PipelineManager::TakeResults()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<Result> results;
+    results.swap(m_Results);
+    return results;
+}
+
+void PipelineManager::Publish(const Job& job, VkPipeline pipeline, bool optimized, const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (job.generation != m_Generation)
+    {
+        vkDestroyPipeline(m_Device, pipeline, nullptr);
+        return;
+    }
+
+    Result result;
+    result.key = job.key;
+    result.pipeline = pipeline;
+    result.optimized = optimized;
+    result.error = error;
+    m_Results.push_back(result);
+}
+
+void PipelineManager::ThreadMain()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WakeUp.wait(lock, [this]() { return m_Exit || !m_Queue.empty(); });
+            if (m_Exit)
+            {
+                return;
+            }
+            job = std::move(m_Queue.front());
+            m_Queue.pop_front();
+            ++m_RunningJobs;
+        }
+
+        try
+        {
+            job.build([&](VkPipeline pipeline, bool optimized) { Publish(job, pipeline, optimized, std::string()); });
+        }
+        catch (const std::exception& e)
+        {
+            Publish(job, VK_NULL_HANDLE, true, e.what());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            auto pending = m_Pending.find(job.key);
+            if (pending != m_Pending.end() && pending->second == job.generation)
+            {
+                m_Pending.erase(pending);
+            }
+            --m_RunningJobs;
+            // The job owns what it captured, released before anyone waiting for the pool goes on
+            job.build = nullptr;
+        }
+        m_Idle.notify_all();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Builds pipelines on a pool of worker threads, so a frame never waits for a driver compile.
+
+    A request is a key chosen by the caller and a job that creates the pipelines. The job may publish a quickly built
+    pipeline first (a fast-linked pipeline library) and the optimized one later: the caller draws with the first one
+    until the second replaces it. Results are collected once per frame with TakeResults, on the thread that draws.
+
+    Invalidate is for the sources changing under the requests in flight (hot reload): what they still publish is
+    destroyed instead of returned, and their keys can be requested again right away.
+*/
+class PipelineManager
+{
+public:
+    struct Result
+    {
+        uint64_t key = 0;
+        VkPipeline pipeline = VK_NULL_HANDLE;   // VK_NULL_HANDLE if the job failed
+        bool optimized = false;                 // the last result of its request
+        std::string error;                      // what the job threw
+    };
+
+    // Called by the job for each pipeline it built, optimized for the last one
+    using PublishFunction = std::function<void(VkPipeline pipeline, bool optimized)>;
+    using BuildFunction = std::function<void(const PublishFunction& publish)>;
+
+    ~PipelineManager() { Stop(); }
+
+    void Start(VkDevice device, uint32_t threadCount);
+    // Waits for the running jobs, drops the queued ones and destroys the results nobody took
+    void Stop();
+
+    // False if the key is already being built
+    bool Request(uint64_t key, BuildFunction build);
+    bool IsPending(uint64_t key) const;
+    // Blocks until every queued and running job is done, for the state the jobs read to change (swap chain)
+    void WaitIdle();
+    void Invalidate();
+
+    // The pipelines published since the last call, oldest first
+    std::vector<Result> TakeResults();
+
+private:
+    struct Job
+    {
+        uint64_t key;
+        uint32_t generation;
+        BuildFunction build;
+    };
+
+    void ThreadMain();
+    void Publish(const Job& job, VkPipeline pipeline, bool optimized, const std::string& error);
+
+    VkDevice m_Device = VK_NULL_HANDLE;
+    std::vector<std::thread> m_Threads;
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    std::condition_variable m_Idle;
+    std::deque<Job> m_Queue;
+    std::map<uint64_t, uint32_t> m_Pending;     // key of every queued or running request, with its generation
+    std::vector<Result> m_Results;
+    uint32_t m_Generation = 0;
+    uint32_t m_RunningJobs = 0;
+    bool m_Exit = false;
+};
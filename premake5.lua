@@ -1,3 +1,15 @@
+newoption
+{
+    trigger = "avx2",
+    description = "Build the SIMD kernels (simd.h) with AVX2 and FMA instead of SSE2, the binaries then need an AVX2 CPU"
+}
+
+newoption
+{
+    trigger = "hot-reload",
+    description = "Build in the GLSL compiler of --hot-reload and --permutation-defines, links shaderc_shared from the Vulkan SDK"
+}
+
 workspace "VulkanPlayground"
     location "Compiler"
 
@@ -26,6 +38,7 @@ project "VulkanPlayground"
     removefiles
     {
         "externals/**",
+        "Benchmarks/**",
     }
 
     includedirs
@@ -51,6 +64,75 @@ project "VulkanPlayground"
             "PLATFORM_WINDOWS"
         }
 
+    -- shaderc_shared: the in-process GLSL compiler, part of the Vulkan SDK
+    filter "options:hot-reload"
+        defines "SHADER_HOT_RELOAD"
+        links { "shaderc_shared" }
+
+    filter "options:avx2"
+        vectorextensions "AVX2"
+
+    filter { "options:avx2", "toolset:not msc*" }
+        buildoptions { "-mfma" }
+
+    filter "configurations:Debug"
+        defines "BUILD_DEBUG"
+        symbols "On"
+        targetsuffix ("_d")
+
+    filter "configurations:Release"
+        defines "BUILD_RELEASE"
+        optimize "On"
+
+-- CPU microbenchmarks: no Vulkan/GLFW calls, builds and runs without a GPU (premake5 gmake2 on Linux)
+project "VulkanPlaygroundBenchmarks"
+    language "C++"
+    cppdialect "C++17"
+    kind "ConsoleApp"
+    targetdir("build/")
+
+    objdir("temp/" .. outputdir .. "/%{prj.name}")
+
+    files
+    {
+        "Benchmarks/**.h", "Benchmarks/**.cpp",
+        "benchmark.h", "benchmark.cpp",
+        "file_utils.h", "file_utils.cpp",
+        "image_loader.h", "image_loader.cpp",
+        "image_writer.h", "image_writer.cpp",
+        "mesh_lod.h", "mesh_lod.cpp",
+        "meshlets.h", "meshlets.cpp",
+        "model_loader.h", "model_loader.cpp",
+        "parallel_for.h", "parallel_for.cpp",
+        "job_system.h", "job_system.cpp",
+        "render_queue.h", "render_queue.cpp",
+        "scene_uniforms.h", "scene_uniforms.cpp",
+        "simd.h",
+        "software_occlusion.h", "software_occlusion.cpp",
+        "bvh.h", "bvh.cpp",
+        "transform_system.h", "transform_system.cpp",
+        "vertex.h",
+    }
+
+    includedirs
+    {
+        "externals/stb/",
+        "externals/glm/",
+        "externals/tinyobjloader/"
+    }
+
+    filter "system:windows"
+        systemversion "latest"
+
+    filter "system:linux"
+        links { "pthread" }
+
+    filter "options:avx2"
+        vectorextensions "AVX2"
+
+    filter { "options:avx2", "toolset:not msc*" }
+        buildoptions { "-mfma" }
+
     filter "configurations:Debug"
         defines "BUILD_DEBUG"
         symbols "On"
@@ -58,4 +140,4 @@ project "VulkanPlayground"
 
     filter "configurations:Release"
         defines "BUILD_RELEASE"
-        optimize "On"
\ No newline at end of file
+        optimize "On"
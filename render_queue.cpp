@@ -0,0 +1,159 @@
+#include "render_queue.h"
+
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <array>
+
+// Below this the whole queue is sorted on the calling thread
+static const uint32_t RADIX_SORT_CHUNK_SIZE = 16384;
+
+static const uint32_t RADIX_BITS = 8;
+static const uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+static const uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+
+static uint64_t Field(uint32_t value, uint32_t bits)
+{
+    return value & ((1ull << bits) - 1);
+}
+
+uint32_t SortKey::QuantizeDepth(float viewDepth, float nearPlane, float farPlane)
+{
+    const float normalized = std::min(std::max((viewDepth - nearPlane) / (farPlane - nearPlane), 0.0f), 1.0f);
+    return static_cast<uint32_t>(normalized * ((1u << DEPTH_BITS) - 1));
+}
+
+uint64_t SortKey::MakeOpaque(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t quantizedDepth)
+{
+    uint64_t key = Field(pass, PASS_BITS);
+    key = (key << PIPELINE_BITS) | Field(pipeline, PIPELINE_BITS);
+    key = (key << MATERIAL_BITS) | Field(material, MATERIAL_BITS);
+    key = (key << MESH_BITS) | Field(mesh, MESH_BITS);
+    key = (key << DEPTH_BITS) | Field(quantizedDepth, DEPTH_BITS);
+    return key;
+}
+
+uint64_t SortKey::MakeTransparent(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t quantizedDepth)
+{
+    // Inverted depth: farthest first
+    uint64_t key = Field(pass, PASS_BITS);
+    key = (key << DEPTH_BITS) | Field(~quantizedDepth, DEPTH_BITS);
+    key = (key << PIPELINE_BITS) | Field(pipeline, PIPELINE_BITS);
+    key = (key << MATERIAL_BITS) | Field(material, MATERIAL_BITS);
+    key = (key << MESH_BITS) | Field(mesh, MESH_BITS);
+    return key;
+}
+
+RenderStateTracker::Changes RenderStateTracker::Apply(const DrawPacket& packet)
+{
+    Changes changes;
+    changes.pipeline = packet.pipeline != m_Pipeline;
+    changes.material = packet.material != m_Material;
+    changes.mesh = packet.mesh != m_Mesh;
+
+    m_Pipeline = packet.pipeline;
+    m_Material = packet.material;
+    m_Mesh = packet.mesh;
+
+    m_Stats.draws++;
+    m_Stats.pipelineBinds += changes.pipeline;
+    m_Stats.materialBinds += changes.material;
+    m_Stats.meshBinds += changes.mesh;
+
+    return changes;
+}
+
+void RenderQueue::Clear()
+{
+    m_Packets.clear();
+    m_Order.clear();
+}
+
+void RenderQueue::Sort(bool multithreaded)
+{
+    const uint32_t count = GetCount();
+
+    m_Order.resize(count);
+    m_Scratch.resize(count);
+
+    if (count < 2)
+    {
+        if (count == 1)
+        {
+            m_Order[0] = { m_Packets[0].sortKey, 0 };
+        }
+        return;
+    }
+
+    const uint32_t chunkCount = multithreaded ? std::max(1u, std::min(GetParallelForThreadCount() * 4, count / RADIX_SORT_CHUNK_SIZE)) : 1;
+    const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    // Fill the items, and find the bits that differ between keys
+    std::vector<uint64_t> chunkDifferences(chunkCount, 0);
+    const uint64_t firstKey = m_Packets[0].sortKey;
+
+    ParallelFor(count, chunkSize, [&](uint32_t begin, uint32_t end)
+        {
+            uint64_t differences = 0;
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const uint64_t key = m_Packets[i].sortKey;
+                m_Order[i] = { key, i };
+                differences |= key ^ firstKey;
+            }
+            chunkDifferences[begin / chunkSize] = differences;
+        });
+
+    uint64_t differences = 0;
+    for (uint64_t chunkDifference : chunkDifferences)
+    {
+        differences |= chunkDifference;
+    }
+
+    std::vector<std::array<uint32_t, RADIX_BUCKETS>> offsets(chunkCount);
+
+    for (uint32_t pass = 0; pass < RADIX_PASSES; ++pass)
+    {
+        const uint32_t shift = pass * RADIX_BITS;
+        if (((differences >> shift) & (RADIX_BUCKETS - 1)) == 0)
+        {
+            continue; // same digit everywhere, the pass wouldn't move anything
+        }
+
+        // Histogram of every chunk
+        ParallelFor(count, chunkSize, [&](uint32_t begin, uint32_t end)
+            {
+                std::array<uint32_t, RADIX_BUCKETS>& histogram = offsets[begin / chunkSize];
+                histogram.fill(0);
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    histogram[(m_Order[i].key >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+            });
+
+        // Exclusive prefix sum, digit major then chunk: chunk c writes digit d after every smaller digit
+        // and after the items with digit d of the chunks before it, which keeps the sort stable
+        uint32_t sum = 0;
+        for (uint32_t digit = 0; digit < RADIX_BUCKETS; ++digit)
+        {
+            for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                const uint32_t bucketCount = offsets[chunk][digit];
+                offsets[chunk][digit] = sum;
+                sum += bucketCount;
+            }
+        }
+
+        ParallelFor(count, chunkSize, [&](uint32_t begin, uint32_t end)
+            {
+                std::array<uint32_t, RADIX_BUCKETS>& offset = offsets[begin / chunkSize];
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    const SortItem& item = m_Order[i];
+                    m_Scratch[offset[(item.key >> shift) & (RADIX_BUCKETS - 1)]++] = item;
+                }
+            });
+
+        m_Order.swap(m_Scratch);
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+    64-bit draw sort key, most significant bits first:
+
+        opaque:       pass (4) | pipeline (10) | material (14) | mesh (12) | depth (24, front to back)
+        transparent:  pass (4) | depth (24, back to front) | pipeline (10) | material (14) | mesh (12)
+
+    Sorting the keys in ascending order groups opaque draws by pipeline, then material, then mesh, so each state
+    is bound once per group, and draws sharing all state are front to back, which lets early depth testing reject
+    hidden fragments. Transparent draws need back to front blending order first and state grouping second.
+*/
+namespace SortKey
+{
+    const uint32_t PASS_BITS = 4;
+    const uint32_t PIPELINE_BITS = 10;
+    const uint32_t MATERIAL_BITS = 14;
+    const uint32_t MESH_BITS = 12;
+    const uint32_t DEPTH_BITS = 24;
+
+    // View depth mapped linearly from [nearPlane, farPlane] to [0, 2^DEPTH_BITS - 1], clamped
+    uint32_t QuantizeDepth(float viewDepth, float nearPlane, float farPlane);
+
+    uint64_t MakeOpaque(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t quantizedDepth);
+    uint64_t MakeTransparent(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t quantizedDepth);
+}
+
+// One draw, the ids index the renderer's own pipeline/material/mesh/object tables
+struct DrawPacket
+{
+    uint64_t sortKey;
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t mesh;
+    uint32_t object;
+    uint32_t lod;       // index range of the mesh, doesn't change any binding
+};
+
+struct RenderQueueStats
+{
+    uint32_t draws = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t materialBinds = 0;     // descriptor sets
+    uint32_t meshBinds = 0;         // vertex + index buffers
+};
+
+// Walks packets in submission order and tells which state has to be bound before each one
+class RenderStateTracker
+{
+public:
+    struct Changes
+    {
+        bool pipeline;
+        bool material;
+        bool mesh;
+    };
+
+    Changes Apply(const DrawPacket& packet);
+
+    const RenderQueueStats& GetStats() const { return m_Stats; }
+
+private:
+    static const uint32_t NONE = ~0u;
+
+    uint32_t m_Pipeline = NONE;
+    uint32_t m_Material = NONE;
+    uint32_t m_Mesh = NONE;
+    RenderQueueStats m_Stats;
+};
+
+/*
+    Per-frame list of draw packets, sorted by key before recording.
+
+    The sort is an LSD radix sort, 8 bits per pass, stable. Digits that are equal in every key (typically the pass,
+    and the pipeline in small scenes) are detected up front and their pass skipped. Large queues are split into
+    contiguous chunks sorted by ParallelFor workers: per-chunk histograms, a prefix sum over (digit, chunk),
+    then every chunk scatters its items to their final position of that pass.
+*/
+class RenderQueue
+{
+public:
+    void Clear();
+    void Add(const DrawPacket& packet) { m_Packets.push_back(packet); }
+
+    void Sort(bool multithreaded = true);
+
+    uint32_t GetCount() const { return static_cast<uint32_t>(m_Packets.size()); }
+
+    // Valid after Sort, until the next Clear/Add
+    const DrawPacket& GetSorted(uint32_t i) const { return m_Packets[m_Order[i].index]; }
+
+private:
+    struct SortItem
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DrawPacket> m_Packets;
+    std::vector<SortItem> m_Order;
+    std::vector<SortItem> m_Scratch;
+};
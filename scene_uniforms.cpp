@@ -0,0 +1,51 @@
+#include "scene_uniforms.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+UniformBufferObject BuildUniformBufferObject(const glm::vec3& eye, const glm::vec3& target, float aspectRatio)
+{
+    const glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 0.0f, 1.0f));
+
+    glm::mat4 proj = glm::perspective(CAMERA_VERTICAL_FOV, aspectRatio, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+
+    proj[1][1] *= -1;
+    /*
+    GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted.
+    The easiest way to compensate for that is to flip the sign on the scaling factor of the Y axis in the projection matrix.
+    If you don't do this, then the image will be rendered upside down.
+    */
+
+    // Multiplied once here instead of once per vertex in the shader
+    UniformBufferObject ubo{};
+    ubo.viewProj = proj * view;
+    return ubo;
+}
+
+glm::mat4 BuildOrbitCullViewProj(const glm::vec3& eye, const glm::vec3& target, float aspectRatio, float maxAngle)
+{
+    // Half angle of the cone through the corners of the frustum; a very wide window stops short of a half space
+    const float coneAngle = std::atan(std::tan(CAMERA_VERTICAL_FOV * 0.5f) * std::sqrt(1.0f + aspectRatio * aspectRatio));
+    const float halfAngle = std::min(coneAngle + maxAngle, 1.5f);
+
+    // The orbiting eyes are within a chord of eye: that ball is inside the cone when its apex is pullBack behind eye
+    const glm::vec3 forward = glm::normalize(target - eye);
+    const float chord = 2.0f * glm::length(target - eye) * std::sin(maxAngle * 0.5f);
+    const float pullBack = chord / std::sin(halfAngle);
+
+    // A point of an orbiting frustum is at least CAMERA_NEAR_PLANE from its eye, at most halfAngle off forward
+    const float nearPlane = pullBack - chord + CAMERA_NEAR_PLANE * std::cos(halfAngle);
+    const float farPlane = pullBack + chord + CAMERA_FAR_PLANE / std::cos(coneAngle);
+
+    glm::mat4 proj = glm::perspective(2.0f * halfAngle, 1.0f, nearPlane, farPlane);
+    proj[1][1] *= -1;
+    return proj * glm::lookAt(eye - forward * pullBack, target, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+float GetProjectionPixelScale(float viewportHeight)
+{
+    // proj[1][1] maps a unit at distance 1 to clip space, half the viewport spans one clip space unit
+    return 0.5f * viewportHeight / std::tan(CAMERA_VERTICAL_FOV * 0.5f);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+const float CAMERA_NEAR_PLANE = 0.1f;
+const float CAMERA_FAR_PLANE = 10.0f;
+const float CAMERA_VERTICAL_FOV = 0.785398163f;     // 45 degrees
+
+// Per-frame data, written once per frame and shared by every object (binding 0)
+struct UniformBufferObject
+{
+    alignas(16) glm::mat4 viewProj;
+};
+
+/*
+    Per-object data, recorded in the command buffer with vkCmdPushConstants right before the draw.
+    No buffer write and no descriptor update per object. 64 bytes, well within the 128 bytes
+    every implementation guarantees (maxPushConstantsSize).
+*/
+struct ObjectPushConstants
+{
+    alignas(16) glm::mat4 model;
+};
+
+// --geometry-pool: the same, plus the VkDeviceAddress of the vertices when the shaders pull them through a pointer
+struct PulledObjectPushConstants
+{
+    alignas(16) glm::mat4 model;
+    uint64_t vertices;
+};
+
+// Camera looking at target with Z up, Vulkan clip space
+UniformBufferObject BuildUniformBufferObject(const glm::vec3& eye, const glm::vec3& target, float aspectRatio);
+
+/*
+    Frustum holding the one of BuildUniformBufferObject for every eye that orbits target at the distance of eye with a
+    view direction at most maxAngle radians away: a square field of view around the cone through the frustum corners,
+    widened by maxAngle, from an eye pulled back far enough for the orbiting eyes to stay inside. For culling before
+    the camera is final (late latching).
+*/
+glm::mat4 BuildOrbitCullViewProj(const glm::vec3& eye, const glm::vec3& target, float aspectRatio, float maxAngle);
+
+// Size in pixels of one world unit seen from a distance of 1, with the projection of BuildUniformBufferObject
+float GetProjectionPixelScale(float viewportHeight);
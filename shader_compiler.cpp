@@ -0,0 +1,144 @@
+#include "shader_compiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Keep in sync with compile_shaders.bat, which builds the same files ahead of time
+static const ShaderSource SHADER_SOURCES[] =
+{
+    { "vert.spv", "shader.vert", {} },
+    { "frag.spv", "shader.frag", {} },
+    { "depth_prepass_vert.spv", "depth_prepass.vert", {} },
+    { "vertex_pull_vert.spv", "vertex_pull.vert", {} },
+    { "vertex_pull_bda_vert.spv", "vertex_pull.vert", { "BUFFER_DEVICE_ADDRESS" } },
+    { "depth_prepass_pull_vert.spv", "vertex_pull.vert", { "DEPTH_PREPASS" } },
+    { "depth_prepass_pull_bda_vert.spv", "vertex_pull.vert", { "DEPTH_PREPASS", "BUFFER_DEVICE_ADDRESS" } },
+    { "hiz_depth_comp.spv", "hiz_depth.comp", {} },
+    { "hiz_depth_ms_comp.spv", "hiz_depth.comp", { "MULTISAMPLED" } },
+    { "hiz_reduce_comp.spv", "hiz_reduce.comp", {} },
+    { "occlusion_cull_comp.spv", "occlusion_cull.comp", {} },
+    { "meshlet_cull_comp.spv", "meshlet_cull.comp", {} },
+    { "meshlet_task.spv", "meshlet.task", {}, true },
+    { "meshlet_mesh.spv", "meshlet.mesh", {}, true },
+};
+
+const ShaderSource& FindShaderSource(const std::string& spirvFile)
+{
+    for (const ShaderSource& source : SHADER_SOURCES)
+    {
+        if (spirvFile == source.spirvFile)
+        {
+            return source;
+        }
+    }
+    throw std::runtime_error("unknown shader " + spirvFile + "!");
+}
+
+std::vector<std::string> GetShaderSourceFiles()
+{
+    std::vector<std::string> files;
+    for (const ShaderSource& source : SHADER_SOURCES)
+    {
+        if (std::find(files.begin(), files.end(), source.sourceFile) == files.end())
+        {
+            files.push_back(source.sourceFile);
+        }
+    }
+    return files;
+}
+
+bool ShaderCompiler::IsAvailable()
+{
+#ifdef SHADER_HOT_RELOAD
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef SHADER_HOT_RELOAD
+// Same mapping as glslc: the stage is the extension of the file
+static shaderc_shader_kind GetShaderKind(const std::string& sourceFile)
+{
+    const std::string extension = sourceFile.substr(sourceFile.find_last_of('.') + 1);
+    if (extension == "vert")
+    {
+        return shaderc_glsl_vertex_shader;
+    }
+    if (extension == "frag")
+    {
+        return shaderc_glsl_fragment_shader;
+    }
+    if (extension == "comp")
+    {
+        return shaderc_glsl_compute_shader;
+    }
+    if (extension == "task")
+    {
+        return shaderc_glsl_task_shader;
+    }
+    if (extension == "mesh")
+    {
+        return shaderc_glsl_mesh_shader;
+    }
+    throw std::runtime_error("unknown shader stage of " + sourceFile + "!");
+}
+
+static void AddDefine(shaderc::CompileOptions& options, const std::string& define)
+{
+    const size_t equals = define.find('=');
+    if (equals == std::string::npos)
+    {
+        options.AddMacroDefinition(define);
+    }
+    else
+    {
+        options.AddMacroDefinition(define.substr(0, equals), define.substr(equals + 1));
+    }
+}
+
+std::vector<char> ShaderCompiler::Compile(const std::vector<char>& glsl, const ShaderSource& source,
+    const std::vector<std::string>& extraDefines, bool optimize) const
+{
+    shaderc::CompileOptions options;
+    for (const std::string& define : source.defines)
+    {
+        AddDefine(options, define);
+    }
+    for (const std::string& define : extraDefines)
+    {
+        AddDefine(options, define);
+    }
+    if (source.spirv14)
+    {
+        options.SetTargetSpirv(shaderc_spirv_version_1_4);
+    }
+    if (optimize)
+    {
+        options.SetOptimizationLevel(shaderc_optimization_level_performance);
+    }
+
+    const shaderc::SpvCompilationResult result = m_Compiler.CompileGlslToSpv(glsl.data(), glsl.size(),
+        GetShaderKind(source.sourceFile), source.sourceFile, options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+        throw std::runtime_error("failed to compile " + std::string(source.spirvFile) + ":\n" + result.GetErrorMessage());
+    }
+
+    // Same bytes as the .spv file glslc writes, so it goes through CreateShaderModule unchanged
+    const size_t size = (result.cend() - result.cbegin()) * sizeof(uint32_t);
+    std::vector<char> spirv(size);
+    if (size > 0)
+    {
+        std::memcpy(spirv.data(), result.cbegin(), size);
+    }
+    return spirv;
+}
+#else
+std::vector<char> ShaderCompiler::Compile(const std::vector<char>&, const ShaderSource& source,
+    const std::vector<std::string>&, bool) const
+{
+    throw std::runtime_error("failed to compile " + std::string(source.spirvFile) + ": built without the GLSL compiler (premake5 --hot-reload)!");
+}
+#endif
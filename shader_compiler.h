@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// SHADER_HOT_RELOAD: built with libshaderc (premake5 --hot-reload), otherwise the compiler only throws
+#ifdef SHADER_HOT_RELOAD
+#include <shaderc/shaderc.hpp>
+#endif
+
+// A SPIR-V file read by the application and the GLSL it is built from, one line of compile_shaders.bat
+struct ShaderSource
+{
+    const char* spirvFile;              // in the shader directory, e.g. "vert.spv"
+    const char* sourceFile;             // same directory, the stage comes from the extension
+    std::vector<std::string> defines;   // -D, NAME or NAME=VALUE
+    bool spirv14 = false;               // --target-spv=spv1.4, for the mesh shading stages
+};
+
+// Every SPIR-V file the application can load, throws std::runtime_error for an unknown one
+const ShaderSource& FindShaderSource(const std::string& spirvFile);
+
+// The GLSL files of the table, each once
+std::vector<std::string> GetShaderSourceFiles();
+
+/*
+    GLSL to SPIR-V in-process, through libshaderc (shipped with the Vulkan SDK): the same compiler and defaults as glslc.
+    A compiler can be used by one thread at a time, create one per thread.
+    Without SHADER_HOT_RELOAD the application is not linked with libshaderc and Compile always throws.
+*/
+class ShaderCompiler
+{
+public:
+    /*
+    Compiles glsl, the contents of source.sourceFile, with the defines of source and extraDefines (permutations).
+    optimize runs the SPIR-V optimizer (glslc -O), which removes the code of branches on constants: glslang keeps it.
+    Throws std::runtime_error with the compiler messages on failure.
+    */
+    std::vector<char> Compile(const std::vector<char>& glsl, const ShaderSource& source,
+        const std::vector<std::string>& extraDefines = {}, bool optimize = false) const;
+
+    // False when built without SHADER_HOT_RELOAD
+    static bool IsAvailable();
+
+private:
+#ifdef SHADER_HOT_RELOAD
+    shaderc::Compiler m_Compiler;
+#endif
+};
@@ -0,0 +1,143 @@
+#include "shader_permutations.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "file_utils.h"
+
+static const char* const SHADING_FEATURE_NAMES[SHADING_FEATURE_COUNT] = { "uv", "repeat", "color" };
+
+uint32_t ParseShadingFeatures(const std::string& names)
+{
+    uint32_t features = 0;
+    if (names == "none")
+    {
+        return features;
+    }
+
+    size_t begin = 0;
+    while (begin <= names.size())
+    {
+        const size_t end = std::min(names.find(',', begin), names.size());
+        const std::string name = names.substr(begin, end - begin);
+
+        uint32_t feature = 0;
+        while (feature < SHADING_FEATURE_COUNT && name != SHADING_FEATURE_NAMES[feature])
+        {
+            ++feature;
+        }
+        if (feature == SHADING_FEATURE_COUNT)
+        {
+            throw std::runtime_error("unknown shading feature " + name + ", expected uv, repeat, color or none");
+        }
+        features |= 1u << feature;
+
+        begin = end + 1;
+    }
+    return features;
+}
+
+std::string GetShadingFeatureNames(uint32_t features)
+{
+    std::string names;
+    for (uint32_t feature = 0; feature < SHADING_FEATURE_COUNT; ++feature)
+    {
+        if (features & (1u << feature))
+        {
+            names += (names.empty() ? "" : ",") + std::string(SHADING_FEATURE_NAMES[feature]);
+        }
+    }
+    return names.empty() ? "none" : names;
+}
+
+// FNV-1a: unlike std::hash the value is the same on every run, the keys name the files of the disk cache
+static void HashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+static void HashString(uint64_t& hash, const std::string& string)
+{
+    // The terminator too, so that { "AB", "C" } and { "A", "BC" } differ
+    HashBytes(hash, string.c_str(), string.size() + 1);
+}
+
+void SpirvCache::Init(const std::string& shaderDirectory, const std::string& cacheDirectory)
+{
+    m_ShaderDirectory = shaderDirectory;
+    m_CacheDirectory = cacheDirectory;
+
+    // Without the directory the cache still works in memory, the compiles are just not kept for the next run
+    std::error_code error;
+    std::filesystem::create_directories(m_CacheDirectory, error);
+}
+
+std::vector<char> SpirvCache::Get(const ShaderSource& source, const std::vector<std::string>& extraDefines, bool optimize)
+{
+    std::vector<char> glsl;
+    ReadFile(m_ShaderDirectory + source.sourceFile, glsl);
+
+    uint64_t key = 14695981039346656037ull;
+    HashBytes(key, glsl.data(), glsl.size());
+    HashString(key, source.sourceFile);
+    for (const std::string& define : source.defines)
+    {
+        HashString(key, define);
+    }
+    for (const std::string& define : extraDefines)
+    {
+        HashString(key, define);
+    }
+    const uint8_t options[] = { static_cast<uint8_t>(source.spirv14), static_cast<uint8_t>(optimize) };
+    HashBytes(key, options, sizeof(options));
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto entry = m_Entries.find(key);
+    if (entry != m_Entries.end())
+    {
+        ++m_Stats.memoryHits;
+        return entry->second;
+    }
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx.spv", static_cast<unsigned long long>(key));
+    const std::string cachePath = m_CacheDirectory + fileName;
+
+    std::vector<char> spirv;
+    std::error_code error;
+    if (std::filesystem::exists(cachePath, error))
+    {
+        ReadFile(cachePath, spirv);
+        ++m_Stats.diskHits;
+    }
+    else
+    {
+        spirv = m_Compiler.Compile(glsl, source, extraDefines, optimize);
+        ++m_Stats.compiles;
+
+        // Written next to the final name first, so another run never reads a partial file
+        const std::string temporaryPath = cachePath + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary);
+            file.write(spirv.data(), spirv.size());
+        }
+        std::filesystem::rename(temporaryPath, cachePath, error);
+    }
+
+    m_Entries.emplace(key, spirv);
+    return spirv;
+}
+
+SpirvCache::Stats SpirvCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader_compiler.h"
+
+/*
+    Feature flags of shader.frag, one bit each: a permutation of the shader is a combination of them.
+    The fragment shader tests the bits of a mask which is either a specialization constant, set when the pipeline is
+    created (one SPIR-V for every permutation, the driver folds the branches), or a define (one SPIR-V per permutation,
+    the optimizer removes the disabled code before the driver sees it).
+*/
+enum ShadingFeature : uint32_t
+{
+    SHADING_FEATURE_UV_DEBUG = 1 << 0,      // output the texture coordinates as colors
+    SHADING_FEATURE_REPEAT = 1 << 1,        // texture coordinates scaled by 2, shows the sampler addressing mode
+    SHADING_FEATURE_VERTEX_COLOR = 1 << 2,  // texture modulated by the vertex color
+};
+static const uint32_t SHADING_FEATURE_COUNT = 3;
+
+// constant_id of the feature mask in shader.frag, and the define that replaces it
+static const uint32_t SHADING_FEATURES_CONSTANT_ID = 0;
+static const char* const SHADING_FEATURES_DEFINE = "FEATURES";
+
+// "uv,repeat,color" or "none", throws std::runtime_error on an unknown name
+uint32_t ParseShadingFeatures(const std::string& names);
+// The reverse, for the logs
+std::string GetShadingFeatureNames(uint32_t features);
+
+/*
+    SPIR-V of the shaders, compiled from their GLSL on first use and kept in memory and in cacheDirectory.
+
+    The key is a hash of the GLSL source, the defines and the options, so an edited shader or another permutation
+    gets a new entry and a stale one is never returned: nothing has to be invalidated, outdated files are just never
+    read again. The source is read again on every Get to hash it, which is what makes the hot reload pick up an edit.
+    Thread safe, one lock for the lookups and the compiles.
+*/
+class SpirvCache
+{
+public:
+    struct Stats
+    {
+        uint32_t memoryHits = 0;
+        uint32_t diskHits = 0;
+        uint32_t compiles = 0;
+    };
+
+    void Init(const std::string& shaderDirectory, const std::string& cacheDirectory);
+
+    // Throws std::runtime_error if the source can't be read or compiled
+    std::vector<char> Get(const ShaderSource& source, const std::vector<std::string>& extraDefines = {}, bool optimize = false);
+
+    Stats GetStats() const;
+
+private:
+    std::string m_ShaderDirectory;
+    std::string m_CacheDirectory;
+
+    mutable std::mutex m_Mutex;
+    ShaderCompiler m_Compiler;
+    std::unordered_map<uint64_t, std::vector<char>> m_Entries;
+    Stats m_Stats;
+};
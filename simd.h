@@ -0,0 +1,161 @@
+#pragma once
+
+/*
+    Thin wrapper over the widest float SIMD instruction set the compiler targets, for SoA kernels.
+
+    SimdFloat holds SIMD_WIDTH floats: 8 with AVX2 (build with /arch:AVX2 or -mavx2 -mfma,
+    see the premake --avx2 option), 4 with NEON or SSE2, 1 otherwise. Kernels written against it
+    process SIMD_WIDTH items per iteration and handle the remainder with the same code at width 1
+    (SimdScalar), or with a scalar loop.
+*/
+
+#if defined(__AVX2__)
+    #define SIMD_AVX2 1
+    #include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    #define SIMD_NEON 1
+    #include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SIMD_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#if defined(SIMD_AVX2)
+
+static const uint32_t SIMD_WIDTH = 8;
+static const char* const SIMD_NAME = "AVX2";
+
+struct SimdFloat
+{
+    __m256 v;
+
+    static SimdFloat Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    static SimdFloat Set(float s) { return { _mm256_set1_ps(s) }; }
+    void Store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline SimdFloat Min(SimdFloat a, SimdFloat b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline SimdFloat Max(SimdFloat a, SimdFloat b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline SimdFloat Abs(SimdFloat a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+inline SimdFloat Sqrt(SimdFloat a) { return { _mm256_sqrt_ps(a.v) }; }
+// Bit i is set when lane i is negative (sign bit set, -0.0 included)
+inline uint32_t SignMask(SimdFloat a) { return static_cast<uint32_t>(_mm256_movemask_ps(a.v)); }
+// a * b + c
+inline SimdFloat MulAdd(SimdFloat a, SimdFloat b, SimdFloat c)
+{
+#if defined(__FMA__) || defined(_MSC_VER)
+    return { _mm256_fmadd_ps(a.v, b.v, c.v) };
+#else
+    return { _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v) };
+#endif
+}
+
+#elif defined(SIMD_NEON)
+
+static const uint32_t SIMD_WIDTH = 4;
+static const char* const SIMD_NAME = "NEON";
+
+struct SimdFloat
+{
+    float32x4_t v;
+
+    static SimdFloat Load(const float* p) { return { vld1q_f32(p) }; }
+    static SimdFloat Set(float s) { return { vdupq_n_f32(s) }; }
+    void Store(float* p) const { vst1q_f32(p, v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return { vaddq_f32(a.v, b.v) }; }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return { vsubq_f32(a.v, b.v) }; }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return { vmulq_f32(a.v, b.v) }; }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return { vdivq_f32(a.v, b.v) }; }
+inline SimdFloat Min(SimdFloat a, SimdFloat b) { return { vminq_f32(a.v, b.v) }; }
+inline SimdFloat Max(SimdFloat a, SimdFloat b) { return { vmaxq_f32(a.v, b.v) }; }
+inline SimdFloat Abs(SimdFloat a) { return { vabsq_f32(a.v) }; }
+inline SimdFloat Sqrt(SimdFloat a) { return { vsqrtq_f32(a.v) }; }
+inline uint32_t SignMask(SimdFloat a)
+{
+    const int32x4_t laneShifts = { 0, 1, 2, 3 };
+    return vaddvq_u32(vshlq_u32(vshrq_n_u32(vreinterpretq_u32_f32(a.v), 31), laneShifts));
+}
+inline SimdFloat MulAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return { vfmaq_f32(c.v, a.v, b.v) }; }
+
+#elif defined(SIMD_SSE2)
+
+static const uint32_t SIMD_WIDTH = 4;
+static const char* const SIMD_NAME = "SSE2";
+
+struct SimdFloat
+{
+    __m128 v;
+
+    static SimdFloat Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static SimdFloat Set(float s) { return { _mm_set1_ps(s) }; }
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return { _mm_add_ps(a.v, b.v) }; }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return { _mm_div_ps(a.v, b.v) }; }
+inline SimdFloat Min(SimdFloat a, SimdFloat b) { return { _mm_min_ps(a.v, b.v) }; }
+inline SimdFloat Max(SimdFloat a, SimdFloat b) { return { _mm_max_ps(a.v, b.v) }; }
+inline SimdFloat Abs(SimdFloat a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+inline SimdFloat Sqrt(SimdFloat a) { return { _mm_sqrt_ps(a.v) }; }
+inline uint32_t SignMask(SimdFloat a) { return static_cast<uint32_t>(_mm_movemask_ps(a.v)); }
+inline SimdFloat MulAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return { _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) }; }
+
+#else
+
+#define SIMD_SCALAR 1
+static const uint32_t SIMD_WIDTH = 1;
+static const char* const SIMD_NAME = "scalar";
+
+#endif
+
+// Width 1 version of SimdFloat, for the remainder of SIMD loops (and the whole loop without SIMD)
+struct SimdScalar
+{
+    float v;
+
+    static SimdScalar Load(const float* p) { return { *p }; }
+    static SimdScalar Set(float s) { return { s }; }
+    void Store(float* p) const { *p = v; }
+};
+
+inline SimdScalar operator+(SimdScalar a, SimdScalar b) { return { a.v + b.v }; }
+inline SimdScalar operator-(SimdScalar a, SimdScalar b) { return { a.v - b.v }; }
+inline SimdScalar operator*(SimdScalar a, SimdScalar b) { return { a.v * b.v }; }
+inline SimdScalar operator/(SimdScalar a, SimdScalar b) { return { a.v / b.v }; }
+inline SimdScalar Min(SimdScalar a, SimdScalar b) { return { a.v < b.v ? a.v : b.v }; }
+inline SimdScalar Max(SimdScalar a, SimdScalar b) { return { a.v > b.v ? a.v : b.v }; }
+inline SimdScalar Abs(SimdScalar a) { return { std::fabs(a.v) }; }
+inline SimdScalar Sqrt(SimdScalar a) { return { std::sqrt(a.v) }; }
+inline uint32_t SignMask(SimdScalar a) { return std::signbit(a.v) ? 1u : 0u; }
+inline SimdScalar MulAdd(SimdScalar a, SimdScalar b, SimdScalar c) { return { a.v * b.v + c.v }; }
+
+#if defined(SIMD_SCALAR)
+using SimdFloat = SimdScalar;
+#endif
+
+// Index of the lowest set bit, to walk the lanes of a SignMask. mask must not be 0.
+inline uint32_t CountTrailingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
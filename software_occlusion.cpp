@@ -0,0 +1,535 @@
+#include "software_occlusion.h"
+
+#include "parallel_for.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+// Multiples of every SIMD_WIDTH, so only the last batch has a scalar remainder
+static const uint32_t VERTEX_BATCH_SIZE = 4096;
+static const uint32_t TRIANGLE_BATCH_SIZE = 4096;
+// Tile rows of a band, the unit of work of the rasterization workers
+static const uint32_t TILE_ROWS_PER_BAND = 2;
+static const uint32_t SPHERE_BATCH_SIZE = 256;
+
+static const uint32_t FULL_COVERAGE = 0xffffffffu;
+
+/*
+Pixel centers this close outside of a triangle are still covered, about the subpixel precision of a GPU.
+Without it, two triangles sharing an edge through a column of pixel centers can both miss it because
+each one rounds the edge differently, and the tiles along it are never fully covered.
+*/
+static const float COVERAGE_TOLERANCE = 1.0f / 256.0f;
+
+void SoftwareOcclusionCuller::Init(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0 || width % TILE_WIDTH != 0 || height % TILE_HEIGHT != 0)
+    {
+        throw std::runtime_error("software occlusion buffer size must be a multiple of "
+            + std::to_string(TILE_WIDTH) + "x" + std::to_string(TILE_HEIGHT) + "!");
+    }
+
+    m_Width = width;
+    m_Height = height;
+    m_TilesX = width / TILE_WIDTH;
+    m_TilesY = height / TILE_HEIGHT;
+
+    m_TileZMax0.resize(m_TilesX * m_TilesY);
+    m_TileZMax1.resize(m_TilesX * m_TilesY);
+    m_TileMask.resize(m_TilesX * m_TilesY);
+
+    BeginFrame();
+}
+
+uint32_t SoftwareOcclusionCuller::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    OccluderMesh mesh;
+    mesh.positionX.reserve(vertices.size());
+    mesh.positionY.reserve(vertices.size());
+    mesh.positionZ.reserve(vertices.size());
+    for (const Vertex& vertex : vertices)
+    {
+        mesh.positionX.push_back(vertex.pos.x);
+        mesh.positionY.push_back(vertex.pos.y);
+        mesh.positionZ.push_back(vertex.pos.z);
+    }
+    mesh.indices.assign(indices.begin(), indices.end() - indices.size() % 3);
+
+    m_Meshes.push_back(std::move(mesh));
+    return static_cast<uint32_t>(m_Meshes.size() - 1);
+}
+
+void SoftwareOcclusionCuller::BeginFrame()
+{
+    // Nothing occludes yet: the farthest depth is the far plane, and the working layer is empty
+    std::fill(m_TileZMax0.begin(), m_TileZMax0.end(), 1.0f);
+    std::fill(m_TileZMax1.begin(), m_TileZMax1.end(), 0.0f);
+    std::fill(m_TileMask.begin(), m_TileMask.end(), 0u);
+
+    m_Occluders.clear();
+    m_VertexCount = 0;
+    m_TriangleCount = 0;
+    m_Stats = {};
+}
+
+void SoftwareOcclusionCuller::AddOccluder(uint32_t mesh, const glm::mat4& worldViewProj)
+{
+    Occluder occluder;
+    occluder.mesh = mesh;
+    occluder.worldViewProj = worldViewProj;
+    occluder.firstVertex = m_VertexCount;
+    occluder.firstTriangle = m_TriangleCount;
+    m_Occluders.push_back(occluder);
+
+    m_VertexCount += static_cast<uint32_t>(m_Meshes[mesh].positionX.size());
+    m_TriangleCount += static_cast<uint32_t>(m_Meshes[mesh].indices.size() / 3);
+}
+
+namespace
+{
+    struct ProjectionStreams
+    {
+        const float* positionX, *positionY, *positionZ;
+        float* screenX, *screenY, *screenZ, *screenW;
+    };
+
+    // Width vertices at once: clip = worldViewProj * (position, 1), then the perspective divide and the viewport transform
+    template<typename S>
+    void ProjectBlock(const ProjectionStreams& streams, uint32_t in, uint32_t out, const S (&worldViewProj)[16], S halfWidth, S halfHeight)
+    {
+        const S x = S::Load(streams.positionX + in);
+        const S y = S::Load(streams.positionY + in);
+        const S z = S::Load(streams.positionZ + in);
+
+        S clip[4];
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            clip[row] = MulAdd(worldViewProj[row], x, MulAdd(worldViewProj[4 + row], y, MulAdd(worldViewProj[8 + row], z, worldViewProj[12 + row])));
+        }
+
+        // Vertices behind the camera get meaningless coordinates here, their triangles are rejected by the w test
+        MulAdd(clip[0] / clip[3], halfWidth, halfWidth).Store(streams.screenX + out);
+        MulAdd(clip[1] / clip[3], halfHeight, halfHeight).Store(streams.screenY + out);
+        (clip[2] / clip[3]).Store(streams.screenZ + out);
+        clip[3].Store(streams.screenW + out);
+    }
+
+    template<typename S>
+    void BroadcastMatrix(const glm::mat4& matrix, S (&broadcast)[16])
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                broadcast[column * 4 + row] = S::Set(matrix[column][row]);
+            }
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::TransformVertices(uint32_t begin, uint32_t end)
+{
+    for (const Occluder& occluder : m_Occluders)
+    {
+        const OccluderMesh& mesh = m_Meshes[occluder.mesh];
+        const uint32_t first = std::max(begin, occluder.firstVertex);
+        const uint32_t last = std::min(end, occluder.firstVertex + static_cast<uint32_t>(mesh.positionX.size()));
+        if (first >= last)
+        {
+            continue;
+        }
+
+        const ProjectionStreams streams = {
+            mesh.positionX.data(), mesh.positionY.data(), mesh.positionZ.data(),
+            m_ScreenX.data(), m_ScreenY.data(), m_ScreenZ.data(), m_ScreenW.data() };
+
+        SimdFloat matrix[16];
+        BroadcastMatrix(occluder.worldViewProj, matrix);
+        const SimdFloat halfWidth = SimdFloat::Set(0.5f * m_Width);
+        const SimdFloat halfHeight = SimdFloat::Set(0.5f * m_Height);
+
+        uint32_t vertex = first;
+        for (; vertex + SIMD_WIDTH <= last; vertex += SIMD_WIDTH)
+        {
+            ProjectBlock(streams, vertex - occluder.firstVertex, vertex, matrix, halfWidth, halfHeight);
+        }
+
+        if (vertex < last)
+        {
+            SimdScalar matrixScalar[16];
+            BroadcastMatrix(occluder.worldViewProj, matrixScalar);
+
+            for (; vertex < last; ++vertex)
+            {
+                ProjectBlock(streams, vertex - occluder.firstVertex, vertex, matrixScalar,
+                    SimdScalar::Set(0.5f * m_Width), SimdScalar::Set(0.5f * m_Height));
+            }
+        }
+    }
+}
+
+uint32_t SoftwareOcclusionCuller::SetupTriangles(uint32_t begin, uint32_t end)
+{
+    // Closer than this the projected coordinates lose too much precision, the triangle is dropped instead of clipped
+    const float minClipW = 1e-5f;
+
+    uint32_t accepted = 0;
+    for (const Occluder& occluder : m_Occluders)
+    {
+        const std::vector<uint32_t>& indices = m_Meshes[occluder.mesh].indices;
+        const uint32_t first = std::max(begin, occluder.firstTriangle);
+        const uint32_t last = std::min(end, occluder.firstTriangle + static_cast<uint32_t>(indices.size() / 3));
+
+        for (uint32_t triangle = first; triangle < last; ++triangle)
+        {
+            ScreenTriangle& screen = m_Triangles[triangle];
+            screen.tileRowMin = 1;
+            screen.tileRowMax = 0;
+
+            const uint32_t* triangleIndices = &indices[(triangle - occluder.firstTriangle) * 3];
+            uint32_t v[3] = {
+                occluder.firstVertex + triangleIndices[0], occluder.firstVertex + triangleIndices[1], occluder.firstVertex + triangleIndices[2] };
+
+            /*
+            Dropping an occluder triangle only makes the buffer less occluding, never wrong.
+            Triangles crossing the near plane would need clipping, they are dropped.
+            */
+            if (m_ScreenW[v[0]] < minClipW || m_ScreenW[v[1]] < minClipW || m_ScreenW[v[2]] < minClipW
+                || m_ScreenZ[v[0]] < 0.0f || m_ScreenZ[v[1]] < 0.0f || m_ScreenZ[v[2]] < 0.0f)
+            {
+                continue;
+            }
+
+            // Same culling as the pipelines: VK_FRONT_FACE_COUNTER_CLOCKWISE in framebuffer coordinates (y down) is a negative area here
+            float area = (m_ScreenX[v[1]] - m_ScreenX[v[0]]) * (m_ScreenY[v[2]] - m_ScreenY[v[0]])
+                - (m_ScreenX[v[2]] - m_ScreenX[v[0]]) * (m_ScreenY[v[1]] - m_ScreenY[v[0]]);
+            if (!(area < 0.0f))
+            {
+                // Back facing, degenerate or NaN
+                continue;
+            }
+            std::swap(v[1], v[2]);
+            area = -area;
+
+            const float x[3] = { m_ScreenX[v[0]], m_ScreenX[v[1]], m_ScreenX[v[2]] };
+            const float y[3] = { m_ScreenY[v[0]], m_ScreenY[v[1]], m_ScreenY[v[2]] };
+            const float z[3] = { m_ScreenZ[v[0]], m_ScreenZ[v[1]], m_ScreenZ[v[2]] };
+
+            // Pixels whose center is inside the bounding box, clamped to the buffer
+            const float minX = std::max(std::ceil(std::min({ x[0], x[1], x[2] }) - 0.5f - COVERAGE_TOLERANCE), 0.0f);
+            const float maxX = std::min(std::floor(std::max({ x[0], x[1], x[2] }) - 0.5f + COVERAGE_TOLERANCE), static_cast<float>(m_Width - 1));
+            const float minY = std::max(std::ceil(std::min({ y[0], y[1], y[2] }) - 0.5f - COVERAGE_TOLERANCE), 0.0f);
+            const float maxY = std::min(std::floor(std::max({ y[0], y[1], y[2] }) - 0.5f + COVERAGE_TOLERANCE), static_cast<float>(m_Height - 1));
+            if (minX > maxX || minY > maxY)
+            {
+                continue;
+            }
+
+            // Edge i goes from vertex i to vertex i + 1, positive on the inside
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                const uint32_t j = (i + 1) % 3;
+                screen.edgeA[i] = y[i] - y[j];
+                screen.edgeB[i] = x[j] - x[i];
+                screen.edgeC[i] = x[i] * y[j] - x[j] * y[i];
+            }
+
+            // z / w is affine in screen space
+            screen.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+            screen.depthB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+            screen.depthC = z[0] - screen.depthA * x[0] - screen.depthB * y[0];
+            screen.depthMin = std::min({ z[0], z[1], z[2] });
+            screen.depthMax = std::max({ z[0], z[1], z[2] });
+
+            screen.pixelMinX = static_cast<int32_t>(minX);
+            screen.pixelMaxX = static_cast<int32_t>(maxX);
+            screen.tileRowMin = static_cast<int32_t>(minY) / static_cast<int32_t>(TILE_HEIGHT);
+            screen.tileRowMax = static_cast<int32_t>(maxY) / static_cast<int32_t>(TILE_HEIGHT);
+            ++accepted;
+        }
+    }
+
+    return accepted;
+}
+
+void SoftwareOcclusionCuller::UpdateTile(uint32_t tile, uint32_t coverage, float triangleDepthMin, float triangleDepthMax)
+{
+    float& zMax0 = m_TileZMax0[tile];
+    float& zMax1 = m_TileZMax1[tile];
+    uint32_t& mask = m_TileMask[tile];
+
+    // Entirely behind what the tile already hides
+    if (triangleDepthMin >= zMax0)
+    {
+        return;
+    }
+
+    // Heuristic of the paper: a triangle much closer than the working layer starts a new one, the old one is dropped
+    if (zMax1 - triangleDepthMax > zMax0 - zMax1)
+    {
+        zMax1 = 0.0f;
+        mask = 0;
+    }
+
+    zMax1 = std::max(zMax1, triangleDepthMax);
+    mask |= coverage;
+
+    // Every pixel is covered by the working layer, nothing in the tile is farther than zMax1
+    if (mask == FULL_COVERAGE)
+    {
+        zMax0 = std::min(zMax0, zMax1);
+        zMax1 = 0.0f;
+        mask = 0;
+    }
+}
+
+void SoftwareOcclusionCuller::BinTriangles()
+{
+    m_BandTriangles.resize((m_TilesY + TILE_ROWS_PER_BAND - 1) / TILE_ROWS_PER_BAND);
+    for (std::vector<uint32_t>& band : m_BandTriangles)
+    {
+        band.clear();
+    }
+
+    // In submission order, so every band sees the occluders in the order they were added
+    for (uint32_t triangle = 0; triangle < m_TriangleCount; ++triangle)
+    {
+        const ScreenTriangle& screen = m_Triangles[triangle];
+        for (int32_t band = screen.tileRowMin / static_cast<int32_t>(TILE_ROWS_PER_BAND);
+            band <= screen.tileRowMax / static_cast<int32_t>(TILE_ROWS_PER_BAND); ++band)
+        {
+            m_BandTriangles[band].push_back(triangle);
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::RasterizeBand(uint32_t band)
+{
+    const uint32_t endRow = std::min((band + 1) * TILE_ROWS_PER_BAND, m_TilesY);
+    for (uint32_t tileRow = band * TILE_ROWS_PER_BAND; tileRow < endRow; ++tileRow)
+    {
+        const float tileY = static_cast<float>(tileRow * TILE_HEIGHT);
+
+        for (uint32_t triangle : m_BandTriangles[band])
+        {
+            const ScreenTriangle& screen = m_Triangles[triangle];
+            if (static_cast<int32_t>(tileRow) < screen.tileRowMin || static_cast<int32_t>(tileRow) > screen.tileRowMax)
+            {
+                continue;
+            }
+
+            // Span of every pixel row: the pixels whose center is on the inside of the three edges
+            int32_t rowFirst[TILE_HEIGHT];
+            int32_t rowLast[TILE_HEIGHT];
+            int32_t spanFirst = screen.pixelMaxX + 1;
+            int32_t spanLast = screen.pixelMinX - 1;
+            for (uint32_t row = 0; row < TILE_HEIGHT; ++row)
+            {
+                const float centerY = tileY + row + 0.5f;
+                float left = static_cast<float>(screen.pixelMinX) + 0.5f;
+                float right = static_cast<float>(screen.pixelMaxX) + 0.5f;
+                for (uint32_t edge = 0; edge < 3; ++edge)
+                {
+                    const float rowValue = screen.edgeB[edge] * centerY + screen.edgeC[edge];
+                    if (screen.edgeA[edge] > 0.0f)
+                    {
+                        left = std::max(left, -rowValue / screen.edgeA[edge]);
+                    }
+                    else if (screen.edgeA[edge] < 0.0f)
+                    {
+                        right = std::min(right, -rowValue / screen.edgeA[edge]);
+                    }
+                    else if (rowValue < -COVERAGE_TOLERANCE * std::fabs(screen.edgeB[edge]))
+                    {
+                        right = left - 1.0f;
+                    }
+                }
+
+                const float first = std::ceil(left - 0.5f - COVERAGE_TOLERANCE);
+                const float last = std::floor(right - 0.5f + COVERAGE_TOLERANCE);
+                if (first > last)
+                {
+                    rowFirst[row] = 1;
+                    rowLast[row] = 0;
+                    continue;
+                }
+
+                rowFirst[row] = static_cast<int32_t>(first);
+                rowLast[row] = static_cast<int32_t>(last);
+                spanFirst = std::min(spanFirst, rowFirst[row]);
+                spanLast = std::max(spanLast, rowLast[row]);
+            }
+
+            if (spanFirst > spanLast)
+            {
+                continue;
+            }
+
+            for (int32_t tileX = spanFirst / static_cast<int32_t>(TILE_WIDTH); tileX <= spanLast / static_cast<int32_t>(TILE_WIDTH); ++tileX)
+            {
+                // One byte per pixel row, bit i is pixel i of the row
+                const int32_t tilePixelX = tileX * static_cast<int32_t>(TILE_WIDTH);
+                uint32_t coverage = 0;
+                for (uint32_t row = 0; row < TILE_HEIGHT; ++row)
+                {
+                    const int32_t low = std::max(rowFirst[row] - tilePixelX, 0);
+                    const int32_t high = std::min(rowLast[row] - tilePixelX, static_cast<int32_t>(TILE_WIDTH) - 1);
+                    if (low <= high)
+                    {
+                        coverage |= ((0xffu << low) & (0xffu >> (TILE_WIDTH - 1 - high))) << (row * TILE_WIDTH);
+                    }
+                }
+
+                if (coverage == 0)
+                {
+                    continue;
+                }
+
+                // Farthest depth of the triangle plane over the tile, at the corner the gradient points to
+                const float cornerX = static_cast<float>(tilePixelX) + (screen.depthA > 0.0f ? TILE_WIDTH : 0.0f);
+                const float cornerY = tileY + (screen.depthB > 0.0f ? TILE_HEIGHT : 0.0f);
+                const float tileDepthMax = std::min(screen.depthA * cornerX + screen.depthB * cornerY + screen.depthC, screen.depthMax);
+
+                UpdateTile(tileRow * m_TilesX + static_cast<uint32_t>(tileX), coverage, screen.depthMin, tileDepthMax);
+            }
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::RasterizeOccluders(bool multithreaded)
+{
+    m_ScreenX.resize(m_VertexCount);
+    m_ScreenY.resize(m_VertexCount);
+    m_ScreenZ.resize(m_VertexCount);
+    m_ScreenW.resize(m_VertexCount);
+    m_Triangles.resize(m_TriangleCount);
+
+    m_Stats.occluders = static_cast<uint32_t>(m_Occluders.size());
+
+    if (!multithreaded)
+    {
+        TransformVertices(0, m_VertexCount);
+        m_Stats.occluderTriangles = SetupTriangles(0, m_TriangleCount);
+        BinTriangles();
+        for (uint32_t band = 0; band < m_BandTriangles.size(); ++band)
+        {
+            RasterizeBand(band);
+        }
+        return;
+    }
+
+    ParallelFor(m_VertexCount, VERTEX_BATCH_SIZE, [this](uint32_t begin, uint32_t end)
+        {
+            TransformVertices(begin, end);
+        });
+
+    std::atomic<uint32_t> accepted{ 0 };
+    ParallelFor(m_TriangleCount, TRIANGLE_BATCH_SIZE, [this, &accepted](uint32_t begin, uint32_t end)
+        {
+            accepted += SetupTriangles(begin, end);
+        });
+    m_Stats.occluderTriangles = accepted;
+
+    // Bands of tile rows never share a tile, the workers write the buffer without synchronization
+    BinTriangles();
+    ParallelFor(static_cast<uint32_t>(m_BandTriangles.size()), 1, [this](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t band = begin; band < end; ++band)
+            {
+                RasterizeBand(band);
+            }
+        });
+}
+
+bool SoftwareOcclusionCuller::IsOccluded(const glm::vec4& sphere, const glm::mat4& viewProj) const
+{
+    // Screen rectangle and nearest depth of the box around the sphere, like occlusion_cull.comp
+    glm::vec3 ndcMin(1e30f);
+    glm::vec3 ndcMax(-1e30f);
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        const glm::vec3 offset((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+        const glm::vec4 clip = viewProj * glm::vec4(glm::vec3(sphere.x, sphere.y, sphere.z) + offset * sphere.w, 1.0f);
+        if (clip.w <= 0.0f)
+        {
+            return false;
+        }
+
+        const glm::vec3 ndc = glm::vec3(clip.x, clip.y, clip.z) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+
+    if (ndcMin.z < 0.0f || ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+    {
+        return false;
+    }
+
+    const float pixelMinX = std::max((ndcMin.x * 0.5f + 0.5f) * m_Width, 0.0f);
+    const float pixelMaxX = std::min((ndcMax.x * 0.5f + 0.5f) * m_Width, static_cast<float>(m_Width - 1));
+    const float pixelMinY = std::max((ndcMin.y * 0.5f + 0.5f) * m_Height, 0.0f);
+    const float pixelMaxY = std::min((ndcMax.y * 0.5f + 0.5f) * m_Height, static_cast<float>(m_Height - 1));
+
+    const uint32_t tileMinX = static_cast<uint32_t>(pixelMinX) / TILE_WIDTH;
+    const uint32_t tileMaxX = static_cast<uint32_t>(pixelMaxX) / TILE_WIDTH;
+    const uint32_t tileMinY = static_cast<uint32_t>(pixelMinY) / TILE_HEIGHT;
+    const uint32_t tileMaxY = static_cast<uint32_t>(pixelMaxY) / TILE_HEIGHT;
+
+    // Farthest occluder depth under the rectangle, SIMD_WIDTH tiles of a row at a time
+    for (uint32_t tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+    {
+        const float* row = &m_TileZMax0[tileY * m_TilesX];
+
+        uint32_t tileX = tileMinX;
+        SimdFloat farthest = SimdFloat::Set(0.0f);
+        for (; tileX + SIMD_WIDTH <= tileMaxX + 1; tileX += SIMD_WIDTH)
+        {
+            farthest = Max(farthest, SimdFloat::Load(row + tileX));
+        }
+
+        float lanes[SIMD_WIDTH];
+        farthest.Store(lanes);
+        float rowFarthest = *std::max_element(lanes, lanes + SIMD_WIDTH);
+        for (; tileX <= tileMaxX; ++tileX)
+        {
+            rowFarthest = std::max(rowFarthest, row[tileX]);
+        }
+
+        if (ndcMin.z <= rowFarthest)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SoftwareOcclusionCuller::TestSpheres(const glm::vec4* spheres, uint32_t count, const glm::mat4& viewProj, uint8_t* visible, bool multithreaded)
+{
+    auto testRange = [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            visible[i] = IsOccluded(spheres[i], viewProj) ? 0 : 1;
+        }
+    };
+
+    if (multithreaded)
+    {
+        ParallelFor(count, SPHERE_BATCH_SIZE, testRange);
+    }
+    else
+    {
+        testRange(0, count);
+    }
+
+    m_Stats.testedObjects += count;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        m_Stats.occludedObjects += visible[i] == 0;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "vertex.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct SoftwareOcclusionStats
+{
+    uint32_t occluders = 0;
+    uint32_t occluderTriangles = 0;     // rasterized: front facing, in front of the near plane and on screen
+    uint32_t testedObjects = 0;
+    uint32_t occludedObjects = 0;
+};
+
+/*
+    CPU occlusion culling, for when the depth attachment can't be sampled on the GPU (see OcclusionCuller).
+    Only uses the CPU, so it builds, runs and is benchmarked without a GPU.
+
+    A few selected occluder meshes are rasterized into a small depth buffer, then the bounding spheres of
+    the objects are tested against it before their draws are recorded.
+
+    The buffer follows masked occlusion culling (Andersson et al., "Masked Software Occlusion Culling", 2016):
+    it is not stored per pixel but per tile of 8x4 pixels, as a 32-bit coverage mask (one byte per row of 8 pixels)
+    and two depths. zMax0 is the farthest depth of the whole tile, zMax1 the farthest depth of the triangles that
+    only cover the pixels of the mask so far. Once the mask is full, zMax1 becomes the new farthest depth of the tile.
+    A row of a triangle inside a tile is two shifts of 0xff, so a tile is covered with a handful of integer operations
+    instead of 32 depth tests. The tests are conservative: an object is only culled when its nearest depth is behind
+    zMax0 of every tile its screen rectangle touches.
+
+    Occluder vertices are transformed and projected SIMD_WIDTH at a time (simd.h), triangles are set up in parallel,
+    and the buffer is split into horizontal bands of tiles rasterized by the ParallelFor workers without any locking.
+*/
+class SoftwareOcclusionCuller
+{
+public:
+    static const uint32_t TILE_WIDTH = 8;
+    static const uint32_t TILE_HEIGHT = 4;
+
+    // Multiples of the tile size. The whole viewport maps to the buffer, so its aspect ratio doesn't matter.
+    void Init(uint32_t width, uint32_t height);
+
+    // Object space positions and triangle list, kept as a structure of arrays. Returns the mesh id.
+    uint32_t AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+    // Clears the buffer and the occluders of the previous frame
+    void BeginFrame();
+    void AddOccluder(uint32_t mesh, const glm::mat4& worldViewProj);
+    void RasterizeOccluders(bool multithreaded = true);
+
+    // World space sphere (xyz center, w radius). Spheres crossing the near plane or outside of the screen are never occluded.
+    bool IsOccluded(const glm::vec4& sphere, const glm::mat4& viewProj) const;
+    // visible[i] is 0 for the occluded spheres, 1 otherwise
+    void TestSpheres(const glm::vec4* spheres, uint32_t count, const glm::mat4& viewProj, uint8_t* visible, bool multithreaded = true);
+
+    const SoftwareOcclusionStats& GetStats() const { return m_Stats; }
+    uint32_t GetWidth() const { return m_Width; }
+    uint32_t GetHeight() const { return m_Height; }
+
+    // Farthest depth of the tile holding the pixel, 1.0 where no occluder covers the whole tile
+    float GetTileDepth(uint32_t x, uint32_t y) const { return m_TileZMax0[(y / TILE_HEIGHT) * m_TilesX + x / TILE_WIDTH]; }
+
+private:
+    struct OccluderMesh
+    {
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<uint32_t> indices;
+    };
+
+    struct Occluder
+    {
+        uint32_t mesh;
+        glm::mat4 worldViewProj;
+        uint32_t firstVertex;       // in the screen vertex streams
+        uint32_t firstTriangle;     // in m_Triangles
+    };
+
+    // Screen space triangle with front facing (counter clockwise) winding, inside when all edge functions are >= 0
+    struct ScreenTriangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];     // edge i: edgeA * x + edgeB * y + edgeC
+        float depthA, depthB, depthC;           // depth plane: depthA * x + depthB * y + depthC
+        float depthMin, depthMax;
+        int32_t pixelMinX, pixelMaxX;
+        int32_t tileRowMin, tileRowMax;         // empty (min > max) when the triangle is rejected
+    };
+
+    void TransformVertices(uint32_t begin, uint32_t end);
+    uint32_t SetupTriangles(uint32_t begin, uint32_t end);
+    void BinTriangles();
+    void RasterizeBand(uint32_t band);
+    void UpdateTile(uint32_t tile, uint32_t coverage, float triangleDepthMin, float triangleDepthMax);
+
+    uint32_t m_Width = 0;
+    uint32_t m_Height = 0;
+    uint32_t m_TilesX = 0;
+    uint32_t m_TilesY = 0;
+
+    // Per tile, row-major. Each band worker only writes the rows of its band.
+    std::vector<float> m_TileZMax0;
+    std::vector<float> m_TileZMax1;
+    std::vector<uint32_t> m_TileMask;
+
+    std::vector<OccluderMesh> m_Meshes;
+    std::vector<Occluder> m_Occluders;
+    uint32_t m_VertexCount = 0;
+    uint32_t m_TriangleCount = 0;
+
+    // Projected occluder vertices: pixel x and y, depth, and clip w to reject the triangles crossing the near plane
+    std::vector<float> m_ScreenX, m_ScreenY, m_ScreenZ, m_ScreenW;
+    std::vector<ScreenTriangle> m_Triangles;
+    std::vector<std::vector<uint32_t>> m_BandTriangles;     // accepted triangles touching each band of tile rows
+
+    SoftwareOcclusionStats m_Stats;
+};
@@ -0,0 +1,58 @@
+#include "startup_timer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+StartupTimer::StartupTimer()
+    : m_StartTime(std::chrono::steady_clock::now()), m_MainThreadId(std::this_thread::get_id())
+{
+}
+
+double StartupTimer::NowMs() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_StartTime).count();
+}
+
+void StartupTimer::Add(const char* name, double startMs, double endMs)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Steps.push_back({ name, std::this_thread::get_id(), startMs, endMs });
+}
+
+void StartupTimer::Print(std::ostream& out) const
+{
+    std::vector<Step> steps;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        steps = m_Steps;
+    }
+
+    std::sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.startMs < b.startMs; });
+
+    // Worker threads are numbered in order of their first step
+    std::map<std::thread::id, int> workerNumbers;
+    double endMs = 0.0;
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-32s %-10s %10s %10s\n", "startup step", "thread", "start ms", "ms");
+    out << line;
+
+    for (const Step& step : steps)
+    {
+        std::string thread = "main";
+        if (step.threadId != m_MainThreadId)
+        {
+            auto it = workerNumbers.emplace(step.threadId, static_cast<int>(workerNumbers.size()) + 1).first;
+            thread = "worker " + std::to_string(it->second);
+        }
+
+        std::snprintf(line, sizeof(line), "%-32s %-10s %10.2f %10.2f\n", step.name, thread.c_str(), step.startMs, step.endMs - step.startMs);
+        out << line;
+
+        endMs = std::max(endMs, step.endMs);
+    }
+
+    std::snprintf(line, sizeof(line), "%-32s %-10s %10s %10.2f\n", "total", "", "", endMs);
+    out << line;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Wall-clock breakdown of the application startup.
+
+    Steps can be recorded from any thread, so work moved to worker threads
+    shows up next to the Vulkan object creation it overlaps with.
+*/
+class StartupTimer
+{
+public:
+    StartupTimer();
+
+    double NowMs() const;
+    void Add(const char* name, double startMs, double endMs);
+
+    // Steps sorted by start time, with the thread each one ran on
+    void Print(std::ostream& out) const;
+
+    class Scope
+    {
+    public:
+        Scope(StartupTimer& timer, const char* name) : m_Timer(timer), m_Name(name), m_StartMs(timer.NowMs()) {}
+        ~Scope() { m_Timer.Add(m_Name, m_StartMs, m_Timer.NowMs()); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StartupTimer& m_Timer;
+        const char* m_Name;
+        double m_StartMs;
+    };
+
+private:
+    struct Step
+    {
+        const char* name;
+        std::thread::id threadId;
+        double startMs;
+        double endMs;
+    };
+
+    std::chrono::steady_clock::time_point m_StartTime;
+    std::thread::id m_MainThreadId;
+
+    mutable std::mutex m_Mutex;
+    std::vector<Step> m_Steps;
+};
@@ -0,0 +1,330 @@
+#include "transform_system.h"
+
+#include "parallel_for.h"
+#include "simd.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Multiple of every SIMD_WIDTH, so only the last batch has a scalar remainder
+static const uint32_t TRANSFORM_BATCH_SIZE = 1024;
+
+BoundingSphere ComputeBoundingSphere(const std::vector<Vertex>& vertices)
+{
+    BoundingSphere sphere;
+    if (vertices.empty())
+    {
+        return sphere;
+    }
+
+    glm::vec3 boundsMin = vertices[0].pos;
+    glm::vec3 boundsMax = vertices[0].pos;
+    for (const Vertex& vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+
+    sphere.center = (boundsMin + boundsMax) * 0.5f;
+
+    float radiusSquared = 0.0f;
+    for (const Vertex& vertex : vertices)
+    {
+        const glm::vec3 offset = vertex.pos - sphere.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    sphere.radius = std::sqrt(radiusSquared);
+
+    return sphere;
+}
+
+Aabb ComputeBoundingBox(const std::vector<Vertex>& vertices)
+{
+    Aabb box;
+    for (const Vertex& vertex : vertices)
+    {
+        box.Grow(vertex.pos);
+    }
+    return box;
+}
+
+Aabb TransformBoundingBox(const Aabb& box, const glm::mat4& transform)
+{
+    if (box.IsEmpty())
+    {
+        return box;
+    }
+
+    const glm::vec3 center = box.GetCenter();
+    const glm::vec3 extent = box.GetExtent();
+
+    glm::vec3 newCenter(transform[3].x, transform[3].y, transform[3].z);
+    glm::vec3 newExtent(0.0f);
+    for (int column = 0; column < 3; ++column)
+    {
+        const glm::vec3 axis(transform[column].x, transform[column].y, transform[column].z);
+        newCenter += axis * center[column];
+        newExtent += glm::abs(axis) * extent[column];
+    }
+
+    Aabb transformed;
+    transformed.min = newCenter - newExtent;
+    transformed.max = newCenter + newExtent;
+    return transformed;
+}
+
+uint32_t TransformSystem::Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const BoundingSphere& localBounds)
+{
+    const uint32_t index = GetCount();
+
+    m_PositionX.push_back(position.x);
+    m_PositionY.push_back(position.y);
+    m_PositionZ.push_back(position.z);
+
+    m_RotationX.push_back(rotation.x);
+    m_RotationY.push_back(rotation.y);
+    m_RotationZ.push_back(rotation.z);
+    m_RotationW.push_back(rotation.w);
+
+    m_ScaleX.push_back(scale.x);
+    m_ScaleY.push_back(scale.y);
+    m_ScaleZ.push_back(scale.z);
+
+    m_BoundsX.push_back(localBounds.center.x);
+    m_BoundsY.push_back(localBounds.center.y);
+    m_BoundsZ.push_back(localBounds.center.z);
+    m_BoundsRadius.push_back(localBounds.radius);
+
+    return index;
+}
+
+void TransformSystem::Clear()
+{
+    for (std::vector<float>* stream : { &m_PositionX, &m_PositionY, &m_PositionZ, &m_RotationX, &m_RotationY, &m_RotationZ, &m_RotationW,
+        &m_ScaleX, &m_ScaleY, &m_ScaleZ, &m_BoundsX, &m_BoundsY, &m_BoundsZ, &m_BoundsRadius })
+    {
+        stream->clear();
+    }
+}
+
+void TransformSystem::SetPosition(uint32_t index, const glm::vec3& position)
+{
+    m_PositionX[index] = position.x;
+    m_PositionY[index] = position.y;
+    m_PositionZ[index] = position.z;
+}
+
+void TransformSystem::SetRotation(uint32_t index, const glm::quat& rotation)
+{
+    m_RotationX[index] = rotation.x;
+    m_RotationY[index] = rotation.y;
+    m_RotationZ[index] = rotation.z;
+    m_RotationW[index] = rotation.w;
+}
+
+void TransformSystem::SetScale(uint32_t index, const glm::vec3& scale)
+{
+    m_ScaleX[index] = scale.x;
+    m_ScaleY[index] = scale.y;
+    m_ScaleZ[index] = scale.z;
+}
+
+const char* TransformSystem::GetSimdName()
+{
+    return SIMD_NAME;
+}
+
+namespace
+{
+    struct TransformStreams
+    {
+        const float* positionX, *positionY, *positionZ;
+        const float* rotationX, *rotationY, *rotationZ, *rotationW;
+        const float* scaleX, *scaleY, *scaleZ;
+        const float* boundsX, *boundsY, *boundsZ, *boundsRadius;
+    };
+
+    /*
+        Width objects at once, every S value holds one component of Width objects.
+        World = translation * rotation * scale, only its upper 3x4 part is computed, the last row is (0, 0, 0, 1).
+    */
+    template<typename S, uint32_t Width>
+    void TransformBlock(const TransformStreams& in, uint32_t first, const S (&viewProj)[16], ObjectTransform* transforms, glm::vec4* worldBounds)
+    {
+        const S qx = S::Load(in.rotationX + first);
+        const S qy = S::Load(in.rotationY + first);
+        const S qz = S::Load(in.rotationZ + first);
+        const S qw = S::Load(in.rotationW + first);
+        const S sx = S::Load(in.scaleX + first);
+        const S sy = S::Load(in.scaleY + first);
+        const S sz = S::Load(in.scaleZ + first);
+
+        const S one = S::Set(1.0f);
+        const S two = S::Set(2.0f);
+
+        const S xx = qx * qx, yy = qy * qy, zz = qz * qz;
+        const S xy = qx * qy, xz = qx * qz, yz = qy * qz;
+        const S wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+        // world[column * 3 + row], same rotation matrix as glm::mat3_cast, columns scaled
+        S world[12];
+        world[0] = (one - two * (yy + zz)) * sx;
+        world[1] = two * (xy + wz) * sx;
+        world[2] = two * (xz - wy) * sx;
+        world[3] = two * (xy - wz) * sy;
+        world[4] = (one - two * (xx + zz)) * sy;
+        world[5] = two * (yz + wx) * sy;
+        world[6] = two * (xz + wy) * sz;
+        world[7] = two * (yz - wx) * sz;
+        world[8] = (one - two * (xx + yy)) * sz;
+        world[9] = S::Load(in.positionX + first);
+        world[10] = S::Load(in.positionY + first);
+        world[11] = S::Load(in.positionZ + first);
+
+        // worldViewProj column j = viewProj * world column j, the w of world columns 0-2 is 0 and of column 3 is 1
+        S worldViewProj[16];
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                const S base = column == 3 ? viewProj[12 + row] : S::Set(0.0f);
+                worldViewProj[column * 4 + row] = MulAdd(viewProj[row], world[column * 3],
+                    MulAdd(viewProj[4 + row], world[column * 3 + 1], MulAdd(viewProj[8 + row], world[column * 3 + 2], base)));
+            }
+        }
+
+        // Transpose to one ObjectTransform per object
+        alignas(32) float lanes[28][Width];
+        for (uint32_t i = 0; i < 12; ++i)
+        {
+            world[i].Store(lanes[i]);
+        }
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            worldViewProj[i].Store(lanes[12 + i]);
+        }
+
+        for (uint32_t lane = 0; lane < Width; ++lane)
+        {
+            alignas(16) float object[32] = {};
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                object[column * 4 + 0] = lanes[column * 3 + 0][lane];
+                object[column * 4 + 1] = lanes[column * 3 + 1][lane];
+                object[column * 4 + 2] = lanes[column * 3 + 2][lane];
+            }
+            object[15] = 1.0f;
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                object[16 + i] = lanes[12 + i][lane];
+            }
+
+            // One contiguous 128 byte write per object, friendly to write-combined memory
+            memcpy(&transforms[first + lane], object, sizeof(object));
+        }
+
+        if (worldBounds)
+        {
+            const S bx = S::Load(in.boundsX + first);
+            const S by = S::Load(in.boundsY + first);
+            const S bz = S::Load(in.boundsZ + first);
+
+            // Rotation keeps distances, only the largest scale grows the radius
+            const S centerX = MulAdd(world[0], bx, MulAdd(world[3], by, MulAdd(world[6], bz, world[9])));
+            const S centerY = MulAdd(world[1], bx, MulAdd(world[4], by, MulAdd(world[7], bz, world[10])));
+            const S centerZ = MulAdd(world[2], bx, MulAdd(world[5], by, MulAdd(world[8], bz, world[11])));
+            const S radius = S::Load(in.boundsRadius + first) * Max(Abs(sx), Max(Abs(sy), Abs(sz)));
+
+            alignas(32) float bounds[4][Width];
+            centerX.Store(bounds[0]);
+            centerY.Store(bounds[1]);
+            centerZ.Store(bounds[2]);
+            radius.Store(bounds[3]);
+
+            for (uint32_t lane = 0; lane < Width; ++lane)
+            {
+                worldBounds[first + lane] = glm::vec4(bounds[0][lane], bounds[1][lane], bounds[2][lane], bounds[3][lane]);
+            }
+        }
+    }
+
+    template<typename S>
+    void BroadcastMatrix(const glm::mat4& matrix, S (&broadcast)[16])
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                broadcast[column * 4 + row] = S::Set(matrix[column][row]);
+            }
+        }
+    }
+}
+
+void TransformSystem::UpdateRange(uint32_t begin, uint32_t end, const glm::mat4& viewProj, ObjectTransform* transforms, glm::vec4* worldBounds) const
+{
+    const TransformStreams streams = {
+        m_PositionX.data(), m_PositionY.data(), m_PositionZ.data(),
+        m_RotationX.data(), m_RotationY.data(), m_RotationZ.data(), m_RotationW.data(),
+        m_ScaleX.data(), m_ScaleY.data(), m_ScaleZ.data(),
+        m_BoundsX.data(), m_BoundsY.data(), m_BoundsZ.data(), m_BoundsRadius.data() };
+
+    SimdFloat viewProjSimd[16];
+    BroadcastMatrix(viewProj, viewProjSimd);
+
+    uint32_t index = begin;
+    for (; index + SIMD_WIDTH <= end; index += SIMD_WIDTH)
+    {
+        TransformBlock<SimdFloat, SIMD_WIDTH>(streams, index, viewProjSimd, transforms, worldBounds);
+    }
+
+    if (index < end)
+    {
+        SimdScalar viewProjScalar[16];
+        BroadcastMatrix(viewProj, viewProjScalar);
+
+        for (; index < end; ++index)
+        {
+            TransformBlock<SimdScalar, 1>(streams, index, viewProjScalar, transforms, worldBounds);
+        }
+    }
+}
+
+void TransformSystem::Update(const glm::mat4& viewProj, ObjectTransform* transforms, glm::vec4* worldBounds, bool multithreaded) const
+{
+    if (!multithreaded)
+    {
+        UpdateRange(0, GetCount(), viewProj, transforms, worldBounds);
+        return;
+    }
+
+    ParallelFor(GetCount(), TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+        {
+            UpdateRange(begin, end, viewProj, transforms, worldBounds);
+        });
+}
+
+void TransformSystem::UpdateReference(const glm::mat4& viewProj, ObjectTransform* transforms, glm::vec4* worldBounds) const
+{
+    for (uint32_t i = 0; i < GetCount(); ++i)
+    {
+        const glm::vec3 position(m_PositionX[i], m_PositionY[i], m_PositionZ[i]);
+        const glm::quat rotation(m_RotationW[i], m_RotationX[i], m_RotationY[i], m_RotationZ[i]);
+        const glm::vec3 scale(m_ScaleX[i], m_ScaleY[i], m_ScaleZ[i]);
+
+        const glm::mat4 world = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+
+        transforms[i].world = world;
+        transforms[i].worldViewProj = viewProj * world;
+
+        if (worldBounds)
+        {
+            const glm::vec4 center = world * glm::vec4(m_BoundsX[i], m_BoundsY[i], m_BoundsZ[i], 1.0f);
+            const float maxScale = std::max(std::fabs(scale.x), std::max(std::fabs(scale.y), std::fabs(scale.z)));
+            worldBounds[i] = glm::vec4(center.x, center.y, center.z, m_BoundsRadius[i] * maxScale);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vertex.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+struct BoundingSphere
+{
+    glm::vec3 center{ 0.0f };
+    float radius = 0.0f;
+};
+
+// Center of the bounding box and distance to the farthest vertex, not minimal but tight enough for culling
+BoundingSphere ComputeBoundingSphere(const std::vector<Vertex>& vertices);
+
+// Axis-aligned bounding box, empty (min > max) until something is added
+struct Aabb
+{
+    glm::vec3 min{ FLT_MAX };
+    glm::vec3 max{ -FLT_MAX };
+
+    void Grow(const glm::vec3& point) { min = glm::min(min, point); max = glm::max(max, point); }
+    void Grow(const Aabb& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+
+    bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    glm::vec3 GetCenter() const { return (min + max) * 0.5f; }
+    glm::vec3 GetExtent() const { return (max - min) * 0.5f; }
+    float GetSurfaceArea() const
+    {
+        const glm::vec3 size = max - min;
+        return IsEmpty() ? 0.0f : 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+};
+
+Aabb ComputeBoundingBox(const std::vector<Vertex>& vertices);
+// Box around the transformed box (Arvo): exact for translations and scales, grows with rotations
+Aabb TransformBoundingBox(const Aabb& box, const glm::mat4& transform);
+
+// Per-object output of the transform system, laid out like the matching GLSL block (std140/std430)
+struct ObjectTransform
+{
+    alignas(16) glm::mat4 world;
+    alignas(16) glm::mat4 worldViewProj;
+};
+
+/*
+    Data-oriented transforms of many objects.
+
+    Positions, rotations (unit quaternions), scales and local bounding spheres are stored as one array
+    per component (structure of arrays), so the update loads N objects' worth of one component in a
+    single SIMD register: AVX2 handles 8 objects per iteration, NEON and SSE2 4. The kernel is selected
+    at compile time (see GetSimdName) and batches of objects are spread over worker threads.
+
+    Update writes every output exactly once, in order and without reading it back, so the destination
+    can be mapped (write-combined) GPU memory, e.g. an allocation of the FrameLinearAllocator.
+    UpdateReference is the naive one glm call per object loop, kept for validation and benchmarks.
+*/
+class TransformSystem
+{
+public:
+    uint32_t Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const BoundingSphere& localBounds);
+    void Clear();
+
+    void SetPosition(uint32_t index, const glm::vec3& position);
+    void SetRotation(uint32_t index, const glm::quat& rotation);
+    void SetScale(uint32_t index, const glm::vec3& scale);
+
+    uint32_t GetCount() const { return static_cast<uint32_t>(m_PositionX.size()); }
+
+    // transforms and worldBounds (xyz center, w radius) hold GetCount() elements, worldBounds may be null
+    void Update(const glm::mat4& viewProj, ObjectTransform* transforms, glm::vec4* worldBounds, bool multithreaded = true) const;
+    void UpdateReference(const glm::mat4& viewProj, ObjectTransform* transforms, glm::vec4* worldBounds) const;
+
+    static const char* GetSimdName();
+
+private:
+    void UpdateRange(uint32_t begin, uint32_t end, const glm::mat4& viewProj, ObjectTransform* transforms, glm::vec4* worldBounds) const;
+
+    std::vector<float> m_PositionX, m_PositionY, m_PositionZ;
+    std::vector<float> m_RotationX, m_RotationY, m_RotationZ, m_RotationW;
+    std::vector<float> m_ScaleX, m_ScaleY, m_ScaleZ;
+    std::vector<float> m_BoundsX, m_BoundsY, m_BoundsZ, m_BoundsRadius;
+};
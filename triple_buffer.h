@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/*
+    Hands the latest value of a producer thread to a consumer thread, without a lock and without either side waiting.
+
+    Three slots: one written by the producer, one read by the consumer, and the one in the middle. Publish swaps the
+    written slot with the middle one and marks it fresh, Update swaps the middle slot with the read one if it is fresh.
+    Both swaps are a single atomic exchange, so neither thread ever waits for the other: a producer faster than the
+    consumer overwrites the values that were never taken (the consumer always gets the latest one), a consumer faster
+    than the producer keeps reading the same value.
+
+    The slots are reused, never copied: a value holding vectors keeps their capacity from one publish to the next.
+*/
+template<typename T>
+class TripleBuffer
+{
+public:
+    // Producer: the slot to fill, owned by the producer until Publish
+    T& GetWriteBuffer() { return m_Slots[m_WriteIndex]; }
+
+    // Producer: the filled slot becomes the latest value, the producer gets another slot to fill
+    void Publish()
+    {
+        // Release: the consumer that takes the slot sees everything written into it
+        const uint32_t previous = m_Middle.exchange(m_WriteIndex | FRESH_BIT, std::memory_order_acq_rel);
+        m_WriteIndex = previous & INDEX_MASK;
+    }
+
+    // Consumer: takes the latest value if one was published since the last call, true if so
+    bool Update()
+    {
+        // Only the producer sets the bit and only the consumer clears it, so it can't be lost between the two
+        if ((m_Middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+        {
+            return false;
+        }
+        const uint32_t previous = m_Middle.exchange(m_ReadIndex, std::memory_order_acq_rel);
+        m_ReadIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    // Consumer: the value taken by the last successful Update, owned by the consumer until the next one
+    T& GetReadBuffer() { return m_Slots[m_ReadIndex]; }
+
+private:
+    static const uint32_t INDEX_MASK = 3;
+    static const uint32_t FRESH_BIT = 4;
+
+    std::array<T, 3> m_Slots;
+    uint32_t m_WriteIndex = 0;
+    uint32_t m_ReadIndex = 1;
+    std::atomic<uint32_t> m_Middle{ 2 };
+};
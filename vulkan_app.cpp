@@ -15,14 +15,18 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include "file_utils.h"
+#include "model_loader.h"
+#include "vulkan_memory.h"
 
 const std::string MODEL_PATH = "Models/viking_room.obj";
 const std::string TEXTURE_PATH = "Textures/viking_room.png";
+const std::string SHADER_DIRECTORY = "shaders/";
+const std::string SHADER_CACHE_DIRECTORY = "shaders/cache/";
+
+// The feature mask of shader.frag, specialized at pipeline creation. A shader built with the features as a define
+// has no such constant, Vulkan then ignores the entry.
+static const VkSpecializationMapEntry SHADING_FEATURES_ENTRY = { SHADING_FEATURES_CONSTANT_ID, 0, sizeof(uint32_t) };
 
 /*
     https://vulkan-tutorial.com/
@@ -83,29 +87,15 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
     }
 }
 
-void ReadFile(const std::string& filename, std::vector<char>& buffer)
-{
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open())
-    {
-        throw std::runtime_error("failed to open file!");
-    }
-
-    size_t fileSize = (size_t)file.tellg();
-    buffer.resize(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-
-    file.close();
-}
-
 void VulkanApplication::Run()
 {
     SetCurrentDirectory();
+    JobSystem::ConfigureGlobal(m_Config.jobThreads, m_Config.pinThreads);
 
-    InitWindow();
+    {
+        StartupTimer::Scope scope(m_StartupTimer, "InitWindow");
+        InitWindow();
+    }
 
     InitVulkan();
 
@@ -116,52 +106,362 @@ void VulkanApplication::Run()
 
 void VulkanApplication::InitVulkan()
 {
-    CreateInstance();
-    SetupDebugMessenger();
-    CreateSurface();
-    PickPhysicalDevice();
-    CreateLogicalDevice();
-    CreateSwapChain();
-    CreateImageViews();
-    CreateRenderPass();
-    CreateDescriptorSetLayout();
-    CreateGraphicsPipeline();
-    CreateCommandPool();
-    CreateColorResources();
-    CreateDepthResources();
-    CreateFramebuffers();
-    CreateTextureImage();
-    CreateTextureImageView();
-    CreateTextureSampler();
+    /*
+    Reading and decoding the assets does not depend on any Vulkan object,
+    so it runs on worker threads while the instance, device, swap chain... are created.
+    Each task is joined right before the first step that needs its result.
+    */
+    StartAssetLoading();
+
+    auto step = [this](const char* name, void (VulkanApplication::*createFunction)())
+    {
+        StartupTimer::Scope scope(m_StartupTimer, name);
+        (this->*createFunction)();
+    };
+
+    auto join = [this](const char* name, std::future<void>& task)
+    {
+        StartupTimer::Scope scope(m_StartupTimer, name);
+        task.get(); // rethrows the exception of a failed task
+    };
 
-    LoadModel();
+    step("CreateInstance", &VulkanApplication::CreateInstance);
+    step("SetupDebugMessenger", &VulkanApplication::SetupDebugMessenger);
+    step("CreateSurface", &VulkanApplication::CreateSurface);
+    step("PickPhysicalDevice", &VulkanApplication::PickPhysicalDevice);
+    step("CreateLogicalDevice", &VulkanApplication::CreateLogicalDevice);
+    step("CreateSwapChain", &VulkanApplication::CreateSwapChain);
+    step("CreateImageViews", &VulkanApplication::CreateImageViews);
+    if (!m_UseDynamicRendering)
+    {
+        step("CreateRenderPass", &VulkanApplication::CreateRenderPass);
+    }
+    step("CreateDescriptorSetLayout", &VulkanApplication::CreateDescriptorSetLayout);
+    join("Join LoadShaders", m_ShadersLoaded);
+    step("StartPipelineManager", &VulkanApplication::StartPipelineManager);
+    step("CreateGraphicsPipeline", &VulkanApplication::CreateGraphicsPipeline);
+    if (m_Config.depthPrepass)
+    {
+        step("CreateDepthPrepassPipeline", &VulkanApplication::CreateDepthPrepassPipeline);
+    }
+    if (m_UseMeshShaders)
+    {
+        step("CreateMeshShaderPipeline", &VulkanApplication::CreateMeshShaderPipeline);
+    }
+    step("CreateCommandPool", &VulkanApplication::CreateCommandPool);
+    step("CreateColorResources", &VulkanApplication::CreateColorResources);
+    step("CreateDepthResources", &VulkanApplication::CreateDepthResources);
+    if (!m_UseDynamicRendering)
+    {
+        step("CreateFramebuffers", &VulkanApplication::CreateFramebuffers);
+    }
+    join("Join LoadTexture", m_TextureLoaded);
+    step("CreateTextureImage", &VulkanApplication::CreateTextureImage);
+    step("CreateTextureImageView", &VulkanApplication::CreateTextureImageView);
+    step("CreateTextureSampler", &VulkanApplication::CreateTextureSampler);
+    join("Join LoadModel", m_ModelLoaded);
+    if (m_Config.geometryPool)
+    {
+        step("CreateGeometryPool", &VulkanApplication::CreateGeometryPool);
+    }
+    else
+    {
+        step("CreateVertexBuffer", &VulkanApplication::CreateVertexBuffer);
+        if (m_Config.depthPrepass)
+        {
+            step("CreatePositionBuffer", &VulkanApplication::CreatePositionBuffer);
+        }
+        step("CreateIndexBuffer", &VulkanApplication::CreateIndexBuffer);
+    }
+    if (m_UseSoftwareOcclusion)
+    {
+        step("CreateSoftwareOcclusion", &VulkanApplication::CreateSoftwareOcclusion);
+    }
+    step("CreateUniformBuffers", &VulkanApplication::CreateUniformBuffers);
+    step("CreateDescriptorAllocators", &VulkanApplication::CreateDescriptorAllocators);
+    if (m_UseOcclusionCulling)
+    {
+        step("CreateOcclusionCuller", &VulkanApplication::CreateOcclusionCuller);
+    }
+    if (m_UseMeshletCulling)
+    {
+        step("CreateMeshletCuller", &VulkanApplication::CreateMeshletCuller);
+    }
+    step("CreateCommandBuffers", &VulkanApplication::CreateCommandBuffers);
+    step("CreateSyncObjects", &VulkanApplication::CreateSyncObjects);
+    step("CreateProfiler", &VulkanApplication::CreateProfiler);
+    if (!m_Config.exportDirectory.empty())
+    {
+        step("StartFrameExport", &VulkanApplication::StartFrameExport);
+    }
+    if (m_Config.mouseCamera)
+    {
+        step("StartLatencyMarkers", &VulkanApplication::StartLatencyMarkers);
+    }
+    if (m_Config.shaderHotReload)
+    {
+        step("StartShaderHotReload", &VulkanApplication::StartShaderHotReload);
+    }
 
-    CreateVertexBuffer();
-    CreateIndexBuffer();
-    CreateUniformBuffers();
-    CreateDescriptorPool();
-    CreateDescriptorSets();
-    CreateCommandBuffers();
-    CreateSyncObjects();
+    if (m_Config.printStartupTiming)
+    {
+        m_StartupTimer.Print(std::cout);
+    }
 }
 
 void VulkanApplication::MainLoop()
 {
+    // The benchmarks step the simulation once per frame, to stay deterministic
+    if (m_Config.renderThread && (m_Config.resizeBenchmarkCount > 0 || m_Config.runBenchmark))
+    {
+        std::cout << "--render-thread ignored: the benchmarks render on the main thread" << std::endl;
+    }
+
+    // The benchmark cameras are scripted, a resize changes the swap chain under the latch, the thumbnails have their own cameras
+    if (m_Config.lateLatch)
+    {
+        m_UseLateLatch = m_Config.resizeBenchmarkCount == 0 && !m_Config.runBenchmark && m_Config.thumbnailViews == 0;
+        if (!m_UseLateLatch)
+        {
+            std::cout << "--late-latch ignored with the benchmarks and --thumbnails, the camera is written before recording" << std::endl;
+        }
+        // The Hi-Z, meshlet and CPU occlusion tests read the camera when recording, they would reject visible objects
+        else if (m_UseOcclusionCulling || m_UseSoftwareOcclusion || m_UseMeshletCulling)
+        {
+            m_UseLateLatch = false;
+            std::cout << "--late-latch ignored with occlusion and meshlet culling, they cull with the camera of the snapshot" << std::endl;
+        }
+    }
+
+    if (m_Config.resizeBenchmarkCount > 0)
+    {
+        ResizeBenchmark();
+        return;
+    }
+
+    if (m_Config.runBenchmark)
+    {
+        BenchmarkLoop();
+        return;
+    }
+
+    if (m_Config.renderThread)
+    {
+        // Before the thread starts: RecreateSwapChain reads it from the render thread
+        m_UseRenderThread = true;
+        RenderThreadLoop();
+        return;
+    }
+
     while (!glfwWindowShouldClose(m_Window))
     {
         glfwPollEvents();
+        PublishSnapshot();
         DrawFrame();
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::this_thread::sleep_for(SIMULATION_INTERVAL);
+    }
+
+    vkDeviceWaitIdle(m_Device);
+}
+
+void VulkanApplication::RenderThreadLoop()
+{
+    /*
+    The main thread keeps what GLFW allows on it only: the events, the window size, and the simulation that reads the
+    input. It publishes a snapshot per step, never waiting for the renderer; the render thread waits for the fences
+    and the presentation engine, never for the simulation. The first snapshot exists before the first frame.
+    */
+    PublishSnapshot();
+    m_StopRendering = false;
+    m_RenderThreadDone = false;
+    m_RenderThread = std::thread(&VulkanApplication::RenderThreadMain, this);
+
+    while (!glfwWindowShouldClose(m_Window) && !m_RenderThreadDone)
+    {
+        // Wakes up for the input right away, steps the simulation at least every interval
+        glfwWaitEventsTimeout(std::chrono::duration<double>(SIMULATION_INTERVAL).count());
+        QueryFramebufferSize();
+        PublishSnapshot();
+    }
+
+    m_StopRendering = true;
+    m_RenderThread.join();
+    if (m_RenderThreadError)
+    {
+        std::rethrow_exception(m_RenderThreadError);
+    }
+}
+
+void VulkanApplication::RenderThreadMain()
+{
+    try
+    {
+        while (!m_StopRendering)
+        {
+            DrawFrame();
+        }
+        vkDeviceWaitIdle(m_Device);
+    }
+    catch (...)
+    {
+        // Rethrown on the main thread, which stops polling once the render thread is done
+        m_RenderThreadError = std::current_exception();
+    }
+    m_RenderThreadDone = true;
+}
+
+void VulkanApplication::BenchmarkLoop()
+{
+    /*
+    Same frame loop as MainLoop, but deterministic:
+    simulation time advances by a fixed timestep per frame (see PublishSnapshot),
+    there is no sleep between frames, and the run stops after a fixed number of frames.
+    */
+    m_Benchmark.Start(m_Config.benchmark);
+    if (m_UseDynamicRendering)
+    {
+        m_Benchmark.AddFeature("dynamic-rendering");
+    }
+    if (m_Config.depthPrepass)
+    {
+        m_Benchmark.AddFeature("depth-prepass");
+    }
+    if (m_Config.lodPixelError > 0.0f)
+    {
+        m_Benchmark.AddFeature("lod");
+    }
+    if (m_FrameReadback.IsEnabled())
+    {
+        m_Benchmark.AddFeature("export");
+    }
+    if (m_Config.thumbnailViews > 0)
+    {
+        m_Benchmark.AddFeature("thumbnails-" + std::to_string(m_Config.thumbnailViews));
+    }
+
+    // GPU times arrive MAX_FRAMES_IN_FLIGHT frames late, only take each collected frame once.
+    // The profiler numbers the submitted frames, like the benchmark.
+    auto addCollectedGpuFrame = [this]()
+    {
+        const int64_t collectedFrame = m_Profiler.GetLastCollectedFrameNumber();
+        if (collectedFrame > m_LastBenchmarkGpuFrame)
+        {
+            m_Benchmark.AddGpuFrameTime(collectedFrame, m_Profiler.GetLastGpuFrameTimeMs());
+            if (m_Profiler.HasPipelineStatistics())
+            {
+                const PipelineStatistics& statistics = m_Profiler.GetLastPipelineStatistics();
+                m_Benchmark.AddShaderInvocations(collectedFrame, statistics.vertexShaderInvocations, statistics.fragmentShaderInvocations);
+            }
+            m_LastBenchmarkGpuFrame = collectedFrame;
+        }
+    };
+
+    while (!m_Benchmark.IsFinished() && !glfwWindowShouldClose(m_Window))
+    {
+        glfwPollEvents();
+
+        const auto frameStart = std::chrono::steady_clock::now();
+        PublishSnapshot();
+        const bool submitted = DrawFrame();
+        const auto frameEnd = std::chrono::steady_clock::now();
+
+        // A frame that only recreated the swap chain is drawn again, with the same camera
+        if (submitted)
+        {
+            if (m_Config.lodPixelError > 0.0f)
+            {
+                m_Benchmark.AddLodTriangles(m_LodTriangles);
+            }
+            m_Benchmark.EndFrame(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+        }
+
+        addCollectedGpuFrame();
+    }
+
+    // The last frames in flight: once the device is idle their queries are read one by one
+    vkDeviceWaitIdle(m_Device);
+    while (m_Profiler.CollectOldestFrame())
+    {
+        addCollectedGpuFrame();
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    m_Benchmark.WriteReport(properties.deviceName, m_SwapChainExtent.width, m_SwapChainExtent.height);
+}
+
+void VulkanApplication::ResizeBenchmark()
+{
+    /*
+    Alternates the window between its initial size and 3/4 of it, and times RecreateSwapChain only.
+    With a render pass every resize also rebuilds one framebuffer per swap chain image, with dynamic rendering
+    only the swap chain, its views and the MSAA/depth images are rebuilt.
+    */
+    int width, height;
+    glfwGetWindowSize(m_Window, &width, &height);
+
+    std::vector<double> recreateTimesMs;
+    for (uint32_t i = 0; i < m_Config.resizeBenchmarkCount && !glfwWindowShouldClose(m_Window); ++i)
+    {
+        if (i % 2 == 0)
+        {
+            glfwSetWindowSize(m_Window, width * 3 / 4, height * 3 / 4);
+        }
+        else
+        {
+            glfwSetWindowSize(m_Window, width, height);
+        }
+        glfwPollEvents();
+
+        const auto start = std::chrono::steady_clock::now();
+        RecreateSwapChain();
+        const auto end = std::chrono::steady_clock::now();
+        recreateTimesMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+        // Render one frame at the new size, as a real resize would
+        PublishSnapshot();
+        DrawFrame();
     }
 
     vkDeviceWaitIdle(m_Device);
+
+    const FrameTimeSummary summary = SummarizeFrameTimes(recreateTimesMs);
+    printf("swap chain recreation (%s), %zu resizes: mean %.3f ms, min %.3f, p50 %.3f, p95 %.3f, max %.3f\n",
+        m_UseDynamicRendering ? "dynamic rendering" : "render pass + framebuffers", summary.count,
+        summary.mean, summary.min, summary.p50, summary.p95, summary.max);
 }
 
 void VulkanApplication::Cleanup()
 {
     //Vulkan
     {
+        // Its thread waits on the swap chain
+        if (m_LatencyMarkers.IsEnabled())
+        {
+            m_LatencyMarkers.Print(std::cout);
+            m_LatencyMarkers.Destroy();
+        }
+
+        // The frames already copied are written, the buffers go before the device
+        m_FrameReadback.Destroy();
+
+        // The watcher and pipeline threads may be building pipelines
+        m_ShaderWatcher.Stop();
+        m_PipelineManager.Stop();
+        for (const std::vector<VkPipeline>& pipelines : m_RetiredPipelines)
+        {
+            for (VkPipeline pipeline : pipelines)
+            {
+                vkDestroyPipeline(m_Device, pipeline, nullptr);
+            }
+        }
+        vkDestroyPipeline(m_Device, m_ReloadedPipelines.graphics, nullptr);
+        vkDestroyPipeline(m_Device, m_ReloadedPipelines.depthPrepass, nullptr);
+        vkDestroyPipeline(m_Device, m_ReloadedPipelines.meshShader, nullptr);
+        m_ReloadedPipelines.graphicsLibraries = {};
+        m_GraphicsLibraries = {};
+
         CleanupSwapChain();
 
         vkDestroySampler(m_Device, m_TextureSampler, nullptr);
@@ -170,13 +470,19 @@ void VulkanApplication::Cleanup()
         vkDestroyImage(m_Device, m_TextureImage, nullptr);
         vkFreeMemory(m_Device, m_TextureImageMemory, nullptr);
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        m_OcclusionCuller.Destroy();
+        m_MeshletCuller.Destroy();
+        m_GeometryPool.Destroy();
+
+        vkDestroyBuffer(m_Device, m_FrameBuffer, nullptr);
+        vkFreeMemory(m_Device, m_FrameBufferMemory, nullptr);
+
+        m_DescriptorCache.Clear();
+        m_DescriptorAllocator.Cleanup();
+        for (DescriptorAllocator& allocator : m_FrameDescriptorAllocators)
         {
-            vkDestroyBuffer(m_Device, m_UniformBuffers[i], nullptr);
-            vkFreeMemory(m_Device, m_UniformBuffersMemory[i], nullptr);
+            allocator.Cleanup();
         }
-
-        vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
         vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
 
         vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
@@ -185,10 +491,36 @@ void VulkanApplication::Cleanup()
         vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
         vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
 
-        vkDestroyPipeline(m_Device, m_GraphicsPipeline, nullptr);
+        if (m_Config.depthPrepass)
+        {
+            vkDestroyBuffer(m_Device, m_PositionBuffer, nullptr);
+            vkFreeMemory(m_Device, m_PositionBufferMemory, nullptr);
+            vkDestroyPipeline(m_Device, m_DepthPrepassPipeline, nullptr);
+        }
+
+        if (m_UseMeshShaders)
+        {
+            for (const auto& permutation : m_MeshShaderPermutations)
+            {
+                vkDestroyPipeline(m_Device, permutation.second, nullptr);
+            }
+            vkDestroyPipelineLayout(m_Device, m_MeshShaderPipelineLayout, nullptr);
+            vkDestroyDescriptorSetLayout(m_Device, m_MeshletSetLayout, nullptr);
+        }
+
+        for (const auto& permutation : m_GraphicsPermutations)
+        {
+            vkDestroyPipeline(m_Device, permutation.second, nullptr);
+        }
         vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
 
         vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+        if (m_UseOcclusionCulling && !m_UseDynamicRendering)
+        {
+            vkDestroyRenderPass(m_Device, m_LoadRenderPass, nullptr);
+        }
+
+        m_Profiler.Destroy();
 
         // should be cleaned onto the main drawing function!
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
@@ -224,11 +556,35 @@ void VulkanApplication::InitWindow()
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    if (m_Config.headless)
+    {
+        // The swap chain still needs a surface, the window is just never shown
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    if (m_Config.runBenchmark)
+    {
+        // Fixed resolution, results of different runs must be comparable
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    }
 
     m_Window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
 
     glfwSetWindowUserPointer(m_Window, this);
     glfwSetFramebufferSizeCallback(m_Window, FramebufferResizeCallback);
+    glfwSetKeyCallback(m_Window, KeyCallback);
+    if (m_Config.mouseCamera)
+    {
+        glfwSetCursorPosCallback(m_Window, CursorPosCallback);
+    }
+    QueryFramebufferSize();
+}
+
+void VulkanApplication::QueryFramebufferSize()
+{
+    int width, height;
+    glfwGetFramebufferSize(m_Window, &width, &height);
+    m_FramebufferWidth = static_cast<uint32_t>(width);
+    m_FramebufferHeight = static_cast<uint32_t>(height);
 }
 
 void VulkanApplication::CreateInstance()
@@ -354,6 +710,81 @@ void VulkanApplication::PickPhysicalDevice()
         m_PhysicalDevice = candidates.rbegin()->second;
 
         m_MsaaSamples = GetMaxUsableSampleCount();
+
+        if (m_Config.dynamicRendering)
+        {
+            m_UseDynamicRendering = IsDynamicRenderingSupported(m_PhysicalDevice);
+            if (!m_UseDynamicRendering)
+            {
+                std::cerr << "VK_KHR_dynamic_rendering is not supported by the device, using a render pass" << std::endl;
+            }
+        }
+
+        if (m_Config.occlusionCulling)
+        {
+            m_UseOcclusionCulling = OcclusionCuller::IsSupported(m_PhysicalDevice, FindDepthFormat(), m_MsaaSamples);
+            if (!m_UseOcclusionCulling)
+            {
+                std::cerr << "the depth attachment can't be sampled on this device, culling occluded objects on the CPU" << std::endl;
+            }
+        }
+        m_UseSoftwareOcclusion = m_Config.cpuOcclusionCulling || (m_Config.occlusionCulling && !m_UseOcclusionCulling);
+
+        if (m_Config.geometryPool)
+        {
+            m_UseBufferDeviceAddress = IsBufferDeviceAddressSupported(m_PhysicalDevice);
+            if (!m_UseBufferDeviceAddress)
+            {
+                std::cerr << "VK_KHR_buffer_device_address is not supported by the device, pulling the vertices from a storage buffer" << std::endl;
+            }
+        }
+
+        if (m_Config.pipelineLibrary)
+        {
+            m_UseGraphicsPipelineLibrary = IsGraphicsPipelineLibrarySupported(m_PhysicalDevice);
+            if (!m_UseGraphicsPipelineLibrary)
+            {
+                std::cerr << "VK_EXT_graphics_pipeline_library is not supported by the device, building whole pipelines on the workers" << std::endl;
+            }
+        }
+
+        if (m_Config.mouseCamera)
+        {
+            m_UsePresentWait = IsPresentWaitSupported(m_PhysicalDevice);
+            if (!m_UsePresentWait)
+            {
+                std::cerr << "VK_KHR_present_wait is not supported by the device, measuring the input latency up to vkQueuePresentKHR" << std::endl;
+            }
+        }
+
+        if (m_Config.meshlets)
+        {
+            m_UseMeshletCulling = !m_UseOcclusionCulling;
+            if (!m_UseMeshletCulling)
+            {
+                std::cerr << "meshlet culling is not combined with the Hi-Z occlusion culling, drawing whole objects" << std::endl;
+            }
+        }
+
+        if (m_Config.meshShaders && m_UseMeshletCulling)
+        {
+            // The depth prepass draws the compacted indices with its vertex shader, so it keeps the compute culling
+            m_UseMeshShaders = !m_Config.depthPrepass && IsMeshShaderSupported(m_PhysicalDevice);
+            if (!m_UseMeshShaders)
+            {
+                std::cerr << "VK_EXT_mesh_shader is not supported by the device or used with --depth-prepass, culling the meshlets in compute" << std::endl;
+            }
+        }
+
+        // Their culling results hold for one camera, the thumbnails share one draw list between many
+        if (m_Config.thumbnailViews > 0 && (m_UseOcclusionCulling || m_UseSoftwareOcclusion || m_UseMeshletCulling))
+        {
+            std::cerr << "occlusion and meshlet culling see the scene from a single camera, disabled with --thumbnails" << std::endl;
+            m_UseOcclusionCulling = false;
+            m_UseSoftwareOcclusion = false;
+            m_UseMeshletCulling = false;
+            m_UseMeshShaders = false;
+        }
     }
     else
     {
@@ -389,6 +820,18 @@ void VulkanApplication::CreateLogicalDevice()
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE; // enable sample shading feature for the device
 
+    if (m_Config.enablePipelineStatistics)
+    {
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supportedFeatures);
+        deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
+        if (!supportedFeatures.pipelineStatisticsQuery)
+        {
+            std::cerr << "pipeline statistics queries are not supported by the device" << std::endl;
+        }
+    }
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -397,8 +840,70 @@ void VulkanApplication::CreateLogicalDevice()
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(m_DeviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = m_DeviceExtensions.data();
+    std::vector<const char*> enabledExtensions = m_DeviceExtensions;
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+
+    if (m_UseDynamicRendering)
+    {
+        enabledExtensions.insert(enabledExtensions.end(), DYNAMIC_RENDERING_EXTENSIONS.begin(), DYNAMIC_RENDERING_EXTENSIONS.end());
+        createInfo.pNext = &dynamicRenderingFeatures;
+    }
+
+    // Task and mesh shaders only, chained in front of the other feature structures
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    meshShaderFeatures.taskShader = VK_TRUE;
+    meshShaderFeatures.meshShader = VK_TRUE;
+
+    if (m_UseMeshShaders)
+    {
+        enabledExtensions.insert(enabledExtensions.end(), MESH_SHADER_EXTENSIONS.begin(), MESH_SHADER_EXTENSIONS.end());
+        meshShaderFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &meshShaderFeatures;
+    }
+
+    VkPhysicalDeviceBufferDeviceAddressFeaturesKHR bufferDeviceAddressFeatures{};
+    bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+    bufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
+
+    if (m_UseBufferDeviceAddress)
+    {
+        enabledExtensions.insert(enabledExtensions.end(), BUFFER_DEVICE_ADDRESS_EXTENSIONS.begin(), BUFFER_DEVICE_ADDRESS_EXTENSIONS.end());
+        bufferDeviceAddressFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &bufferDeviceAddressFeatures;
+    }
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures{};
+    graphicsPipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    graphicsPipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+
+    if (m_UseGraphicsPipelineLibrary)
+    {
+        enabledExtensions.insert(enabledExtensions.end(), GRAPHICS_PIPELINE_LIBRARY_EXTENSIONS.begin(), GRAPHICS_PIPELINE_LIBRARY_EXTENSIONS.end());
+        graphicsPipelineLibraryFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &graphicsPipelineLibraryFeatures;
+    }
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    presentIdFeatures.presentId = VK_TRUE;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.presentWait = VK_TRUE;
+
+    if (m_UsePresentWait)
+    {
+        enabledExtensions.insert(enabledExtensions.end(), PRESENT_WAIT_EXTENSIONS.begin(), PRESENT_WAIT_EXTENSIONS.end());
+        presentIdFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        presentWaitFeatures.pNext = &presentIdFeatures;
+        createInfo.pNext = &presentWaitFeatures;
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
     /*
         Previous implementations of Vulkan made a distinction between instance and device specific validation layers,
         but this is no longer the case. That means that the enabledLayerCount and ppEnabledLayerNames fields
@@ -423,9 +928,51 @@ void VulkanApplication::CreateLogicalDevice()
 
     vkGetDeviceQueue(m_Device, indices.graphicsFamily.value(), 0, &m_GraphicsQueue);
     vkGetDeviceQueue(m_Device, indices.presentFamily.value(), 0, &m_PresentQueue);
-}
 
-void VulkanApplication::CreateSwapChain()
+    // Extension commands are not exported by the loader, they are fetched from the device
+    if (m_UseDynamicRendering)
+    {
+        m_CmdBeginRendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(m_Device, "vkCmdBeginRenderingKHR");
+        m_CmdEndRendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(m_Device, "vkCmdEndRenderingKHR");
+
+        if (!m_CmdBeginRendering || !m_CmdEndRendering)
+        {
+            throw std::runtime_error("failed to load the VK_KHR_dynamic_rendering commands!");
+        }
+    }
+
+    if (m_UseMeshShaders)
+    {
+        m_CmdDrawMeshTasks = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(m_Device, "vkCmdDrawMeshTasksEXT");
+
+        if (!m_CmdDrawMeshTasks)
+        {
+            throw std::runtime_error("failed to load the VK_EXT_mesh_shader commands!");
+        }
+    }
+
+    if (m_UseBufferDeviceAddress)
+    {
+        m_GetBufferDeviceAddress = (PFN_vkGetBufferDeviceAddressKHR)vkGetDeviceProcAddr(m_Device, "vkGetBufferDeviceAddressKHR");
+
+        if (!m_GetBufferDeviceAddress)
+        {
+            throw std::runtime_error("failed to load the VK_KHR_buffer_device_address commands!");
+        }
+    }
+
+    if (m_UsePresentWait)
+    {
+        m_WaitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(m_Device, "vkWaitForPresentKHR");
+
+        if (!m_WaitForPresent)
+        {
+            throw std::runtime_error("failed to load the VK_KHR_present_wait commands!");
+        }
+    }
+}
+
+void VulkanApplication::CreateSwapChain()
 {
     const SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice);
 
@@ -462,6 +1009,15 @@ void VulkanApplication::CreateSwapChain()
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // The frame export copies the presented images into its readback buffers
+    if (!m_Config.exportDirectory.empty())
+    {
+        if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) || !FrameReadback::IsFormatSupported(surfaceFormat.format))
+        {
+            throw std::runtime_error("the swap chain images can't be read back for --export!");
+        }
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
     
     const QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
     const uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -524,17 +1080,36 @@ void VulkanApplication::CreateSwapChain()
 
 void VulkanApplication::RecreateSwapChain()
 {
-    int width = 0, height = 0;
-    while (width == 0 || height == 0)
+    /*
+    window minimization a special case
+    Only the main thread can wait for the events, the render thread waits for the main thread to see the new size.
+    */
+    if (!m_UseRenderThread)
     {
-        /*
-        window minimization a special case
-        */
-        glfwGetFramebufferSize(m_Window, &width, &height);
-        glfwWaitEvents();
+        QueryFramebufferSize();
+    }
+    while (m_FramebufferWidth == 0 || m_FramebufferHeight == 0)
+    {
+        if (!m_UseRenderThread)
+        {
+            glfwWaitEvents();
+            QueryFramebufferSize();
+        }
+        else if (m_StopRendering)
+        {
+            return;
+        }
+        else
+        {
+            std::this_thread::sleep_for(SIMULATION_INTERVAL);
+        }
     }
 
     vkDeviceWaitIdle(m_Device);
+    // The pipeline threads read the swap chain format
+    m_PipelineManager.WaitIdle();
+    // So does a shader reload on the watcher thread, which is not waited for: it can take a while
+    std::lock_guard<std::mutex> swapChainLock(m_SwapChainMutex);
 
     CleanupSwapChain();
 
@@ -546,8 +1121,18 @@ void VulkanApplication::RecreateSwapChain()
 
     CreateDepthResources();
 
+    // The depth pyramid has the size of the depth attachment and reads it
+    if (m_UseOcclusionCulling)
+    {
+        m_OcclusionCuller.CreateDepthPyramid(m_DepthImage, m_DepthImageView, GetDepthAspects(), m_MsaaSamples, m_SwapChainExtent);
+    }
+
     // The framebuffers directly depend on the swap chain images, and thus must be recreated as well.
-    CreateFramebuffers();
+    // With dynamic rendering there are none: the image views are given to vkCmdBeginRendering every frame.
+    if (!m_UseDynamicRendering)
+    {
+        CreateFramebuffers();
+    }
 
     /*
     We don't recreate the renderpass here for simplicity. In theory it can be possible for the swap chain
@@ -565,6 +1150,10 @@ void VulkanApplication::CleanupSwapChain()
     vkFreeMemory(m_Device, m_ColorImageMemory, nullptr);
 
     // Cleanup Depth
+    if (m_UseOcclusionCulling)
+    {
+        m_OcclusionCuller.DestroyDepthPyramid();
+    }
     vkDestroyImageView(m_Device, m_DepthImageView, nullptr);
     vkDestroyImage(m_Device, m_DepthImage, nullptr);
     vkFreeMemory(m_Device, m_DepthImageMemory, nullptr);
@@ -579,6 +1168,9 @@ void VulkanApplication::CleanupSwapChain()
         vkDestroyImageView(m_Device, m_SwapChainImageViews[i], nullptr);
     }
 
+    // The latency thread may be waiting for one of its presents
+    auto swapchainLock = m_LatencyMarkers.LockSwapchain();
+    m_LatencyMarkers.ForgetSwapchain(m_SwapChain);
     vkDestroySwapchainKHR(m_Device, m_SwapChain, nullptr);
 }
 
@@ -672,6 +1264,11 @@ void VulkanApplication::CreateRenderPass()
     This may allow the hardware to perform additional optimizations. Just like the color buffer, we don't care about the previous depth contents,
     so we can use VK_IMAGE_LAYOUT_UNDEFINED as initialLayout.
     */
+    if (m_UseOcclusionCulling)
+    {
+        // The depth pyramid is built from it, and the second culling phase keeps drawing into it
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    }
 
     VkAttachmentReference depthAttachmentRef{};
     depthAttachmentRef.attachment = 1;
@@ -721,6 +1318,21 @@ void VulkanApplication::CreateRenderPass()
     we should specify the access mask for writes.
     */
 
+    /*
+    --export: the frame is copied out of the resolved image after the render pass. Without an outgoing dependency the
+    implicit one ends at BOTTOM_OF_PIPE, which the transfer barrier of FrameReadback::RecordCopy can't chain with:
+    the finalLayout transition to PRESENT_SRC_KHR must be done before the copy transitions the image again.
+    */
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0] = dependency;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    const uint32_t dependencyCount = m_Config.exportDirectory.empty() ? 1 : 2;
+
     std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -728,13 +1340,44 @@ void VulkanApplication::CreateRenderPass()
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = dependencyCount;
+    renderPassInfo.pDependencies = dependencies.data();
 
     if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to create render pass!");
     }
+
+    if (m_UseOcclusionCulling)
+    {
+        /*
+        Second occlusion culling phase: the color and depth of the first phase are loaded, not cleared.
+        The attachments only differ in load operations and layouts, so this render pass is compatible with
+        m_RenderPass: the same framebuffers and pipelines work with both.
+        */
+        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        // Wait for the first phase to write color, and for the depth pyramid build to read depth
+        VkSubpassDependency loadDependency{};
+        loadDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        loadDependency.dstSubpass = 0;
+        loadDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        loadDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        loadDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        loadDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0] = loadDependency;
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_LoadRenderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
 }
 
 void VulkanApplication::CreateDescriptorSetLayout()
@@ -754,12 +1397,28 @@ void VulkanApplication::CreateDescriptorSetLayout()
     // UBO 
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; // offset given at bind time, see FrameLinearAllocator
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    if (m_UseMeshShaders)
+    {
+        // The task shader culls with viewProj, the mesh shader transforms the vertices
+        uboLayoutBinding.stageFlags |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
     uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+    // Vertices of the geometry pool, when the vertex shader can't pull them through their address
+    VkDescriptorSetLayoutBinding vertexLayoutBinding{};
+    vertexLayoutBinding.binding = 2;
+    vertexLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    vertexLayoutBinding.descriptorCount = 1;
+    vertexLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding, samplerLayoutBinding };
+    if (m_Config.geometryPool && !m_UseBufferDeviceAddress)
+    {
+        bindings.push_back(vertexLayoutBinding);
+    }
     
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -772,15 +1431,66 @@ void VulkanApplication::CreateDescriptorSetLayout()
     }
 }
 
+void VulkanApplication::StartPipelineManager()
+{
+    // Half the hardware threads at most: the pipelines are built while the frames are recorded and the assets decoded
+    const uint32_t threadCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, MAX_PIPELINE_THREADS);
+    m_PipelineManager.Start(m_Device, threadCount);
+    m_RetiredPipelines.resize(MAX_FRAMES_IN_FLIGHT);
+}
+
 void VulkanApplication::CreateGraphicsPipeline()
 {
-    std::vector<char> vertShaderCode;
-    ReadFile("shaders/vert.spv", vertShaderCode);
-    std::vector<char>  fragShaderCode;
-    ReadFile("shaders/frag.spv", fragShaderCode);
+    //////////////////////////////////////////////////////////////////////////
+    // Pipeline layout
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1; // Optional
+    pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout; // Optional
+    // Per-object transforms, see ObjectPushConstants
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = m_Config.geometryPool ? sizeof(PulledObjectPushConstants) : sizeof(ObjectPushConstants);
+
+    pipelineLayoutInfo.pushConstantRangeCount = 1; // Optional
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange; // Optional
+    /*
+        You can use uniform values in shaders, which are globals similar to dynamic state variables that can be
+        changed at drawing time to alter the behavior of your shaders without having to recreate them
+    */
+    if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
 
-    const VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-    const VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+    // m_VertShaderCode and m_FragShaderCode are read by LoadShaders during startup
+    const std::vector<char>& vertShaderCode = !m_Config.geometryPool ? m_VertShaderCode
+        : m_UseBufferDeviceAddress ? m_VertexPullingShaders.deviceAddress : m_VertexPullingShaders.storageBuffer;
+    if (m_UseGraphicsPipelineLibrary)
+    {
+        // The first frames draw with the fast link, a pipeline thread replaces it with the optimized one
+        m_GraphicsLibraries = BuildGraphicsPipelineLibraries(vertShaderCode);
+        const std::shared_ptr<const VkPipeline> fragmentShader = OwnPipelineLibrary(
+            BuildGraphicsPipeline({}, m_FragShaderCode, m_ShadingFeatures, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT));
+        m_GraphicsPipeline = LinkGraphicsPipeline(m_GraphicsLibraries, *fragmentShader, false);
+        RequestPipeline(PIPELINE_SHADED, m_ShadingFeatures, fragmentShader);
+    }
+    else
+    {
+        m_GraphicsPipeline = BuildGraphicsPipeline(vertShaderCode, m_FragShaderCode, m_ShadingFeatures);
+    }
+    m_GraphicsPermutations[m_ShadingFeatures] = m_GraphicsPipeline;
+}
+
+VkPipeline VulkanApplication::BuildGraphicsPipeline(const std::vector<char>& vertShaderCode, const std::vector<char>& fragShaderCode, uint32_t shadingFeatures,
+    VkGraphicsPipelineLibraryFlagsEXT libraryParts) const
+{
+    // A library only has the shaders of its parts
+    const bool hasVertexShader = libraryParts == 0 || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+    const bool hasFragmentShader = libraryParts == 0 || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+    const VkShaderModule vertShaderModule = hasVertexShader ? CreateShaderModule(vertShaderCode) : VK_NULL_HANDLE;
+    const VkShaderModule fragShaderModule = hasFragmentShader ? CreateShaderModule(fragShaderCode) : VK_NULL_HANDLE;
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -794,21 +1504,44 @@ void VulkanApplication::CreateGraphicsPipeline()
     fragShaderStageInfo.module = fragShaderModule;
     fragShaderStageInfo.pName = "main";
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+    // The permutation: the driver compiles the branches of the disabled features out
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries = &SHADING_FEATURES_ENTRY;
+    specializationInfo.dataSize = sizeof(shadingFeatures);
+    specializationInfo.pData = &shadingFeatures;
+    fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    if (hasVertexShader)
+    {
+        shaderStages.push_back(vertShaderStageInfo);
+    }
+    if (hasFragmentShader)
+    {
+        shaderStages.push_back(fragShaderStageInfo);
+    }
 
     //////////////////////////////////////////////////////////////////////////
     // Input assembly
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    auto bindingDescription = Vertex::GetBindingDescription();
-    auto attributeDescriptions = Vertex::GetAttributeDescriptions();
+    auto bindingDescription = VertexLayout::GetBindingDescription();
+    auto attributeDescriptions = VertexLayout::GetAttributeDescriptions();
 
     vertexInputInfo.vertexBindingDescriptionCount = 1;
     vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
     vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
     vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
+    // The geometry pool has no vertex input at all, the vertex shader fetches the vertices itself
+    if (m_Config.geometryPool)
+    {
+        vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    }
+
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -904,6 +1637,16 @@ void VulkanApplication::CreateGraphicsPipeline()
         depthCompareOp field specifies the comparison that is performed to keep or discard fragments.
         We're sticking to the convention of lower depth = closer, so the depth of new fragments should be less.
         */
+        if (m_Config.depthPrepass)
+        {
+            /*
+            The prepass already wrote the closest depth of every pixel: only the fragments that produced it pass
+            an EQUAL test, so the expensive fragment shader runs once per sample no matter how much overdraw the scene has.
+            Both vertex shaders declare gl_Position invariant so the depths match exactly.
+            */
+            depthStencil.depthWriteEnable = VK_FALSE;
+            depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+        }
         depthStencil.depthBoundsTestEnable = VK_FALSE;
         depthStencil.minDepthBounds = 0.0f; // Optional
         depthStencil.maxDepthBounds = 1.0f; // Optional
@@ -972,27 +1715,10 @@ void VulkanApplication::CreateGraphicsPipeline()
         framebuffer will actually be affected. It is also possible to disable both modes, as we've done here,
         in which case the fragment colors will be written to the framebuffer unmodified.
     */
-    //////////////////////////////////////////////////////////////////////////
-    // Pipeline layout
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1; // Optional
-    pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout; // Optional
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-    /*
-        You can use uniform values in shaders, which are globals similar to dynamic state variables that can be
-        changed at drawing time to alter the behavior of your shaders without having to recreate them
-    */
-    if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
-
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
 
     // Then we reference all of the structures describing the fixed-function stage.
     pipelineInfo.pVertexInputState = &vertexInputInfo;
@@ -1009,6 +1735,37 @@ void VulkanApplication::CreateGraphicsPipeline()
     pipelineInfo.renderPass = m_RenderPass;
     pipelineInfo.subpass = 0;
 
+    /*
+    Without a render pass, the pipeline only needs the formats of the attachments it renders to.
+    */
+    VkPipelineRenderingCreateInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &m_SwapChainImageFormat;
+    renderingInfo.depthAttachmentFormat = FindDepthFormat();
+    renderingInfo.stencilAttachmentFormat = HasStencilComponent(renderingInfo.depthAttachmentFormat) ? renderingInfo.depthAttachmentFormat : VK_FORMAT_UNDEFINED;
+
+    if (m_UseDynamicRendering)
+    {
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+    }
+
+    /*
+    A library only takes the state of its parts, the rest of the structures above is ignored. The link-time optimization
+    information is kept, so LinkGraphicsPipeline can also build the optimized pipeline from the libraries.
+    */
+    VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+    libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    libraryInfo.flags = libraryParts;
+
+    if (libraryParts != 0)
+    {
+        libraryInfo.pNext = pipelineInfo.pNext;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+    }
+
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
     /*
@@ -1021,149 +1778,512 @@ void VulkanApplication::CreateGraphicsPipeline()
     to be created by index with basePipelineIndex. 
     */
 
-            
-    if (vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_GraphicsPipeline) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to create graphics pipeline!");
-    }
+    VkPipeline pipeline;
+    const VkResult result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
 
     vkDestroyShaderModule(m_Device, fragShaderModule, nullptr);
     vkDestroyShaderModule(m_Device, vertShaderModule, nullptr);
-}
-
-void VulkanApplication::CreateFramebuffers()
-{
-    /*
-    The attachments specified during render pass creation are bound by wrapping them into a
-    VkFramebuffer object. A framebuffer object references all of the VkImageView objects
-    that represent the attachments.
-
-    That means that we have to create a framebuffer for all of the images in the swap chain and
-    use the one that corresponds to the retrieved image at drawing time.
-    */
-    m_SwapChainFramebuffers.resize(m_SwapChainImageViews.size());
 
-    for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
+    if (result != VK_SUCCESS)
     {
-        std::array<VkImageView, 3> attachments =
-        {
-            m_ColorImageView,
-            m_DepthImageView, 
-            m_SwapChainImageViews[i],
-        };
-
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = m_RenderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());;
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = m_SwapChainExtent.width;
-        framebufferInfo.height = m_SwapChainExtent.height;
-        framebufferInfo.layers = 1;
-        /*
-            We first need to specify with which renderPass the framebuffer needs to be compatible. 
-            You can only use a framebuffer with the render passes that it is compatible with, which roughly means
-            that they use the same number and type of attachments.
-
-            The attachmentCount and pAttachments parameters specify the VkImageView objects that should be bound
-            to the respective attachment descriptions in the render pass pAttachment array.
-
-            layers refers to the number of layers in image arrays
-
-            The color attachment differs for every swap chain image, but the same depth image can be used by all of them
-            because only a single subpass is running at the same time due semaphores.
-        */
-        if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_SwapChainFramebuffers[i]) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
+        throw std::runtime_error("failed to create graphics pipeline!");
     }
+    return pipeline;
 }
 
-void VulkanApplication::CreateCommandPool()
+GraphicsPipelineLibraries VulkanApplication::BuildGraphicsPipelineLibraries(const std::vector<char>& vertShaderCode) const
 {
-    const QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+    GraphicsPipelineLibraries libraries;
+    libraries.vertexInput = OwnPipelineLibrary(BuildGraphicsPipeline({}, {}, 0, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT));
+    libraries.preRasterization = OwnPipelineLibrary(BuildGraphicsPipeline(vertShaderCode, {}, 0, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT));
+    libraries.fragmentOutput = OwnPipelineLibrary(BuildGraphicsPipeline({}, {}, 0, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT));
+    return libraries;
+}
+
+VkPipeline VulkanApplication::LinkGraphicsPipeline(const GraphicsPipelineLibraries& libraries, VkPipeline fragmentShader, bool optimize) const
+{
+    const VkPipeline parts[] = { *libraries.vertexInput, *libraries.preRasterization, fragmentShader, *libraries.fragmentOutput };
+
+    VkPipelineLibraryCreateInfoKHR linkInfo{};
+    linkInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    linkInfo.libraryCount = static_cast<uint32_t>(std::size(parts));
+    linkInfo.pLibraries = parts;
 
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
     /*
-    There are two possible flags for command pools:
-        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded with new commands very often (may change memory allocation behavior)
-        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
-    Each command pool can only allocate command buffers that are submitted on a single type of queue.
+    Without optimization the driver mostly concatenates the code it compiled for each library: fast enough to be done
+    on first use, but the stages are not optimized across each other (unused outputs, constant propagation...).
+    With VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT it compiles the whole pipeline again, like a monolithic one.
     */
-    if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS)
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = &linkInfo;
+    pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipelineInfo.layout = m_PipelineLayout;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
     {
-        throw std::runtime_error("failed to create command pool!");
+        throw std::runtime_error("failed to link graphics pipeline!");
     }
+    return pipeline;
 }
 
-void VulkanApplication::CreateColorResources()
+std::shared_ptr<const VkPipeline> VulkanApplication::OwnPipelineLibrary(VkPipeline library) const
 {
-    const VkFormat colorFormat = m_SwapChainImageFormat;
-
-    CreateImage(m_SwapChainExtent.width, m_SwapChainExtent.height, 1, m_MsaaSamples, colorFormat,
-        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_ColorImage, m_ColorImageMemory);
-
-    m_ColorImageView = CreateImageView(m_ColorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    // A linked pipeline doesn't need its libraries anymore, only the links in progress do
+    const VkDevice device = m_Device;
+    return std::shared_ptr<const VkPipeline>(new VkPipeline(library), [device](const VkPipeline* library)
+    {
+        vkDestroyPipeline(device, *library, nullptr);
+        delete library;
+    });
 }
 
-void VulkanApplication::CreateDepthResources()
+void VulkanApplication::CreateDepthPrepassPipeline()
 {
-    const VkFormat depthFormat = FindDepthFormat();
-
-    CreateImage(m_SwapChainExtent.width, m_SwapChainExtent.height, 1, m_MsaaSamples, depthFormat,
-        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_DepthImage, m_DepthImageMemory);
-
-    m_DepthImageView = CreateImageView(m_DepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
     /*
-    That's it for creating the depth image. We don't need to map it or copy another image to it,
-    because we're going to clear it at the start of the render pass like the color attachment.
+    Same render pass/attachment formats, layout and fixed-function state as the main pipeline,
+    but the vertex stage reads positions only and there is no fragment stage: the rasterizer only writes depth.
     */
+    const std::vector<char>& vertShaderCode = !m_Config.geometryPool ? m_DepthPrepassVertShaderCode
+        : m_UseBufferDeviceAddress ? m_VertexPullingShaders.depthPrepassDeviceAddress : m_VertexPullingShaders.depthPrepassStorageBuffer;
+    m_DepthPrepassPipeline = BuildDepthPrepassPipeline(vertShaderCode);
 }
 
-void VulkanApplication::CreateTextureImage()
+VkPipeline VulkanApplication::BuildDepthPrepassPipeline(const std::vector<char>& vertShaderCode) const
 {
-    int texWidth, texHeight, texChannels;
-    //stbi_uc* pixels = stbi_load("textures/texture.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-
-    if (!pixels)
-    {
-        throw std::runtime_error("failed to load texture image!");
-    }
+    const VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
 
-    m_MipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-    /*
-     The max function selects the largest dimension. The log2 function calculates how many times that dimension can be divided by 2.
-     The floor function handles cases where the largest dimension is not a power of 2.
-     1 is added so that the original image has a mip level.
-    */
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.pName = "main";
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    // A tightly packed vec3 stream, see CreatePositionBuffer
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(glm::vec3);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    VkVertexInputAttributeDescription attributeDescription{};
+    attributeDescription.binding = 0;
+    attributeDescription.location = 0;
+    attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescription.offset = 0;
 
-    void* data;
-    vkMapMemory(m_Device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(m_Device, stagingBufferMemory);
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount = 1;
+    vertexInputInfo.pVertexAttributeDescriptions = &attributeDescription;
 
-    stbi_image_free(pixels);
+    // The geometry pool has no position stream, the vertex shader reads the positions of the full vertices
+    if (m_Config.geometryPool)
+    {
+        vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    }
 
-    CreateImage(texWidth, texHeight, m_MipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_TextureImage, m_TextureImageMemory);
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-    /*
-    The next step is to copy the staging buffer to the texture image. This involves two steps:
-        Transition the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+    std::vector<VkDynamicState> dynamicStates =
+    {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    // Has to match the main pass exactly, otherwise the EQUAL test rejects fragments on some edges
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    // No fragment shader, so nothing to run per sample: sample shading stays off
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = m_MsaaSamples;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    // The subpass still has its color attachment, it is just never written
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = 0;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 1;
+    pipelineInfo.pStages = &vertShaderStageInfo;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = m_PipelineLayout; // same set and push constants as the main pipeline
+    pipelineInfo.renderPass = m_RenderPass;
+    pipelineInfo.subpass = 0;
+
+    VkPipelineRenderingCreateInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &m_SwapChainImageFormat;
+    renderingInfo.depthAttachmentFormat = FindDepthFormat();
+    renderingInfo.stencilAttachmentFormat = HasStencilComponent(renderingInfo.depthAttachmentFormat) ? renderingInfo.depthAttachmentFormat : VK_FORMAT_UNDEFINED;
+
+    if (m_UseDynamicRendering)
+    {
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+    }
+
+    VkPipeline pipeline;
+    const VkResult result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+
+    vkDestroyShaderModule(m_Device, vertShaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create depth prepass pipeline!");
+    }
+    return pipeline;
+}
+
+void VulkanApplication::CreateMeshShaderPipeline()
+{
+    // Set 1: meshlets, meshlet vertices, meshlet triangles, vertex buffer, statistics, see GetMeshletDescriptorSet
+    std::array<VkDescriptorSetLayoutBinding, 5> meshletBindings{};
+    for (uint32_t i = 0; i < meshletBindings.size(); ++i)
+    {
+        meshletBindings[i].binding = i;
+        meshletBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        meshletBindings[i].descriptorCount = 1;
+        meshletBindings[i].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = static_cast<uint32_t>(meshletBindings.size());
+    setLayoutInfo.pBindings = meshletBindings.data();
+    if (vkCreateDescriptorSetLayout(m_Device, &setLayoutInfo, nullptr, &m_MeshletSetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create meshlet descriptor set layout!");
+    }
+
+    // Set 0 is the scene set of the main pipeline. The push constants differ, so it is rebound with this layout.
+    const VkDescriptorSetLayout setLayouts[] = { m_DescriptorSetLayout, m_MeshletSetLayout };
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(MeshletPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 2;
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_MeshShaderPipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create mesh shader pipeline layout!");
+    }
+
+    m_MeshShaderPipeline = BuildMeshShaderPipeline(m_MeshletTaskShaderCode, m_MeshletMeshShaderCode, m_FragShaderCode, m_ShadingFeatures);
+    m_MeshShaderPermutations[m_ShadingFeatures] = m_MeshShaderPipeline;
+
+    m_MeshletTaskShaderCode.clear();
+    m_MeshletMeshShaderCode.clear();
+}
+
+VkPipeline VulkanApplication::BuildMeshShaderPipeline(const std::vector<char>& taskShaderCode, const std::vector<char>& meshShaderCode,
+    const std::vector<char>& fragShaderCode, uint32_t shadingFeatures) const
+{
+    /*
+    Same attachments and fixed-function state as the main pipeline, but the task and mesh stages replace the vertex
+    input and the vertex shader: the task shader culls the meshlets, the mesh shader outputs the triangles of the
+    survivors with the varyings shader.frag expects.
+    */
+    const VkShaderModule taskShaderModule = CreateShaderModule(taskShaderCode);
+    const VkShaderModule meshShaderModule = CreateShaderModule(meshShaderCode);
+    const VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+
+    std::array<VkPipelineShaderStageCreateInfo, 3> shaderStages{};
+    const VkShaderStageFlagBits stages[] = { VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT };
+    const VkShaderModule modules[] = { taskShaderModule, meshShaderModule, fragShaderModule };
+    for (size_t i = 0; i < shaderStages.size(); ++i)
+    {
+        shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage = stages[i];
+        shaderStages[i].module = modules[i];
+        shaderStages[i].pName = "main";
+    }
+
+    // Same permutation constant as the main pipeline
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries = &SHADING_FEATURES_ENTRY;
+    specializationInfo.dataSize = sizeof(shadingFeatures);
+    specializationInfo.pData = &shadingFeatures;
+    shaderStages[2].pSpecializationInfo = &specializationInfo;
+
+    std::vector<VkDynamicState> dynamicStates =
+    {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    // The meshlets are culled as a whole, the rasterizer still culls the remaining back faces one by one
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_TRUE;
+    multisampling.rasterizationSamples = m_MsaaSamples;
+    multisampling.minSampleShading = .2f;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    // No vertex input and input assembly state: the mesh shader outputs the primitives itself
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = m_MeshShaderPipelineLayout;
+    pipelineInfo.renderPass = m_RenderPass;
+    pipelineInfo.subpass = 0;
+
+    VkPipelineRenderingCreateInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &m_SwapChainImageFormat;
+    renderingInfo.depthAttachmentFormat = FindDepthFormat();
+    renderingInfo.stencilAttachmentFormat = HasStencilComponent(renderingInfo.depthAttachmentFormat) ? renderingInfo.depthAttachmentFormat : VK_FORMAT_UNDEFINED;
+
+    if (m_UseDynamicRendering)
+    {
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+    }
+
+    VkPipeline pipeline;
+    const VkResult result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+
+    vkDestroyShaderModule(m_Device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(m_Device, meshShaderModule, nullptr);
+    vkDestroyShaderModule(m_Device, taskShaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create mesh shader pipeline!");
+    }
+    return pipeline;
+}
+
+void VulkanApplication::CreateFramebuffers()
+{
+    /*
+    The attachments specified during render pass creation are bound by wrapping them into a
+    VkFramebuffer object. A framebuffer object references all of the VkImageView objects
+    that represent the attachments.
+
+    That means that we have to create a framebuffer for all of the images in the swap chain and
+    use the one that corresponds to the retrieved image at drawing time.
+    */
+    m_SwapChainFramebuffers.resize(m_SwapChainImageViews.size());
+
+    for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
+    {
+        std::array<VkImageView, 3> attachments =
+        {
+            m_ColorImageView,
+            m_DepthImageView, 
+            m_SwapChainImageViews[i],
+        };
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_RenderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());;
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = m_SwapChainExtent.width;
+        framebufferInfo.height = m_SwapChainExtent.height;
+        framebufferInfo.layers = 1;
+        /*
+            We first need to specify with which renderPass the framebuffer needs to be compatible. 
+            You can only use a framebuffer with the render passes that it is compatible with, which roughly means
+            that they use the same number and type of attachments.
+
+            The attachmentCount and pAttachments parameters specify the VkImageView objects that should be bound
+            to the respective attachment descriptions in the render pass pAttachment array.
+
+            layers refers to the number of layers in image arrays
+
+            The color attachment differs for every swap chain image, but the same depth image can be used by all of them
+            because only a single subpass is running at the same time due semaphores.
+        */
+        if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_SwapChainFramebuffers[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+}
+
+void VulkanApplication::CreateCommandPool()
+{
+    const QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    /*
+    There are two possible flags for command pools:
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded with new commands very often (may change memory allocation behavior)
+        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
+    Each command pool can only allocate command buffers that are submitted on a single type of queue.
+    */
+    if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create command pool!");
+    }
+}
+
+void VulkanApplication::CreateColorResources()
+{
+    const VkFormat colorFormat = m_SwapChainImageFormat;
+
+    CreateImage(m_SwapChainExtent.width, m_SwapChainExtent.height, 1, m_MsaaSamples, colorFormat,
+        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_ColorImage, m_ColorImageMemory);
+
+    m_ColorImageView = CreateImageView(m_ColorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+}
+
+void VulkanApplication::CreateDepthResources()
+{
+    const VkFormat depthFormat = FindDepthFormat();
+
+    // Occlusion culling samples it to build the depth pyramid
+    const VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (m_UseOcclusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+
+    CreateImage(m_SwapChainExtent.width, m_SwapChainExtent.height, 1, m_MsaaSamples, depthFormat,
+        VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_DepthImage, m_DepthImageMemory);
+
+    m_DepthImageView = CreateImageView(m_DepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    /*
+    That's it for creating the depth image. We don't need to map it or copy another image to it,
+    because we're going to clear it at the start of the render pass like the color attachment.
+    */
+}
+
+void VulkanApplication::CreateTextureImage()
+{
+    // m_TextureData is decoded by LoadTexture during startup
+    const int texWidth = m_TextureData.width;
+    const int texHeight = m_TextureData.height;
+    VkDeviceSize imageSize = m_TextureData.GetSize();
+
+    m_MipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    /*
+     The max function selects the largest dimension. The log2 function calculates how many times that dimension can be divided by 2.
+     The floor function handles cases where the largest dimension is not a power of 2.
+     1 is added so that the original image has a mip level.
+    */
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+
+    CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(m_Device, stagingBufferMemory, 0, imageSize, 0, &data);
+    memcpy(data, m_TextureData.pixels.get(), static_cast<size_t>(imageSize));
+    vkUnmapMemory(m_Device, stagingBufferMemory);
+
+    m_TextureData = ImageData{};
+
+    CreateImage(texWidth, texHeight, m_MipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_TextureImage, m_TextureImageMemory);
+
+    /*
+    The next step is to copy the staging buffer to the texture image. This involves two steps:
+        Transition the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
         Execute the buffer to image copy operation
     */
     TransitionImageLayout(m_TextureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_MipLevels);
@@ -1261,7 +2381,10 @@ void VulkanApplication::CreateVertexBuffer()
     memcpy(data, m_Vertices.data(), (size_t)bufferSize);
     vkUnmapMemory(m_Device, stagingBufferMemory);
 
-    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_VertexBuffer, m_VertexBufferMemory);
+    // The mesh shader has no vertex input, it reads the vertices as a storage buffer
+    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+        | (m_UseMeshShaders ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0);
+    CreateBuffer(bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_VertexBuffer, m_VertexBufferMemory);
 
     CopyBuffer(stagingBuffer, m_VertexBuffer, bufferSize);
 
@@ -1280,6 +2403,37 @@ void VulkanApplication::CreateVertexBuffer()
     */
 }
 
+void VulkanApplication::CreatePositionBuffer()
+{
+    /*
+    The depth prepass only needs positions: a separate tightly packed stream fetches 12 bytes per vertex
+    instead of the whole Vertex, and shares the index buffer with the main pass.
+    */
+    std::vector<glm::vec3> positions(m_Vertices.size());
+    for (size_t i = 0; i < m_Vertices.size(); ++i)
+    {
+        positions[i] = m_Vertices[i].pos;
+    }
+
+    VkDeviceSize bufferSize = sizeof(positions[0]) * positions.size();
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
+    memcpy(data, positions.data(), (size_t)bufferSize);
+    vkUnmapMemory(m_Device, stagingBufferMemory);
+
+    CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_PositionBuffer, m_PositionBufferMemory);
+
+    CopyBuffer(stagingBuffer, m_PositionBuffer, bufferSize);
+
+    vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
+    vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
+}
+
 void VulkanApplication::CreateIndexBuffer()
 {
     VkDeviceSize bufferSize = sizeof(m_Indices[0]) * m_Indices.size();//sizeof(indicesData[0]) * indicesData.size();
@@ -1301,116 +2455,455 @@ void VulkanApplication::CreateIndexBuffer()
     vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
 }
 
+void VulkanApplication::CreateGeometryPool()
+{
+    /*
+    The model is the only mesh today, the LODs are ranges of its index list. Any other mesh added to the pool
+    later draws with the same bindings, only its firstIndex and vertexOffset differ.
+    */
+    m_GeometryPool.Init(m_PhysicalDevice, m_Device, GEOMETRY_POOL_MAX_VERTICES, GEOMETRY_POOL_MAX_INDICES, m_GetBufferDeviceAddress);
+    m_ModelGeometry = m_GeometryPool.Add(m_GraphicsQueue, m_CommandPool, m_Vertices, m_Indices);
+
+    m_VertexPullingShaders = {};
+}
+
 void VulkanApplication::CreateUniformBuffers()
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    /*
+    A single buffer for all the transient data of all the frames in flight, instead of one tiny buffer
+    (and one memory allocation) per frame. It stays mapped for the lifetime of the application.
+    */
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    // Also read as storage buffers (occlusion culling objects). Both limits are powers of two, the larger one satisfies both.
+    const VkDeviceSize alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+
+    const VkDeviceSize bufferSize = FrameLinearAllocator::GetRequiredSize(FRAME_ALLOCATOR_BYTES_PER_FRAME, MAX_FRAMES_IN_FLIGHT, alignment);
+
+    CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_FrameBuffer, m_FrameBufferMemory);
+
+    void* mappedData;
+    vkMapMemory(m_Device, m_FrameBufferMemory, 0, bufferSize, 0, &mappedData);
+
+    m_FrameAllocator.Init(m_FrameBuffer, mappedData, FRAME_ALLOCATOR_BYTES_PER_FRAME, alignment);
+}
+
+void VulkanApplication::CreateDescriptorAllocators()
+{
+    /*
+    Inadequate descriptor pools are a good example of a problem that the validation layers will not catch:
+    As of Vulkan 1.1, vkAllocateDescriptorSets may fail with the error code VK_ERROR_POOL_OUT_OF_MEMORY
+    if the pool is not sufficiently large, but the driver may also try to solve the problem internally.
+    This means that sometimes (depending on hardware, pool size and allocation size) the driver will let us
+    get away with an allocation that exceeds the limits of our descriptor pool.
+    Other times, vkAllocateDescriptorSets will fail and return VK_ERROR_POOL_OUT_OF_MEMORY.
+    This can be particularly frustrating if the allocation succeeds on some machines, but fails on others.
+
+    The DescriptorAllocator handles that error by chaining a new pool, so no pool has to be sized for the whole scene.
+    */
+    m_DescriptorAllocator.Init(m_Device);
+    m_DescriptorCache.Init(m_Device, &m_DescriptorAllocator);
+
+    // Sets only valid for one frame, reset wholesale once the fence of that frame has signaled
+    m_FrameDescriptorAllocators.resize(MAX_FRAMES_IN_FLIGHT);
+    for (DescriptorAllocator& allocator : m_FrameDescriptorAllocators)
+    {
+        allocator.Init(m_Device);
+    }
+}
+
+void VulkanApplication::CreateOcclusionCuller()
+{
+    m_OcclusionCuller.Init(m_PhysicalDevice, m_Device, MAX_FRAMES_IN_FLIGHT, OCCLUSION_CULLING_MAX_OBJECTS, m_OcclusionCullingShaders);
+    m_OcclusionCuller.CreateDepthPyramid(m_DepthImage, m_DepthImageView, GetDepthAspects(), m_MsaaSamples, m_SwapChainExtent);
+
+    m_OcclusionCullingShaders = {};
+}
+
+void VulkanApplication::CreateMeshletCuller()
+{
+    // Without a cull shader the culler only uploads the meshlets, the task shader does the culling
+    const std::vector<char> noCullShader;
+    m_MeshletCuller.Init(m_PhysicalDevice, m_Device, m_GraphicsQueue, m_CommandPool, MAX_FRAMES_IN_FLIGHT,
+        MESHLET_CULLING_MAX_OBJECTS, MESHLET_CULLING_MAX_INDICES, m_ModelMeshlets, m_UseMeshShaders ? noCullShader : m_MeshletCullShaderCode);
+
+    // The ranges of m_ModelMeshletLods are all that is left to know on the CPU
+    m_ModelMeshlets = {};
+    m_MeshletCullShaderCode.clear();
+}
+
+void VulkanApplication::CreateSoftwareOcclusion()
+{
+    // The model is the only occluder, it can't hide itself: its nearest bounding depth is in front of its triangles.
+    // Always at full detail, a simplified mesh may stick out of the real one and hide what should be visible.
+    m_SoftwareOcclusion.Init(SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT);
+    const std::vector<uint32_t> fullDetailIndices(m_Indices.begin(), m_Indices.begin() + m_ModelLods[0].indexCount);
+    m_OccluderMesh = m_SoftwareOcclusion.AddMesh(m_Vertices, fullDetailIndices);
+}
+
+void VulkanApplication::CullSoftwareOcclusion()
+{
+    CpuProfileScope scope(m_Profiler, "SoftwareOcclusion");
+
+    m_SoftwareOcclusion.BeginFrame();
+    // With the projection of the frame, the one TestSpheres uses: the snapshot's follows the window, not the swap chain
+    m_SoftwareOcclusion.AddOccluder(m_OccluderMesh, m_ViewProj * m_ObjectTransforms[m_ModelObject].world);
+    m_SoftwareOcclusion.RasterizeOccluders();
+
+    m_ObjectVisible.resize(GetObjectCount());
+    m_SoftwareOcclusion.TestSpheres(m_ObjectBounds.data(), GetObjectCount(), m_ViewProj, m_ObjectVisible.data());
+
+    if (m_Profiler.IsEnabled())
+    {
+        const SoftwareOcclusionStats& stats = m_SoftwareOcclusion.GetStats();
+        m_Profiler.AddCounter("CPU occlusion culling",
+            {
+                { "occluder triangles", stats.occluderTriangles },
+                { "objects", stats.testedObjects },
+                { "occluded", stats.occludedObjects },
+            });
+    }
+}
+
+uint32_t VulkanApplication::SelectObjectLod(uint32_t object) const
+{
+    if (m_Config.lodPixelError <= 0.0f)
+    {
+        return 0;
+    }
+
+    // Distance to the nearest point of the bounding sphere, the error is never projected bigger than that
+    const glm::vec4& bounds = m_ObjectBounds[object];
+    const float distance = std::max(glm::length(glm::vec3(bounds.x, bounds.y, bounds.z) - m_CameraPosition) - bounds.w, CAMERA_NEAR_PLANE);
+    const float worldScale = m_ModelRadius > 0.0f ? bounds.w / m_ModelRadius : 1.0f;
+    return SelectMeshLod(m_ModelLods, worldScale, distance, m_LodPixelScale, m_Config.lodPixelError);
+}
+
+void VulkanApplication::BuildRenderQueue()
+{
+    /*
+    One packet per object in the frustum and not occluded. The ids index the tables resolved in RecordRenderQueue;
+    with a single material they are all 0 and only the depth part of the key differs.
+    With --depth-prepass every object gets a second packet in pass 0, which sorts before the shaded pass 1.
+    */
+    m_RenderQueue.Clear();
+
+    const uint32_t shadedPass = m_Config.depthPrepass ? 1 : 0;
+
+    // Culling input, read by the compute shader straight from the frame allocator
+    OcclusionCullObject* cullObjects = nullptr;
+    if (m_UseOcclusionCulling && GetObjectCount() > 0)
+    {
+        const FrameLinearAllocator::Allocation allocation = m_FrameAllocator.Allocate(GetObjectCount() * sizeof(OcclusionCullObject));
+        cullObjects = static_cast<OcclusionCullObject*>(allocation.data);
+        m_CullObjectsOffset = allocation.offset;
+    }
+
+    if (m_UseSoftwareOcclusion)
+    {
+        CullSoftwareOcclusion();
+    }
+
+    // The compute shader indexes them by object, so they are all written, visible or not
+    for (uint32_t object = 0; cullObjects && object < GetObjectCount(); ++object)
+    {
+        const MeshLod& lod = m_ModelLods[SelectObjectLod(object)];
+        OcclusionCullObject& cullObject = cullObjects[object];
+        cullObject.sphere = m_ObjectBounds[object];
+        cullObject.indexCount = lod.indexCount;
+        cullObject.firstIndex = m_ModelGeometry.firstIndex + lod.firstIndex;
+        cullObject.vertexOffset = m_ModelGeometry.vertexOffset;
+        cullObject.padding = 0;
+    }
+
+    m_LodDraws.assign(m_ModelLods.size(), 0);
+    m_LodTriangles.assign(m_ModelLods.size(), 0);
+
+    // Objects outside of the view frustum never get a packet
+    m_VisibleObjects.clear();
+    if (m_ThumbnailViews.empty())
+    {
+        m_SceneBvh.QueryFrustum(m_CullViewProj, m_VisibleObjects);
+    }
+    else
+    {
+        // One draw list for every view: the objects in any of their frustums, each view's viewport clips the rest
+        for (const ThumbnailView& view : m_ThumbnailViews)
+        {
+            m_SceneBvh.QueryFrustum(view.viewProj, m_VisibleObjects);
+        }
+        std::sort(m_VisibleObjects.begin(), m_VisibleObjects.end());
+        m_VisibleObjects.erase(std::unique(m_VisibleObjects.begin(), m_VisibleObjects.end()), m_VisibleObjects.end());
+    }
+
+    /*
+    Meshlet culling input, one MeshletCullObject per visible object in packet order. The compacted indices of each
+    object get the worst case room, its whole LOD; the objects that don't fit any more are drawn whole.
+    */
+    MeshletCullObject* meshletObjects = nullptr;
+    uint32_t meshletObjectCapacity = 0;
+    uint32_t meshletIndexCount = 0;
+    m_MeshletObjectCount = 0;
+    m_MaxMeshletCount = 0;
+    if (m_UseMeshletCulling)
+    {
+        m_MeshletDrawSlots.assign(GetObjectCount(), NO_MESHLET_SLOT);
+    }
+    if (m_UseMeshletCulling && !m_UseMeshShaders && !m_VisibleObjects.empty())
+    {
+        meshletObjectCapacity = std::min(static_cast<uint32_t>(m_VisibleObjects.size()), m_MeshletCuller.GetMaxObjects());
+        const FrameLinearAllocator::Allocation allocation = m_FrameAllocator.Allocate(meshletObjectCapacity * sizeof(MeshletCullObject));
+        meshletObjects = static_cast<MeshletCullObject*>(allocation.data);
+        m_MeshletObjectsOffset = allocation.offset;
+    }
+
+    for (uint32_t object : m_VisibleObjects)
+    {
+        const glm::vec4& bounds = m_ObjectBounds[object];
+
+        // Hidden behind the CPU occluders: no packet at all, the GPU culling never sees it
+        if (m_UseSoftwareOcclusion && !m_ObjectVisible[object])
+        {
+            continue;
+        }
+
+        const float viewDepth = glm::length(glm::vec3(bounds.x, bounds.y, bounds.z) - m_CameraPosition) - bounds.w;
+        const uint32_t depthKey = SortKey::QuantizeDepth(viewDepth, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+
+        DrawPacket packet{};
+        packet.pipeline = PIPELINE_SHADED;
+        packet.material = 0;
+        packet.mesh = m_Config.geometryPool ? MESH_GEOMETRY_POOL : MESH_MODEL;
+        packet.object = object;
+        packet.lod = SelectObjectLod(object);
+
+        if (m_UseMeshShaders)
+        {
+            packet.pipeline = PIPELINE_MESH_SHADER;
+            packet.mesh = MESH_MODEL_MESHLETS;
+        }
+        else if (meshletObjects && m_MeshletObjectCount < meshletObjectCapacity
+            && meshletIndexCount + m_ModelLods[packet.lod].indexCount <= m_MeshletCuller.GetMaxIndices())
+        {
+            const MeshletRange& meshlets = m_ModelMeshletLods[packet.lod];
+            MeshletCullObject& cullObject = meshletObjects[m_MeshletObjectCount];
+            cullObject.world = m_ObjectTransforms[object].world;
+            cullObject.cameraPosition = GetMeshletCullingCamera(cullObject.world, m_CameraPosition);
+            cullObject.firstMeshlet = meshlets.firstMeshlet;
+            cullObject.meshletCount = meshlets.meshletCount;
+            cullObject.outputFirstIndex = meshletIndexCount;
+            cullObject.vertexOffset = m_ModelGeometry.vertexOffset;
+
+            m_MeshletDrawSlots[object] = m_MeshletObjectCount++;
+            m_MaxMeshletCount = std::max(m_MaxMeshletCount, meshlets.meshletCount);
+            meshletIndexCount += m_ModelLods[packet.lod].indexCount;
+            packet.mesh = MESH_MODEL_MESHLETS;
+        }
+
+        packet.sortKey = SortKey::MakeOpaque(shadedPass, packet.pipeline, packet.material, packet.mesh, depthKey);
+
+        m_RenderQueue.Add(packet);
 
-    m_UniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    m_UniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    m_UniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        const uint32_t passCount = m_Config.depthPrepass ? 2 : 1;
+        m_LodDraws[packet.lod] += passCount;
+        m_LodTriangles[packet.lod] += passCount * (m_ModelLods[packet.lod].indexCount / 3);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            m_UniformBuffers[i], m_UniformBuffersMemory[i]);
+        if (m_Config.depthPrepass)
+        {
+            packet.pipeline = PIPELINE_DEPTH_PREPASS;
+            // The prepass pulls the positions from the pool too, only the separate stream has its own mesh
+            if (!m_Config.geometryPool)
+            {
+                packet.mesh = packet.mesh == MESH_MODEL_MESHLETS ? MESH_MODEL_POSITIONS_MESHLETS : MESH_MODEL_POSITIONS;
+            }
+            packet.sortKey = SortKey::MakeOpaque(0, packet.pipeline, packet.material, packet.mesh, depthKey);
 
-        vkMapMemory(m_Device, m_UniformBuffersMemory[i], 0, bufferSize, 0, &m_UniformBuffersMapped[i]);
+            m_RenderQueue.Add(packet);
+        }
     }
-}
-
-void VulkanApplication::CreateDescriptorPool()
-{
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; // UBO
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // Sampler
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-    poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    /*
-    Inadequate descriptor pools are a good example of a problem that the validation layers will not catch:
-    As of Vulkan 1.1, vkAllocateDescriptorSets may fail with the error code VK_ERROR_POOL_OUT_OF_MEMORY
-    if the pool is not sufficiently large, but the driver may also try to solve the problem internally.
-    This means that sometimes (depending on hardware, pool size and allocation size) the driver will let us
-    get away with an allocation that exceeds the limits of our descriptor pool.
-    Other times, vkAllocateDescriptorSets will fail and return VK_ERROR_POOL_OUT_OF_MEMORY.
-    This can be particularly frustrating if the allocation succeeds on some machines, but fails on others.
-    */
+    m_RenderQueue.Sort();
 
-    if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool) != VK_SUCCESS)
+    if (m_Profiler.IsEnabled() && m_Config.lodPixelError > 0.0f)
     {
-        throw std::runtime_error("failed to create descriptor pool!");
+        static const char* DRAW_NAMES[MAX_MESH_LOD_COUNT] = { "lod0 draws", "lod1 draws", "lod2 draws", "lod3 draws", "lod4 draws", "lod5 draws" };
+        static const char* TRIANGLE_NAMES[MAX_MESH_LOD_COUNT] = { "lod0 triangles", "lod1 triangles", "lod2 triangles", "lod3 triangles", "lod4 triangles", "lod5 triangles" };
+
+        std::vector<std::pair<const char*, uint64_t>> values;
+        for (size_t lod = 0; lod < m_ModelLods.size(); ++lod)
+        {
+            values.emplace_back(DRAW_NAMES[lod], m_LodDraws[lod]);
+            values.emplace_back(TRIANGLE_NAMES[lod], m_LodTriangles[lod]);
+        }
+        m_Profiler.AddCounter("Mesh LOD", values);
     }
 }
 
-void VulkanApplication::CreateDescriptorSets()
+void VulkanApplication::RecordRenderQueue(VkCommandBuffer commandBuffer, RenderStateTracker& tracker, uint32_t cullPhase)
 {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, m_DescriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_DescriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    allocInfo.pSetLayouts = layouts.data();
+    // Walks the sorted packets and only records the binds whose state differs from the previous draw
+    for (uint32_t i = 0; i < m_RenderQueue.GetCount(); ++i)
+    {
+        const DrawPacket& packet = m_RenderQueue.GetSorted(i);
+        const RenderStateTracker::Changes changes = tracker.Apply(packet);
 
-    m_DescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        if (changes.pipeline)
+        {
+            const VkPipeline pipeline = packet.pipeline == PIPELINE_DEPTH_PREPASS ? m_DepthPrepassPipeline
+                : packet.pipeline == PIPELINE_MESH_SHADER ? m_MeshShaderPipeline : m_GraphicsPipeline;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            /*
+            We've now told Vulkan which operations to execute in the graphics pipeline and
+            which attachment to use in the fragment shader.
+            */
+        }
 
-    if (vkAllocateDescriptorSets(m_Device, &allocInfo, m_DescriptorSets.data()) != VK_SUCCESS)
-    {
-        throw std::runtime_error("failed to allocate descriptor sets!");
-    }
+        // The mesh shader pipeline only shares set 0 with the others, its push constants differ
+        const VkPipelineLayout pipelineLayout = packet.pipeline == PIPELINE_MESH_SHADER ? m_MeshShaderPipelineLayout : m_PipelineLayout;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    {
-        // UBO
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = m_UniformBuffers[i];
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(UniformBufferObject);
+        if (changes.material)
+        {
+            VkDescriptorSet descriptorSet = GetSceneDescriptorSet();
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &m_FrameUniformOffset);
+        }
+
+        if (changes.mesh && packet.pipeline == PIPELINE_MESH_SHADER)
+        {
+            // No vertex input: the meshlets and the vertices are storage buffers of set 1
+            VkDescriptorSet meshletSet = GetMeshletDescriptorSet();
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &meshletSet, 0, nullptr);
+        }
+        else if (changes.mesh)
+        {
+            // The geometry pool has no vertex buffer binding, the vertex shaders pull the vertices
+            if (!m_Config.geometryPool)
+            {
+                const bool positions = packet.mesh == MESH_MODEL_POSITIONS || packet.mesh == MESH_MODEL_POSITIONS_MESHLETS;
+                VkBuffer vertexBuffers[] = { positions ? m_PositionBuffer : m_VertexBuffer };
+                VkDeviceSize offsets[] = { 0 };
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+            }
 
-        // Sampler
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = m_TextureImageView;
-        imageInfo.sampler = m_TextureSampler;
+            // The same vertices, only the visible meshlets of the indices
+            const bool meshlets = packet.mesh == MESH_MODEL_MESHLETS || packet.mesh == MESH_MODEL_POSITIONS_MESHLETS;
+            const VkBuffer indexBuffer = meshlets ? m_MeshletCuller.GetIndexBuffer()
+                : m_Config.geometryPool ? m_GeometryPool.GetIndexBuffer() : m_IndexBuffer;
+            vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        }
 
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        if (packet.pipeline == PIPELINE_MESH_SHADER)
+        {
+            const glm::mat4& world = m_ObjectTransforms[packet.object].world;
+            const MeshletRange& meshlets = m_ModelMeshletLods[packet.lod];
+
+            MeshletPushConstants meshletConstants{};
+            meshletConstants.model = world;
+            meshletConstants.cameraPosition = GetMeshletCullingCamera(world, m_CameraPosition);
+            meshletConstants.firstMeshlet = meshlets.firstMeshlet;
+            meshletConstants.meshletCount = meshlets.meshletCount;
+            meshletConstants.statsIndex = m_CurrentFrameIdx;
+            meshletConstants.vertexOffset = m_ModelGeometry.vertexOffset;
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+                0, sizeof(MeshletPushConstants), &meshletConstants);
+
+            // One task workgroup per TASK_GROUP_SIZE meshlets, each launches a mesh workgroup per visible meshlet
+            const uint32_t taskGroups = (meshlets.meshletCount + MeshletCuller::TASK_GROUP_SIZE - 1) / MeshletCuller::TASK_GROUP_SIZE;
+            m_CmdDrawMeshTasks(commandBuffer, taskGroups, 1, 1);
+            continue;
+        }
 
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = m_DescriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-        /*
-        We need to specify the type of descriptor again.
-        It's possible to update multiple descriptors at once in an array, starting at index dstArrayElement.
-        The descriptorCount field specifies how many array elements you want to update.
-        */
+        if (m_Config.geometryPool)
+        {
+            // The storage buffer variant of the shaders only reads the model, the range covers both
+            PulledObjectPushConstants objectConstants{};
+            objectConstants.model = m_ObjectTransforms[packet.object].world;
+            objectConstants.vertices = m_GeometryPool.GetVertexBufferAddress();
+            vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PulledObjectPushConstants), &objectConstants);
+        }
+        else
+        {
+            ObjectPushConstants objectConstants;
+            objectConstants.model = m_ObjectTransforms[packet.object].world;
+            vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ObjectPushConstants), &objectConstants);
+        }
+
+        if (m_UseOcclusionCulling)
+        {
+            // instanceCount is 0 when the object was culled in this phase
+            vkCmdDrawIndexedIndirect(commandBuffer, m_OcclusionCuller.GetDrawCommandBuffer(),
+                m_OcclusionCuller.GetDrawCommandOffset(cullPhase, packet.object), 1, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else if (packet.mesh == MESH_MODEL_MESHLETS || packet.mesh == MESH_MODEL_POSITIONS_MESHLETS)
+        {
+            // indexCount is the number of indices of the visible meshlets, written by the culling
+            vkCmdDrawIndexedIndirect(commandBuffer, m_MeshletCuller.GetDrawCommandBuffer(),
+                m_MeshletCuller.GetDrawCommandOffset(m_MeshletDrawSlots[packet.object]), 1, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        else
+        {
+            const MeshLod& lod = m_ModelLods[packet.lod];
+            // The LODs are ranges of the indices of the model, wherever the model is in its buffers
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, m_ModelGeometry.firstIndex + lod.firstIndex, m_ModelGeometry.vertexOffset, 0);
+        }
+    }
+}
 
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = m_DescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
-        descriptorWrites[1].pTexelBufferView = nullptr; // Optional
+void VulkanApplication::RecordThumbnailViews(VkCommandBuffer commandBuffer, RenderStateTracker& tracker)
+{
+    /*
+    The same sorted packets for every view, only the viewport and the UBO window change in between. The packets were
+    culled and sorted once, and the pipeline and the vertex and index buffers stay bound from one view to the next.
+    */
+    for (size_t i = 0; i < m_ThumbnailViews.size(); ++i)
+    {
+        const ThumbnailView& view = m_ThumbnailViews[i];
+        vkCmdSetViewport(commandBuffer, 0, 1, &view.viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &view.scissor);
 
-        /*
-        The pBufferInfo field is used for descriptors that refer to buffer data, pImageInfo is used for descriptors
-        that refer to image data, and pTexelBufferView is used for descriptors that refer to buffer views.
-        */
+        // Used by the material binds of RecordRenderQueue, the set still bound from the previous view gets it here
+        m_FrameUniformOffset = view.uniformOffset;
+        if (i > 0)
+        {
+            VkDescriptorSet descriptorSet = GetSceneDescriptorSet();
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &descriptorSet, 1, &m_FrameUniformOffset);
+        }
 
-        vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        RecordRenderQueue(commandBuffer, tracker, 0);
     }
+
+    m_FrameUniformOffset = m_ThumbnailViews.front().uniformOffset;
+}
+
+VkDescriptorSet VulkanApplication::GetSceneDescriptorSet()
+{
     /*
-    The descriptors are now ready to be used by the shaders!
+    The UBO is a window of sizeof(UniformBufferObject) in the frame buffer, moved by the dynamic offset,
+    so the same set serves every frame in flight. It is allocated and written on first use only,
+    after that this is a hash lookup.
     */
+    DescriptorSetBindings bindings;
+    bindings.Buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, m_FrameAllocator.GetBuffer(), 0, sizeof(UniformBufferObject));
+    bindings.Image(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_TextureImageView, m_TextureSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    if (m_Config.geometryPool && !m_UseBufferDeviceAddress)
+    {
+        bindings.Buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_GeometryPool.GetVertexBuffer(), 0, VK_WHOLE_SIZE);
+    }
+
+    return m_DescriptorCache.Get(m_DescriptorSetLayout, bindings);
+}
+
+VkDescriptorSet VulkanApplication::GetMeshletDescriptorSet()
+{
+    // Static buffers, the statistics of every frame in flight are indexed with MeshletPushConstants::statsIndex
+    DescriptorSetBindings bindings;
+    bindings.Buffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletCuller.GetMeshletBuffer(), 0, VK_WHOLE_SIZE);
+    bindings.Buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletCuller.GetMeshletVertexBuffer(), 0, VK_WHOLE_SIZE);
+    bindings.Buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletCuller.GetMeshletTriangleBuffer(), 0, VK_WHOLE_SIZE);
+    bindings.Buffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_Config.geometryPool ? m_GeometryPool.GetVertexBuffer() : m_VertexBuffer, 0, VK_WHOLE_SIZE);
+    bindings.Buffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_MeshletCuller.GetStatsBuffer(), 0, VK_WHOLE_SIZE);
+
+    return m_DescriptorCache.Get(m_MeshletSetLayout, bindings);
 }
 
 void VulkanApplication::CreateCommandBuffers()
@@ -1463,7 +2956,46 @@ void VulkanApplication::CreateSyncObjects()
     }
 }
 
-void VulkanApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) const
+void VulkanApplication::CreateProfiler()
+{
+    const QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
+
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supportedFeatures);
+
+    m_Profiler.Init(m_PhysicalDevice, m_Device, indices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT,
+        m_Config.traceFilePath, m_Config.runBenchmark, m_Config.enablePipelineStatistics && supportedFeatures.pipelineStatisticsQuery);
+}
+
+void VulkanApplication::StartFrameExport()
+{
+    /*
+    A buffer is busy from the frame that copies into it until a worker wrote its file: one per frame in flight,
+    one per worker, and as many queued so a slow file doesn't drop the next frames right away.
+    */
+    const uint32_t threadCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, MAX_EXPORT_THREADS);
+    const uint32_t slotCount = MAX_FRAMES_IN_FLIGHT + 2 * threadCount;
+    m_FrameReadback.Init(m_PhysicalDevice, m_Device, slotCount, threadCount, m_Config.exportDirectory, m_Config.exportFormat);
+}
+
+void VulkanApplication::StartLatencyMarkers()
+{
+    // Without present wait only the CPU side is measured, no thread is started
+    m_LatencyMarkers.Init(m_Device, m_UsePresentWait ? m_WaitForPresent : nullptr);
+}
+
+void VulkanApplication::StartShaderHotReload()
+{
+    // Every GLSL file, not only those of the pipelines in use: saving another one just reports that it was skipped
+    std::vector<std::string> paths;
+    for (const std::string& sourceFile : GetShaderSourceFiles())
+    {
+        paths.push_back(SHADER_DIRECTORY + sourceFile);
+    }
+    m_ShaderWatcher.Start(paths, SHADER_WATCH_INTERVAL, [this](const std::vector<std::string>& changedFiles) { ReloadShaders(changedFiles); });
+}
+
+void VulkanApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1482,74 +3014,54 @@ void VulkanApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint3
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
-    VkRenderPassBeginInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = m_RenderPass;
-    renderPassInfo.framebuffer = m_SwapChainFramebuffers[imageIndex];
-
-    // Define the size of the render area
-    renderPassInfo.renderArea.offset = { 0, 0 };
-    renderPassInfo.renderArea.extent = m_SwapChainExtent;
-
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
-    clearValues[1].depthStencil = { 1.0f, 0 };
-    /*
-    The range of depths in the depth buffer is 0.0 to 1.0 in Vulkan, where 1.0 lies at the far view plane and 0.0 at the near view plane.
-    The initial value at each point in the depth buffer should be the furthest possible depth, which is 1.0.
-
-    !!! Note that the order of clearValues should be identical to the order of your attachments.
-    */
-
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
+    // Queries have to be reset outside of a render pass before they are written again
+    m_Profiler.ResetQueries(commandBuffer);
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (m_UseOcclusionCulling)
     {
-        /*
-        The first parameter for every command is always the command buffer to record the command to.
-        The second parameter specifies the details of the render pass we've just provided.
-        The final parameter controls how the drawing commands within the render pass will be provided.
-        It can have one of two values:
-            VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command buffer itself and no secondary command buffers will be executed.
-            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
-        All of the functions that record commands can be recognized by their vkCmd prefix.
-        */
-
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
-        /*
-        We've now told Vulkan which operations to execute in the graphics pipeline and
-        which attachment to use in the fragment shader.
-        */
+        m_Profiler.BeginGpuScope(commandBuffer, "Occlusion cull phase 1");
+        m_OcclusionCuller.RecordCull(commandBuffer, m_FrameDescriptorAllocators[m_CurrentFrameIdx], m_CurrentFrameIdx, 0,
+            m_FrameAllocator.GetBuffer(), m_CullObjectsOffset, GetObjectCount(), m_ViewProj);
+        m_Profiler.EndGpuScope(commandBuffer);
+    }
 
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(m_SwapChainExtent.width);
-        viewport.height = static_cast<float>(m_SwapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.offset = { 0, 0 };
-        scissor.extent = m_SwapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-        /*
-        We did specify viewport and scissor state for this pipeline to be dynamic.
-        So we need to set them in the command buffer before issuing our draw command.
-        */
+    if (m_UseMeshletCulling)
+    {
+        m_Profiler.BeginGpuScope(commandBuffer, "Meshlet cull");
+        if (m_UseMeshShaders)
+        {
+            // The task shaders of the pass count into the statistics
+            m_MeshletCuller.RecordResetStats(commandBuffer, m_CurrentFrameIdx, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT);
+        }
+        else
+        {
+            m_MeshletCuller.RecordCull(commandBuffer, m_FrameDescriptorAllocators[m_CurrentFrameIdx], m_CurrentFrameIdx,
+                m_FrameAllocator.GetBuffer(), m_MeshletObjectsOffset, m_MeshletObjectCount, m_MaxMeshletCount, m_ViewProj);
+        }
+        m_Profiler.EndGpuScope(commandBuffer);
+    }
 
-        VkBuffer vertexBuffers[] = { m_VertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    // Outside of the render passes, so it spans both occlusion culling phases
+    m_Profiler.BeginPipelineStatistics(commandBuffer);
 
-        vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    RenderStateTracker tracker;
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSets[m_CurrentFrameIdx], 0, nullptr);
+    m_Profiler.BeginGpuScope(commandBuffer, "RenderPass");
+    BeginScenePass(commandBuffer, imageIndex, false);
+    {
+        m_Profiler.BeginGpuScope(commandBuffer, "Draw");
 
         //vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_Indices.dataindicesData.size()), 1, 0, 0, 0);
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_Indices.size()), 1, 0, 0, 0);
+        if (m_ThumbnailViews.empty())
+        {
+            RecordRenderQueue(commandBuffer, tracker, 0);
+        }
+        else
+        {
+            RecordThumbnailViews(commandBuffer, tracker);
+        }
+
+        m_Profiler.EndGpuScope(commandBuffer);
 
         //vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
 
@@ -1563,7 +3075,58 @@ void VulkanApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint3
             firstInstance: Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex.
         */
     }
-    vkCmdEndRenderPass(commandBuffer);
+    EndScenePass(commandBuffer, imageIndex, !m_UseOcclusionCulling);
+    m_Profiler.EndGpuScope(commandBuffer);
+
+    if (m_UseMeshShaders)
+    {
+        m_MeshletCuller.RecordStatsReadBarrier(commandBuffer, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT);
+    }
+
+    if (m_UseOcclusionCulling)
+    {
+        /*
+        Second phase: the pyramid now holds the depth of everything drawn so far,
+        the objects it rejected in phase 1 that turn out visible are drawn on top.
+        Pipelines, descriptor sets and buffers stay bound across the render passes.
+        */
+        m_Profiler.BeginGpuScope(commandBuffer, "Depth pyramid");
+        m_OcclusionCuller.RecordDepthPyramid(commandBuffer);
+        m_Profiler.EndGpuScope(commandBuffer);
+
+        m_Profiler.BeginGpuScope(commandBuffer, "Occlusion cull phase 2");
+        m_OcclusionCuller.RecordCull(commandBuffer, m_FrameDescriptorAllocators[m_CurrentFrameIdx], m_CurrentFrameIdx, 1,
+            m_FrameAllocator.GetBuffer(), m_CullObjectsOffset, GetObjectCount(), m_ViewProj);
+        m_Profiler.EndGpuScope(commandBuffer);
+
+        m_Profiler.BeginGpuScope(commandBuffer, "RenderPass phase 2");
+        BeginScenePass(commandBuffer, imageIndex, true);
+        RecordRenderQueue(commandBuffer, tracker, 1);
+        EndScenePass(commandBuffer, imageIndex, true);
+        m_Profiler.EndGpuScope(commandBuffer);
+    }
+
+    m_Profiler.EndPipelineStatistics(commandBuffer);
+
+    if (m_FrameReadback.IsEnabled())
+    {
+        m_Profiler.BeginGpuScope(commandBuffer, "Frame export copy");
+        m_FrameReadback.RecordCopy(commandBuffer, m_SwapChainImages[imageIndex], m_SwapChainImageFormat, m_SwapChainExtent, m_CurrentFrameIdx);
+        m_Profiler.EndGpuScope(commandBuffer);
+    }
+
+    m_RenderStats = tracker.GetStats();
+
+    if (m_Profiler.IsEnabled())
+    {
+        m_Profiler.AddCounter("Render queue",
+            {
+                { "draws", m_RenderStats.draws },
+                { "pipeline binds", m_RenderStats.pipelineBinds },
+                { "material binds", m_RenderStats.materialBinds },
+                { "mesh binds", m_RenderStats.meshBinds },
+            });
+    }
     
     // We've finished recording the command buffer
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
@@ -1572,6 +3135,206 @@ void VulkanApplication::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint3
     }
 }
 
+void VulkanApplication::BeginScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool loadContents)
+{
+    if (m_UseDynamicRendering)
+    {
+        BeginDynamicRendering(commandBuffer, imageIndex, loadContents);
+    }
+    else
+    {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = loadContents ? m_LoadRenderPass : m_RenderPass;
+        renderPassInfo.framebuffer = m_SwapChainFramebuffers[imageIndex];
+
+        // Define the size of the render area
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = m_SwapChainExtent;
+
+        std::array<VkClearValue, 2> clearValues{};
+        clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+        /*
+        The range of depths in the depth buffer is 0.0 to 1.0 in Vulkan, where 1.0 lies at the far view plane and 0.0 at the near view plane.
+        The initial value at each point in the depth buffer should be the furthest possible depth, which is 1.0.
+
+        !!! Note that the order of clearValues should be identical to the order of your attachments.
+        */
+
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    /*
+    The first parameter for every command is always the command buffer to record the command to.
+    The second parameter specifies the details of the render pass we've just provided.
+    The final parameter controls how the drawing commands within the render pass will be provided.
+    It can have one of two values:
+        VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary command buffer itself and no secondary command buffers will be executed.
+        VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
+    All of the functions that record commands can be recognized by their vkCmd prefix.
+    */
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(m_SwapChainExtent.width);
+    viewport.height = static_cast<float>(m_SwapChainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = m_SwapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    /*
+    We did specify viewport and scissor state for this pipeline to be dynamic.
+    So we need to set them in the command buffer before issuing our draw command.
+    */
+}
+
+void VulkanApplication::EndScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool present)
+{
+    if (m_UseDynamicRendering)
+    {
+        EndDynamicRendering(commandBuffer, imageIndex, present);
+    }
+    else
+    {
+        // The render passes leave the resolved image in PRESENT_SRC_KHR, present only matters for dynamic rendering
+        vkCmdEndRenderPass(commandBuffer);
+    }
+}
+
+void VulkanApplication::BeginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool loadContents)
+{
+    /*
+    The render pass performed these layout transitions implicitly (initialLayout/finalLayout and the subpass dependency),
+    without one they are explicit barriers. The contents of all three images are discarded (UNDEFINED):
+        MSAA color: cleared, only its resolve is kept. It is shared by the frames in flight, so wait for the previous writes.
+        Swap chain image: resolve target. Its availability is already ordered by the semaphore wait at COLOR_ATTACHMENT_OUTPUT.
+        Depth: cleared, shared by the frames in flight like the MSAA color image.
+    With loadContents (second occlusion culling phase) the MSAA color and depth images keep what the first phase drew,
+    and the depth was last read by the depth pyramid build.
+    */
+    const VkFormat depthFormat = FindDepthFormat();
+
+    std::array<VkImageMemoryBarrier, 3> barriers{};
+    for (VkImageMemoryBarrier& barrier : barriers)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    }
+
+    barriers[0].image = m_ColorImage;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (loadContents)
+    {
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        barriers[0].dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    }
+
+    barriers[1].image = m_SwapChainImages[imageIndex];
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barriers[1].srcAccessMask = loadContents ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+    barriers[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    barriers[2].image = m_DepthImage;
+    barriers[2].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barriers[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[2].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (HasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+    if (loadContents)
+    {
+        barriers[2].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        barriers[2].srcAccessMask = 0;
+    }
+
+    const VkPipelineStageFlags attachmentStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+        | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkPipelineStageFlags srcStages = attachmentStages | (loadContents ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0);
+
+    vkCmdPipelineBarrier(commandBuffer, srcStages, attachmentStages, 0, 0, nullptr, 0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    // Same attachments, load/store operations and clear values as the render pass
+    VkRenderingAttachmentInfoKHR colorAttachment{};
+    colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    colorAttachment.imageView = m_ColorImageView;
+    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+    colorAttachment.resolveImageView = m_SwapChainImageViews[imageIndex];
+    colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // The second occlusion culling phase draws on top of the first one
+    colorAttachment.storeOp = m_UseOcclusionCulling && !loadContents ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.clearValue.color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+
+    VkRenderingAttachmentInfoKHR depthAttachment{};
+    depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+    depthAttachment.imageView = m_DepthImageView;
+    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // The depth pyramid is built from the first occlusion culling phase
+    depthAttachment.storeOp = m_UseOcclusionCulling && !loadContents ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+    VkRenderingInfoKHR renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+    renderingInfo.renderArea.offset = { 0, 0 };
+    renderingInfo.renderArea.extent = m_SwapChainExtent;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachments = &colorAttachment;
+    renderingInfo.pDepthAttachment = &depthAttachment;
+    renderingInfo.pStencilAttachment = HasStencilComponent(depthFormat) ? &depthAttachment : nullptr;
+
+    m_CmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void VulkanApplication::EndDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool present)
+{
+    m_CmdEndRendering(commandBuffer);
+
+    // Another pass still draws into the images
+    if (!present)
+    {
+        return;
+    }
+
+    // The render pass finalLayout: the resolved image goes to the presentation engine
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_SwapChainImages[imageIndex];
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+    // --export: same as the outgoing subpass dependency, the copy of FrameReadback::RecordCopy waits on the transfer stage
+    if (m_FrameReadback.IsEnabled())
+    {
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, dstStage, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
+
 VkCommandBuffer VulkanApplication::BeginSingleTimeCommands()
 {
     VkCommandBufferAllocateInfo allocInfo{};
@@ -1587,51 +3350,252 @@ VkCommandBuffer VulkanApplication::BeginSingleTimeCommands()
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    return commandBuffer;
+}
+
+void VulkanApplication::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+{
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(m_GraphicsQueue);
+
+    vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &commandBuffer);
+}
+
+void VulkanApplication::PublishSnapshot()
+{
+    static auto startTime = std::chrono::high_resolution_clock::now();
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    const float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+    // Benchmark frames depend on the frame index only, never on the wall clock
+    const CameraKeyframe camera = m_Benchmark.IsActive() ? m_Benchmark.GetCurrentCamera()
+        : m_Config.mouseCamera ? GetMouseCamera(m_CursorInput) : CameraKeyframe{};
+    const float modelAngle = m_Benchmark.IsActive() ? camera.modelAngle : time * glm::radians(90.0f);
+
+    FrameSnapshot& snapshot = m_Snapshots.GetWriteBuffer();
+    snapshot.step = ++m_SimulationStep;
+    snapshot.camera = camera;
+    snapshot.input = m_CursorInput;
+    snapshot.shadingFeatures = m_InputShadingFeatures;
+
+    // Model rotated around Z
+    m_SceneTransforms.SetRotation(m_ModelObject, glm::angleAxis(modelAngle, glm::vec3(0.0f, 0.0f, 1.0f)));
+
+    // The world view projection of the objects (CPU occluders) with the window's aspect ratio, the swap chain follows it
+    const float aspectRatio = m_FramebufferHeight > 0 ? m_FramebufferWidth / static_cast<float>(m_FramebufferHeight) : 1.0f;
+    const UniformBufferObject ubo = BuildUniformBufferObject(camera.eye, camera.target, aspectRatio);
+
+    snapshot.objectTransforms.resize(m_SceneTransforms.GetCount());
+    snapshot.objectBounds.resize(m_SceneTransforms.GetCount());
+    m_SceneTransforms.Update(ubo.viewProj, snapshot.objectTransforms.data(), snapshot.objectBounds.data());
+
+    m_Snapshots.Publish();
+}
+
+void VulkanApplication::TakeSnapshot()
+{
+    if (!m_Snapshots.Update())
+    {
+        ++m_RepeatedSnapshots;
+        return;
+    }
+
+    // Swapped, not copied: the snapshot slot gets the vectors of the previous frame to refill
+    FrameSnapshot& snapshot = m_Snapshots.GetReadBuffer();
+    std::swap(m_ObjectTransforms, snapshot.objectTransforms);
+    std::swap(m_ObjectBounds, snapshot.objectBounds);
+    m_Camera = snapshot.camera;
+    m_FrameInput = snapshot.input;
+    m_SnapshotStep = snapshot.step;
+
+    if (snapshot.shadingFeatures != m_SnapshotShadingFeatures)
+    {
+        m_SnapshotShadingFeatures = snapshot.shadingFeatures;
+        m_RequestedShadingFeatures = snapshot.shadingFeatures;
+    }
+}
+
+uint32_t VulkanApplication::UpdateUniformBuffer()
+{
+    const CameraKeyframe& camera = m_Camera;
+
+    UniformBufferObject ubo = BuildUniformBufferObject(camera.eye, camera.target,
+        m_SwapChainExtent.width / (float)m_SwapChainExtent.height);
+    float viewportHeight = static_cast<float>(m_SwapChainExtent.height);
+
+    // The first thumbnail is the camera of the frame, with the aspect ratio of its cell
+    if (m_Config.thumbnailViews > 0)
+    {
+        UpdateThumbnailViews(camera);
+        ubo.viewProj = m_ThumbnailViews.front().viewProj;
+        viewportHeight = m_ThumbnailViews.front().viewport.height;
+    }
+
+    m_CameraPosition = camera.eye;
+    m_ViewProj = ubo.viewProj;
+    m_CullViewProj = ubo.viewProj;
+    if (m_UseLateLatch)
+    {
+        // Every camera LatchCamera can pick: both axes moved by MAX_LATCH_PIXELS
+        m_CullViewProj = BuildOrbitCullViewProj(camera.eye, camera.target, m_SwapChainExtent.width / (float)m_SwapChainExtent.height,
+            static_cast<float>(2.0 * MAX_LATCH_PIXELS) * MOUSE_RADIANS_PER_PIXEL);
+    }
+    m_LodPixelScale = GetProjectionPixelScale(viewportHeight);
+
+    UpdateSceneBvh();
+
+    if (!m_ThumbnailViews.empty())
+    {
+        return m_ThumbnailViews.front().uniformOffset;
+    }
+
+    // Kept mapped for LatchCamera, which may overwrite it before submit
+    const FrameLinearAllocator::Allocation allocation = m_FrameAllocator.Allocate(sizeof(UniformBufferObject));
+    memcpy(allocation.data, &ubo, sizeof(UniformBufferObject));
+    m_FrameUniformData = allocation.data;
 
-    return commandBuffer;
+    if (m_LatencyMarkers.IsEnabled() && !m_UseLateLatch)
+    {
+        m_LatencyMarkers.SetFrameInput(m_FrameInput.sequence, m_FrameInput.time);
+        m_LatencyMarkers.Mark(LatencyMarkers::MARKER_LATCH);
+    }
+
+    return allocation.offset;
 }
 
-void VulkanApplication::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+void VulkanApplication::LatchCamera()
 {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_GraphicsQueue);
+    /*
+    Without the render thread this is the thread that polls, the events that came in during recording are read now.
+    With it the main thread polls, and publishes every cursor event to m_LatchInputs without waiting for a step.
+    */
+    if (!m_UseRenderThread)
+    {
+        glfwPollEvents();
+    }
+    // The snapshot may carry an older input than the one the last frame latched
+    const InputSample culledInput = m_FrameInput;
+    m_LatchInputs.Update();
+    if (m_LatchInputs.GetReadBuffer().sequence > m_FrameInput.sequence)
+    {
+        m_FrameInput = m_LatchInputs.GetReadBuffer();
+    }
 
-    vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &commandBuffer);
+    /*
+    Only the uniforms change: the BVH query and the LOD selection used the camera of the snapshot, a few milliseconds
+    older. The query's frustum holds every camera up to MAX_LATCH_PIXELS away from it, so the latched cursor is kept in
+    that range; a faster move is drawn late by a frame instead of missing the objects at the edges.
+    */
+    InputSample latchedInput = m_FrameInput;
+    latchedInput.cursorX = std::clamp(latchedInput.cursorX, culledInput.cursorX - MAX_LATCH_PIXELS, culledInput.cursorX + MAX_LATCH_PIXELS);
+    latchedInput.cursorY = std::clamp(latchedInput.cursorY, culledInput.cursorY - MAX_LATCH_PIXELS, culledInput.cursorY + MAX_LATCH_PIXELS);
+    const CameraKeyframe camera = GetMouseCamera(latchedInput);
+    const UniformBufferObject ubo = BuildUniformBufferObject(camera.eye, camera.target,
+        m_SwapChainExtent.width / (float)m_SwapChainExtent.height);
+    memcpy(m_FrameUniformData, &ubo, sizeof(UniformBufferObject));
+
+    m_LatencyMarkers.SetFrameInput(m_FrameInput.sequence, m_FrameInput.time);
+    m_LatencyMarkers.Mark(LatencyMarkers::MARKER_LATCH);
 }
 
-void VulkanApplication::UpdateUniformBuffer(uint32_t currentImage)
+CameraKeyframe VulkanApplication::GetMouseCamera(const InputSample& input) const
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    const float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    // Orbit around the target, starting from the default eye: yaw follows x, pitch follows y and stops short of the poles
+    CameraKeyframe camera{};
+    const glm::vec3 offset = camera.eye - camera.target;
+    const float distance = glm::length(offset);
+    const float yaw = std::atan2(offset.y, offset.x) - static_cast<float>(input.cursorX) * MOUSE_RADIANS_PER_PIXEL;
+    const float pitch = std::clamp(std::asin(offset.z / distance) + static_cast<float>(input.cursorY) * MOUSE_RADIANS_PER_PIXEL, -1.4f, 1.4f);
+
+    camera.eye = camera.target + distance * glm::vec3(std::cos(pitch) * std::cos(yaw), std::cos(pitch) * std::sin(yaw), std::sin(pitch));
+    return camera;
+}
 
-    UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+void VulkanApplication::UpdateThumbnailViews(const CameraKeyframe& camera)
+{
+    /*
+    A grid over the swap chain image with as many columns as rows, or one more, filled row by row.
+    The views orbit the target at the distance of camera, 360 / k degrees apart: the objects are as far
+    from every view, so the LOD and the depth order chosen for the first one suit them all.
+    */
+    const uint32_t viewCount = m_Config.thumbnailViews;
+    const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(viewCount))));
+    const uint32_t rows = (viewCount + columns - 1) / columns;
+    const uint32_t cellWidth = std::max(m_SwapChainExtent.width / columns, 1u);
+    const uint32_t cellHeight = std::max(m_SwapChainExtent.height / rows, 1u);
+
+    m_ThumbnailViews.resize(viewCount);
+    for (uint32_t i = 0; i < viewCount; ++i)
+    {
+        ThumbnailView& view = m_ThumbnailViews[i];
+        view.scissor.offset = { static_cast<int32_t>((i % columns) * cellWidth), static_cast<int32_t>((i / columns) * cellHeight) };
+        view.scissor.extent = { cellWidth, cellHeight };
+        view.viewport.x = static_cast<float>(view.scissor.offset.x);
+        view.viewport.y = static_cast<float>(view.scissor.offset.y);
+        view.viewport.width = static_cast<float>(cellWidth);
+        view.viewport.height = static_cast<float>(cellHeight);
+        view.viewport.minDepth = 0.0f;
+        view.viewport.maxDepth = 1.0f;
+
+        // Rotated around the Z axis through the target
+        const float angle = glm::radians(360.0f) * i / viewCount;
+        const glm::vec3 offset = camera.eye - camera.target;
+        const glm::vec3 eye = camera.target + glm::vec3(offset.x * std::cos(angle) - offset.y * std::sin(angle),
+            offset.x * std::sin(angle) + offset.y * std::cos(angle), offset.z);
+        const UniformBufferObject ubo = BuildUniformBufferObject(eye, camera.target, cellWidth / static_cast<float>(cellHeight));
+        view.viewProj = ubo.viewProj;
+        view.uniformOffset = m_FrameAllocator.Push(ubo);
+    }
+}
 
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+void VulkanApplication::UpdateSceneBvh()
+{
+    CpuProfileScope scope(m_Profiler, "SceneBvh");
 
-    ubo.proj = glm::perspective(glm::radians(45.0f), m_SwapChainExtent.width / (float)m_SwapChainExtent.height, 0.1f, 10.0f);
+    // Every object shares the model for now
+    const uint32_t objectCount = GetObjectCount();
+    m_ObjectBoxes.resize(objectCount);
+    for (uint32_t object = 0; object < objectCount; ++object)
+    {
+        m_ObjectBoxes[object] = TransformBoundingBox(m_ModelBoundingBox, m_ObjectTransforms[object].world);
+    }
 
-    ubo.proj[1][1] *= -1;
     /*
-    GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted.
-    The easiest way to compensate for that is to flip the sign on the scaling factor of the Y axis in the projection matrix.
-    If you don't do this, then the image will be rendered upside down.
+    Refitting keeps the tree and only grows its boxes, which is enough while the objects move a little.
+    Once the boxes overlap so much that the tree costs 50% more to traverse, it is built again from scratch.
     */
+    const bool rebuild = m_SceneBvh.GetInstanceCount() != objectCount || m_SceneBvh.GetCostRatio() > SCENE_BVH_REBUILD_COST_RATIO;
+    if (rebuild)
+    {
+        m_SceneBvh.Build(m_ObjectBoxes.data(), objectCount);
+    }
+    else
+    {
+        m_SceneBvh.Refit(m_ObjectBoxes.data());
+    }
 
-    memcpy(m_UniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    if (m_Profiler.IsEnabled())
+    {
+        m_Profiler.AddCounter("Scene BVH",
+            {
+                { "objects", objectCount },
+                { "nodes", m_SceneBvh.GetNodeCount() },
+                { "rebuilt", rebuild ? 1u : 0u },
+            });
+    }
 }
 
-void VulkanApplication::DrawFrame()
+bool VulkanApplication::DrawFrame()
 {
     /*
     At a high level, rendering a frame in Vulkan consists of a common set of steps:
@@ -1649,7 +3613,80 @@ void VulkanApplication::DrawFrame()
     fences are used to keep the CPU and GPU in sync with each-other.
     */
 
-    vkWaitForFences(m_Device, 1, &m_InFlightFences[m_CurrentFrameIdx], VK_TRUE, UINT64_MAX);
+    {
+        CpuProfileScope scope(m_Profiler, "WaitForFence");
+        vkWaitForFences(m_Device, 1, &m_InFlightFences[m_CurrentFrameIdx], VK_TRUE, UINT64_MAX);
+    }
+    // The fence guarantees that the queries written by this frame slot last time are available
+    m_Profiler.BeginFrame(m_CurrentFrameIdx);
+    // Same for the frame allocator region and the per-frame descriptor sets: the GPU is done reading them
+    m_FrameAllocator.BeginFrame(m_CurrentFrameIdx);
+    m_FrameDescriptorAllocators[m_CurrentFrameIdx].ResetPools();
+    // And for the pipelines replaced (shader reload, optimized permutation) when this frame slot was last recorded
+    for (VkPipeline pipeline : m_RetiredPipelines[m_CurrentFrameIdx])
+    {
+        vkDestroyPipeline(m_Device, pipeline, nullptr);
+    }
+    m_RetiredPipelines[m_CurrentFrameIdx].clear();
+    if (m_Profiler.IsEnabled())
+    {
+        // Since the last frame: the jobs of both the simulation and the render thread, utilization over all the threads
+        const JobSystemStats jobStats = JobSystem::GetGlobal().GetStats();
+        const double elapsedMs = jobStats.elapsedMs - m_LastJobStats.elapsedMs;
+        const double busyMs = jobStats.busyMs - m_LastJobStats.busyMs;
+        m_Profiler.AddCounter("Jobs",
+            {
+                { "jobs", jobStats.jobs - m_LastJobStats.jobs },
+                { "steals", jobStats.steals - m_LastJobStats.steals },
+                { "utilization %", static_cast<uint64_t>(elapsedMs > 0.0 ? 100.0 * busyMs / (elapsedMs * jobStats.threadCount) : 0.0) },
+            });
+        m_LastJobStats = jobStats;
+    }
+    // And the frame copied into a readback buffer is complete, it can be encoded
+    m_FrameReadback.BeginFrame(m_CurrentFrameIdx);
+    if (m_FrameReadback.IsEnabled() && m_Profiler.IsEnabled())
+    {
+        const FrameReadback::Stats exportStats = m_FrameReadback.GetStats();
+        m_Profiler.AddCounter("Frame export",
+            {
+                { "exported", exportStats.exported },
+                { "dropped", exportStats.dropped },
+                { "busy buffers", exportStats.busySlots },
+            });
+    }
+    if (m_LatencyMarkers.IsEnabled() && m_Profiler.IsEnabled())
+    {
+        const std::array<uint64_t, LatencyMarkers::MARKER_COUNT> latency = m_LatencyMarkers.GetLastMicroseconds();
+        m_Profiler.AddCounter("Input latency",
+            {
+                { "to latch us", latency[LatencyMarkers::MARKER_LATCH] },
+                { "to submit us", latency[LatencyMarkers::MARKER_SUBMIT] },
+                { "to present us", latency[LatencyMarkers::MARKER_PRESENT] },
+                { "to display us", latency[LatencyMarkers::MARKER_DISPLAY] },
+            });
+    }
+    if (m_UseOcclusionCulling && m_Profiler.IsEnabled())
+    {
+        const OcclusionCullingStats cullStats = m_OcclusionCuller.ReadStats(m_CurrentFrameIdx);
+        m_Profiler.AddCounter("Occlusion culling",
+            {
+                { "objects", cullStats.objects },
+                { "frustum culled", cullStats.frustumCulled },
+                { "phase 1 visible", cullStats.phase1Visible },
+                { "phase 2 visible", cullStats.phase2Visible },
+            });
+    }
+    if (m_UseMeshletCulling && m_Profiler.IsEnabled())
+    {
+        const MeshletCullingStats meshletStats = m_MeshletCuller.ReadStats(m_CurrentFrameIdx);
+        m_Profiler.AddCounter("Meshlet culling",
+            {
+                { "meshlets", meshletStats.meshlets },
+                { "frustum culled", meshletStats.frustumCulled },
+                { "backface culled", meshletStats.backfaceCulled },
+                { "triangles", meshletStats.triangles },
+            });
+    }
     /*
     At the start of the frame, we want to wait until the previous frame has finished,
     so that the command buffer and semaphores are available to use.
@@ -1662,7 +3699,11 @@ void VulkanApplication::DrawFrame()
     */
 
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrameIdx], VK_NULL_HANDLE, &imageIndex);
+    VkResult result;
+    {
+        CpuProfileScope scope(m_Profiler, "Acquire");
+        result = vkAcquireNextImageKHR(m_Device, m_SwapChain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrameIdx], VK_NULL_HANDLE, &imageIndex);
+    }
     
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
     {
@@ -1671,7 +3712,7 @@ void VulkanApplication::DrawFrame()
         Usually happens after a window resize. It can be returned by The vkAcquireNextImageKHR and vkQueuePresentKHR functions.
         */
         RecreateSwapChain();
-        return;
+        return false;
     }
     else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
     {
@@ -1694,22 +3735,44 @@ void VulkanApplication::DrawFrame()
     The index refers to the VkImage in our swapChainImages array. We're going to use that index to pick the VkFrameBuffer.
     */
 
-    UpdateUniformBuffer(m_CurrentFrameIdx);
+    // The camera, the transforms and the shading permutation requested by the keys
+    TakeSnapshot();
+    if (m_Profiler.IsEnabled())
+    {
+        m_Profiler.AddCounter("Snapshots",
+            {
+                { "simulation step", m_SnapshotStep },
+                { "repeated frames", m_RepeatedSnapshots },
+            });
+    }
+
+    // Only once the image is acquired: a frame that returns early would not submit, its fence would not protect the retired pipelines
+    if (m_Config.shaderHotReload)
+    {
+        ApplyReloadedPipelines();
+    }
+    UpdatePipelines();
+
+    m_FrameUniformOffset = UpdateUniformBuffer();
+    BuildRenderQueue();
 
     // After waiting, we need to manually reset the fence to the unsignaled statei
     vkResetFences(m_Device, 1, &m_InFlightFences[m_CurrentFrameIdx]);
 
     //////////////////////////////////////////////////////////////////////////
     // Recording the command buffer
+    {
+        CpuProfileScope scope(m_Profiler, "Record");
 
-    vkResetCommandBuffer(m_CommandBuffers[m_CurrentFrameIdx], 0);
-    /*
-    With the imageIndex specifying the swap chain image to use in hand, we can now record the command buffer.
-    First, we call vkResetCommandBuffer on the command buffer to make sure it is able to be recorded.
-    */
+        vkResetCommandBuffer(m_CommandBuffers[m_CurrentFrameIdx], 0);
+        /*
+        With the imageIndex specifying the swap chain image to use in hand, we can now record the command buffer.
+        First, we call vkResetCommandBuffer on the command buffer to make sure it is able to be recorded.
+        */
 
-    // Now call the function recordCommandBuffer to record the commands we want.
-    RecordCommandBuffer(m_CommandBuffers[m_CurrentFrameIdx], imageIndex);
+        // Now call the function recordCommandBuffer to record the commands we want.
+        RecordCommandBuffer(m_CommandBuffers[m_CurrentFrameIdx], imageIndex);
+    }
 
     //////////////////////////////////////////////////////////////////////////
     // Submitting the command buffer
@@ -1745,78 +3808,437 @@ void VulkanApplication::DrawFrame()
     have finished execution. In our case we're using the m_RenderFinishedSemaphore for that purpose.
     */
 
-    if (vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, m_InFlightFences[m_CurrentFrameIdx]) != VK_SUCCESS)
+    // The recorded commands read the uniforms at their dynamic offset, the camera can still change until the submission
+    if (m_UseLateLatch)
+    {
+        CpuProfileScope scope(m_Profiler, "LatchCamera");
+        LatchCamera();
+    }
+
+    {
+        CpuProfileScope scope(m_Profiler, "Submit");
+        m_Profiler.MarkSubmit();
+
+        if (vkQueueSubmit(m_GraphicsQueue, 1, &submitInfo, m_InFlightFences[m_CurrentFrameIdx]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+    }
+    m_LatencyMarkers.Mark(LatencyMarkers::MARKER_SUBMIT);
+    /*
+     The function takes an array of VkSubmitInfo structures as argument for efficiency when the workload is much larger.
+     The last parameter references an optional fence that will be signaled when the command buffers finish execution.
+     This allows us to know when it is safe for the command buffer to be reused, thus we want to give it inFlightFence.
+     Now on the next frame, the CPU will wait for this command buffer to finish executing before it records new commands into it.
+    */
+
+    //////////////////////////////////////////////////////////////////////////
+    // Subpass dependencies
+    /*
+     the subpasses in a render pass automatically take care of image layout transitions.
+     These transitions are controlled by subpass dependencies,
+     which specify memory and execution dependencies between subpasses. 
+
+     There are two built-in dependencies that take care of the transition at the start of the render pass
+     and at the end of the render pass, but the former does not occur at the right time.
+     It assumes that the transition occurs at the start of the pipeline, but we haven't acquired the image yet at that point!
+     There are two ways to deal with this problem. We could change the waitStages for the
+     imageAvailableSemaphore to VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT to ensure that the render passes don't begin until the image is available,
+     or we can make the render pass wait for the VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT stage.
+    */
+
+    //////////////////////////////////////////////////////////////////////////
+    // Presentation
+    /*
+    The last step of drawing a frame is submitting the result back to the swap chain to have it eventually show up on the screen. 
+    */
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+    /*
+    The first two parameters specify which semaphores to wait on before presentation can happen, just like VkSubmitInfo.
+    Since we want to wait on the command buffer to finish execution, thus our triangle being drawn, we take the semaphores which will be
+    signaled and wait on them.
+    */
+
+    VkSwapchainKHR swapChains[] = { m_SwapChain };
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = swapChains;
+    presentInfo.pImageIndices = &imageIndex;
+    /*
+    The next two parameters specify the swap chains to present images to and the index of the image for each swap chain.
+    */
+    presentInfo.pResults = nullptr; // Optional
+    /*
+    There is one last optional parameter called pResults. It allows you to specify an array of VkResult values
+    to check for every individual swap chain if presentation was successful.
+    It's not necessary if you're only using a single swap chain, because you can simply use the return value of the present function.
+    */
+
+    // VK_KHR_present_id: the id vkWaitForPresentKHR waits for on the latency thread
+    const uint64_t presentId = m_UsePresentWait ? m_LatencyMarkers.GetNextPresentId() : 0;
+    VkPresentIdKHR presentIdInfo{};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+    if (m_UsePresentWait)
+    {
+        presentInfo.pNext = &presentIdInfo;
+    }
+
+    {
+        CpuProfileScope scope(m_Profiler, "Present");
+        auto swapchainLock = m_LatencyMarkers.LockSwapchain();
+        result = vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+    }
+    m_LatencyMarkers.Mark(LatencyMarkers::MARKER_PRESENT);
+    m_LatencyMarkers.EndFrame(m_SwapChain, result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR ? presentId : 0);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_IsFamebufferResized)
+    {
+        m_IsFamebufferResized = false;
+        RecreateSwapChain();
+    }
+    else if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to present swap chain image!");
+    }
+    /*
+    The vkQueuePresentKHR function submits the request to present an image to the swap chain.
+    */
+
+    m_CurrentFrameIdx = (m_CurrentFrameIdx + 1) % MAX_FRAMES_IN_FLIGHT;
+    return true;
+}
+
+// The permutation in the low bits, see RequestPipeline
+static uint64_t GetPipelineKey(uint32_t pipelineId, uint32_t shadingFeatures)
+{
+    return (static_cast<uint64_t>(pipelineId) << 32) | shadingFeatures;
+}
+
+bool VulkanApplication::SelectShadingPermutation(uint32_t shadingFeatures)
+{
+    /*
+    Built on first use: all the combinations up front would multiply the pipeline creation time of the startup
+    by 2^SHADING_FEATURE_COUNT, for permutations that may never be drawn. Switching back is a map lookup.
+    The switch waits for every pipeline of the permutation, so the frame never mixes two of them.
+    */
+    bool ready = true;
+    if (m_GraphicsPermutations.count(shadingFeatures) == 0)
+    {
+        RequestPipeline(PIPELINE_SHADED, shadingFeatures);
+        ready = false;
+    }
+    if (m_UseMeshShaders && m_MeshShaderPermutations.count(shadingFeatures) == 0)
+    {
+        RequestPipeline(PIPELINE_MESH_SHADER, shadingFeatures);
+        ready = false;
+    }
+    if (!ready)
+    {
+        return false;
+    }
+
+    m_GraphicsPipeline = m_GraphicsPermutations[shadingFeatures];
+    if (m_UseMeshShaders)
+    {
+        m_MeshShaderPipeline = m_MeshShaderPermutations[shadingFeatures];
+    }
+    m_ShadingFeatures = shadingFeatures;
+    return true;
+}
+
+void VulkanApplication::RequestPipeline(uint32_t pipelineId, uint32_t shadingFeatures, std::shared_ptr<const VkPipeline> fragmentShader)
+{
+    /*
+    The jobs run on the pipeline threads: like ReloadShaders, they only read what InitVulkan set up. The SPIR-V is
+    read or compiled by the job too, the frame thread only queues it. Requesting a permutation being built does nothing.
+    */
+    const uint64_t key = GetPipelineKey(pipelineId, shadingFeatures);
+    if (m_PipelineManager.IsPending(key))
+    {
+        return;
+    }
+
+    // Printed with --startup-timing only, switching permutations would fill the console otherwise
+    const auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [start]()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    const bool printTiming = m_Config.printStartupTiming;
+
+    if (pipelineId == PIPELINE_MESH_SHADER)
+    {
+        m_PipelineManager.Request(key, [=](const PipelineManager::PublishFunction& publish)
+        {
+            publish(BuildMeshShaderPipeline(LoadShaderCode("meshlet_task.spv"), LoadShaderCode("meshlet_mesh.spv"),
+                LoadFragmentShaderCode(shadingFeatures), shadingFeatures), true);
+            if (printTiming)
+            {
+                std::cout << "mesh shader pipeline of shading permutation " << GetShadingFeatureNames(shadingFeatures)
+                    << " built in " << elapsedMs() << " ms" << std::endl;
+            }
+        });
+    }
+    else if (!m_UseGraphicsPipelineLibrary)
+    {
+        m_PipelineManager.Request(key, [=](const PipelineManager::PublishFunction& publish)
+        {
+            publish(BuildGraphicsPipeline(LoadShaderCode(GetVertexShaderFile()), LoadFragmentShaderCode(shadingFeatures), shadingFeatures), true);
+            if (printTiming)
+            {
+                std::cout << "graphics pipeline of shading permutation " << GetShadingFeatureNames(shadingFeatures)
+                    << " built in " << elapsedMs() << " ms" << std::endl;
+            }
+        });
+    }
+    else
+    {
+        // Only the fragment shader differs between the permutations, the other parts are the shared libraries
+        const GraphicsPipelineLibraries libraries = m_GraphicsLibraries;
+        m_PipelineManager.Request(key, [=](const PipelineManager::PublishFunction& publish)
+        {
+            std::shared_ptr<const VkPipeline> fragmentLibrary = fragmentShader;
+            double fastLinkMs = 0.0;
+            if (!fragmentLibrary)
+            {
+                fragmentLibrary = OwnPipelineLibrary(BuildGraphicsPipeline({}, LoadFragmentShaderCode(shadingFeatures), shadingFeatures,
+                    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT));
+                publish(LinkGraphicsPipeline(libraries, *fragmentLibrary, false), false);
+                fastLinkMs = elapsedMs();
+            }
+            publish(LinkGraphicsPipeline(libraries, *fragmentLibrary, true), true);
+            if (printTiming)
+            {
+                std::cout << "graphics pipeline of shading permutation " << GetShadingFeatureNames(shadingFeatures)
+                    << ": fast link after " << fastLinkMs << " ms, optimized after " << elapsedMs() << " ms" << std::endl;
+            }
+        });
+    }
+}
+
+void VulkanApplication::UpdatePipelines()
+{
+    for (const PipelineManager::Result& result : m_PipelineManager.TakeResults())
+    {
+        const uint32_t shadingFeatures = static_cast<uint32_t>(result.key);
+        if (result.pipeline == VK_NULL_HANDLE)
+        {
+            // A permutation that doesn't compile (--permutation-defines) is not selected, the keys can try again
+            std::cerr << "shading permutation " << GetShadingFeatureNames(shadingFeatures) << ": " << result.error << std::endl;
+            if (m_RequestedShadingFeatures == shadingFeatures)
+            {
+                m_RequestedShadingFeatures = m_ShadingFeatures;
+            }
+            continue;
+        }
+
+        // An optimized pipeline replaces the fast-linked one, which the frames in flight may still draw with
+        std::map<uint32_t, VkPipeline>& permutations = (result.key >> 32) == PIPELINE_MESH_SHADER ? m_MeshShaderPermutations : m_GraphicsPermutations;
+        auto permutation = permutations.find(shadingFeatures);
+        if (permutation != permutations.end())
+        {
+            m_RetiredPipelines[m_CurrentFrameIdx].push_back(permutation->second);
+        }
+        permutations[shadingFeatures] = result.pipeline;
+    }
+
+    // The pipelines of the previous permutation stay in use by the frames in flight, and cached for later
+    if (m_RequestedShadingFeatures != m_ShadingFeatures)
+    {
+        SelectShadingPermutation(m_RequestedShadingFeatures);
+    }
+
+    m_GraphicsPipeline = m_GraphicsPermutations[m_ShadingFeatures];
+    if (m_UseMeshShaders)
+    {
+        m_MeshShaderPipeline = m_MeshShaderPermutations[m_ShadingFeatures];
+    }
+}
+
+const char* VulkanApplication::GetVertexShaderFile() const
+{
+    return !m_Config.geometryPool ? "vert.spv" : m_UseBufferDeviceAddress ? "vertex_pull_bda_vert.spv" : "vertex_pull_vert.spv";
+}
+
+const char* VulkanApplication::GetDepthPrepassShaderFile() const
+{
+    return !m_Config.geometryPool ? "depth_prepass_vert.spv"
+        : m_UseBufferDeviceAddress ? "depth_prepass_pull_bda_vert.spv" : "depth_prepass_pull_vert.spv";
+}
+
+void VulkanApplication::ReloadShaders(const std::vector<std::string>& changedFiles)
+{
+    /*
+    Runs on the watcher thread while the main thread keeps drawing with the current pipelines. The Build* functions
+    only read what InitVulkan set up, and vkCreateGraphicsPipelines needs no synchronization without a pipeline cache.
+    Every stage of a rebuilt pipeline is compiled again, the SPIR-V of the startup is released once it's used.
+    */
+    auto usesChangedFile = [&](std::initializer_list<const char*> spirvFiles)
+    {
+        for (const char* spirvFile : spirvFiles)
+        {
+            const std::string sourcePath = SHADER_DIRECTORY + FindShaderSource(spirvFile).sourceFile;
+            if (std::find(changedFiles.begin(), changedFiles.end(), sourcePath) != changedFiles.end())
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+    const auto start = std::chrono::steady_clock::now();
+    ReloadedPipelines pipelines;
+    // Only the current permutation, the others are rebuilt when they are selected again
+    const uint32_t shadingFeatures = m_ShadingFeatures;
+    pipelines.graphicsFeatures = shadingFeatures;
+    pipelines.meshShaderFeatures = shadingFeatures;
+    try
+    {
+        const bool rebuildGraphics = usesChangedFile({ GetVertexShaderFile(), "frag.spv" });
+        const bool rebuildLibraries = m_UseGraphicsPipelineLibrary && usesChangedFile({ GetVertexShaderFile() });
+        const bool rebuildDepthPrepass = m_Config.depthPrepass && usesChangedFile({ GetDepthPrepassShaderFile() });
+        const bool rebuildMeshShader = m_UseMeshShaders && usesChangedFile({ "meshlet_task.spv", "meshlet_mesh.spv", "frag.spv" });
+
+        // Compiled first: a resize only waits for the pipeline creation below, not for the GLSL compiler
+        const std::vector<char> vertShaderCode = rebuildGraphics || rebuildLibraries ? LoadShaderCode(GetVertexShaderFile()) : std::vector<char>();
+        const std::vector<char> fragShaderCode = rebuildGraphics || rebuildMeshShader ? LoadFragmentShaderCode(shadingFeatures) : std::vector<char>();
+        const std::vector<char> depthPrepassShaderCode = rebuildDepthPrepass ? LoadShaderCode(GetDepthPrepassShaderFile()) : std::vector<char>();
+        const std::vector<char> taskShaderCode = rebuildMeshShader ? LoadShaderCode("meshlet_task.spv") : std::vector<char>();
+        const std::vector<char> meshShaderCode = rebuildMeshShader ? LoadShaderCode("meshlet_mesh.spv") : std::vector<char>();
+
+        // The pipelines are built for the swap chain format and the render pass, RecreateSwapChain rewrites them
+        std::lock_guard<std::mutex> swapChainLock(m_SwapChainMutex);
+        if (rebuildGraphics)
+        {
+            pipelines.graphics = BuildGraphicsPipeline(vertShaderCode, fragShaderCode, shadingFeatures);
+        }
+        if (rebuildLibraries)
+        {
+            pipelines.graphicsLibraries = BuildGraphicsPipelineLibraries(vertShaderCode);
+        }
+        if (rebuildDepthPrepass)
+        {
+            pipelines.depthPrepass = BuildDepthPrepassPipeline(depthPrepassShaderCode);
+        }
+        if (rebuildMeshShader)
+        {
+            pipelines.meshShader = BuildMeshShaderPipeline(taskShaderCode, meshShaderCode, fragShaderCode, shadingFeatures);
+        }
+    }
+    catch (const std::exception& e)
     {
-        throw std::runtime_error("failed to submit draw command buffer!");
+        // A typo in a shader must not end the session: keep the current pipelines until the next save compiles
+        std::cerr << "shader reload: " << e.what() << std::endl;
+        vkDestroyPipeline(m_Device, pipelines.graphics, nullptr);
+        vkDestroyPipeline(m_Device, pipelines.depthPrepass, nullptr);
+        return;
     }
-    /*
-     The function takes an array of VkSubmitInfo structures as argument for efficiency when the workload is much larger.
-     The last parameter references an optional fence that will be signaled when the command buffers finish execution.
-     This allows us to know when it is safe for the command buffer to be reused, thus we want to give it inFlightFence.
-     Now on the next frame, the CPU will wait for this command buffer to finish executing before it records new commands into it.
-    */
-
-    //////////////////////////////////////////////////////////////////////////
-    // Subpass dependencies
-    /*
-     the subpasses in a render pass automatically take care of image layout transitions.
-     These transitions are controlled by subpass dependencies,
-     which specify memory and execution dependencies between subpasses. 
 
-     There are two built-in dependencies that take care of the transition at the start of the render pass
-     and at the end of the render pass, but the former does not occur at the right time.
-     It assumes that the transition occurs at the start of the pipeline, but we haven't acquired the image yet at that point!
-     There are two ways to deal with this problem. We could change the waitStages for the
-     imageAvailableSemaphore to VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT to ensure that the render passes don't begin until the image is available,
-     or we can make the render pass wait for the VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT stage.
-    */
+    if (pipelines.graphics == VK_NULL_HANDLE && pipelines.depthPrepass == VK_NULL_HANDLE && pipelines.meshShader == VK_NULL_HANDLE)
+    {
+        // The compute shaders belong to the cullers, they are only read at startup
+        std::cout << "shader reload: " << changedFiles.front() << " is not used by a graphics pipeline, skipped" << std::endl;
+        return;
+    }
 
-    //////////////////////////////////////////////////////////////////////////
-    // Presentation
-    /*
-    The last step of drawing a frame is submitting the result back to the swap chain to have it eventually show up on the screen. 
-    */
+    {
+        std::lock_guard<std::mutex> lock(m_ReloadMutex);
+        // A rebuild that was never swapped in is not used by any frame, the newer one replaces it right away
+        auto publish = [this](VkPipeline& pending, VkPipeline pipeline)
+        {
+            if (pipeline != VK_NULL_HANDLE)
+            {
+                vkDestroyPipeline(m_Device, pending, nullptr);
+                pending = pipeline;
+            }
+        };
+        publish(m_ReloadedPipelines.graphics, pipelines.graphics);
+        publish(m_ReloadedPipelines.depthPrepass, pipelines.depthPrepass);
+        publish(m_ReloadedPipelines.meshShader, pipelines.meshShader);
+        if (pipelines.graphics != VK_NULL_HANDLE)
+        {
+            m_ReloadedPipelines.graphicsFeatures = pipelines.graphicsFeatures;
+        }
+        if (pipelines.graphicsLibraries.preRasterization)
+        {
+            m_ReloadedPipelines.graphicsLibraries = pipelines.graphicsLibraries;
+        }
+        if (pipelines.meshShader != VK_NULL_HANDLE)
+        {
+            m_ReloadedPipelines.meshShaderFeatures = pipelines.meshShaderFeatures;
+        }
+    }
 
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    // Every save of an interactive session would print one, only with the other timings
+    if (m_Config.printStartupTiming)
+    {
+        const double reloadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "shader reload: " << changedFiles.front() << (changedFiles.size() > 1 ? " and others" : "")
+            << " rebuilt in " << reloadMs << " ms" << std::endl;
+    }
+}
 
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-    /*
-    The first two parameters specify which semaphores to wait on before presentation can happen, just like VkSubmitInfo.
-    Since we want to wait on the command buffer to finish execution, thus our triangle being drawn, we take the semaphores which will be
-    signaled and wait on them.
-    */
+void VulkanApplication::ApplyReloadedPipelines()
+{
+    ReloadedPipelines pipelines;
+    {
+        std::lock_guard<std::mutex> lock(m_ReloadMutex);
+        std::swap(pipelines, m_ReloadedPipelines);
+    }
+    if (pipelines.graphics == VK_NULL_HANDLE && pipelines.depthPrepass == VK_NULL_HANDLE && pipelines.meshShader == VK_NULL_HANDLE)
+    {
+        return;
+    }
 
-    VkSwapchainKHR swapChains[] = { m_SwapChain };
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    /*
-    The next two parameters specify the swap chains to present images to and the index of the image for each swap chain.
-    */
-    presentInfo.pResults = nullptr; // Optional
-    /*
-    There is one last optional parameter called pResults. It allows you to specify an array of VkResult values
-    to check for every individual swap chain if presentation was successful.
-    It's not necessary if you're only using a single swap chain, because you can simply use the return value of the present function.
-    */
+    // The previous frame may still draw with the old pipelines: they are destroyed after the next fence of this frame slot
+    std::vector<VkPipeline>& retired = m_RetiredPipelines[m_CurrentFrameIdx];
+    if (pipelines.depthPrepass != VK_NULL_HANDLE)
+    {
+        retired.push_back(m_DepthPrepassPipeline);
+        m_DepthPrepassPipeline = pipelines.depthPrepass;
+    }
 
-    result = vkQueuePresentKHR(m_PresentQueue, &presentInfo);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_IsFamebufferResized)
+    // What the pipeline threads are still building is from the old sources, it is dropped
+    if (pipelines.graphics != VK_NULL_HANDLE || pipelines.meshShader != VK_NULL_HANDLE)
     {
-        m_IsFamebufferResized = false;
-        RecreateSwapChain();
+        m_PipelineManager.Invalidate();
     }
-    else if (result != VK_SUCCESS)
+    if (pipelines.graphicsLibraries.preRasterization)
     {
-        throw std::runtime_error("failed to present swap chain image!");
+        m_GraphicsLibraries = pipelines.graphicsLibraries;
     }
+
     /*
-    The vkQueuePresentKHR function submits the request to present an image to the swap chain.
+    Every cached permutation was built from the old source, only the reloaded one is kept. If a key changed the
+    permutation since the reload started, the current one stays until its rebuild from the new source replaces it.
     */
-
-    m_CurrentFrameIdx = (m_CurrentFrameIdx + 1) % MAX_FRAMES_IN_FLIGHT;
+    auto swapIn = [&](uint32_t pipelineId, std::map<uint32_t, VkPipeline>& permutations, VkPipeline reloaded, uint32_t reloadedFeatures)
+    {
+        if (reloaded == VK_NULL_HANDLE)
+        {
+            return;
+        }
+        for (auto permutation = permutations.begin(); permutation != permutations.end();)
+        {
+            if (permutation->first == m_ShadingFeatures && permutation->first != reloadedFeatures)
+            {
+                RequestPipeline(pipelineId, m_ShadingFeatures);
+                ++permutation;
+            }
+            else
+            {
+                retired.push_back(permutation->second);
+                permutation = permutations.erase(permutation);
+            }
+        }
+        permutations[reloadedFeatures] = reloaded;
+    };
+    swapIn(PIPELINE_SHADED, m_GraphicsPermutations, pipelines.graphics, pipelines.graphicsFeatures);
+    swapIn(PIPELINE_MESH_SHADER, m_MeshShaderPermutations, pipelines.meshShader, pipelines.meshShaderFeatures);
 }
 
 VkImageView VulkanApplication::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) const
@@ -2252,6 +4674,169 @@ bool VulkanApplication::CheckValidationLayerSupport() const
     return true;
 }
 
+bool VulkanApplication::IsDynamicRenderingSupported(VkPhysicalDevice device) const
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> requiredExtensions(DYNAMIC_RENDERING_EXTENSIONS.begin(), DYNAMIC_RENDERING_EXTENSIONS.end());
+
+    for (const auto& extension : availableExtensions)
+    {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    if (!requiredExtensions.empty())
+    {
+        return false;
+    }
+
+    // The extension can be exposed with the feature disabled
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &dynamicRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+}
+
+bool VulkanApplication::IsMeshShaderSupported(VkPhysicalDevice device) const
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> requiredExtensions(MESH_SHADER_EXTENSIONS.begin(), MESH_SHADER_EXTENSIONS.end());
+
+    for (const auto& extension : availableExtensions)
+    {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    if (!requiredExtensions.empty())
+    {
+        return false;
+    }
+
+    // Both stages are needed, the culling runs in the task shader
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &meshShaderFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return meshShaderFeatures.taskShader == VK_TRUE && meshShaderFeatures.meshShader == VK_TRUE;
+}
+
+bool VulkanApplication::IsBufferDeviceAddressSupported(VkPhysicalDevice device) const
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> requiredExtensions(BUFFER_DEVICE_ADDRESS_EXTENSIONS.begin(), BUFFER_DEVICE_ADDRESS_EXTENSIONS.end());
+
+    for (const auto& extension : availableExtensions)
+    {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    if (!requiredExtensions.empty())
+    {
+        return false;
+    }
+
+    VkPhysicalDeviceBufferDeviceAddressFeaturesKHR bufferDeviceAddressFeatures{};
+    bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &bufferDeviceAddressFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return bufferDeviceAddressFeatures.bufferDeviceAddress == VK_TRUE;
+}
+
+bool VulkanApplication::IsGraphicsPipelineLibrarySupported(VkPhysicalDevice device) const
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> requiredExtensions(GRAPHICS_PIPELINE_LIBRARY_EXTENSIONS.begin(), GRAPHICS_PIPELINE_LIBRARY_EXTENSIONS.end());
+
+    for (const auto& extension : availableExtensions)
+    {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    if (!requiredExtensions.empty())
+    {
+        return false;
+    }
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibraryFeatures{};
+    graphicsPipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &graphicsPipelineLibraryFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    // Still used without graphicsPipelineLibraryFastLinking: the link is then slower, but it stays off the frame thread
+    return graphicsPipelineLibraryFeatures.graphicsPipelineLibrary == VK_TRUE;
+}
+
+bool VulkanApplication::IsPresentWaitSupported(VkPhysicalDevice device) const
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> requiredExtensions(PRESENT_WAIT_EXTENSIONS.begin(), PRESENT_WAIT_EXTENSIONS.end());
+
+    for (const auto& extension : availableExtensions)
+    {
+        requiredExtensions.erase(extension.extensionName);
+    }
+
+    if (!requiredExtensions.empty())
+    {
+        return false;
+    }
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = &presentIdFeatures;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &presentWaitFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    // Some drivers expose the extensions on surfaces that can't report the presents, they leave the features off
+    return presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+}
+
 bool VulkanApplication::CheckDeviceExtensionSupport(VkPhysicalDevice device) const
 {
     uint32_t extensionCount;
@@ -2369,14 +4954,11 @@ VkExtent2D VulkanApplication::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& c
     }
     else
     {
-        // Get the resolution of the surface in pixels
-        int width, height;
-        glfwGetFramebufferSize(m_Window, &width, &height);
-
+        // The resolution of the surface in pixels, as the main thread last saw it
         VkExtent2D actualExtent =
         {
-            static_cast<uint32_t>(width),
-            static_cast<uint32_t>(height)
+            m_FramebufferWidth,
+            m_FramebufferHeight
         };
 
         actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
@@ -2423,15 +5005,10 @@ QueueFamilyIndices VulkanApplication::FindQueueFamilies(VkPhysicalDevice device)
 
 uint32_t VulkanApplication::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
 {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    const uint32_t memoryType = ::FindMemoryType(m_PhysicalDevice, typeFilter, properties);
+    if (memoryType != NO_MEMORY_TYPE)
     {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            return i;
-        }
+        return memoryType;
     }
     /*
     The memoryTypes array consists of VkMemoryType structs that specify the heap and properties of each type of memory.
@@ -2543,9 +5120,38 @@ int VulkanApplication::RateDeviceSuitability(VkPhysicalDevice device) const
 void VulkanApplication::FramebufferResizeCallback(GLFWwindow* window, int width, int height)
 {
     auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
+    app->m_FramebufferWidth = static_cast<uint32_t>(width);
+    app->m_FramebufferHeight = static_cast<uint32_t>(height);
     app->m_IsFamebufferResized = true;
 }
 
+void VulkanApplication::KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action == GLFW_PRESS && key >= GLFW_KEY_1 && key < GLFW_KEY_1 + static_cast<int>(SHADING_FEATURE_COUNT))
+    {
+        auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
+        app->m_InputShadingFeatures ^= 1u << (key - GLFW_KEY_1);
+    }
+}
+
+void VulkanApplication::CursorPosCallback(GLFWwindow* window, double x, double y)
+{
+    auto app = reinterpret_cast<VulkanApplication*>(glfwGetWindowUserPointer(window));
+
+    // GLFW has no event timestamps, the callback runs while the events are polled
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    InputSample& input = app->m_CursorInput;
+    input.cursorX = x - width * 0.5;
+    input.cursorY = y - height * 0.5;
+    input.time = std::chrono::steady_clock::now();
+    ++input.sequence;
+
+    // Straight to the latch, the next snapshot carries it as well
+    app->m_LatchInputs.GetWriteBuffer() = input;
+    app->m_LatchInputs.Publish();
+}
+
 void VulkanApplication::SetCurrentDirectory()
 {
 #ifdef _WIN32
@@ -2566,53 +5172,130 @@ void VulkanApplication::SetCurrentDirectory()
 #endif
 }
 
+void VulkanApplication::StartAssetLoading()
+{
+    /*
+    std::launch::deferred runs the task on the joining thread when it is joined,
+    which is exactly the old sequential order: the comparison point for --serial-startup.
+    */
+    JobSystem& jobs = JobSystem::GetGlobal();
+    if (m_Config.serialStartup || jobs.GetThreadCount() == 1)
+    {
+        // Without workers the jobs would only run once the main thread waits for them, never in a blocking get()
+        m_ShadersLoaded = std::async(std::launch::deferred, &VulkanApplication::LoadShaders, this);
+        m_TextureLoaded = std::async(std::launch::deferred, &VulkanApplication::LoadTexture, this);
+        m_ModelLoaded = std::async(std::launch::deferred, &VulkanApplication::LoadModel, this);
+        return;
+    }
+
+    // On the job workers, which also take the ParallelFor batches of the loaders
+    m_ShadersLoaded = jobs.Async("LoadShaders", [this]() { LoadShaders(); });
+    m_TextureLoaded = jobs.Async("LoadTexture", [this]() { LoadTexture(); });
+    m_ModelLoaded = jobs.Async("LoadModel", [this]() { LoadModel(); });
+}
+
 void VulkanApplication::LoadModel()
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+    StartupTimer::Scope scope(m_StartupTimer, "LoadModel");
+    LoadObjModel(MODEL_PATH, m_Vertices, m_Indices);
+
+    const BoundingSphere bounds = ComputeBoundingSphere(m_Vertices);
+    m_ModelObject = m_SceneTransforms.Add(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f), bounds);
+    m_ModelBoundingBox = ComputeBoundingBox(m_Vertices);
+    m_ModelRadius = bounds.radius;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+    // The simplified index ranges are appended to m_Indices, so they all land in the one index buffer
+    if (m_Config.lodPixelError > 0.0f)
     {
-        throw std::runtime_error(warn + err);
+        m_ModelLods = GenerateMeshLods(m_Vertices, m_Indices);
+    }
+    else
+    {
+        m_ModelLods = { MeshLod{ 0, static_cast<uint32_t>(m_Indices.size()), 0.0f } };
     }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
-    for (const auto& shape : shapes)
+    // Every LOD gets its own meshlets, all of them in the same buffers
+    if (m_Config.meshlets)
     {
-        for (const auto& index : shape.mesh.indices)
+        for (const MeshLod& lod : m_ModelLods)
         {
-            Vertex vertex{};
+            m_ModelMeshletLods.push_back(AppendMeshlets(m_ModelMeshlets, m_Vertices, m_Indices.data() + lod.firstIndex, lod.indexCount));
+        }
+    }
+}
 
-            vertex.pos =
-            {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
+void VulkanApplication::LoadTexture()
+{
+    StartupTimer::Scope scope(m_StartupTimer, "LoadTexture");
+    m_TextureData = LoadImageRGBA(TEXTURE_PATH);
+}
 
-            vertex.texCoord =
-            {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                /*
-                The OBJ format assumes a coordinate system where a vertical coordinate of 0 means the bottom of the image,
-                however we've uploaded our image into Vulkan in a top to bottom orientation where 0 means the top of the image.
-                Solve this by flipping the vertical component of the texture coordinates
-                */
-            };
-
-            if (uniqueVertices.count(vertex) == 0)
-            {
-                uniqueVertices[vertex] = static_cast<uint32_t>(m_Vertices.size());
-                m_Vertices.push_back(vertex);
-            }
+void VulkanApplication::LoadShaders()
+{
+    StartupTimer::Scope scope(m_StartupTimer, "LoadShaders");
+    m_SpirvCache.Init(SHADER_DIRECTORY, SHADER_CACHE_DIRECTORY);
 
-            m_Indices.push_back(uniqueVertices[vertex]);
+    auto load = [this](const char* spirvFile, std::vector<char>& code)
+    {
+        code = LoadShaderCode(spirvFile);
+    };
 
-            vertex.color = { 1.0f, 1.0f, 1.0f };
+    load("vert.spv", m_VertShaderCode);
+    m_FragShaderCode = LoadFragmentShaderCode(m_ShadingFeatures);
+    if (m_Config.depthPrepass)
+    {
+        load("depth_prepass_vert.spv", m_DepthPrepassVertShaderCode);
+    }
+    if (m_Config.occlusionCulling)
+    {
+        load("hiz_depth_comp.spv", m_OcclusionCullingShaders.depthReduce);
+        load("hiz_depth_ms_comp.spv", m_OcclusionCullingShaders.depthReduceMs);
+        load("hiz_reduce_comp.spv", m_OcclusionCullingShaders.pyramidReduce);
+        load("occlusion_cull_comp.spv", m_OcclusionCullingShaders.cull);
+    }
+    // The device isn't picked yet, so the shaders of both meshlet paths are read
+    if (m_Config.meshlets)
+    {
+        load("meshlet_cull_comp.spv", m_MeshletCullShaderCode);
+    }
+    if (m_Config.geometryPool)
+    {
+        load("vertex_pull_vert.spv", m_VertexPullingShaders.storageBuffer);
+        load("vertex_pull_bda_vert.spv", m_VertexPullingShaders.deviceAddress);
+        if (m_Config.depthPrepass)
+        {
+            load("depth_prepass_pull_vert.spv", m_VertexPullingShaders.depthPrepassStorageBuffer);
+            load("depth_prepass_pull_bda_vert.spv", m_VertexPullingShaders.depthPrepassDeviceAddress);
         }
     }
+    if (m_Config.meshShaders)
+    {
+        load("meshlet_task.spv", m_MeshletTaskShaderCode);
+        load("meshlet_mesh.spv", m_MeshletMeshShaderCode);
+    }
+}
+
+std::vector<char> VulkanApplication::LoadShaderCode(const char* spirvFile)
+{
+    // --hot-reload compiles the GLSL itself, compile_shaders.bat is then not needed
+    if (m_Config.shaderHotReload)
+    {
+        return m_SpirvCache.Get(FindShaderSource(spirvFile));
+    }
+
+    std::vector<char> code;
+    ReadFile(SHADER_DIRECTORY + spirvFile, code);
+    return code;
+}
+
+std::vector<char> VulkanApplication::LoadFragmentShaderCode(uint32_t shadingFeatures)
+{
+    if (!m_Config.permutationDefines)
+    {
+        return LoadShaderCode("frag.spv");
+    }
+
+    // Optimized, or the code of the disabled features would still be there: glslang doesn't remove constant branches
+    const std::string define = std::string(SHADING_FEATURES_DEFINE) + "=" + std::to_string(shadingFeatures) + "u";
+    return m_SpirvCache.Get(FindShaderSource("frag.spv"), { define }, true);
 }
@@ -25,16 +25,47 @@
 
 #include <vulkan/vulkan.h>
 
+#include "app_config.h"
+#include "bvh.h"
+#include "descriptor_allocator.h"
+#include "file_watcher.h"
+#include "frame_allocator.h"
+#include "frame_readback.h"
+#include "geometry_pool.h"
+#include "gpu_profiler.h"
+#include "job_system.h"
+#include "latency_markers.h"
+#include "mesh_lod.h"
+#include "meshlet_culling.h"
+#include "occlusion_culling.h"
+#include "pipeline_manager.h"
+#include "software_occlusion.h"
+#include "render_queue.h"
+#include "image_loader.h"
+#include "scene_uniforms.h"
+#include "shader_permutations.h"
+#include "startup_timer.h"
+#include "transform_system.h"
+#include "triple_buffer.h"
+#include "vertex.h"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 /*
     https://vulkan-tutorial.com/
 */
 
-struct Vertex
+/*
+    Vertex input layout of Vertex (vertex.h) for the graphics pipeline
+*/
+struct VertexLayout
 {
-    glm::vec3 pos;
-    glm::vec3 color;
-    glm::vec2 texCoord;
-
     static VkVertexInputBindingDescription GetBindingDescription()
     {
         VkVertexInputBindingDescription bindingDescription{};
@@ -82,24 +113,8 @@ struct Vertex
 
         return attributeDescriptions;
     }
-
-    bool operator==(const Vertex& other) const
-    {
-        return pos == other.pos && color == other.color && texCoord == other.texCoord;
-    }
 };
 
-namespace std
-{
-    template<> struct hash<Vertex>
-    {
-        size_t operator()(Vertex const& vertex) const
-        {
-            return ((hash<glm::vec3>()(vertex.pos) ^ (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.texCoord) << 1);
-        }
-    };
-}
-
 //const std::vector<Vertex> verticesData = {
 //    {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
 //    {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
@@ -122,13 +137,6 @@ namespace std
 //    4, 5, 6, 6, 7, 4
 //};
 
-struct UniformBufferObject
-{
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 view;
-    alignas(16) glm::mat4 proj;
-};
-
 struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
@@ -147,9 +155,40 @@ struct SwapChainSupportDetails
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+/*
+    --pipeline-library: the parts of the graphics pipeline that are the same for every shading permutation, built once.
+    The fragment output interface is what MSAA/AA settings change, the vertex input interface what vertex formats change.
+    Shared with the worker jobs that link them: a library is destroyed with its last reference.
+*/
+struct GraphicsPipelineLibraries
+{
+    std::shared_ptr<const VkPipeline> vertexInput;
+    std::shared_ptr<const VkPipeline> preRasterization;     // vertex shader, viewport, rasterization
+    std::shared_ptr<const VkPipeline> fragmentOutput;       // color blend, attachment formats, sample count
+};
+
+/*
+    --mouse-camera: cursor position relative to the window center, in screen coordinates
+*/
+struct InputSample
+{
+    double cursorX = 0.0;
+    double cursorY = 0.0;
+    uint64_t sequence = 0;                          // increases with every cursor event, 0 before the first one
+    std::chrono::steady_clock::time_point time;     // when the event was received
+};
+
 class VulkanApplication
 {
 public:
+    explicit VulkanApplication(const ApplicationConfig& config)
+        : m_Config(config)
+        , m_ShadingFeatures(config.shadingFeatures)
+        , m_RequestedShadingFeatures(config.shadingFeatures)
+        , m_InputShadingFeatures(config.shadingFeatures)
+        , m_SnapshotShadingFeatures(config.shadingFeatures)
+    {
+    }
 
     void Run();
 
@@ -157,6 +196,11 @@ private:
     void InitVulkan();
 
     void MainLoop();
+    void BenchmarkLoop();
+    void ResizeBenchmark();
+    // --render-thread: the main thread polls the input and simulates, RenderThreadMain draws
+    void RenderThreadLoop();
+    void RenderThreadMain();
 
     void Cleanup();
 
@@ -176,7 +220,32 @@ private:
     void CreateImageViews();
     void CreateRenderPass();
     void CreateDescriptorSetLayout();
+    void StartPipelineManager();
     void CreateGraphicsPipeline();
+    void CreateDepthPrepassPipeline(); // --depth-prepass
+    void CreateMeshShaderPipeline(); // --mesh-shaders
+    // The pipelines of the three above with the given SPIR-V, also called from the shader watcher and pipeline threads.
+    // shadingFeatures specializes shader.frag, see ShadingFeature.
+    // libraryParts builds only these parts as a pipeline library (a shader whose part is not built may be empty).
+    VkPipeline BuildGraphicsPipeline(const std::vector<char>& vertShaderCode, const std::vector<char>& fragShaderCode, uint32_t shadingFeatures,
+        VkGraphicsPipelineLibraryFlagsEXT libraryParts = 0) const;
+    VkPipeline BuildDepthPrepassPipeline(const std::vector<char>& vertShaderCode) const;
+    VkPipeline BuildMeshShaderPipeline(const std::vector<char>& taskShaderCode, const std::vector<char>& meshShaderCode,
+        const std::vector<char>& fragShaderCode, uint32_t shadingFeatures) const;
+    // --pipeline-library: every part but the fragment shader, and the link of all the parts into a pipeline
+    GraphicsPipelineLibraries BuildGraphicsPipelineLibraries(const std::vector<char>& vertShaderCode) const;
+    VkPipeline LinkGraphicsPipeline(const GraphicsPipelineLibraries& libraries, VkPipeline fragmentShader, bool optimize) const;
+    std::shared_ptr<const VkPipeline> OwnPipelineLibrary(VkPipeline library) const;
+    /*
+    Makes the pipelines of a shader.frag permutation current if they are built. Otherwise requests them from the pipeline
+    workers and returns false: the frames go on with the current permutation until they are ready.
+    */
+    bool SelectShadingPermutation(uint32_t shadingFeatures);
+    // pipelineId is PIPELINE_SHADED or PIPELINE_MESH_SHADER. With pipeline libraries, a fragmentShader library already
+    // built is only linked with optimizations.
+    void RequestPipeline(uint32_t pipelineId, uint32_t shadingFeatures, std::shared_ptr<const VkPipeline> fragmentShader = nullptr);
+    // Once per frame: takes the pipelines the workers built, switches to the requested permutation when it is ready
+    void UpdatePipelines();
     void CreateFramebuffers();
     void CreateCommandPool();
     void CreateColorResources(); // MSAA image
@@ -185,24 +254,84 @@ private:
     void CreateTextureImageView();
     void CreateTextureSampler();
     void CreateVertexBuffer();
+    void CreatePositionBuffer(); // --depth-prepass
     void CreateIndexBuffer();
+    void CreateGeometryPool(); // --geometry-pool, instead of the three above
     void CreateUniformBuffers();
-    void CreateDescriptorPool();
-    void CreateDescriptorSets();
+    void CreateDescriptorAllocators();
+    void CreateOcclusionCuller(); // --occlusion-culling
+    void CreateSoftwareOcclusion(); // --cpu-occlusion-culling
+    void CreateMeshletCuller(); // --meshlets
     void CreateCommandBuffers();
     void CreateSyncObjects();
-
-    void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) const;
+    void CreateProfiler();
+    void StartFrameExport(); // --export
+    void StartLatencyMarkers(); // --mouse-camera
+    void StartShaderHotReload(); // --hot-reload
+
+    void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    /*
+    Render pass or dynamic rendering, plus viewport and scissor. With occlusion culling the scene is drawn in two passes:
+    the second one loads the attachments of the first (loadContents), only the second one presents.
+    */
+    void BeginScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool loadContents);
+    void EndScenePass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool present);
+    // --dynamic-rendering: explicit layout transitions around vkCmdBeginRenderingKHR/vkCmdEndRenderingKHR
+    void BeginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool loadContents);
+    void EndDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool present);
+    VkDescriptorSet GetSceneDescriptorSet();
+    VkDescriptorSet GetMeshletDescriptorSet(); // --mesh-shaders
 
     VkCommandBuffer BeginSingleTimeCommands();
     void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
 
-    void UpdateUniformBuffer(uint32_t currentImage);
-
-    void DrawFrame();
+    // Simulation step on the main thread: camera, model rotation and object transforms into a snapshot for the renderer
+    void PublishSnapshot();
+    // Render thread: the latest snapshot, if a new one was published. Its transforms become m_ObjectTransforms/m_ObjectBounds.
+    void TakeSnapshot();
+    // Objects of the snapshot being drawn: m_SceneTransforms belongs to the simulation
+    uint32_t GetObjectCount() const { return static_cast<uint32_t>(m_ObjectTransforms.size()); }
+    // Main thread only (GLFW), the size the render thread creates the swap chain with
+    void QueryFramebufferSize();
+    // Returns the dynamic offset of the frame uniforms in the frame allocator, for the camera of the snapshot
+    uint32_t UpdateUniformBuffer();
+    // --late-latch: right before submit, rewrites the frame uniforms with the camera of the latest input
+    void LatchCamera();
+    // --mouse-camera: the default camera orbited around its target by the cursor
+    CameraKeyframe GetMouseCamera(const InputSample& input) const;
+    // --thumbnails: the grid cells and the cameras orbiting the target of camera, with their UBOs
+    void UpdateThumbnailViews(const CameraKeyframe& camera);
+    // World space boxes of the objects and the BVH over them: refitted every frame, rebuilt once it degrades
+    void UpdateSceneBvh();
+    // Rasterizes the occluders on the CPU and tests every object against them, before BuildRenderQueue
+    void CullSoftwareOcclusion();
+    // LOD 0 unless --lod-error, then the coarsest LOD whose projected error is small enough
+    uint32_t SelectObjectLod(uint32_t object) const;
+    // Sorted draw packets of the frame, recorded with the minimum number of binds
+    void BuildRenderQueue();
+    // cullPhase selects the indirect draw commands of the occlusion culling phase, ignored without culling
+    void RecordRenderQueue(VkCommandBuffer commandBuffer, RenderStateTracker& tracker, uint32_t cullPhase);
+    // --thumbnails: the render queue once per view, in its cell
+    void RecordThumbnailViews(VkCommandBuffer commandBuffer, RenderStateTracker& tracker);
+
+    // False when the frame was not submitted: the swap chain was out of date and got recreated
+    bool DrawFrame();
+
+    // --hot-reload: recompiles the changed GLSL and rebuilds the pipelines using it, on the shader watcher thread
+    void ReloadShaders(const std::vector<std::string>& changedFiles);
+    // At the start of a frame: swaps in the rebuilt pipelines, the replaced ones are destroyed once no frame uses them
+    void ApplyReloadedPipelines();
+    // SPIR-V file of the vertex stage of the main and the depth prepass pipelines
+    const char* GetVertexShaderFile() const;
+    const char* GetDepthPrepassShaderFile() const;
 
     bool CheckValidationLayerSupport() const;
     bool CheckDeviceExtensionSupport(VkPhysicalDevice device) const;
+    bool IsDynamicRenderingSupported(VkPhysicalDevice device) const;
+    bool IsMeshShaderSupported(VkPhysicalDevice device) const;
+    bool IsBufferDeviceAddressSupported(VkPhysicalDevice device) const;
+    bool IsGraphicsPipelineLibrarySupported(VkPhysicalDevice device) const;
+    bool IsPresentWaitSupported(VkPhysicalDevice device) const;
 
     std::vector<const char*> GetRequiredExtensions() const;
 
@@ -243,15 +372,35 @@ private:
         return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
     }
 
+    // Aspects of the depth image, for barriers
+    VkImageAspectFlags GetDepthAspects() const
+    {
+        return VK_IMAGE_ASPECT_DEPTH_BIT | (HasStencilComponent(FindDepthFormat()) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+    }
+
     static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
+    // Keys 1 to 3 toggle the shading features, see ShadingFeature
+    static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+    // --mouse-camera: timestamps the cursor position and hands it to the latch
+    static void CursorPosCallback(GLFWwindow* window, double x, double y);
 
     void SetCurrentDirectory();
 
+    // Startup: reads and decodes the assets on worker threads (or lazily with --serial-startup)
+    void StartAssetLoading();
     void LoadModel();
+    void LoadTexture();
+    void LoadShaders();
+    // The SPIR-V compile_shaders.bat wrote, or with --hot-reload the SPIR-V of the current GLSL, through m_SpirvCache
+    std::vector<char> LoadShaderCode(const char* spirvFile);
+    // shader.frag, with the features compiled in with --permutation-defines, otherwise the same for every permutation
+    std::vector<char> LoadFragmentShaderCode(uint32_t shadingFeatures);
 
 private:
     const int MAX_FRAMES_IN_FLIGHT = 2;
 
+    ApplicationConfig m_Config;
+
     // is measured in screen coordinates
     // But Vulkan works with pixels
     // glfwGetFramebufferSize to query the resolution of the window in pixel
@@ -281,26 +430,121 @@ private:
 
     // Pipeline
     VkRenderPass m_RenderPass;
+    VkRenderPass m_LoadRenderPass;       // same attachments, loaded instead of cleared: second occlusion culling phase
     VkDescriptorSetLayout m_DescriptorSetLayout; // UBO
     VkPipelineLayout m_PipelineLayout;
     VkPipeline m_GraphicsPipeline;
+    VkPipeline m_DepthPrepassPipeline;   // depth only, no fragment shader
 
     VkCommandPool m_CommandPool;
-    VkDescriptorPool m_DescriptorPool;
-    std::vector<VkDescriptorSet> m_DescriptorSets;
+    DescriptorAllocator m_DescriptorAllocator;          // long-lived sets, through m_DescriptorCache
+    DescriptorSetCache m_DescriptorCache;
+    std::vector<DescriptorAllocator> m_FrameDescriptorAllocators;
+
+    // Shaders, read from disk during startup
+    std::vector<char> m_VertShaderCode;
+    std::vector<char> m_FragShaderCode;
+    std::vector<char> m_DepthPrepassVertShaderCode;
+    std::vector<char> m_MeshletCullShaderCode;
+    std::vector<char> m_MeshletTaskShaderCode;
+    std::vector<char> m_MeshletMeshShaderCode;
+    VertexPullingShaders m_VertexPullingShaders;
 
     // Mesh data
     std::vector<Vertex> m_Vertices;
     std::vector<uint32_t> m_Indices;
 
-    VkBuffer m_VertexBuffer;
-    VkDeviceMemory m_VertexBufferMemory;
-    VkBuffer m_IndexBuffer;
-    VkDeviceMemory m_IndexBufferMemory;
-
-    std::vector<VkBuffer> m_UniformBuffers;
-    std::vector<VkDeviceMemory> m_UniformBuffersMemory;
-    std::vector<void*> m_UniformBuffersMapped;
+    VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_VertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_IndexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer m_PositionBuffer = VK_NULL_HANDLE;           // positions only, read by the depth prepass
+    VkDeviceMemory m_PositionBufferMemory = VK_NULL_HANDLE;
+
+    // With --geometry-pool the buffers above are not created, every mesh is a range of the pool
+    static const uint32_t GEOMETRY_POOL_MAX_VERTICES = 1 << 20;
+    static const uint32_t GEOMETRY_POOL_MAX_INDICES = 1 << 22;
+    GeometryPool m_GeometryPool;
+    GeometryAllocation m_ModelGeometry;     // all zero without the pool: the model owns its buffers
+    bool m_UseBufferDeviceAddress = false;  // pull the vertices through a pointer, otherwise a storage buffer
+
+    // Transient per-frame data (uniforms), one region per frame in flight
+    static const VkDeviceSize FRAME_ALLOCATOR_BYTES_PER_FRAME = 256 * 1024;
+    VkBuffer m_FrameBuffer;
+    VkDeviceMemory m_FrameBufferMemory;
+    FrameLinearAllocator m_FrameAllocator;
+    uint32_t m_FrameUniformOffset = 0;
+
+    // Every object of the scene, updated once per frame in UpdateUniformBuffer
+    TransformSystem m_SceneTransforms;
+    std::vector<ObjectTransform> m_ObjectTransforms;
+    std::vector<glm::vec4> m_ObjectBounds;
+    uint32_t m_ModelObject = 0;
+    Aabb m_ModelBoundingBox;                // object space, computed once at load time
+    float m_ModelRadius = 0.0f;             // object space bounding sphere, to get the scale of the objects
+    std::vector<MeshLod> m_ModelLods;       // index ranges in m_Indices, only LOD 0 without --lod-error
+    float m_LodPixelScale = 0.0f;           // GetProjectionPixelScale of the frame
+    std::vector<uint64_t> m_LodDraws;       // per LOD, packets of the frame
+    std::vector<uint64_t> m_LodTriangles;
+    glm::vec3 m_CameraPosition{ 0.0f };
+    glm::mat4 m_ViewProj{ 1.0f };
+    glm::mat4 m_CullViewProj{ 1.0f };       // the frustum of the BVH query, wider than m_ViewProj with --late-latch
+
+    // --thumbnails: the cameras of the frame, the first one is m_CameraPosition and m_ViewProj
+    struct ThumbnailView
+    {
+        VkViewport viewport;
+        VkRect2D scissor;               // the cell of the view in the swap chain image
+        uint32_t uniformOffset;         // dynamic offset of its UBO in the frame allocator
+        glm::mat4 viewProj;
+    };
+    std::vector<ThumbnailView> m_ThumbnailViews;
+
+    // Pipeline and mesh ids of the draw packets, resolved in RecordRenderQueue
+    enum RenderPipelineId : uint32_t { PIPELINE_SHADED = 0, PIPELINE_DEPTH_PREPASS = 1, PIPELINE_MESH_SHADER = 2 };
+    // The *_MESHLETS meshes draw the indices compacted by the meshlet culling, or the meshlets themselves with mesh shaders
+    // MESH_GEOMETRY_POOL is every mesh of the pool: they share all their bindings, the draws only differ by offsets
+    enum RenderMeshId : uint32_t { MESH_MODEL = 0, MESH_MODEL_POSITIONS = 1, MESH_MODEL_MESHLETS = 2, MESH_MODEL_POSITIONS_MESHLETS = 3, MESH_GEOMETRY_POOL = 4 };
+    RenderQueue m_RenderQueue;
+    RenderQueueStats m_RenderStats;     // of the last recorded frame
+
+    // Frustum culling of the objects before they get draw packets
+    static constexpr float SCENE_BVH_REBUILD_COST_RATIO = 1.5f;
+    std::vector<Aabb> m_ObjectBoxes;
+    Bvh m_SceneBvh;
+    std::vector<uint32_t> m_VisibleObjects;     // in the frustum, written by BuildRenderQueue
+
+    // Only with --occlusion-culling on a device that supports it
+    static const uint32_t OCCLUSION_CULLING_MAX_OBJECTS = 4096;
+    bool m_UseOcclusionCulling = false;
+    OcclusionCuller m_OcclusionCuller;
+    OcclusionCullingShaders m_OcclusionCullingShaders;
+    VkDeviceSize m_CullObjectsOffset = 0;   // OcclusionCullObject of every object in the frame allocator
+
+    // With --cpu-occlusion-culling, or --occlusion-culling on a device that can't sample the depth attachment
+    static const uint32_t SOFTWARE_OCCLUSION_WIDTH = 256;
+    static const uint32_t SOFTWARE_OCCLUSION_HEIGHT = 128;
+    bool m_UseSoftwareOcclusion = false;
+    SoftwareOcclusionCuller m_SoftwareOcclusion;
+    uint32_t m_OccluderMesh = 0;
+    std::vector<uint8_t> m_ObjectVisible;   // per object, written by CullSoftwareOcclusion
+
+    // Only with --meshlets, and not with the Hi-Z culling: both own the draw commands of the objects
+    static const uint32_t MESHLET_CULLING_MAX_OBJECTS = 1024;
+    static const uint32_t MESHLET_CULLING_MAX_INDICES = 1 << 22;
+    bool m_UseMeshletCulling = false;
+    bool m_UseMeshShaders = false;          // --mesh-shaders on a device that supports them, otherwise the compute culling
+    MeshletCuller m_MeshletCuller;
+    MeshletMesh m_ModelMeshlets;            // built at load time, released once uploaded
+    std::vector<MeshletRange> m_ModelMeshletLods;   // per LOD of m_ModelLods
+    VkDeviceSize m_MeshletObjectsOffset = 0;        // MeshletCullObject of the culled objects in the frame allocator
+    uint32_t m_MeshletObjectCount = 0;
+    uint32_t m_MaxMeshletCount = 0;                 // of the culled objects, width of the culling dispatch
+    std::vector<uint32_t> m_MeshletDrawSlots;       // per object, its MeshletCullObject, NO_MESHLET_SLOT when drawn whole
+    static constexpr uint32_t NO_MESHLET_SLOT = ~0u;
+    VkDescriptorSetLayout m_MeshletSetLayout = VK_NULL_HANDLE;  // set 1 of the mesh shader pipeline
+    VkPipelineLayout m_MeshShaderPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_MeshShaderPipeline = VK_NULL_HANDLE;
 
     // Depth
     VkImage m_DepthImage;
@@ -311,6 +555,7 @@ private:
     uint32_t m_MipLevels;
 
     // Texture
+    ImageData m_TextureData; // decoded pixels, released once uploaded
     VkImage m_TextureImage;
     VkDeviceMemory m_TextureImageMemory;
     VkImageView m_TextureImageView;
@@ -330,6 +575,54 @@ private:
 
     uint32_t m_CurrentFrameIdx = 0;
 
+    // Permutations of shader.frag: the pipelines that use it exist once per feature mask
+    std::atomic<uint32_t> m_ShadingFeatures;        // of m_GraphicsPipeline and m_MeshShaderPipeline
+    uint32_t m_RequestedShadingFeatures;            // toggled by the keys, applied once its pipelines are built
+    std::map<uint32_t, VkPipeline> m_GraphicsPermutations;      // built on first use, m_GraphicsPipeline is one of them
+    std::map<uint32_t, VkPipeline> m_MeshShaderPermutations;    // same with m_MeshShaderPipeline
+    // The GLSL compiled at runtime (--hot-reload, --permutation-defines), by hash of the source and the defines
+    SpirvCache m_SpirvCache;
+
+    // Worker threads that build the pipelines of the permutations, see m_PipelineManager
+    static const uint32_t MAX_PIPELINE_THREADS = 4;
+    // Only with --pipeline-library on a device that supports it
+    bool m_UseGraphicsPipelineLibrary = false;
+    GraphicsPipelineLibraries m_GraphicsLibraries;
+    // Replaced pipelines (hot reload, fast link), per frame slot: destroyed after its fence
+    std::vector<std::vector<VkPipeline>> m_RetiredPipelines;
+
+    // Only with --hot-reload
+    struct ReloadedPipelines
+    {
+        VkPipeline graphics = VK_NULL_HANDLE;
+        VkPipeline depthPrepass = VK_NULL_HANDLE;
+        VkPipeline meshShader = VK_NULL_HANDLE;
+        uint32_t graphicsFeatures = 0;              // shading permutation of graphics
+        uint32_t meshShaderFeatures = 0;
+        GraphicsPipelineLibraries graphicsLibraries; // --pipeline-library, when the vertex shader changed
+    };
+    static constexpr std::chrono::milliseconds SHADER_WATCH_INTERVAL{ 250 };
+    std::mutex m_ReloadMutex;
+    ReloadedPipelines m_ReloadedPipelines;          // built by ReloadShaders, not swapped in yet, under m_ReloadMutex
+    std::mutex m_SwapChainMutex;                    // RecreateSwapChain, against the pipelines ReloadShaders builds
+
+    // Profiler: CPU/GPU scopes and pipeline statistics, disabled unless a trace file is given
+    GpuProfiler m_Profiler;
+
+    // Frame export (--export): readback buffers for the frames in flight and the ones being encoded, plus a few queued
+    static const uint32_t MAX_EXPORT_THREADS = 4;
+    FrameReadback m_FrameReadback;
+
+    // --mouse-camera: input to present latency of the frames drawn with new input
+    LatencyMarkers m_LatencyMarkers;
+
+    // Job system counters of the previous frame, the profiler shows the difference
+    JobSystemStats m_LastJobStats;
+
+    // Benchmark: fixed timestep and scripted camera, only active with --benchmark
+    Benchmark m_Benchmark;
+    int64_t m_LastBenchmarkGpuFrame = -1;
+
     const std::vector<const char*> m_ValidationLayers =
     {
         "VK_LAYER_KHRONOS_validation"
@@ -340,11 +633,119 @@ private:
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
+    // VK_KHR_dynamic_rendering and its dependencies that are not core in Vulkan 1.1
+    const std::vector<const char*> DYNAMIC_RENDERING_EXTENSIONS =
+    {
+        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+        VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+        VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME
+    };
+
+    // Only with --dynamic-rendering on a device that supports it
+    bool m_UseDynamicRendering = false;
+    PFN_vkCmdBeginRenderingKHR m_CmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR m_CmdEndRendering = nullptr;
+
+    // VK_EXT_mesh_shader and its dependencies that are not core in Vulkan 1.1
+    const std::vector<const char*> MESH_SHADER_EXTENSIONS =
+    {
+        VK_EXT_MESH_SHADER_EXTENSION_NAME,
+        VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+        VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
+    };
+
+    PFN_vkCmdDrawMeshTasksEXT m_CmdDrawMeshTasks = nullptr;
+
+    // Only with --geometry-pool on a device that supports it, Vulkan 1.1 needs the extension
+    const std::vector<const char*> BUFFER_DEVICE_ADDRESS_EXTENSIONS =
+    {
+        VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME
+    };
+
+    PFN_vkGetBufferDeviceAddressKHR m_GetBufferDeviceAddress = nullptr;
+
+    // VK_EXT_graphics_pipeline_library and its dependency
+    const std::vector<const char*> GRAPHICS_PIPELINE_LIBRARY_EXTENSIONS =
+    {
+        VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+        VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME
+    };
+
+    // The present ids of the frames, and waiting for them to be displayed
+    const std::vector<const char*> PRESENT_WAIT_EXTENSIONS =
+    {
+        VK_KHR_PRESENT_ID_EXTENSION_NAME,
+        VK_KHR_PRESENT_WAIT_EXTENSION_NAME
+    };
+
+    // Only with --mouse-camera on a device that supports it, otherwise the latency is measured up to vkQueuePresentKHR
+    bool m_UsePresentWait = false;
+    PFN_vkWaitForPresentKHR m_WaitForPresent = nullptr;
+
 #ifdef NDEBUG
     const bool m_EnableValidationLayers = false;
 #else
     const bool m_EnableValidationLayers = true;
 #endif
 
-    bool m_IsFamebufferResized = false;
+    // Written by the GLFW callbacks on the main thread, read by the thread that draws
+    std::atomic<bool> m_IsFamebufferResized{ false };
+    std::atomic<uint32_t> m_FramebufferWidth{ 0 };
+    std::atomic<uint32_t> m_FramebufferHeight{ 0 };
+
+    // What the renderer needs of a simulation step, immutable once published
+    struct FrameSnapshot
+    {
+        uint64_t step = 0;                              // simulation step, steps never taken show as gaps
+        CameraKeyframe camera;
+        InputSample input;                              // the camera was built from it with --mouse-camera
+        std::vector<ObjectTransform> objectTransforms;
+        std::vector<glm::vec4> objectBounds;            // xyz center, w radius
+        uint32_t shadingFeatures = 0;                   // as toggled by the keys
+    };
+    /*
+    Simulation to rendering handoff. Without --render-thread the main thread publishes a snapshot and draws it right
+    away; with it the main thread publishes at its own rate and the render thread draws the latest one, the same
+    snapshot again if the simulation didn't step in between.
+    */
+    TripleBuffer<FrameSnapshot> m_Snapshots;
+    static constexpr std::chrono::milliseconds SIMULATION_INTERVAL{ 5 };
+    uint64_t m_SimulationStep = 0;                      // main thread
+    uint32_t m_InputShadingFeatures;                    // main thread, toggled by the keys
+    CameraKeyframe m_Camera;                            // render thread, of the snapshot being drawn
+    uint64_t m_SnapshotStep = 0;
+    uint32_t m_SnapshotShadingFeatures;                 // a change is a new request, a failed one isn't retried every frame
+    uint64_t m_RepeatedSnapshots = 0;                   // frames that drew a snapshot already drawn
+
+    /*
+    --late-latch: the cursor events skip the snapshot, they are published on their own right away, and the frame takes
+    the latest one just before vkQueueSubmit. The uniforms are in host coherent memory: writing them after recording
+    is enough, the GPU reads them once the submission starts. Not with the benchmarks, resizes and thumbnails, nor
+    with the occlusion and meshlet culling, which test the objects against the camera of the snapshot.
+    */
+    static constexpr float MOUSE_RADIANS_PER_PIXEL = 0.005f;
+    static constexpr double MAX_LATCH_PIXELS = 20.0;    // per axis, from the cursor of the snapshot
+    InputSample m_CursorInput;                          // main thread, written by CursorPosCallback
+    TripleBuffer<InputSample> m_LatchInputs;
+    InputSample m_FrameInput;                           // thread that draws, the input of the camera of the frame
+    void* m_FrameUniformData = nullptr;                 // mapped UBO of the frame, rewritten by LatchCamera
+    bool m_UseLateLatch = false;
+
+    // --render-thread, not with the benchmarks: their frames must follow the simulation steps one to one
+    bool m_UseRenderThread = false;
+    std::atomic<bool> m_StopRendering{ false };
+    std::atomic<bool> m_RenderThreadDone{ false };
+    std::exception_ptr m_RenderThreadError;
+    std::thread m_RenderThread;
+
+    // Stopped before the members their threads read are destroyed
+    FileWatcher m_ShaderWatcher;
+    PipelineManager m_PipelineManager;
+
+    // Startup: per-step timing, and the asset tasks joined before the data they fill is used.
+    // Declared last, so on an exception the tasks are waited for before the members they write are destroyed.
+    StartupTimer m_StartupTimer;
+    std::future<void> m_ModelLoaded;
+    std::future<void> m_TextureLoaded;
+    std::future<void> m_ShadersLoaded;
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "vulkan_memory.h"
+
+#include <stdexcept>
+#include <string>
+
+uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+    return NO_MEMORY_TYPE;
+}
+
+VkDeviceMemory AllocateMemory(VkPhysicalDevice physicalDevice, VkDevice device, const VkMemoryRequirements& requirements,
+    std::initializer_list<VkMemoryPropertyFlags> preferences, const char* name, VkMemoryAllocateFlags allocateFlags,
+    VkMemoryPropertyFlags* memoryProperties)
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = NO_MEMORY_TYPE;
+    for (VkMemoryPropertyFlags properties : preferences)
+    {
+        allocInfo.memoryTypeIndex = FindMemoryType(physicalDevice, requirements.memoryTypeBits, properties);
+        if (allocInfo.memoryTypeIndex != NO_MEMORY_TYPE)
+        {
+            break;
+        }
+    }
+
+    VkMemoryAllocateFlagsInfoKHR allocFlags{};
+    allocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+    allocFlags.flags = allocateFlags;
+    if (allocateFlags != 0)
+    {
+        allocInfo.pNext = &allocFlags;
+    }
+
+    VkDeviceMemory memory;
+    if (allocInfo.memoryTypeIndex == NO_MEMORY_TYPE || vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error(std::string("failed to allocate ") + name + " memory!");
+    }
+
+    if (memoryProperties != nullptr)
+    {
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+        *memoryProperties = memProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags;
+    }
+    return memory;
+}
+
+VkMemoryPropertyFlags CreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+    std::initializer_list<VkMemoryPropertyFlags> preferences, const char* name, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error(std::string("failed to create ") + name + " buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    // A buffer with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT must be bound to memory allocated for it
+    const VkMemoryAllocateFlags allocateFlags =
+        (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR) != 0 ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR : 0;
+
+    VkMemoryPropertyFlags memoryProperties = 0;
+    memory = AllocateMemory(physicalDevice, device, memRequirements, preferences, name, allocateFlags, &memoryProperties);
+    vkBindBufferMemory(device, buffer, memory, 0);
+    return memoryProperties;
+}
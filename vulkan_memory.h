@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <initializer_list>
+
+// Returned by FindMemoryType when no memory type matches
+static const uint32_t NO_MEMORY_TYPE = UINT32_MAX;
+
+/*
+    Index of the first memory type of the device allowed by typeFilter (VkMemoryRequirements::memoryTypeBits)
+    that has all the properties, NO_MEMORY_TYPE if there is none.
+*/
+uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+/*
+    Memory for requirements, of a memory type with the first of the property sets in preferences that the device has.
+    name goes into the error: "failed to allocate <name> memory!". memoryProperties, when given, receives every
+    property of the memory type chosen, which can be more than the ones asked for (HOST_COHERENT with HOST_CACHED).
+*/
+VkDeviceMemory AllocateMemory(VkPhysicalDevice physicalDevice, VkDevice device, const VkMemoryRequirements& requirements,
+    std::initializer_list<VkMemoryPropertyFlags> preferences, const char* name, VkMemoryAllocateFlags allocateFlags = 0,
+    VkMemoryPropertyFlags* memoryProperties = nullptr);
+
+/*
+    Exclusive buffer bound to memory of its own, allocated as AllocateMemory does. A buffer with
+    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT gets memory allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT.
+    Throws "failed to create <name> buffer!". Returns the properties of the memory type.
+*/
+VkMemoryPropertyFlags CreateBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+    std::initializer_list<VkMemoryPropertyFlags> preferences, const char* name, VkBuffer& buffer, VkDeviceMemory& memory);